@@ -19,6 +19,7 @@ import bpy
 import bpy_extras.io_utils
 import mathutils
 import os
+import struct
 
 # Triangulates the mesh me
 def mesh_triangulate(me):
@@ -35,8 +36,13 @@ def write_file(file
 	, EXPORT_NORMALS=True
 	, EXPORT_UV=True
 	, EXPORT_APPLY_MODIFIERS=True
+	, EXPORT_BINARY=True
 	):
 
+	# Vertex attributes and indices, written after the SJSON text
+	# when exporting binary streams
+	streams = bytearray()
+
 	def veckey3d(v):
 		return round(v.x, 6), round(v.y, 6), round(v.z, 6)
 
@@ -46,6 +52,25 @@ def write_file(file
 	def fw(string):
 		file.write(bytes(string, 'UTF-8'))
 
+	# Writes the stream { offset = N size = M } whose M items start
+	# at byte N after the null byte terminating the SJSON text
+	def write_stream(fmt, values):
+		offset = len(streams)
+		streams.extend(struct.pack('<%d%s' % (len(values), fmt), *values))
+		fw("{ offset = %d size = %d }" % (offset, len(values)))
+
+	def write_floats(values):
+		if EXPORT_BINARY:
+			write_stream('f', values)
+		else:
+			fw("["); fw("".join(" %.6f" % v for v in values)); fw(" ]")
+
+	def write_ints(values):
+		if EXPORT_BINARY:
+			write_stream('I', values)
+		else:
+			fw("["); fw("".join(" %d" % i for i in values)); fw(" ]")
+
 	def write_mesh(ob, name):
 		try:
 			me = ob.to_mesh(scene, EXPORT_APPLY_MODIFIERS, 'PREVIEW', calc_tessface=False)
@@ -79,12 +104,15 @@ def write_file(file
 		bitangents = {}
 		texcoords = {}
 
-		def write_positions(me):
+		def positions(me):
+			data = []
 			for v in me.vertices:
 				x, y, z = veckey3d(v.co)
-				fw(" %.6f %.6f %.6f" % (x, z, y))
+				data += [x, z, y]
+			return data
 
-		def write_normals(me):
+		def normals_data(me):
+			data = []
 			for f in me.polygons:
 				if f.use_smooth:
 					for v_idx in f.vertices:
@@ -93,22 +121,26 @@ def write_file(file
 						if noKey not in normals:
 							normals[noKey] = len(normals)
 							x, y, z = noKey
-							fw(" %.6f %.6f %.6f" % (x, z, y))
+							data += [x, z, y]
 				else:
 					noKey = veckey3d(f.normal)
 					if noKey not in normals:
 						normals[noKey] = len(normals)
 						x, y, z = noKey
-						fw(" %.6f %.6f %.6f" % (x, z, y))
+						data += [x, z, y]
+			return data
 
-		def write_tangents(me):
+		def tangents_data(me):
+			data = []
 			for l in me.loops:
 				noKey = veckey3d(l.tangent)
 				if noKey not in tangents:
 					tangents[noKey] = len(tangents)
-					fw(" %.6f %.6f %.6f" % noKey)
+					data += noKey
+			return data
 
-		def write_bitangents(me):
+		def bitangents_data(me):
+			data = []
 			for l in me.loops:
 				n = l.normal
 				t = l.tangent
@@ -117,9 +149,11 @@ def write_file(file
 				noKey = veckey3d(sgn * nt)
 				if noKey not in bitangents:
 					bitangents[noKey] = len(bitangents)
-					fw(" %.6f %.6f %.6f" % noKey)
+					data += noKey
+			return data
 
-		def write_texcoords(me):
+		def texcoords_data(me):
+			data = []
 			for f in me.polygons:
 				for loop_index in f.loop_indices:
 					uv = uv_layer[loop_index].uv
@@ -127,65 +161,73 @@ def write_file(file
 					if uvkey not in texcoords:
 						texcoords[uvkey] = len(texcoords)
 						u, v = uvkey
-						fw(" %.6f %.6f" % (u, 1.0 - v))
+						data += [u, 1.0 - v]
+			return data
 
-		def write_position_indices(me):
+		def position_indices(me):
+			data = []
 			for f in me.polygons:
 				for v_idx in f.vertices:
 					v = me.vertices[v_idx]
-					fw(' %d' % v.index)
+					data.append(v.index)
+			return data
 
-		def write_normal_indices(me, normals):
+		def normal_indices(me, normals):
+			data = []
 			for f in me.polygons:
 				if f.use_smooth:
 					for v_idx in f.vertices:
 						v = me.vertices[v_idx]
-						fw(' %d' % (normals[veckey3d(v.normal)]))
+						data.append(normals[veckey3d(v.normal)])
 				else:
 					no = normals[veckey3d(f.normal)]
 					for v_idx in f.vertices:
-						fw(' %d' % no)
+						data.append(no)
+			return data
 
-		def write_tangent_indices(me, tangents):
-			for l in me.loops:
-				fw(' %d' % (tangents[veckey3d(l.tangent)]))
+		def tangent_indices(me, tangents):
+			return [tangents[veckey3d(l.tangent)] for l in me.loops]
 
-		def write_bitangent_indices(me, bitangents):
+		def bitangent_indices(me, bitangents):
+			data = []
 			for l in me.loops:
 				n = l.normal
 				t = l.tangent
 				sgn = l.bitangent_sign
 				nt = n.cross(t)
-				fw(' %d' % bitangents[veckey3d(sgn * nt)])
+				data.append(bitangents[veckey3d(sgn * nt)])
+			return data
 
-		def write_texcoord_indices(me, texcoords):
+		def texcoord_indices(me, texcoords):
+			data = []
 			for f in me.polygons:
 				for loop_index in f.loop_indices:
 					uv = uv_layer[loop_index].uv
-					fw(' %d' % texcoords[veckey2d(uv)])
+					data.append(texcoords[veckey2d(uv)])
+			return data
 
 		def write_indices(me, normals, texcoords):
 			fw("        indices = {\n");
 			fw("            size = %d\n" % (3*len(me.polygons))) # Assume triagles
 			fw("            data = [\n")
-			fw("                ["); write_position_indices(me); fw(" ]\n")
+			fw("                "); write_ints(position_indices(me)); fw("\n")
 			if EXPORT_NORMALS:
-				fw("                ["); write_normal_indices(me, normals); fw(" ]\n")
+				fw("                "); write_ints(normal_indices(me, normals)); fw("\n")
 			if faceuv:
-				fw("                ["); write_texcoord_indices(me, texcoords); fw(" ]\n")
-				fw("                ["); write_tangent_indices(me, tangents); fw(" ]\n")
-				fw("                ["); write_bitangent_indices(me, bitangents); fw(" ]\n")
+				fw("                "); write_ints(texcoord_indices(me, texcoords)); fw("\n")
+				fw("                "); write_ints(tangent_indices(me, tangents)); fw("\n")
+				fw("                "); write_ints(bitangent_indices(me, bitangents)); fw("\n")
 			fw("            ]\n")
 			fw("        }\n")
 
 		fw("    \"%s\" = {\n" % name)
-		fw("        position = ["); write_positions(me); fw(" ]\n")
+		fw("        position = "); write_floats(positions(me)); fw("\n")
 		if EXPORT_NORMALS:
-			fw("        normal = ["); write_normals(me); fw(" ]\n")
+			fw("        normal = "); write_floats(normals_data(me)); fw("\n")
 		if faceuv:
-			fw("        texcoord = ["); write_texcoords(me); fw(" ]\n")
-			fw("        tangent = ["); write_tangents(me); fw(" ]\n")
-			fw("        bitangent = ["); write_bitangents(me); fw(" ]\n")
+			fw("        texcoord = "); write_floats(texcoords_data(me)); fw("\n")
+			fw("        tangent = "); write_floats(tangents_data(me)); fw("\n")
+			fw("        bitangent = "); write_floats(bitangents_data(me)); fw("\n")
 		write_indices(me, normals, texcoords);
 		fw("    }\n")
 
@@ -222,12 +264,17 @@ def write_file(file
 	write_geometries(objects)
 	write_nodes(objects)
 
+	if EXPORT_BINARY:
+		file.write(b'\0')
+		file.write(streams)
+
 def _write(context
 	, filepath
 	, EXPORT_NORMALS
 	, EXPORT_UV
 	, EXPORT_APPLY_MODIFIERS
 	, EXPORT_SEL_ONLY
+	, EXPORT_BINARY
 	):
 
 	scene = context.scene
@@ -245,6 +292,7 @@ def _write(context
 		, EXPORT_NORMALS
 		, EXPORT_UV
 		, EXPORT_APPLY_MODIFIERS
+		, EXPORT_BINARY
 	)
 	f.close()
 
@@ -255,6 +303,7 @@ def save(operator
 	, use_uvs=True
 	, use_mesh_modifiers=True
 	, use_selection=True
+	, use_binary=True
 	):
 
 	_write(context
@@ -263,6 +312,7 @@ def save(operator
 		, EXPORT_UV=use_uvs
 		, EXPORT_APPLY_MODIFIERS=use_mesh_modifiers
 		, EXPORT_SEL_ONLY=use_selection
+		, EXPORT_BINARY=use_binary
 		)
 
 	return {'FINISHED'}
@@ -302,6 +352,11 @@ class MyExporter(bpy.types.Operator, ExportHelper):
 		, default=True
 		)
 
+	use_binary = BoolProperty(name="Binary Streams"
+		, description="Write vertex attributes and indices as binary streams"
+		, default=True
+		)
+
 	def execute(self, context):
 		from mathutils import Matrix
 		keywords = self.as_keywords(ignore=("axis_forward"
@@ -38,8 +38,6 @@ end
 
 -- From Bitsquid's grid_plane.lua
 function draw_grid(lines, tm, center, size, axis, color)
-	local nv, nq, nm = Device.temp_count()
-
 	local pos = snap_vector(tm, center, size)
 	local x = nil
 	local y = nil
@@ -75,13 +73,9 @@ function draw_grid(lines, tm, center, size, axis, color)
 			DebugLine.add_line(lines, -size / 2 * y + p, size / 2 * y + p, line_color)
 		end
 	end
-
-	Device.set_temp_count(nv, nq, nm)
 end
 
 function draw_world_origin_grid(lines, size, step)
-	local nv, nq, nm = Device.temp_count()
-
 	local n = size / step
 	local r = n * step
 
@@ -95,8 +89,6 @@ function draw_world_origin_grid(lines, size, step)
 
 	DebugLine.add_line(lines, Vector3(-r, 0,  0), Vector3(r, 0, 0), Color4.black())
 	DebugLine.add_line(lines, Vector3( 0, 0, -r), Vector3(0, 0, r), Color4.black())
-
-	Device.set_temp_count(nv, nq, nm)
 end
 
 function draw_mesh_obb(render_world, unit_id, lines)
@@ -110,21 +102,6 @@ function draw_sprite_obb(render_world, unit_id, lines)
 	DebugLine.add_obb(lines, tm, hext, Color4.red())
 end
 
-function raycast(objects, pos, dir)
-	local nearest = math.huge
-	local hit = nil
-
-	for k, v in pairs(objects) do
-		local t = v:raycast(pos, dir)
-		if t ~= -1.0 and t < nearest then
-			nearest = t
-			hit = nearest
-		end
-	end
-
-	return hit
-end
-
 Selection = class(Selection)
 
 function Selection:init()
@@ -476,17 +453,7 @@ end
 function SelectTool:mouse_down(x, y)
 	local pos, dir = LevelEditor:camera():camera_ray(x, y)
 
-	-- raycast()
-	local nearest = math.huge
-	local selected_object = nil
-
-	for k, v in pairs(LevelEditor._objects) do
-		local t = v:raycast(pos, dir)
-		if t ~= -1.0 and t < nearest then
-			nearest = t
-			selected_object = v
-		end
-	end
+	local selected_object = LevelEditor:raycast(pos, dir)
 
 	if selected_object ~= nil then
 		if not LevelEditor:multiple_selection_enabled() then
@@ -606,7 +573,7 @@ function PlaceTool:mouse_up(x, y)
 			, scale = level_object:local_scale()
 			}
 
-		LevelEditor._objects[guid] = level_object
+		LevelEditor:add_object(level_object)
 	elseif self._placeable_type == "sound" then
 		local guid = Device.guid()
 		level_object = SoundObject(LevelEditor._world, guid, "", 10.0, 1.0, false)
@@ -624,7 +591,7 @@ function PlaceTool:mouse_up(x, y)
 			, loop = level_object._loop
 			}
 
-		LevelEditor._objects[guid] = level_object
+		LevelEditor:add_object(level_object)
 	end
 
 	LevelEditor._selection:clear()
@@ -1307,6 +1274,7 @@ function LevelEditor:init()
 	self._grid = { size = 1 }
 	self._rotation_snap = 15.0 * math.pi / 180.0
 	self._objects = {}
+	self._objects_by_unit = {}
 	self._selection = Selection()
 	self._show_grid = true
 	self._snap_to_grid = true
@@ -1350,8 +1318,8 @@ function LevelEditor:update(dt)
 	self._mouse.wheel.delta = 0
 
 	local pos, dir = self._fpscamera:camera_ray(self._mouse.x, self._mouse.y)
-	local t = raycast(self._objects, pos, dir)
-	self._spawn_height = t and (pos + dir * t).y or 0
+	local object, t = self:raycast(pos, dir)
+	self._spawn_height = object and (pos + dir * t).y or 0
 
 	if self._show_grid then
 		draw_world_origin_grid(self._lines, 10, self._grid.size)
@@ -1518,20 +1486,20 @@ end
 function LevelEditor:spawn_unit(id, type, pos, rot, scale)
 	local unit = World.spawn_unit(self._world, type, pos, rot)
 	local unit_box = UnitBox(self._world, id, unit, type)
-	self._objects[id] = unit_box
+	self:add_object(unit_box)
 end
 
 function LevelEditor:spawn_empty_unit(id)
 	local unit = World.spawn_empty_unit(self._world)
 	local unit_box = UnitBox(self._world, id, unit, nil)
-	self._objects[id] = unit_box
+	self:add_object(unit_box)
 end
 
 function LevelEditor:spawn_sound(id, name, pos, rot, range, volume, loop)
 	local sound = SoundObject(self._world, id, name, range, volume, loop)
 	sound:set_local_position(pos)
 	sound:set_local_rotation(rot)
-	self._objects[id] = sound
+	self:add_object(sound)
 end
 
 function LevelEditor:add_transform_component(id, component_id, pos, rot, scale)
@@ -1575,7 +1543,26 @@ function LevelEditor:set_placeable(placeable_type, name)
 	self.place_tool:set_placeable(placeable_type, name)
 end
 
+function LevelEditor:add_object(object)
+	self._objects[object:id()] = object
+	self._objects_by_unit[object:unit_id()] = object
+end
+
+-- Returns the object nearest to pos along dir and its distance or nil.
+function LevelEditor:raycast(pos, dir)
+	local units, distances = RenderWorld.raycast(self._rw, pos, dir)
+	for i, unit in ipairs(units) do
+		local object = self._objects_by_unit[unit]
+		if object then
+			return object, distances[i]
+		end
+	end
+
+	return nil
+end
+
 function LevelEditor:destroy(id)
+	self._objects_by_unit[self._objects[id]:unit_id()] = nil
 	self._objects[id]:destroy()
 	self._objects[id] = nil
 	self._selection:remove(id)
@@ -152,7 +152,7 @@ bgfx_shaders = {
 		varying = "
 			vec2 v_texcoord0 : TEXCOORD0 = vec2(0.0, 0.0);
 
-			vec2 a_position  : POSITION;
+			vec3 a_position  : POSITION;
 			vec2 a_texcoord0 : TEXCOORD0;
 		"
 
@@ -164,7 +164,7 @@ bgfx_shaders = {
 		vs_code = "
 			void main()
 			{
-				gl_Position = mul(u_modelViewProj, vec4(a_position, 0.0, 1.0));
+				gl_Position = mul(u_viewProj, vec4(a_position, 1.0));
 				v_texcoord0 = a_texcoord0;
 			}
 		"
@@ -210,13 +210,28 @@ bgfx_shaders = {
 
 		vs_code =
 		"
+			// Dequantization of the mesh attributes, see MeshGeometry
+			uniform vec4 u_mesh_dequantize;
+
+			// Unfolds the octahedral normal e in [-1; 1]^2
+			vec3 octahedral_decode(vec2 e)
+			{
+				vec3 n = vec3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+				float t = max(-n.z, 0.0);
+				n.xy += (1.0 - 2.0 * step(0.0, n.xy)) * t;
+				return n;
+			}
+
 			void main()
 			{
 				gl_Position = mul(u_modelViewProj, vec4(a_position, 1.0));
 				v_view = mul(u_modelView, vec4(a_position, 1.0));
-				v_normal = normalize(mul(u_modelView, vec4(a_normal, 0.0)).xyz);
 
-				v_texcoord0 = a_texcoord0;
+				vec3 normal = a_normal * u_mesh_dequantize.x + u_mesh_dequantize.y;
+				normal = mix(normal, octahedral_decode(normal.xy), u_mesh_dequantize.z);
+				v_normal = normalize(mul(u_modelView, vec4(normal, 0.0)).xyz);
+
+				v_texcoord0 = mix(a_texcoord0, a_texcoord0 * 0.5 + 0.5, u_mesh_dequantize.w);
 			}
 		"
 
@@ -11,6 +11,7 @@ function crown_project(_name, _kind, _defines)
 		includedirs {
 			CROWN_DIR .. "src",
 			CROWN_DIR .. "3rdparty/bgfx/include",
+			CROWN_DIR .. "3rdparty/bimg/include",
 			CROWN_DIR .. "3rdparty/bx/include",
 			CROWN_DIR .. "3rdparty/stb",
 		}
@@ -84,6 +85,13 @@ function crown_project(_name, _kind, _defines)
 				"CROWN_DEVELOPMENT=1"
 			}
 
+		if _OPTIONS["with-profiler"] then
+			configuration {}
+				defines {
+					"CROWN_PROFILER=1"
+				}
+		end
+
 		configuration { "android*" }
 			kind "ConsoleApp"
 			targetextension ".so"
@@ -104,6 +112,9 @@ function crown_project(_name, _kind, _defines)
 				"dl",
 				"GL",
 			}
+			linkoptions {
+				"-rdynamic", -- Export symbols used by the Lua FFI
+			}
 
 		configuration { "vs* or mingw*" }
 			links {
@@ -28,6 +28,11 @@ newoption {
 	description = "Build with Bullet support."
 }
 
+newoption {
+	trigger = "with-profiler",
+	description = "Build with the profiler enabled in release configurations."
+}
+
 newoption {
 	trigger = "with-tools",
 	description = "Build with tools."
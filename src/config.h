@@ -19,6 +19,10 @@
 
 #define CROWN_RELEASE (!CROWN_DEBUG && !CROWN_DEVELOPMENT)
 
+#ifndef CROWN_PROFILER
+	#define CROWN_PROFILER CROWN_DEBUG
+#endif // CROWN_PROFILER
+
 #ifndef CROWN_BUILD_UNIT_TESTS
 	#define CROWN_BUILD_UNIT_TESTS 1
 #endif // CROWN_BUILD_UNIT_TESTS
@@ -95,6 +99,10 @@
 	#define CROWN_TEMP_DIRECTORY "temp"
 #endif // CROWN_TEMP_DIRECTORY
 
+#ifndef CROWN_SHADER_CACHE_DIRECTORY
+	#define CROWN_SHADER_CACHE_DIRECTORY CROWN_TEMP_DIRECTORY "/shaders"
+#endif // CROWN_SHADER_CACHE_DIRECTORY
+
 #ifndef CROWN_DATAIGNORE
 	#define CROWN_DATAIGNORE ".dataignore"
 #endif // CROWN_DATAIGNORE
@@ -103,18 +111,26 @@
 	#define CROWN_LAST_LOG "last.log"
 #endif // CROWN_LAST_LOG
 
+#ifndef CROWN_PROFILE_CAPTURE
+	#define CROWN_PROFILE_CAPTURE "profile.json"
+#endif // CROWN_PROFILE_CAPTURE
+
 #ifndef CROWN_MAX_JOYPADS
 	#define CROWN_MAX_JOYPADS 4
 #endif // CROWN_MAX_JOYPADS
 
-#ifndef CROWN_MAX_LUA_VECTOR3
-	#define CROWN_MAX_LUA_VECTOR3 8192
-#endif // CE_MAX
+#ifndef CROWN_TEXTURE_STREAMING_MIN_SIZE
+	#define CROWN_TEXTURE_STREAMING_MIN_SIZE 64
+#endif // CROWN_TEXTURE_STREAMING_MIN_SIZE
+
+#ifndef CROWN_TEXTURE_STREAMING_BUDGET
+	#define CROWN_TEXTURE_STREAMING_BUDGET (1024*1024)
+#endif // CROWN_TEXTURE_STREAMING_BUDGET
 
-#ifndef CROWN_MAX_LUA_MATRIX4X4
-	#define CROWN_MAX_LUA_MATRIX4X4 8192
-#endif // CE_MAX
+#ifndef CROWN_MAX_SPRITE_LAYERS
+	#define CROWN_MAX_SPRITE_LAYERS 256
+#endif // CROWN_MAX_SPRITE_LAYERS
 
-#ifndef CROWN_MAX_LUA_QUATERNION
-	#define CROWN_MAX_LUA_QUATERNION 8192
-#endif // CE_MAX
+#ifndef CROWN_MAX_SPRITE_DEPTH
+	#define CROWN_MAX_SPRITE_DEPTH 16777215
+#endif // CROWN_MAX_SPRITE_DEPTH
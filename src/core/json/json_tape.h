@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2012-2017 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/array.h"
+#include "core/error/error.h"
+#include "core/json/types.h"
+#include "core/strings/string.h"
+
+namespace crown
+{
+/// Functions to manipulate JsonTape.
+///
+/// Nodes are referred to by index. The node 0 is the root object.
+///
+/// @ingroup JSON
+namespace json_tape
+{
+	/// Returns the node @a i of the tape @a jt.
+	inline const JsonNode& node(const JsonTape& jt, u32 i)
+	{
+		return jt._nodes[i];
+	}
+
+	/// Returns the number of children of the array or object @a i.
+	inline u32 size(const JsonTape& jt, u32 i)
+	{
+		return jt._nodes[i].size;
+	}
+
+	/// Returns the first child of the array or object @a i.
+	inline u32 begin(const JsonTape& jt, u32 i)
+	{
+		CE_UNUSED(jt);
+		return i + 1;
+	}
+
+	/// Returns the node following the last child of the array or object @a i.
+	inline u32 end(const JsonTape& jt, u32 i)
+	{
+		return jt._nodes[i].next;
+	}
+
+	/// Returns the sibling following the node @a i.
+	inline u32 next(const JsonTape& jt, u32 i)
+	{
+		return jt._nodes[i].next;
+	}
+
+	/// Returns the member @a key of the object @a i or UINT32_MAX if not found.
+	inline u32 find(const JsonTape& jt, u32 i, const char* key)
+	{
+		const u32 len = strlen32(key);
+		for (u32 cur = begin(jt, i), end = json_tape::end(jt, i); cur != end; cur = next(jt, cur))
+		{
+			const JsonNode& n = jt._nodes[cur];
+			if (n.key_length == len && strncmp(n.key, key, len) == 0)
+				return cur;
+		}
+
+		return UINT32_MAX;
+	}
+
+	/// Returns whether the object @a i has the member @a key.
+	inline bool has(const JsonTape& jt, u32 i, const char* key)
+	{
+		return find(jt, i, key) != UINT32_MAX;
+	}
+
+	/// Returns the member @a key of the object @a i.
+	inline u32 get(const JsonTape& jt, u32 i, const char* key)
+	{
+		const u32 member = find(jt, i, key);
+		CE_ASSERT(member != UINT32_MAX, "Key not found: '%s'", key);
+		return member;
+	}
+
+	/// Returns the number @a i as f32.
+	inline f32 to_float(const JsonTape& jt, u32 i)
+	{
+		CE_ASSERT(jt._nodes[i].type == JsonValueType::NUMBER, "Not a number");
+		return (f32)jt._nodes[i].number;
+	}
+
+	/// Returns the number @a i as int.
+	inline s32 to_int(const JsonTape& jt, u32 i)
+	{
+		CE_ASSERT(jt._nodes[i].type == JsonValueType::NUMBER, "Not a number");
+		return (s32)jt._nodes[i].number;
+	}
+
+	/// Returns the boolean @a i as bool.
+	inline bool to_bool(const JsonTape& jt, u32 i)
+	{
+		CE_ASSERT(jt._nodes[i].type == JsonValueType::BOOL, "Not a boolean");
+		return jt._nodes[i].number != 0.0;
+	}
+
+} // namespace json_tape
+
+inline JsonTape::JsonTape(Allocator& a)
+	: _nodes(a)
+{
+}
+
+} // namespace crown
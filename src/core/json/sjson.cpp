@@ -4,15 +4,56 @@
  */
 
 #include "core/containers/map.h"
+#include "core/json/json_tape.h"
 #include "core/json/sjson.h"
 #include "core/memory/temp_allocator.h"
 #include "core/strings/dynamic_string.h"
 #include "core/strings/string.h"
+#include <stdlib.h> // strtod
+
+// Character classes
+#define SJSON_SPACE   0x1 // Skipped between values
+#define SJSON_DELIM   0x2 // Terminates values other than strings, arrays and objects
+#define SJSON_KEY_END 0x4 // Terminates unquoted keys
+#define SJSON_DIGIT   0x8
 
 namespace crown
 {
 namespace sjson
 {
+	static const u8 s_class[256] =
+	{
+		0x6, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x7, 0x7, 0x5, 0x5, 0x7, 0x0, 0x0,
+		0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+		0x7, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x3, 0x0, 0x0, 0x0,
+		0x8, 0x8, 0x8, 0x8, 0x8, 0x8, 0x8, 0x8, 0x8, 0x8, 0x4, 0x0, 0x0, 0x4, 0x0, 0x0,
+		0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+		0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x2, 0x0, 0x0,
+		0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+		0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x2, 0x0, 0x0,
+		0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+		0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+		0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+		0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+		0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+		0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+		0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+		0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+	};
+
+	// Powers of ten that are exactly representable as f64
+	static const f64 s_pow10[] =
+	{
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+		1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+		1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	inline bool is(char c, u8 mask)
+	{
+		return (s_class[(u8)c] & mask) != 0;
+	}
+
 	static const char* next(const char* json, const char c = 0)
 	{
 		CE_ENSURE(NULL != json);
@@ -54,7 +95,7 @@ namespace sjson
 		case '"': json = skip_string(json); break;
 		case '[': json = skip_block(json, '[', ']'); break;
 		case '{': json = skip_block(json, '{', '}'); break;
-		default: for (; *json != '\0' && *json != ',' && *json != '\n' && *json != ' ' && *json != '}' && *json != ']'; ++json) ; break;
+		default: for (; !is(*json, SJSON_DELIM); ++json) ; break;
 		}
 
 		return json;
@@ -92,14 +133,16 @@ namespace sjson
 	{
 		CE_ENSURE(NULL != json);
 
-		while (*json)
+		while (true)
 		{
-			if (*json == '/') json = skip_comments(json);
-			else if (isspace(*json) || *json == ',') ++json;
-			else break;
-		}
+			while (is(*json, SJSON_SPACE))
+				++json;
 
-		return json;
+			if (*json != '/')
+				return json;
+
+			json = skip_comments(json);
+		}
 	}
 
 	JsonValueType::Enum type(const char* json)
@@ -137,56 +180,93 @@ namespace sjson
 		return NULL;
 	}
 
-	static f64 parse_number(const char* json)
+	// Parses the number @a json into @a val and returns the pointer past its end.
+	// Numbers with at most 19 significant digits and small exponents are computed
+	// exactly with a single multiplication or division, the others by strtod().
+	static const char* parse_number(const char* json, f64& val)
 	{
 		CE_ENSURE(NULL != json);
 
-		TempAllocator512 alloc;
-	 	Array<char> number(alloc);
-
-		if (*json == '-')
-		{
-			array::push_back(number, '-');
+		const char* begin = json;
+		const bool negative = *json == '-';
+		if (negative)
 			++json;
-		}
-		while (isdigit(*json))
+
+		u64 mantissa = 0;
+		s32 exponent = 0;
+		u32 num_digits = 0;
+		bool exact = is(*json, SJSON_DIGIT);
+		CE_ASSERT(exact, "Bad number: %.16s", begin);
+
+		for (; is(*json, SJSON_DIGIT); ++json)
 		{
-			array::push_back(number, *json);
-			++json;
+			if (num_digits < 19)
+			{
+				mantissa = mantissa*10 + (*json - '0');
+				num_digits += mantissa != 0;
+			}
+			else
+			{
+				++exponent;
+				exact = false;
+			}
 		}
 
 		if (*json == '.')
 		{
-			array::push_back(number, '.');
-			while (*++json && isdigit(*json))
+			for (++json; is(*json, SJSON_DIGIT); ++json)
 			{
-				array::push_back(number, *json);
+				if (num_digits < 19)
+				{
+					mantissa = mantissa*10 + (*json - '0');
+					num_digits += mantissa != 0;
+					--exponent;
+				}
+				else
+				{
+					exact = false;
+				}
 			}
 		}
 
 		if (*json == 'e' || *json == 'E')
 		{
-			array::push_back(number, *json);
 			++json;
 
+			const bool negative_exp = *json == '-';
 			if (*json == '-' || *json == '+')
-			{
-				array::push_back(number, *json);
 				++json;
-			}
-			while (isdigit(*json))
+
+			s32 exp = 0;
+			for (; is(*json, SJSON_DIGIT); ++json)
 			{
-				array::push_back(number, *json);
-				++json;
+				if (exp < 10000)
+					exp = exp*10 + (*json - '0');
 			}
+
+			exponent += negative_exp ? -exp : exp;
 		}
 
-		array::push_back(number, '\0');
+		if (exact && mantissa <= (u64(1) << 53) && exponent >= -22 && exponent <= 22)
+		{
+			val = exponent < 0
+				? f64(mantissa) / s_pow10[-exponent]
+				: f64(mantissa) * s_pow10[exponent]
+				;
+			val = negative ? -val : val;
+		}
+		else
+		{
+			val = strtod(begin, NULL);
+		}
 
+		return json;
+	}
+
+	static f64 parse_number(const char* json)
+	{
 		f64 val;
-		int ok = sscanf(array::begin(number), "%lf", &val);
-		CE_ASSERT(ok == 1, "Failed to parse f64: %s", array::begin(number));
-		CE_UNUSED(ok);
+		parse_number(json, val);
 		return val;
 	}
 
@@ -361,6 +441,121 @@ namespace sjson
 		CE_FATAL("Bad object");
 	}
 
+	static const char* parse_value(const char* json, JsonTape& tape, const char* key, u32 key_length);
+
+	// Parses the members of the object @a parent until the @a close character.
+	static const char* parse_members(const char* json, JsonTape& tape, u32 parent, char close)
+	{
+		json = skip_spaces(json);
+
+		while (*json != close)
+		{
+			CE_ASSERT(*json != '\0', "Bad object");
+
+			const char* key = json;
+			u32 key_length;
+			if (*json == '"')
+			{
+				key = json + 1;
+				json = skip_string(json);
+				key_length = u32(json - key - 1);
+			}
+			else
+			{
+				while (!is(*json, SJSON_KEY_END))
+					++json;
+				key_length = u32(json - key);
+			}
+
+			json = skip_spaces(json);
+			json = next(json, (*json == '=') ? '=' : ':');
+			json = skip_spaces(json);
+			json = parse_value(json, tape, key, key_length);
+			json = skip_spaces(json);
+
+			++tape._nodes[parent].size;
+		}
+
+		return close != '\0' ? json + 1 : json;
+	}
+
+	// Parses the items of the array @a parent.
+	static const char* parse_items(const char* json, JsonTape& tape, u32 parent)
+	{
+		json = skip_spaces(json);
+
+		while (*json != ']')
+		{
+			CE_ASSERT(*json != '\0', "Bad array");
+
+			json = parse_value(json, tape, NULL, 0);
+			json = skip_spaces(json);
+
+			++tape._nodes[parent].size;
+		}
+
+		return json + 1;
+	}
+
+	static u32 push_node(JsonTape& tape, JsonValueType::Enum type, const char* json, const char* key, u32 key_length)
+	{
+		JsonNode node;
+		node.type       = type;
+		node.next       = 0;
+		node.size       = 0;
+		node.key_length = key_length;
+		node.key        = key;
+		node.json       = json;
+		node.number     = 0.0;
+		return array::push_back(tape._nodes, node);
+	}
+
+	static const char* parse_value(const char* json, JsonTape& tape, const char* key, u32 key_length)
+	{
+		const JsonValueType::Enum t = type(json);
+		const u32 i = push_node(tape, t, json, key, key_length);
+
+		switch (t)
+		{
+		case JsonValueType::OBJECT: json = parse_members(json + 1, tape, i, '}'); break;
+		case JsonValueType::ARRAY: json = parse_items(json + 1, tape, i); break;
+		case JsonValueType::STRING: json = skip_string(json); break;
+		case JsonValueType::NUMBER: json = parse_number(json, tape._nodes[i].number); break;
+		case JsonValueType::BOOL: tape._nodes[i].number = parse_bool(json) ? 1.0 : 0.0; json = skip_value(json); break;
+		default: json = skip_value(json); break;
+		}
+
+		// Children have been pushed after the node
+		tape._nodes[i].next = array::size(tape._nodes);
+		return json;
+	}
+
+	void parse(const char* json, JsonTape& tape)
+	{
+		CE_ENSURE(NULL != json);
+
+		array::clear(tape._nodes);
+		json = skip_spaces(json);
+
+		if (*json == '{')
+		{
+			parse_value(json, tape, NULL, 0);
+		}
+		else
+		{
+			push_node(tape, JsonValueType::OBJECT, json, NULL, 0);
+			parse_members(json, tape, 0, '\0');
+			tape._nodes[0].next = array::size(tape._nodes);
+		}
+	}
+
+	void parse(Buffer& json, JsonTape& tape)
+	{
+		array::push_back(json, '\0');
+		array::pop_back(json);
+		parse(array::begin(json), tape);
+	}
+
 	void parse(const char* json, JsonObject& object)
 	{
 		CE_ENSURE(NULL != json);
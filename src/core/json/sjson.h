@@ -46,6 +46,14 @@ namespace sjson
 	/// Parses the SJSON-encoded @a json.
 	void parse(Buffer& json, JsonObject& object);
 
+	/// Parses the whole SJSON-encoded @a json in a single pass and puts all
+	/// its values into @a tape. Strings, arrays and objects point into the
+	/// original string @a json, which must outlive the @a tape.
+	void parse(const char* json, JsonTape& tape);
+
+	/// Parses the whole SJSON-encoded @a json in a single pass.
+	void parse(Buffer& json, JsonTape& tape);
+
 } // namespace sjson
 
 namespace sjson
@@ -46,4 +46,30 @@ struct JsonObject
 	const char* operator[](const FixedString& key) const;
 };
 
+/// Value in a JsonTape.
+///
+/// @ingroup JSON
+struct JsonNode
+{
+	JsonValueType::Enum type;
+	u32 next;           ///< Index of the node following this value and all its children.
+	u32 size;           ///< Number of children of arrays and objects.
+	u32 key_length;
+	const char* key;    ///< Key of the object member, not null-terminated.
+	const char* json;   ///< Pointer to the value into the original json string.
+	f64 number;         ///< Value of numbers and booleans.
+};
+
+/// Flat list of all the values in a json-encoded document, in the
+/// order they appear in the text. The children of arrays and objects
+/// immediately follow their parent.
+///
+/// @ingroup JSON
+struct JsonTape
+{
+	Array<JsonNode> _nodes;
+
+	JsonTape(Allocator& a);
+};
+
 } // namespace crown
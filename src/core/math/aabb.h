@@ -55,6 +55,33 @@ namespace aabb
 
 } // namespace aabb
 
+namespace aabb_internal
+{
+	// Transforms the eight vertices of the box. Used when SIMD instructions
+	// are not available, and as a reference by the tests.
+	inline AABB transformed_scalar(const AABB& b, const Matrix4x4& m)
+	{
+		Vector3 vertices[8];
+		aabb::to_vertices(b, vertices);
+
+		vertices[0] = vertices[0] * m;
+		vertices[1] = vertices[1] * m;
+		vertices[2] = vertices[2] * m;
+		vertices[3] = vertices[3] * m;
+		vertices[4] = vertices[4] * m;
+		vertices[5] = vertices[5] * m;
+		vertices[6] = vertices[6] * m;
+		vertices[7] = vertices[7] * m;
+
+		AABB r;
+		r.min = vertices[0];
+		r.max = vertices[0];
+		aabb::add_points(r, 7, &vertices[1]);
+		return r;
+	}
+
+} // namespace aabb_internal
+
 namespace aabb
 {
 	inline void reset(AABB& b)
@@ -114,22 +141,45 @@ namespace aabb
 
 	inline AABB transformed(const AABB& b, const Matrix4x4& m)
 	{
-		Vector3 vertices[8];
-		to_vertices(b, vertices);
-
-		vertices[0] = vertices[0] * m;
-		vertices[1] = vertices[1] * m;
-		vertices[2] = vertices[2] * m;
-		vertices[3] = vertices[3] * m;
-		vertices[4] = vertices[4] * m;
-		vertices[5] = vertices[5] * m;
-		vertices[6] = vertices[6] * m;
-		vertices[7] = vertices[7] * m;
+#if CROWN_SIMD
+		using namespace simd;
+		const f32x4 x = load(&m.x.x);
+		const f32x4 y = load(&m.y.x);
+		const f32x4 z = load(&m.z.x);
+
+		// Each axis contributes its smallest and largest transformed
+		// extents to the bounds, starting from the translation
+		f32x4 rmin = load(&m.t.x);
+		f32x4 rmax = rmin;
+		f32x4 e0 = mul(splat(b.min.x), x);
+		f32x4 e1 = mul(splat(b.max.x), x);
+		rmin = add(rmin, simd::min(e0, e1));
+		rmax = add(rmax, simd::max(e0, e1));
+		e0 = mul(splat(b.min.y), y);
+		e1 = mul(splat(b.max.y), y);
+		rmin = add(rmin, simd::min(e0, e1));
+		rmax = add(rmax, simd::max(e0, e1));
+		e0 = mul(splat(b.min.z), z);
+		e1 = mul(splat(b.max.z), z);
+		rmin = add(rmin, simd::min(e0, e1));
+		rmax = add(rmax, simd::max(e0, e1));
+
+		f32 tmin[4];
+		f32 tmax[4];
+		store(tmin, rmin);
+		store(tmax, rmax);
 
 		AABB r;
-		aabb::reset(r);
-		aabb::add_points(r, 8, vertices);
+		r.min.x = tmin[0];
+		r.min.y = tmin[1];
+		r.min.z = tmin[2];
+		r.max.x = tmax[0];
+		r.max.y = tmax[1];
+		r.max.z = tmax[2];
 		return r;
+#else
+		return aabb_internal::transformed_scalar(b, m);
+#endif
 	}
 
 	inline void to_vertices(const AABB& b, Vector3 v[8])
@@ -0,0 +1,447 @@
+/*
+ * Copyright (c) 2012-2017 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/math/aabb.h"
+#include "core/math/aabb_tree.h"
+#include "core/math/intersection.h"
+#include "core/math/vector3.h"
+#include "core/memory/temp_allocator.h"
+
+#define AABB_TREE_NULL_NODE UINT32_MAX
+
+namespace crown
+{
+namespace aabb_tree_internal
+{
+	inline AABB merge(const AABB& a, const AABB& b)
+	{
+		AABB c;
+		c.min = min(a.min, b.min);
+		c.max = max(a.max, b.max);
+		return c;
+	}
+
+	inline f32 surface_area(const AABB& b)
+	{
+		const Vector3 d = b.max - b.min;
+		return 2.0f * (d.x*d.y + d.y*d.z + d.z*d.x);
+	}
+
+	inline bool contains(const AABB& a, const AABB& b)
+	{
+		return a.min.x <= b.min.x
+			&& a.min.y <= b.min.y
+			&& a.min.z <= b.min.z
+			&& a.max.x >= b.max.x
+			&& a.max.y >= b.max.y
+			&& a.max.z >= b.max.z
+			;
+	}
+
+	inline s32 max_height(s32 a, s32 b)
+	{
+		return a > b ? a : b;
+	}
+
+} // namespace aabb_tree_internal
+
+AABBTree::AABBTree(Allocator& a, f32 margin)
+	: _nodes(a)
+	, _root(AABB_TREE_NULL_NODE)
+	, _free_list(AABB_TREE_NULL_NODE)
+	, _margin(margin)
+{
+}
+
+u32 AABBTree::create(const AABB& aabb, u32 user_data)
+{
+	const Vector3 margin = vector3(_margin, _margin, _margin);
+
+	const u32 proxy = allocate_node();
+	_nodes[proxy].aabb.min  = aabb.min - margin;
+	_nodes[proxy].aabb.max  = aabb.max + margin;
+	_nodes[proxy].user_data = user_data;
+	_nodes[proxy].height    = 0;
+
+	insert_leaf(proxy);
+	return proxy;
+}
+
+void AABBTree::destroy(u32 proxy)
+{
+	CE_ASSERT(proxy < array::size(_nodes), "Index out of bounds");
+	CE_ASSERT(_nodes[proxy].right == AABB_TREE_NULL_NODE, "Node is not a leaf");
+
+	remove_leaf(proxy);
+	deallocate_node(proxy);
+}
+
+bool AABBTree::move(u32 proxy, const AABB& aabb)
+{
+	using namespace aabb_tree_internal;
+
+	CE_ASSERT(proxy < array::size(_nodes), "Index out of bounds");
+	CE_ASSERT(_nodes[proxy].right == AABB_TREE_NULL_NODE, "Node is not a leaf");
+
+	const Vector3 margin = vector3(_margin, _margin, _margin);
+
+	AABB fat;
+	fat.min = aabb.min - margin;
+	fat.max = aabb.max + margin;
+
+	// Boxes that still fit their enlarged box stay where they are,
+	// unless the enlarged box is much bigger than needed
+	AABB huge;
+	huge.min = fat.min - margin*4.0f;
+	huge.max = fat.max + margin*4.0f;
+
+	const AABB& old = _nodes[proxy].aabb;
+	if (contains(old, aabb) && contains(huge, old))
+		return false;
+
+	remove_leaf(proxy);
+	_nodes[proxy].aabb = fat;
+	insert_leaf(proxy);
+	return true;
+}
+
+u32 AABBTree::user_data(u32 proxy) const
+{
+	CE_ASSERT(proxy < array::size(_nodes), "Index out of bounds");
+	return _nodes[proxy].user_data;
+}
+
+const AABB& AABBTree::fat_aabb(u32 proxy) const
+{
+	CE_ASSERT(proxy < array::size(_nodes), "Index out of bounds");
+	return _nodes[proxy].aabb;
+}
+
+s32 AABBTree::height() const
+{
+	return _root == AABB_TREE_NULL_NODE ? 0 : _nodes[_root].height;
+}
+
+void AABBTree::query_ray(const Vector3& from, const Vector3& dir, Array<u32>& user_data) const
+{
+	if (_root == AABB_TREE_NULL_NODE)
+		return;
+
+	TempAllocator512 ta;
+	Array<u32> stack(ta);
+	array::push_back(stack, _root);
+
+	while (!array::empty(stack))
+	{
+		const Node& n = _nodes[array::back(stack)];
+		array::pop_back(stack);
+
+		if (ray_aabb_intersection(from, dir, n.aabb) == -1.0f)
+			continue;
+
+		if (n.right == AABB_TREE_NULL_NODE)
+		{
+			array::push_back(user_data, n.user_data);
+		}
+		else
+		{
+			array::push_back(stack, n.left);
+			array::push_back(stack, n.right);
+		}
+	}
+}
+
+void AABBTree::query_frustum(const Frustum& f, Array<u32>& user_data) const
+{
+	if (_root == AABB_TREE_NULL_NODE)
+		return;
+
+	TempAllocator512 ta;
+	Array<u32> stack(ta);
+	array::push_back(stack, _root);
+
+	while (!array::empty(stack))
+	{
+		const Node& n = _nodes[array::back(stack)];
+		array::pop_back(stack);
+
+		if (!frustum_box_intersection(f, n.aabb))
+			continue;
+
+		if (n.right == AABB_TREE_NULL_NODE)
+		{
+			array::push_back(user_data, n.user_data);
+		}
+		else
+		{
+			array::push_back(stack, n.left);
+			array::push_back(stack, n.right);
+		}
+	}
+}
+
+void AABBTree::query_sphere(const Sphere& s, Array<u32>& user_data) const
+{
+	if (_root == AABB_TREE_NULL_NODE)
+		return;
+
+	TempAllocator512 ta;
+	Array<u32> stack(ta);
+	array::push_back(stack, _root);
+
+	while (!array::empty(stack))
+	{
+		const Node& n = _nodes[array::back(stack)];
+		array::pop_back(stack);
+
+		if (!sphere_box_intersection(s, n.aabb))
+			continue;
+
+		if (n.right == AABB_TREE_NULL_NODE)
+		{
+			array::push_back(user_data, n.user_data);
+		}
+		else
+		{
+			array::push_back(stack, n.left);
+			array::push_back(stack, n.right);
+		}
+	}
+}
+
+u32 AABBTree::allocate_node()
+{
+	u32 node = _free_list;
+
+	if (node == AABB_TREE_NULL_NODE)
+	{
+		node = array::size(_nodes);
+		array::resize(_nodes, node + 1);
+	}
+	else
+	{
+		_free_list = _nodes[node].parent;
+	}
+
+	_nodes[node].parent    = AABB_TREE_NULL_NODE;
+	_nodes[node].left      = AABB_TREE_NULL_NODE;
+	_nodes[node].right     = AABB_TREE_NULL_NODE;
+	_nodes[node].user_data = 0;
+	_nodes[node].height    = 0;
+	return node;
+}
+
+void AABBTree::deallocate_node(u32 node)
+{
+	_nodes[node].parent = _free_list;
+	_nodes[node].height = -1;
+	_free_list = node;
+}
+
+// Walks down the tree looking for the sibling that makes the total
+// surface area of the tree the smallest.
+// See: Box2D, b2DynamicTree::InsertLeaf()
+void AABBTree::insert_leaf(u32 leaf)
+{
+	using namespace aabb_tree_internal;
+
+	if (_root == AABB_TREE_NULL_NODE)
+	{
+		_root = leaf;
+		_nodes[leaf].parent = AABB_TREE_NULL_NODE;
+		return;
+	}
+
+	const AABB leaf_aabb = _nodes[leaf].aabb;
+
+	u32 index = _root;
+	while (_nodes[index].right != AABB_TREE_NULL_NODE)
+	{
+		const Node& n = _nodes[index];
+		const Node& l = _nodes[n.left];
+		const Node& r = _nodes[n.right];
+
+		const f32 area = surface_area(n.aabb);
+		const f32 combined_area = surface_area(merge(n.aabb, leaf_aabb));
+
+		// Cost of creating a new parent for this node and the new leaf
+		const f32 cost = 2.0f * combined_area;
+
+		// Minimum cost of pushing the leaf further down the tree
+		const f32 inheritance_cost = 2.0f * (combined_area - area);
+
+		f32 cost_left = surface_area(merge(leaf_aabb, l.aabb)) + inheritance_cost;
+		if (l.right != AABB_TREE_NULL_NODE)
+			cost_left -= surface_area(l.aabb);
+
+		f32 cost_right = surface_area(merge(leaf_aabb, r.aabb)) + inheritance_cost;
+		if (r.right != AABB_TREE_NULL_NODE)
+			cost_right -= surface_area(r.aabb);
+
+		if (cost < cost_left && cost < cost_right)
+			break;
+
+		index = cost_left < cost_right ? n.left : n.right;
+	}
+
+	const u32 sibling = index;
+	const u32 old_parent = _nodes[sibling].parent;
+	const u32 new_parent = allocate_node();
+
+	_nodes[new_parent].parent = old_parent;
+	_nodes[new_parent].aabb   = merge(leaf_aabb, _nodes[sibling].aabb);
+	_nodes[new_parent].height = _nodes[sibling].height + 1;
+	_nodes[new_parent].left   = sibling;
+	_nodes[new_parent].right  = leaf;
+	_nodes[sibling].parent    = new_parent;
+	_nodes[leaf].parent       = new_parent;
+
+	if (old_parent == AABB_TREE_NULL_NODE)
+		_root = new_parent;
+	else if (_nodes[old_parent].left == sibling)
+		_nodes[old_parent].left = new_parent;
+	else
+		_nodes[old_parent].right = new_parent;
+
+	// Fix the heights and the boxes of the ancestors
+	index = _nodes[leaf].parent;
+	while (index != AABB_TREE_NULL_NODE)
+	{
+		index = balance(index);
+
+		Node& n = _nodes[index];
+		n.height = 1 + max_height(_nodes[n.left].height, _nodes[n.right].height);
+		n.aabb   = merge(_nodes[n.left].aabb, _nodes[n.right].aabb);
+
+		index = n.parent;
+	}
+}
+
+void AABBTree::remove_leaf(u32 leaf)
+{
+	using namespace aabb_tree_internal;
+
+	if (leaf == _root)
+	{
+		_root = AABB_TREE_NULL_NODE;
+		return;
+	}
+
+	const u32 parent = _nodes[leaf].parent;
+	const u32 grand_parent = _nodes[parent].parent;
+	const u32 sibling = _nodes[parent].left == leaf
+		? _nodes[parent].right
+		: _nodes[parent].left
+		;
+
+	deallocate_node(parent);
+
+	if (grand_parent == AABB_TREE_NULL_NODE)
+	{
+		_root = sibling;
+		_nodes[sibling].parent = AABB_TREE_NULL_NODE;
+		return;
+	}
+
+	// The sibling takes the place of the parent
+	if (_nodes[grand_parent].left == parent)
+		_nodes[grand_parent].left = sibling;
+	else
+		_nodes[grand_parent].right = sibling;
+	_nodes[sibling].parent = grand_parent;
+
+	u32 index = grand_parent;
+	while (index != AABB_TREE_NULL_NODE)
+	{
+		index = balance(index);
+
+		Node& n = _nodes[index];
+		n.height = 1 + max_height(_nodes[n.left].height, _nodes[n.right].height);
+		n.aabb   = merge(_nodes[n.left].aabb, _nodes[n.right].aabb);
+
+		index = n.parent;
+	}
+}
+
+// Rotates the subtree at @a a if it is unbalanced and returns its new root.
+// See: Box2D, b2DynamicTree::Balance()
+u32 AABBTree::balance(u32 a)
+{
+	using namespace aabb_tree_internal;
+
+	Node* n = array::begin(_nodes);
+
+	if (n[a].right == AABB_TREE_NULL_NODE || n[a].height < 2)
+		return a;
+
+	const u32 b = n[a].left;
+	const u32 c = n[a].right;
+	const s32 bal = n[c].height - n[b].height;
+
+	if (bal > 1)
+	{
+		// Rotate c up
+		const u32 f = n[c].left;
+		const u32 g = n[c].right;
+
+		n[c].left = a;
+		n[c].parent = n[a].parent;
+		n[a].parent = c;
+
+		if (n[c].parent == AABB_TREE_NULL_NODE)
+			_root = c;
+		else if (n[n[c].parent].left == a)
+			n[n[c].parent].left = c;
+		else
+			n[n[c].parent].right = c;
+
+		const u32 high = n[f].height > n[g].height ? f : g;
+		const u32 low  = n[f].height > n[g].height ? g : f;
+
+		n[c].right = high;
+		n[a].right = low;
+		n[low].parent = a;
+		n[a].aabb = merge(n[b].aabb, n[low].aabb);
+		n[c].aabb = merge(n[a].aabb, n[high].aabb);
+		n[a].height = 1 + max_height(n[b].height, n[low].height);
+		n[c].height = 1 + max_height(n[a].height, n[high].height);
+		return c;
+	}
+
+	if (bal < -1)
+	{
+		// Rotate b up
+		const u32 d = n[b].left;
+		const u32 e = n[b].right;
+
+		n[b].left = a;
+		n[b].parent = n[a].parent;
+		n[a].parent = b;
+
+		if (n[b].parent == AABB_TREE_NULL_NODE)
+			_root = b;
+		else if (n[n[b].parent].left == a)
+			n[n[b].parent].left = b;
+		else
+			n[n[b].parent].right = b;
+
+		const u32 high = n[d].height > n[e].height ? d : e;
+		const u32 low  = n[d].height > n[e].height ? e : d;
+
+		n[b].right = high;
+		n[a].left = low;
+		n[low].parent = a;
+		n[a].aabb = merge(n[c].aabb, n[low].aabb);
+		n[b].aabb = merge(n[a].aabb, n[high].aabb);
+		n[a].height = 1 + max_height(n[c].height, n[low].height);
+		n[b].height = 1 + max_height(n[a].height, n[high].height);
+		return b;
+	}
+
+	return a;
+}
+
+} // namespace crown
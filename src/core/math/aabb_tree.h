@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2012-2017 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/math/types.h"
+
+namespace crown
+{
+/// Dynamic bounding volume hierarchy of axis-aligned boxes.
+///
+/// Each leaf stores a box enlarged by a margin, so that objects moving
+/// by small amounts do not need to be inserted again at every move.
+///
+/// @ingroup Math
+struct AABBTree
+{
+	struct Node
+	{
+		AABB aabb;
+		u32 parent;    // Next free node if the node is not in use
+		u32 left;
+		u32 right;     // UINT32_MAX if the node is a leaf
+		u32 user_data;
+		s32 height;    // 0 for leaves, -1 for nodes not in use
+	};
+
+	Array<Node> _nodes;
+	u32 _root;
+	u32 _free_list;
+	f32 _margin;
+
+	/// Leaves boxes are enlarged by @a margin on each side.
+	AABBTree(Allocator& a, f32 margin);
+
+	/// Inserts the box @a aabb and returns its proxy.
+	u32 create(const AABB& aabb, u32 user_data);
+
+	/// Removes the @a proxy.
+	void destroy(u32 proxy);
+
+	/// Updates the box of the @a proxy to @a aabb.
+	/// Returns whether the proxy had to be inserted again.
+	bool move(u32 proxy, const AABB& aabb);
+
+	/// Returns the user data of the @a proxy.
+	u32 user_data(u32 proxy) const;
+
+	/// Returns the enlarged box of the @a proxy.
+	const AABB& fat_aabb(u32 proxy) const;
+
+	/// Returns the height of the tree.
+	s32 height() const;
+
+	/// Fills @a user_data with the user data of the boxes hit by the ray (from, dir).
+	void query_ray(const Vector3& from, const Vector3& dir, Array<u32>& user_data) const;
+
+	/// Fills @a user_data with the user data of the boxes intersecting the frustum @a f.
+	void query_frustum(const Frustum& f, Array<u32>& user_data) const;
+
+	/// Fills @a user_data with the user data of the boxes intersecting the sphere @a s.
+	void query_sphere(const Sphere& s, Array<u32>& user_data) const;
+
+private:
+
+	u32 allocate_node();
+	void deallocate_node(u32 node);
+	void insert_leaf(u32 leaf);
+	void remove_leaf(u32 leaf);
+	u32 balance(u32 node);
+
+	// Disable copying
+	AABBTree(const AABBTree&);
+	AABBTree& operator=(const AABBTree&);
+};
+
+} // namespace crown
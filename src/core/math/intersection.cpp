@@ -146,6 +146,43 @@ f32 ray_obb_intersection(const Vector3& from, const Vector3& dir, const Matrix4x
 	return tmin;
 }
 
+f32 ray_aabb_intersection(const Vector3& from, const Vector3& dir, const AABB& b)
+{
+	f32 tmin = 0.0f;
+	f32 tmax = 999999999.9f;
+
+	const f32* o = to_float_ptr(from);
+	const f32* d = to_float_ptr(dir);
+	const f32* bmin = to_float_ptr(b.min);
+	const f32* bmax = to_float_ptr(b.max);
+
+	for (u32 i = 0; i < 3; ++i)
+	{
+		if (fabs(d[i]) > 0.000001f)
+		{
+			const f32 inv_d = 1.0f / d[i];
+			f32 t1 = (bmin[i] - o[i])*inv_d;
+			f32 t2 = (bmax[i] - o[i])*inv_d;
+
+			if (t1 > t2) { f32 w=t1;t1=t2;t2=w; }
+
+			tmin = fmax(tmin, t1);
+			tmax = fmin(tmax, t2);
+
+			if (tmin > tmax)
+				return -1.0f;
+		}
+		else
+		{
+			// The ray is parallel to the slab
+			if (o[i] < bmin[i] || o[i] > bmax[i])
+				return -1.0f;
+		}
+	}
+
+	return tmin;
+}
+
 f32 ray_triangle_intersection(const Vector3& from, const Vector3& dir, const Vector3& v0, const Vector3& v1, const Vector3& v2)
 {
 	const Vector3 verts[] = { v0, v1, v2 };
@@ -153,68 +190,83 @@ f32 ray_triangle_intersection(const Vector3& from, const Vector3& dir, const Vec
 	return ray_mesh_intersection(from, dir, MATRIX4X4_IDENTITY, verts, sizeof(Vector3), inds, 3);
 }
 
-f32 ray_mesh_intersection(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const void* vertices, u32 stride, const u16* indices, u32 num)
+namespace intersection_internal
 {
-	bool hit = false;
-	f32 tmin = 999999999.9f;
-
-	for (u32 i = 0; i < num; i += 3)
+	template <typename IndexType>
+	static f32 ray_mesh_intersection(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const void* vertices, u32 stride, const IndexType* indices, u32 num)
 	{
-		const u32 i0 = indices[i + 0];
-		const u32 i1 = indices[i + 1];
-		const u32 i2 = indices[i + 2];
+		bool hit = false;
+		f32 tmin = 999999999.9f;
 
-		const Vector3& v0 = *(const Vector3*)((const char*)vertices + i0*stride) * tm;
-		const Vector3& v1 = *(const Vector3*)((const char*)vertices + i1*stride) * tm;
-		const Vector3& v2 = *(const Vector3*)((const char*)vertices + i2*stride) * tm;
+		for (u32 i = 0; i < num; i += 3)
+		{
+			const u32 i0 = indices[i + 0];
+			const u32 i1 = indices[i + 1];
+			const u32 i2 = indices[i + 2];
 
-		// https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm
+			const Vector3& v0 = *(const Vector3*)((const char*)vertices + i0*stride) * tm;
+			const Vector3& v1 = *(const Vector3*)((const char*)vertices + i1*stride) * tm;
+			const Vector3& v2 = *(const Vector3*)((const char*)vertices + i2*stride) * tm;
 
-		// Find vectors for two edges sharing v0
-		const Vector3 e1 = v1 - v0;
-		const Vector3 e2 = v2 - v0;
+			// https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm
 
-		// Begin calculating determinant - also used to calculate u parameter
-		const Vector3 P = cross(dir, e2);
+			// Find vectors for two edges sharing v0
+			const Vector3 e1 = v1 - v0;
+			const Vector3 e2 = v2 - v0;
 
-		// If determinant is near zero, ray lies in plane of triangle
-		const f32 det = dot(e1, P);
-		if (fequal(det, 0.0f))
-			continue;
+			// Begin calculating determinant - also used to calculate u parameter
+			const Vector3 P = cross(dir, e2);
 
-		const f32 inv_det = 1.0f / det;
+			// If determinant is near zero, ray lies in plane of triangle
+			const f32 det = dot(e1, P);
+			if (fequal(det, 0.0f))
+				continue;
 
-		// Distance from v0 to ray origin
-		const Vector3 T = from - v0;
+			const f32 inv_det = 1.0f / det;
 
-		// u parameter and test bound
-		const f32 u = dot(T, P) * inv_det;
+			// Distance from v0 to ray origin
+			const Vector3 T = from - v0;
 
-		// The intersection lies outside of the triangle
-		if (u < 0.0f || u > 1.0f)
-			continue;
+			// u parameter and test bound
+			const f32 u = dot(T, P) * inv_det;
 
-		// Prepare to test v parameter
-		const Vector3 Q = cross(T, e1);
+			// The intersection lies outside of the triangle
+			if (u < 0.0f || u > 1.0f)
+				continue;
 
-		// v parameter and test bound
-		const f32 v = dot(dir, Q) * inv_det;
+			// Prepare to test v parameter
+			const Vector3 Q = cross(T, e1);
 
-		// The intersection lies outside of the triangle
-		if (v < 0.0f || u + v  > 1.0f)
-			continue;
+			// v parameter and test bound
+			const f32 v = dot(dir, Q) * inv_det;
 
-		const f32 t = dot(e2, Q) * inv_det;
+			// The intersection lies outside of the triangle
+			if (v < 0.0f || u + v  > 1.0f)
+				continue;
 
-		// Ray intersection
-		if (t > FLOAT_EPSILON)
-		{
-			hit = true;
-			tmin = fmin(t, tmin);
+			const f32 t = dot(e2, Q) * inv_det;
+
+			// Ray intersection
+			if (t > FLOAT_EPSILON)
+			{
+				hit = true;
+				tmin = fmin(t, tmin);
+			}
 		}
+
+		return hit ? tmin : -1.0f;
 	}
 
-	return hit ? tmin : -1.0f;
+} // namespace intersection_internal
+
+f32 ray_mesh_intersection(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const void* vertices, u32 stride, const u16* indices, u32 num)
+{
+	return intersection_internal::ray_mesh_intersection(from, dir, tm, vertices, stride, indices, num);
+}
+
+f32 ray_mesh_intersection(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const void* vertices, u32 stride, const u32* indices, u32 num)
+{
+	return intersection_internal::ray_mesh_intersection(from, dir, tm, vertices, stride, indices, num);
 }
 
 bool plane_3_intersection(const Plane3& a, const Plane3& b, const Plane3& c, Vector3& ip)
@@ -342,4 +394,11 @@ bool frustum_box_intersection(const Frustum& f, const AABB& b)
 	return true;
 }
 
+bool sphere_box_intersection(const Sphere& s, const AABB& b)
+{
+	// Distance from the center of the sphere to the closest point of the box
+	const Vector3 p = min(max(s.c, b.min), b.max);
+	return length_squared(s.c - p) <= s.r*s.r;
+}
+
 } // namespace crown
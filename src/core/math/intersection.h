@@ -28,6 +28,10 @@ f32 ray_sphere_intersection(const Vector3& from, const Vector3& dir, const Spher
 /// bounding box (tm, half_extents) or -1.0 if no intersection.
 f32 ray_obb_intersection(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const Vector3& half_extents);
 
+/// Returns the distance along ray (from, dir) to intersection point with the box @a b,
+/// 0.0 if @a from is inside the box or -1.0 if no intersection.
+f32 ray_aabb_intersection(const Vector3& from, const Vector3& dir, const AABB& b);
+
 /// Returns the distance along ray (from, dir) to intersection point with the triangle
 /// (v0, v1, v2) or -1.0 if no intersection.
 f32 ray_triangle_intersection(const Vector3& from, const Vector3& dir, const Vector3& v0, const Vector3& v1, const Vector3& v2);
@@ -36,6 +40,10 @@ f32 ray_triangle_intersection(const Vector3& from, const Vector3& dir, const Vec
 /// mesh defined by (vertices, stride, indices, num) or -1.0 if no intersection.
 f32 ray_mesh_intersection(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const void* vertices, u32 stride, const u16* indices, u32 num);
 
+/// Returns the distance along ray (from, dir) to intersection point with the triangle
+/// mesh defined by (vertices, stride, indices, num) or -1.0 if no intersection.
+f32 ray_mesh_intersection(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const void* vertices, u32 stride, const u32* indices, u32 num);
+
 /// Returns whether the planes @a a, @a b and @a c intersects and if so fills @a ip with the intersection point.
 bool plane_3_intersection(const Plane3& a, const Plane3& b, const Plane3& c, Vector3& ip);
 
@@ -45,6 +53,9 @@ bool frustum_sphere_intersection(const Frustum& f, const Sphere& s);
 /// Returns whether the frustum @a f and the AABB @a b intersects.
 bool frustum_box_intersection(const Frustum& f, const AABB& b);
 
+/// Returns whether the sphere @a s and the AABB @a b intersects.
+bool sphere_box_intersection(const Sphere& s, const AABB& b);
+
 /// @}
 
 } // namespace crown
@@ -7,53 +7,137 @@
 
 namespace crown
 {
-Matrix4x4& invert(Matrix4x4& m)
+namespace matrix4x4_internal
 {
-	const f32 xx = m.x.x;
-	const f32 xy = m.x.y;
-	const f32 xz = m.x.z;
-	const f32 xw = m.x.w;
-	const f32 yx = m.y.x;
-	const f32 yy = m.y.y;
-	const f32 yz = m.y.z;
-	const f32 yw = m.y.w;
-	const f32 zx = m.z.x;
-	const f32 zy = m.z.y;
-	const f32 zz = m.z.z;
-	const f32 zw = m.z.w;
-	const f32 tx = m.t.x;
-	const f32 ty = m.t.y;
-	const f32 tz = m.t.z;
-	const f32 tw = m.t.w;
-
-	f32 det = 0.0f;
-	det += xx * (yy * (zz*tw - tz*zw) - zy * (yz*tw - tz*yw) + ty * (yz*zw - zz*yw));
-	det -= yx * (xy * (zz*tw - tz*zw) - zy * (xz*tw - tz*xw) + ty * (xz*zw - zz*xw));
-	det += zx * (xy * (yz*tw - tz*yw) - yy * (xz*tw - tz*xw) + ty * (xz*yw - yz*xw));
-	det -= tx * (xy * (yz*zw - zz*yw) - yy * (xz*zw - zz*xw) + zy * (xz*yw - yz*xw));
-
-	const f32 inv_det = 1.0f / det;
-
-	m.x.x = + (yy * (zz*tw - tz*zw) - zy * (yz*tw - tz*yw) + ty * (yz*zw - zz*yw)) * inv_det;
-	m.x.y = - (xy * (zz*tw - tz*zw) - zy * (xz*tw - tz*xw) + ty * (xz*zw - zz*xw)) * inv_det;
-	m.x.z = + (xy * (yz*tw - tz*yw) - yy * (xz*tw - tz*xw) + ty * (xz*yw - yz*xw)) * inv_det;
-	m.x.w = - (xy * (yz*zw - zz*yw) - yy * (xz*zw - zz*xw) + zy * (xz*yw - yz*xw)) * inv_det;
-
-	m.y.x = - (yx * (zz*tw - tz*zw) - zx * (yz*tw - tz*yw) + tx * (yz*zw - zz*yw)) * inv_det;
-	m.y.y = + (xx * (zz*tw - tz*zw) - zx * (xz*tw - tz*xw) + tx * (xz*zw - zz*xw)) * inv_det;
-	m.y.z = - (xx * (yz*tw - tz*yw) - yx * (xz*tw - tz*xw) + tx * (xz*yw - yz*xw)) * inv_det;
-	m.y.w = + (xx * (yz*zw - zz*yw) - yx * (xz*zw - zz*xw) + zx * (xz*yw - yz*xw)) * inv_det;
-
-	m.z.x = + (yx * (zy*tw - ty*zw) - zx * (yy*tw - ty*yw) + tx * (yy*zw - zy*yw)) * inv_det;
-	m.z.y = - (xx * (zy*tw - ty*zw) - zx * (xy*tw - ty*xw) + tx * (xy*zw - zy*xw)) * inv_det;
-	m.z.z = + (xx * (yy*tw - ty*yw) - yx * (xy*tw - ty*xw) + tx * (xy*yw - yy*xw)) * inv_det;
-	m.z.w = - (xx * (yy*zw - zy*yw) - yx * (xy*zw - zy*xw) + zx * (xy*yw - yy*xw)) * inv_det;
-
-	m.t.x = - (yx * (zy*tz - ty*zz) - zx * (yy*tz - ty*yz) + tx * (yy*zz - zy*yz)) * inv_det;
-	m.t.y = + (xx * (zy*tz - ty*zz) - zx * (xy*tz - ty*xz) + tx * (xy*zz - zy*xz)) * inv_det;
-	m.t.z = - (xx * (yy*tz - ty*yz) - yx * (xy*tz - ty*xz) + tx * (xy*yz - yy*xz)) * inv_det;
-	m.t.w = + (xx * (yy*zz - zy*yz) - yx * (xy*zz - zy*xz) + zx * (xy*yz - yy*xz)) * inv_det;
+#if CROWN_SIMD_SSE2
+	using namespace simd;
+
+	// 2x2 matrices are stored as (xx, xy, yx, yy)
+	static inline f32x4 mat2_mul(f32x4 a, f32x4 b)
+	{
+		return madd(a, CROWN_SIMD_SWIZZLE(b, 0, 3, 0, 3), mul(CROWN_SIMD_SWIZZLE(a, 1, 0, 3, 2), CROWN_SIMD_SWIZZLE(b, 2, 1, 2, 1)));
+	}
+
+	// Returns adj(a) * b
+	static inline f32x4 mat2_adj_mul(f32x4 a, f32x4 b)
+	{
+		return sub(mul(CROWN_SIMD_SWIZZLE(a, 3, 3, 0, 0), b), mul(CROWN_SIMD_SWIZZLE(a, 1, 1, 2, 2), CROWN_SIMD_SWIZZLE(b, 2, 3, 0, 1)));
+	}
+
+	// Returns a * adj(b)
+	static inline f32x4 mat2_mul_adj(f32x4 a, f32x4 b)
+	{
+		return sub(mul(a, CROWN_SIMD_SWIZZLE(b, 3, 0, 3, 0)), mul(CROWN_SIMD_SWIZZLE(a, 1, 0, 3, 2), CROWN_SIMD_SWIZZLE(b, 2, 1, 2, 1)));
+	}
+
+	// Inverts the matrix by blocks:
+	// | A B |
+	// | C D |
+	static void invert_simd(Matrix4x4& m)
+	{
+		const f32x4 r0 = load(&m.x.x);
+		const f32x4 r1 = load(&m.y.x);
+		const f32x4 r2 = load(&m.z.x);
+		const f32x4 r3 = load(&m.t.x);
+
+		const f32x4 a = _mm_movelh_ps(r0, r1);
+		const f32x4 b = _mm_movehl_ps(r1, r0);
+		const f32x4 c = _mm_movelh_ps(r2, r3);
+		const f32x4 d = _mm_movehl_ps(r3, r2);
+
+		// Determinants of A, B, C and D
+		const f32x4 det_sub = sub(mul(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1)))
+			, mul(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0)))
+			);
+		const f32x4 det_a = CROWN_SIMD_SWIZZLE(det_sub, 0, 0, 0, 0);
+		const f32x4 det_b = CROWN_SIMD_SWIZZLE(det_sub, 1, 1, 1, 1);
+		const f32x4 det_c = CROWN_SIMD_SWIZZLE(det_sub, 2, 2, 2, 2);
+		const f32x4 det_d = CROWN_SIMD_SWIZZLE(det_sub, 3, 3, 3, 3);
+
+		const f32x4 d_c = mat2_adj_mul(d, c);
+		const f32x4 a_b = mat2_adj_mul(a, b);
+
+		f32x4 x = sub(mul(det_d, a), mat2_mul(b, d_c));
+		f32x4 w = sub(mul(det_a, d), mat2_mul(c, a_b));
+		f32x4 y = sub(mul(det_b, c), mat2_mul_adj(d, a_b));
+		f32x4 z = sub(mul(det_c, b), mat2_mul_adj(a, d_c));
+
+		// det(M) = det(A)*det(D) + det(B)*det(C) - tr(adj(A)*B*adj(D)*C)
+		f32x4 tr = mul(a_b, CROWN_SIMD_SWIZZLE(d_c, 0, 2, 1, 3));
+		tr = add(tr, CROWN_SIMD_SWIZZLE(tr, 2, 3, 0, 1));
+		tr = add(tr, CROWN_SIMD_SWIZZLE(tr, 1, 0, 3, 2));
+		const f32x4 det = sub(madd(det_a, det_d, mul(det_b, det_c)), tr);
+
+		const f32x4 inv_det = _mm_div_ps(set(1.0f, -1.0f, -1.0f, 1.0f), det);
+		x = mul(x, inv_det);
+		y = mul(y, inv_det);
+		z = mul(z, inv_det);
+		w = mul(w, inv_det);
 
+		store(&m.x.x, _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+		store(&m.y.x, _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+		store(&m.z.x, _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+		store(&m.t.x, _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+	}
+#endif // CROWN_SIMD_SSE2
+
+	void invert_scalar(Matrix4x4& m)
+	{
+		const f32 xx = m.x.x;
+		const f32 xy = m.x.y;
+		const f32 xz = m.x.z;
+		const f32 xw = m.x.w;
+		const f32 yx = m.y.x;
+		const f32 yy = m.y.y;
+		const f32 yz = m.y.z;
+		const f32 yw = m.y.w;
+		const f32 zx = m.z.x;
+		const f32 zy = m.z.y;
+		const f32 zz = m.z.z;
+		const f32 zw = m.z.w;
+		const f32 tx = m.t.x;
+		const f32 ty = m.t.y;
+		const f32 tz = m.t.z;
+		const f32 tw = m.t.w;
+
+		f32 det = 0.0f;
+		det += xx * (yy * (zz*tw - tz*zw) - zy * (yz*tw - tz*yw) + ty * (yz*zw - zz*yw));
+		det -= yx * (xy * (zz*tw - tz*zw) - zy * (xz*tw - tz*xw) + ty * (xz*zw - zz*xw));
+		det += zx * (xy * (yz*tw - tz*yw) - yy * (xz*tw - tz*xw) + ty * (xz*yw - yz*xw));
+		det -= tx * (xy * (yz*zw - zz*yw) - yy * (xz*zw - zz*xw) + zy * (xz*yw - yz*xw));
+
+		const f32 inv_det = 1.0f / det;
+
+		m.x.x = + (yy * (zz*tw - tz*zw) - zy * (yz*tw - tz*yw) + ty * (yz*zw - zz*yw)) * inv_det;
+		m.x.y = - (xy * (zz*tw - tz*zw) - zy * (xz*tw - tz*xw) + ty * (xz*zw - zz*xw)) * inv_det;
+		m.x.z = + (xy * (yz*tw - tz*yw) - yy * (xz*tw - tz*xw) + ty * (xz*yw - yz*xw)) * inv_det;
+		m.x.w = - (xy * (yz*zw - zz*yw) - yy * (xz*zw - zz*xw) + zy * (xz*yw - yz*xw)) * inv_det;
+
+		m.y.x = - (yx * (zz*tw - tz*zw) - zx * (yz*tw - tz*yw) + tx * (yz*zw - zz*yw)) * inv_det;
+		m.y.y = + (xx * (zz*tw - tz*zw) - zx * (xz*tw - tz*xw) + tx * (xz*zw - zz*xw)) * inv_det;
+		m.y.z = - (xx * (yz*tw - tz*yw) - yx * (xz*tw - tz*xw) + tx * (xz*yw - yz*xw)) * inv_det;
+		m.y.w = + (xx * (yz*zw - zz*yw) - yx * (xz*zw - zz*xw) + zx * (xz*yw - yz*xw)) * inv_det;
+
+		m.z.x = + (yx * (zy*tw - ty*zw) - zx * (yy*tw - ty*yw) + tx * (yy*zw - zy*yw)) * inv_det;
+		m.z.y = - (xx * (zy*tw - ty*zw) - zx * (xy*tw - ty*xw) + tx * (xy*zw - zy*xw)) * inv_det;
+		m.z.z = + (xx * (yy*tw - ty*yw) - yx * (xy*tw - ty*xw) + tx * (xy*yw - yy*xw)) * inv_det;
+		m.z.w = - (xx * (yy*zw - zy*yw) - yx * (xy*zw - zy*xw) + zx * (xy*yw - yy*xw)) * inv_det;
+
+		m.t.x = - (yx * (zy*tz - ty*zz) - zx * (yy*tz - ty*yz) + tx * (yy*zz - zy*yz)) * inv_det;
+		m.t.y = + (xx * (zy*tz - ty*zz) - zx * (xy*tz - ty*xz) + tx * (xy*zz - zy*xz)) * inv_det;
+		m.t.z = - (xx * (yy*tz - ty*yz) - yx * (xy*tz - ty*xz) + tx * (xy*yz - yy*xz)) * inv_det;
+		m.t.w = + (xx * (yy*zz - zy*yz) - yx * (xy*zz - zy*xz) + zx * (xy*yz - yy*xz)) * inv_det;
+	}
+
+} // namespace matrix4x4_internal
+
+Matrix4x4& invert(Matrix4x4& m)
+{
+#if CROWN_SIMD_SSE2
+	matrix4x4_internal::invert_simd(m);
+#else
+	matrix4x4_internal::invert_scalar(m);
+#endif
 	return m;
 }
 
@@ -8,11 +8,121 @@
 #include "core/math/math.h"
 #include "core/math/matrix3x3.h"
 #include "core/math/quaternion.h"
+#include "core/math/simd.h"
 #include "core/math/types.h"
 #include "core/math/vector4.h"
 
 namespace crown
 {
+namespace matrix4x4_internal
+{
+	// Scalar implementations of the functions below. They are used when
+	// SIMD instructions are not available, and as a reference by the tests.
+
+	inline void multiply_scalar(Matrix4x4& a, const Matrix4x4& b)
+	{
+		Matrix4x4 tmp;
+
+		tmp.x.x = a.x.x*b.x.x + a.x.y*b.y.x + a.x.z*b.z.x + a.x.w*b.t.x;
+		tmp.x.y = a.x.x*b.x.y + a.x.y*b.y.y + a.x.z*b.z.y + a.x.w*b.t.y;
+		tmp.x.z = a.x.x*b.x.z + a.x.y*b.y.z + a.x.z*b.z.z + a.x.w*b.t.z;
+		tmp.x.w = a.x.x*b.x.w + a.x.y*b.y.w + a.x.z*b.z.w + a.x.w*b.t.w;
+
+		tmp.y.x = a.y.x*b.x.x + a.y.y*b.y.x + a.y.z*b.z.x + a.y.w*b.t.x;
+		tmp.y.y = a.y.x*b.x.y + a.y.y*b.y.y + a.y.z*b.z.y + a.y.w*b.t.y;
+		tmp.y.z = a.y.x*b.x.z + a.y.y*b.y.z + a.y.z*b.z.z + a.y.w*b.t.z;
+		tmp.y.w = a.y.x*b.x.w + a.y.y*b.y.w + a.y.z*b.z.w + a.y.w*b.t.w;
+
+		tmp.z.x = a.z.x*b.x.x + a.z.y*b.y.x + a.z.z*b.z.x + a.z.w*b.t.x;
+		tmp.z.y = a.z.x*b.x.y + a.z.y*b.y.y + a.z.z*b.z.y + a.z.w*b.t.y;
+		tmp.z.z = a.z.x*b.x.z + a.z.y*b.y.z + a.z.z*b.z.z + a.z.w*b.t.z;
+		tmp.z.w = a.z.x*b.x.w + a.z.y*b.y.w + a.z.z*b.z.w + a.z.w*b.t.w;
+
+		tmp.t.x = a.t.x*b.x.x + a.t.y*b.y.x + a.t.z*b.z.x + a.t.w*b.t.x;
+		tmp.t.y = a.t.x*b.x.y + a.t.y*b.y.y + a.t.z*b.z.y + a.t.w*b.t.y;
+		tmp.t.z = a.t.x*b.x.z + a.t.y*b.y.z + a.t.z*b.z.z + a.t.w*b.t.z;
+		tmp.t.w = a.t.x*b.x.w + a.t.y*b.y.w + a.t.z*b.z.w + a.t.w*b.t.w;
+
+		a = tmp;
+	}
+
+	inline Vector3 transform_scalar(const Vector3& v, const Matrix4x4& a)
+	{
+		Vector3 r;
+		r.x = v.x*a.x.x + v.y*a.y.x + v.z*a.z.x + a.t.x;
+		r.y = v.x*a.x.y + v.y*a.y.y + v.z*a.z.y + a.t.y;
+		r.z = v.x*a.x.z + v.y*a.y.z + v.z*a.z.z + a.t.z;
+		return r;
+	}
+
+	inline Vector4 transform_scalar(const Vector4& v, const Matrix4x4& a)
+	{
+		Vector4 r;
+		r.x = v.x*a.x.x + v.y*a.y.x + v.z*a.z.x + v.w*a.t.x;
+		r.y = v.x*a.x.y + v.y*a.y.y + v.z*a.z.y + v.w*a.t.y;
+		r.z = v.x*a.x.z + v.y*a.y.z + v.z*a.z.z + v.w*a.t.z;
+		r.w = v.x*a.x.w + v.y*a.y.w + v.z*a.z.w + v.w*a.t.w;
+		return r;
+	}
+
+	inline void transpose_scalar(Matrix4x4& m)
+	{
+		f32 tmp;
+
+		tmp = m.x.y;
+		m.x.y = m.y.x;
+		m.y.x = tmp;
+
+		tmp = m.x.z;
+		m.x.z = m.z.x;
+		m.z.x = tmp;
+
+		tmp = m.x.w;
+		m.x.w = m.t.x;
+		m.t.x = tmp;
+
+		tmp = m.y.z;
+		m.y.z = m.z.y;
+		m.z.y = tmp;
+
+		tmp = m.y.w;
+		m.y.w = m.t.y;
+		m.t.y = tmp;
+
+		tmp = m.z.w;
+		m.z.w = m.t.z;
+		m.t.z = tmp;
+	}
+
+	void invert_scalar(Matrix4x4& m);
+
+	inline Matrix4x4 from_quaternion_scalar(const Quaternion& r, const Vector3& t)
+	{
+		Matrix4x4 m;
+		m.x.x = 1.0f - 2.0f * r.y * r.y - 2.0f * r.z * r.z;
+		m.x.y = 2.0f * r.x * r.y + 2.0f * r.w * r.z;
+		m.x.z = 2.0f * r.x * r.z - 2.0f * r.w * r.y;
+		m.x.w = 0.0f;
+
+		m.y.x = 2.0f * r.x * r.y - 2.0f * r.w * r.z;
+		m.y.y = 1.0f - 2.0f * r.x * r.x - 2.0f * r.z * r.z;
+		m.y.z = 2.0f * r.y * r.z + 2.0f * r.w * r.x;
+		m.y.w = 0.0f;
+
+		m.z.x = 2.0f * r.x * r.z + 2.0f * r.w * r.y;
+		m.z.y = 2.0f * r.y * r.z - 2.0f * r.w * r.x;
+		m.z.z = 1.0f - 2.0f * r.x * r.x - 2.0f * r.y * r.y;
+		m.z.w = 0.0f;
+
+		m.t.x = t.x;
+		m.t.y = t.y;
+		m.t.z = t.z;
+		m.t.w = 1.0f;
+		return m;
+	}
+
+} // namespace matrix4x4_internal
+
 /// @addtogroup Math
 /// @{
 
@@ -101,27 +211,32 @@ inline Matrix4x4 matrix4x4(const Vector3& x, const Vector3& y, const Vector3& z,
 /// Returns a new matrix from rotation @a r and translation @a t.
 inline Matrix4x4 matrix4x4(const Quaternion& r, const Vector3& t)
 {
-	Matrix4x4 m;
-	m.x.x = 1.0f - 2.0f * r.y * r.y - 2.0f * r.z * r.z;
-	m.x.y = 2.0f * r.x * r.y + 2.0f * r.w * r.z;
-	m.x.z = 2.0f * r.x * r.z - 2.0f * r.w * r.y;
-	m.x.w = 0.0f;
-
-	m.y.x = 2.0f * r.x * r.y - 2.0f * r.w * r.z;
-	m.y.y = 1.0f - 2.0f * r.x * r.x - 2.0f * r.z * r.z;
-	m.y.z = 2.0f * r.y * r.z + 2.0f * r.w * r.x;
-	m.y.w = 0.0f;
+#if CROWN_SIMD_SSE2
+	using namespace simd;
+	const f32x4 q  = load(&r.x);
+	const f32x4 q2 = add(q, q);
 
-	m.z.x = 2.0f * r.x * r.z + 2.0f * r.w * r.y;
-	m.z.y = 2.0f * r.y * r.z - 2.0f * r.w * r.x;
-	m.z.z = 1.0f - 2.0f * r.x * r.x - 2.0f * r.y * r.y;
-	m.z.w = 0.0f;
+	// Each row is the sum of two products of permuted quaternion components,
+	// with the signs and the w column folded in the constant vectors
+	f32x4 x = mul(mul(CROWN_SIMD_SWIZZLE(q, 1, 0, 0, 0), set(-1.0f,  1.0f,  1.0f, 0.0f)), CROWN_SIMD_SWIZZLE(q2, 1, 1, 2, 2));
+	f32x4 y = mul(mul(CROWN_SIMD_SWIZZLE(q, 1, 0, 1, 1), set( 1.0f, -1.0f,  1.0f, 0.0f)), CROWN_SIMD_SWIZZLE(q2, 0, 0, 2, 2));
+	f32x4 z = mul(mul(CROWN_SIMD_SWIZZLE(q, 2, 2, 0, 0), set( 1.0f,  1.0f, -1.0f, 0.0f)), CROWN_SIMD_SWIZZLE(q2, 0, 1, 0, 0));
+	x = madd(mul(CROWN_SIMD_SWIZZLE(q, 2, 3, 3, 3), set(-1.0f,  1.0f, -1.0f, 0.0f)), CROWN_SIMD_SWIZZLE(q2, 2, 2, 1, 1), x);
+	y = madd(mul(CROWN_SIMD_SWIZZLE(q, 3, 2, 3, 3), set(-1.0f, -1.0f,  1.0f, 0.0f)), CROWN_SIMD_SWIZZLE(q2, 2, 2, 0, 0), y);
+	z = madd(mul(CROWN_SIMD_SWIZZLE(q, 3, 3, 1, 1), set( 1.0f, -1.0f, -1.0f, 0.0f)), CROWN_SIMD_SWIZZLE(q2, 1, 0, 1, 1), z);
 
+	Matrix4x4 m;
+	store(&m.x.x, add(x, set(1.0f, 0.0f, 0.0f, 0.0f)));
+	store(&m.y.x, add(y, set(0.0f, 1.0f, 0.0f, 0.0f)));
+	store(&m.z.x, add(z, set(0.0f, 0.0f, 1.0f, 0.0f)));
 	m.t.x = t.x;
 	m.t.y = t.y;
 	m.t.z = t.z;
 	m.t.w = 1.0f;
 	return m;
+#else
+	return matrix4x4_internal::from_quaternion_scalar(r, t);
+#endif
 }
 
 /// Returns a new matrix from translation @a t.
@@ -209,29 +324,19 @@ inline Matrix4x4& operator*=(Matrix4x4& a, f32 k)
 /// Multiplies the matrix @a a by @a b and returns the result. (i.e. transforms first by @a a then by @a b)
 inline Matrix4x4& operator*=(Matrix4x4& a, const Matrix4x4& b)
 {
-	Matrix4x4 tmp;
-
-	tmp.x.x = a.x.x*b.x.x + a.x.y*b.y.x + a.x.z*b.z.x + a.x.w*b.t.x;
-	tmp.x.y = a.x.x*b.x.y + a.x.y*b.y.y + a.x.z*b.z.y + a.x.w*b.t.y;
-	tmp.x.z = a.x.x*b.x.z + a.x.y*b.y.z + a.x.z*b.z.z + a.x.w*b.t.z;
-	tmp.x.w = a.x.x*b.x.w + a.x.y*b.y.w + a.x.z*b.z.w + a.x.w*b.t.w;
-
-	tmp.y.x = a.y.x*b.x.x + a.y.y*b.y.x + a.y.z*b.z.x + a.y.w*b.t.x;
-	tmp.y.y = a.y.x*b.x.y + a.y.y*b.y.y + a.y.z*b.z.y + a.y.w*b.t.y;
-	tmp.y.z = a.y.x*b.x.z + a.y.y*b.y.z + a.y.z*b.z.z + a.y.w*b.t.z;
-	tmp.y.w = a.y.x*b.x.w + a.y.y*b.y.w + a.y.z*b.z.w + a.y.w*b.t.w;
-
-	tmp.z.x = a.z.x*b.x.x + a.z.y*b.y.x + a.z.z*b.z.x + a.z.w*b.t.x;
-	tmp.z.y = a.z.x*b.x.y + a.z.y*b.y.y + a.z.z*b.z.y + a.z.w*b.t.y;
-	tmp.z.z = a.z.x*b.x.z + a.z.y*b.y.z + a.z.z*b.z.z + a.z.w*b.t.z;
-	tmp.z.w = a.z.x*b.x.w + a.z.y*b.y.w + a.z.z*b.z.w + a.z.w*b.t.w;
-
-	tmp.t.x = a.t.x*b.x.x + a.t.y*b.y.x + a.t.z*b.z.x + a.t.w*b.t.x;
-	tmp.t.y = a.t.x*b.x.y + a.t.y*b.y.y + a.t.z*b.z.y + a.t.w*b.t.y;
-	tmp.t.z = a.t.x*b.x.z + a.t.y*b.y.z + a.t.z*b.z.z + a.t.w*b.t.z;
-	tmp.t.w = a.t.x*b.x.w + a.t.y*b.y.w + a.t.z*b.z.w + a.t.w*b.t.w;
-
-	a = tmp;
+#if CROWN_SIMD
+	using namespace simd;
+	const f32x4 x = load(&b.x.x);
+	const f32x4 y = load(&b.y.x);
+	const f32x4 z = load(&b.z.x);
+	const f32x4 t = load(&b.t.x);
+	store(&a.x.x, transform(a.x.x, a.x.y, a.x.z, a.x.w, x, y, z, t));
+	store(&a.y.x, transform(a.y.x, a.y.y, a.y.z, a.y.w, x, y, z, t));
+	store(&a.z.x, transform(a.z.x, a.z.y, a.z.z, a.z.w, x, y, z, t));
+	store(&a.t.x, transform(a.t.x, a.t.y, a.t.z, a.t.w, x, y, z, t));
+#else
+	matrix4x4_internal::multiply_scalar(a, b);
+#endif
 	return a;
 }
 
@@ -266,22 +371,41 @@ inline Matrix4x4 operator*(f32 k, Matrix4x4 a)
 /// Multiplies the matrix @a a by the vector @a v and returns the result.
 inline Vector3 operator*(const Vector3& v, const Matrix4x4& a)
 {
+#if CROWN_SIMD
+	using namespace simd;
+	f32 tmp[4];
+	store(tmp, transform(v.x, v.y, v.z, 1.0f
+		, load(&a.x.x)
+		, load(&a.y.x)
+		, load(&a.z.x)
+		, load(&a.t.x)
+		));
 	Vector3 r;
-	r.x = v.x*a.x.x + v.y*a.y.x + v.z*a.z.x + a.t.x;
-	r.y = v.x*a.x.y + v.y*a.y.y + v.z*a.z.y + a.t.y;
-	r.z = v.x*a.x.z + v.y*a.y.z + v.z*a.z.z + a.t.z;
+	r.x = tmp[0];
+	r.y = tmp[1];
+	r.z = tmp[2];
 	return r;
+#else
+	return matrix4x4_internal::transform_scalar(v, a);
+#endif
 }
 
 /// Multiplies the matrix @a by the vector @a v and returns the result.
 inline Vector4 operator*(const Vector4& v, const Matrix4x4& a)
 {
+#if CROWN_SIMD
+	using namespace simd;
 	Vector4 r;
-	r.x = v.x*a.x.x + v.y*a.y.x + v.z*a.z.x + v.w*a.t.x;
-	r.y = v.x*a.x.y + v.y*a.y.y + v.z*a.z.y + v.w*a.t.y;
-	r.z = v.x*a.x.z + v.y*a.y.z + v.z*a.z.z + v.w*a.t.z;
-	r.w = v.x*a.x.w + v.y*a.y.w + v.z*a.z.w + v.w*a.t.w;
+	store(&r.x, transform(v.x, v.y, v.z, v.w
+		, load(&a.x.x)
+		, load(&a.y.x)
+		, load(&a.z.x)
+		, load(&a.t.x)
+		));
 	return r;
+#else
+	return matrix4x4_internal::transform_scalar(v, a);
+#endif
 }
 
 /// Multiplies the matrix @a a by @a b and returns the result. (i.e. transforms first by @a a then by @a b)
@@ -347,32 +471,20 @@ inline void orthographic(Matrix4x4& m, f32 left, f32 right, f32 bottom, f32 top,
 /// Transposes the matrix @a m and returns the result.
 inline Matrix4x4& transpose(Matrix4x4& m)
 {
-	f32 tmp;
-
-	tmp = m.x.y;
-	m.x.y = m.y.x;
-	m.y.x = tmp;
-
-	tmp = m.x.z;
-	m.x.z = m.z.x;
-	m.z.x = tmp;
-
-	tmp = m.x.w;
-	m.x.w = m.t.x;
-	m.t.x = tmp;
-
-	tmp = m.y.z;
-	m.y.z = m.z.y;
-	m.z.y = tmp;
-
-	tmp = m.y.w;
-	m.y.w = m.t.y;
-	m.t.y = tmp;
-
-	tmp = m.z.w;
-	m.z.w = m.t.z;
-	m.t.z = tmp;
-
+#if CROWN_SIMD
+	using namespace simd;
+	f32x4 x = load(&m.x.x);
+	f32x4 y = load(&m.y.x);
+	f32x4 z = load(&m.z.x);
+	f32x4 t = load(&m.t.x);
+	simd::transpose(x, y, z, t);
+	store(&m.x.x, x);
+	store(&m.y.x, y);
+	store(&m.z.x, z);
+	store(&m.t.x, t);
+#else
+	matrix4x4_internal::transpose_scalar(m);
+#endif
 	return m;
 }
 
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2012-2017 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/platform.h"
+#include "core/types.h"
+
+#if CROWN_SIMD_SSE2
+	#include <emmintrin.h>
+#elif CROWN_SIMD_NEON
+	#include <arm_neon.h>
+#endif
+
+#if CROWN_SIMD
+
+namespace crown
+{
+/// Thin wrappers around the 4-wide float instructions of the target CPU.
+///
+/// @ingroup Math
+namespace simd
+{
+#if CROWN_SIMD_SSE2
+	typedef __m128 f32x4;
+
+	/// Returns the lanes @a x, @a y, @a z and @a w of @a a.
+	#define CROWN_SIMD_SWIZZLE(a, x, y, z, w) _mm_shuffle_ps(a, a, _MM_SHUFFLE(w, z, y, x))
+
+	/// Loads four floats from the unaligned address @a p.
+	inline f32x4 load(const f32* p)
+	{
+		return _mm_loadu_ps(p);
+	}
+
+	/// Stores four floats to the unaligned address @a p.
+	inline void store(f32* p, f32x4 a)
+	{
+		_mm_storeu_ps(p, a);
+	}
+
+	/// Returns @a a replicated in all four lanes.
+	inline f32x4 splat(f32 a)
+	{
+		return _mm_set1_ps(a);
+	}
+
+	/// Returns the vector (x, y, z, w).
+	inline f32x4 set(f32 x, f32 y, f32 z, f32 w)
+	{
+		return _mm_setr_ps(x, y, z, w);
+	}
+
+	inline f32x4 add(f32x4 a, f32x4 b)
+	{
+		return _mm_add_ps(a, b);
+	}
+
+	inline f32x4 sub(f32x4 a, f32x4 b)
+	{
+		return _mm_sub_ps(a, b);
+	}
+
+	inline f32x4 mul(f32x4 a, f32x4 b)
+	{
+		return _mm_mul_ps(a, b);
+	}
+
+	inline f32x4 min(f32x4 a, f32x4 b)
+	{
+		return _mm_min_ps(a, b);
+	}
+
+	inline f32x4 max(f32x4 a, f32x4 b)
+	{
+		return _mm_max_ps(a, b);
+	}
+
+	/// Transposes the 4x4 matrix whose rows are @a a, @a b, @a c and @a d.
+	inline void transpose(f32x4& a, f32x4& b, f32x4& c, f32x4& d)
+	{
+		_MM_TRANSPOSE4_PS(a, b, c, d);
+	}
+#elif CROWN_SIMD_NEON
+	typedef float32x4_t f32x4;
+
+	inline f32x4 load(const f32* p)
+	{
+		return vld1q_f32(p);
+	}
+
+	inline void store(f32* p, f32x4 a)
+	{
+		vst1q_f32(p, a);
+	}
+
+	inline f32x4 splat(f32 a)
+	{
+		return vdupq_n_f32(a);
+	}
+
+	inline f32x4 set(f32 x, f32 y, f32 z, f32 w)
+	{
+		const f32 v[] = { x, y, z, w };
+		return vld1q_f32(v);
+	}
+
+	inline f32x4 add(f32x4 a, f32x4 b)
+	{
+		return vaddq_f32(a, b);
+	}
+
+	inline f32x4 sub(f32x4 a, f32x4 b)
+	{
+		return vsubq_f32(a, b);
+	}
+
+	inline f32x4 mul(f32x4 a, f32x4 b)
+	{
+		return vmulq_f32(a, b);
+	}
+
+	inline f32x4 min(f32x4 a, f32x4 b)
+	{
+		return vminq_f32(a, b);
+	}
+
+	inline f32x4 max(f32x4 a, f32x4 b)
+	{
+		return vmaxq_f32(a, b);
+	}
+
+	inline void transpose(f32x4& a, f32x4& b, f32x4& c, f32x4& d)
+	{
+		const float32x4x2_t ab = vtrnq_f32(a, b);
+		const float32x4x2_t cd = vtrnq_f32(c, d);
+		a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+		b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+		c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+		d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+	}
+#endif // CROWN_SIMD_SSE2
+
+	/// Returns @a a * @a b + @a c.
+	/// The product is rounded before the sum, as in the scalar code.
+	inline f32x4 madd(f32x4 a, f32x4 b, f32x4 c)
+	{
+		return add(mul(a, b), c);
+	}
+
+	/// Returns the row vector (@a vx, @a vy, @a vz, @a vw) multiplied by the matrix
+	/// whose rows are @a x, @a y, @a z and @a t.
+	inline f32x4 transform(f32 vx, f32 vy, f32 vz, f32 vw, f32x4 x, f32x4 y, f32x4 z, f32x4 t)
+	{
+		f32x4 r = mul(splat(vx), x);
+		r = madd(splat(vy), y, r);
+		r = madd(splat(vz), z, r);
+		r = madd(splat(vw), t, r);
+		return r;
+	}
+
+} // namespace simd
+
+} // namespace crown
+
+#endif // CROWN_SIMD
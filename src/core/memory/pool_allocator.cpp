@@ -11,6 +11,7 @@ namespace crown
 PoolAllocator::PoolAllocator(Allocator& backing, u32 num_blocks, u32 block_size, u32 block_align)
 	: _backing(backing)
 	, _start(NULL)
+	, _end(NULL)
 	, _freelist(NULL)
 	, _block_size(block_size)
 	, _block_align(block_align)
@@ -21,7 +22,9 @@ PoolAllocator::PoolAllocator(Allocator& backing, u32 num_blocks, u32 block_size,
 	CE_ASSERT(block_size > 0, "Unsupported block size");
 	CE_ASSERT(block_align > 0, "Unsupported block alignment");
 
-	u32 actual_block_size = block_size + block_align;
+	// Blocks must be able to hold a freelist pointer and keep the following ones aligned
+	u32 actual_block_size = block_size < sizeof(uintptr_t) ? sizeof(uintptr_t) : block_size;
+	actual_block_size = (actual_block_size + block_align - 1) & ~(block_align - 1);
 	u32 pool_size = num_blocks * actual_block_size;
 
 	char* mem = (char*) backing.allocate(pool_size, block_align);
@@ -39,6 +42,7 @@ PoolAllocator::PoolAllocator(Allocator& backing, u32 num_blocks, u32 block_size,
 	*end = (uintptr_t) NULL;
 
 	_start = mem;
+	_end = mem + pool_size;
 	_freelist = mem;
 }
 
@@ -84,4 +88,14 @@ u32 PoolAllocator::total_allocated()
 	return _allocated_size;
 }
 
+bool PoolAllocator::owns(const void* ptr) const
+{
+	return ptr >= _start && ptr < _end;
+}
+
+bool PoolAllocator::full() const
+{
+	return _freelist == NULL;
+}
+
 } // namespace crown
@@ -18,6 +18,7 @@ class PoolAllocator : public Allocator
 	Allocator&	_backing;
 
 	void* _start;
+	void* _end;
 	void* _freelist;
 	u32 _block_size;
 	u32 _block_align;
@@ -45,6 +46,12 @@ public:
 
 	/// @copydoc Allocator::total_allocated()
 	u32 total_allocated();
+
+	/// Returns whether @a ptr belongs to the memory pool.
+	bool owns(const void* ptr) const;
+
+	/// Returns whether all the blocks in the memory pool are allocated.
+	bool full() const;
 };
 
 } // namespace crown
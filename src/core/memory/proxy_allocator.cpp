@@ -3,29 +3,91 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "core/containers/array.h"
 #include "core/error/error.h"
 #include "core/memory/proxy_allocator.h"
+#include "core/memory/temp_allocator.h"
+#include "core/strings/string_stream.h"
+#include "core/thread/mutex.h"
 #include "device/profiler.h"
 
 namespace crown
 {
+namespace proxy_allocator_internal
+{
+	// All the proxy allocators alive
+	static ProxyAllocator* _head = NULL;
+
+	static Mutex& list_mutex()
+	{
+		static Mutex m;
+		return m;
+	}
+
+} // namespace proxy_allocator_internal
+
 ProxyAllocator::ProxyAllocator(Allocator& allocator, const char* name)
 	: _allocator(allocator)
 	, _name(name)
+	, _parent(NULL)
+	, _next(NULL)
+	, _num_allocations(0)
+	, _allocated_size(0)
+	, _peak_size(0)
+	, _frame_allocations(0)
+	, _frame_allocated_size(0)
 {
 	CE_ASSERT(name != NULL, "Name must be != NULL");
+
+	using namespace proxy_allocator_internal;
+	ScopedMutex sm(list_mutex());
+
+	for (ProxyAllocator* pa = _head; pa != NULL; pa = pa->_next)
+	{
+		if (pa == &allocator)
+		{
+			_parent = pa;
+			break;
+		}
+	}
+
+	_next = _head;
+	_head = this;
+}
+
+ProxyAllocator::~ProxyAllocator()
+{
+	using namespace proxy_allocator_internal;
+	ScopedMutex sm(list_mutex());
+
+	ProxyAllocator** pa = &_head;
+	while (*pa != this)
+		pa = &(*pa)->_next;
+	*pa = _next;
+
+	for (ProxyAllocator* child = _head; child != NULL; child = child->_next)
+	{
+		if (child->_parent == this)
+			child->_parent = _parent;
+	}
 }
 
 void* ProxyAllocator::allocate(u32 size, u32 align)
 {
 	void* p = _allocator.allocate(size, align);
-	ALLOCATE_MEMORY(_name, _allocator.allocated_size(p));
+	const u32 actual_size = _allocator.allocated_size(p);
+	record_allocate(actual_size == SIZE_NOT_TRACKED ? 0 : actual_size);
 	return p;
 }
 
 void ProxyAllocator::deallocate(void* data)
 {
-	DEALLOCATE_MEMORY(_name, (data == NULL) ? 0 :_allocator.allocated_size((const void*)data));
+	if (data == NULL)
+		return;
+
+	// Bytes are only counted when the backing allocator tracks them
+	const u32 actual_size = _allocator.allocated_size((const void*)data);
+	record_deallocate(actual_size == SIZE_NOT_TRACKED ? 0 : actual_size);
 	_allocator.deallocate(data);
 }
 
@@ -34,4 +96,100 @@ const char* ProxyAllocator::name() const
 	return _name;
 }
 
+void ProxyAllocator::record_allocate(u32 size)
+{
+	_num_allocations.fetch_add(1);
+	const u32 allocated_size = (u32)_allocated_size.fetch_add((int)size) + size;
+	_frame_allocations.fetch_add(1);
+	_frame_allocated_size.fetch_add((int)size);
+
+	u32 peak_size = (u32)_peak_size.load();
+	while (allocated_size > peak_size && !_peak_size.compare_and_swap((int)peak_size, (int)allocated_size))
+		peak_size = (u32)_peak_size.load();
+}
+
+void ProxyAllocator::record_deallocate(u32 size)
+{
+	const u32 num_allocations = (u32)_num_allocations.fetch_add(-1);
+	const u32 allocated_size = (u32)_allocated_size.fetch_add(-(int)size);
+	CE_ASSERT(num_allocations > 0 && size <= allocated_size, "Deallocating more than allocated");
+	CE_UNUSED(num_allocations);
+	CE_UNUSED(allocated_size);
+}
+
+namespace proxy_allocator
+{
+	void record()
+	{
+		using namespace proxy_allocator_internal;
+		ScopedMutex sm(list_mutex());
+
+		for (ProxyAllocator* pa = _head; pa != NULL; pa = pa->_next)
+		{
+			RecordAllocator ra;
+			ra.name = pa->_name;
+			ra.num_allocations = (u32)pa->_num_allocations.load();
+			ra.allocated_size = (u32)pa->_allocated_size.load();
+			ra.peak_size = (u32)pa->_peak_size.load();
+			ra.frame_allocations = (u32)pa->_frame_allocations.load();
+			ra.frame_allocated_size = (u32)pa->_frame_allocated_size.load();
+			RECORD_ALLOCATOR(ra);
+
+			// Subtract what was read so that concurrent allocations are not lost
+			pa->_frame_allocations.fetch_add(-(int)ra.frame_allocations);
+			pa->_frame_allocated_size.fetch_add(-(int)ra.frame_allocated_size);
+		}
+	}
+
+	void dump(StringStream& ss)
+	{
+		using namespace proxy_allocator_internal;
+		ScopedMutex sm(list_mutex());
+
+		// Depth-first visit starting from the allocators without a parent
+		TempAllocator1024 ta;
+		Array<ProxyAllocator*> stack(ta);
+		Array<u32> depth(ta);
+
+		for (ProxyAllocator* pa = _head; pa != NULL; pa = pa->_next)
+		{
+			if (pa->_parent == NULL)
+			{
+				array::push_back(stack, pa);
+				array::push_back(depth, 0u);
+			}
+		}
+
+		while (array::size(stack) != 0)
+		{
+			ProxyAllocator* pa = array::back(stack);
+			const u32 dd = array::back(depth);
+			array::pop_back(stack);
+			array::pop_back(depth);
+
+			for (u32 i = 0; i < dd; ++i)
+				ss << "  ";
+
+			ss << pa->_name
+				<< ": " << (u32)pa->_num_allocations.load() << " allocations"
+				<< ", " << (u32)pa->_allocated_size.load() << " bytes"
+				<< ", peak " << (u32)pa->_peak_size.load() << " bytes"
+				<< ", frame " << (u32)pa->_frame_allocations.load() << " allocations"
+				<< ", " << (u32)pa->_frame_allocated_size.load() << " bytes"
+				<< "\n"
+				;
+
+			for (ProxyAllocator* child = _head; child != NULL; child = child->_next)
+			{
+				if (child->_parent == pa)
+				{
+					array::push_back(stack, child);
+					array::push_back(depth, dd + 1);
+				}
+			}
+		}
+	}
+
+} // namespace proxy_allocator
+
 } // namespace crown
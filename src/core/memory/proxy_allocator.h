@@ -6,23 +6,49 @@
 #pragma once
 
 #include "core/memory/allocator.h"
+#include "core/strings/types.h"
+#include "core/thread/atomic_int.h"
 
 namespace crown
 {
+class ProxyAllocator;
+
+namespace proxy_allocator
+{
+	void record();
+	void dump(StringStream& ss);
+
+} // namespace proxy_allocator
+
 /// Offers the facility to tag allocators by a string identifier.
 /// Proxy allocator is appended to a global linked list when instantiated
 /// so that it is possible to later visit that list for debugging purposes.
 ///
+/// A proxy allocator whose backing allocator is another proxy allocator
+/// becomes its child in the tree printed by proxy_allocator::dump().
+///
 /// @ingroup Memory
 class ProxyAllocator : public Allocator
 {
 	Allocator& _allocator;
 	const char* _name;
+	ProxyAllocator* _parent;
+	ProxyAllocator* _next;
+
+	AtomicInt _num_allocations;
+	AtomicInt _allocated_size;
+	AtomicInt _peak_size;
+	AtomicInt _frame_allocations;
+	AtomicInt _frame_allocated_size;
+
+	friend void proxy_allocator::record();
+	friend void proxy_allocator::dump(StringStream& ss);
 
 public:
 
 	/// Tag all allocations made with @a allocator by the given @a name
 	ProxyAllocator(Allocator& allocator, const char* name);
+	~ProxyAllocator();
 
 	/// @copydoc Allocator::allocate()
 	void* allocate(u32 size, u32 align = Allocator::DEFAULT_ALIGN);
@@ -31,13 +57,35 @@ public:
 	void deallocate(void* data);
 
 	/// @copydoc Allocator::allocated_size()
-	u32 allocated_size(const void* /*ptr*/) { return SIZE_NOT_TRACKED; }
+	u32 allocated_size(const void* ptr) { return _allocator.allocated_size(ptr); }
 
 	/// @copydoc Allocator::total_allocated()
-	u32 total_allocated() { return SIZE_NOT_TRACKED; }
+	u32 total_allocated() { return (u32)_allocated_size.load(); }
 
 	/// Returns the name of the proxy allocator
 	const char* name() const;
+
+	/// Records an allocation of @a size bytes made on behalf of this
+	/// allocator by code that manages its own memory.
+	void record_allocate(u32 size);
+
+	/// Records a deallocation of @a size bytes made on behalf of this
+	/// allocator by code that manages its own memory.
+	void record_deallocate(u32 size);
 };
 
+/// Functions to inspect all the proxy allocators.
+///
+/// @ingroup Memory
+namespace proxy_allocator
+{
+	/// Records the statistics of all the proxy allocators in the profiler
+	/// and starts counting the allocations of a new frame.
+	void record();
+
+	/// Writes the tree of all the proxy allocators and their statistics to @a ss.
+	void dump(StringStream& ss);
+
+} // namespace proxy_allocator
+
 } // namespace crown
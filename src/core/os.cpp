@@ -16,7 +16,7 @@
 	#include <dirent.h> // opendir, readdir
 	#include <dlfcn.h>    // dlopen, dlclose, dlsym
 	#include <errno.h>
-	#include <stdio.h>    // fputs
+	#include <stdio.h>    // fputs, rename
 	#include <stdlib.h>   // getenv
 	#include <string.h>   // memset
 	#include <sys/stat.h> // lstat, mknod, mkdir
@@ -76,6 +76,19 @@ namespace os
 #endif
 	}
 
+	/// Returns the number of processors available.
+	u32 num_processors()
+	{
+#if CROWN_PLATFORM_POSIX
+		const long n = sysconf(_SC_NPROCESSORS_ONLN);
+		return n > 0 ? u32(n) : 1;
+#elif CROWN_PLATFORM_WINDOWS
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return u32(info.dwNumberOfProcessors);
+#endif
+	}
+
 	/// Opens the library at @a path.
 	void* library_open(const char* path)
 	{
@@ -225,6 +238,15 @@ namespace os
 #endif
 	}
 
+	bool rename(const char* old_path, const char* new_path)
+	{
+#if CROWN_PLATFORM_POSIX
+		return ::rename(old_path, new_path) == 0;
+#elif CROWN_PLATFORM_WINDOWS
+		return MoveFileEx(old_path, new_path, MOVEFILE_REPLACE_EXISTING) != 0;
+#endif
+	}
+
 	/// Creates a directory named @a path.
 	void create_directory(const char* path)
 	{
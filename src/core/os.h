@@ -26,6 +26,9 @@ namespace os
 	/// Suspends execution for @a ms milliseconds.
 	void sleep(u32 ms);
 
+	/// Returns the number of processors available.
+	u32 num_processors();
+
 	/// Opens the library at @a path.
 	void* library_open(const char* path);
 
@@ -56,6 +59,10 @@ namespace os
 	/// Deletes the file at @a path.
 	void delete_file(const char* path);
 
+	/// Renames the file @a old_path to @a new_path, replacing @a new_path if it exists.
+	/// Returns whether the file has been renamed.
+	bool rename(const char* old_path, const char* new_path);
+
 	/// Creates a directory named @a path.
 	void create_directory(const char* path);
 
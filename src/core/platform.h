@@ -29,6 +29,9 @@
 #define CROWN_CPU_ENDIAN_BIG 0
 #define CROWN_CPU_ENDIAN_LITTLE 0
 
+#define CROWN_SIMD_NEON 0
+#define CROWN_SIMD_SSE2 0
+
 // http://sourceforge.net/apps/mediawiki/predef/index.php?title=Compilers
 #if defined(_MSC_VER)
 	#undef CROWN_COMPILER_MSVC
@@ -115,6 +118,19 @@
 	#define CROWN_CPU_ENDIAN_LITTLE 1
 #endif
 
+// Define CROWN_NO_SIMD to force the scalar math paths
+#if !defined(CROWN_NO_SIMD)
+	#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		#undef CROWN_SIMD_SSE2
+		#define CROWN_SIMD_SSE2 1
+	#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+		#undef CROWN_SIMD_NEON
+		#define CROWN_SIMD_NEON 1
+	#endif
+#endif // !defined(CROWN_NO_SIMD)
+
+#define CROWN_SIMD (CROWN_SIMD_NEON || CROWN_SIMD_SSE2)
+
 #if CROWN_COMPILER_GCC
 	#define CROWN_COMPILER_NAME "GCC"
 #elif CROWN_COMPILER_MSVC
@@ -44,6 +44,27 @@ struct AtomicInt
 #endif
 	}
 
+	/// Adds @a val and returns the previous value.
+	int fetch_add(int val)
+	{
+#if CROWN_PLATFORM_POSIX && CROWN_COMPILER_GCC
+		return __sync_fetch_and_add(&_val, val);
+#elif CROWN_PLATFORM_WINDOWS
+		return InterlockedExchangeAdd(&_val, val);
+#endif
+	}
+
+	/// Sets the value to @a val if it equals @a cmp.
+	/// Returns whether the value was set.
+	bool compare_and_swap(int cmp, int val)
+	{
+#if CROWN_PLATFORM_POSIX && CROWN_COMPILER_GCC
+		return __sync_bool_compare_and_swap(&_val, cmp, val);
+#elif CROWN_PLATFORM_WINDOWS
+		return InterlockedCompareExchange(&_val, val, cmp) == cmp;
+#endif
+	}
+
 	void store(int val)
 	{
 #if CROWN_PLATFORM_POSIX && CROWN_COMPILER_GCC
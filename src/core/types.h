@@ -51,8 +51,10 @@ typedef double   f64;
 
 #if defined(__GNUC__)
 	#define CE_THREAD __thread
+	#define CE_NOINLINE __attribute__((noinline))
 #elif defined(_MSC_VER)
 	#define CE_THREAD __declspec(thread)
+	#define CE_NOINLINE __declspec(noinline)
 #else
 	#error "Compiler not supported"
 #endif
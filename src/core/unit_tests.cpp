@@ -14,23 +14,29 @@
 #include "core/filesystem/path.h"
 #include "core/guid.h"
 #include "core/json/json.h"
+#include "core/json/json_tape.h"
 #include "core/json/sjson.h"
 #include "core/math/aabb.h"
+#include "core/math/aabb_tree.h"
 #include "core/math/color4.h"
+#include "core/math/intersection.h"
 #include "core/math/math.h"
 #include "core/math/matrix3x3.h"
 #include "core/math/matrix4x4.h"
 #include "core/math/quaternion.h"
+#include "core/math/random.h"
 #include "core/math/sphere.h"
 #include "core/math/vector2.h"
 #include "core/math/vector3.h"
 #include "core/math/vector4.h"
 #include "core/memory/memory.h"
+#include "core/memory/proxy_allocator.h"
 #include "core/memory/temp_allocator.h"
 #include "core/murmur.h"
 #include "core/strings/dynamic_string.h"
 #include "core/strings/string.h"
 #include "core/strings/string_id.h"
+#include "core/strings/string_stream.h"
 
 #define ENSURE(condition)                                \
 	do                                                   \
@@ -58,6 +64,28 @@ static void test_memory()
 	ENSURE(a.allocated_size(p) >= 32);
 	a.deallocate(p);
 
+	{
+		ProxyAllocator parent(a, "parent");
+		ProxyAllocator child(parent, "child");
+
+		void* p0 = child.allocate(32);
+		void* p1 = child.allocate(64);
+		const u32 size = child.total_allocated();
+		ENSURE(size >= 96);
+		ENSURE(parent.total_allocated() == size);
+		child.deallocate(p0);
+		ENSURE(child.total_allocated() == child.allocated_size(p1));
+		child.deallocate(p1);
+		ENSURE(child.total_allocated() == 0);
+		ENSURE(parent.total_allocated() == 0);
+
+		StringStream ss(a);
+		proxy_allocator::dump(ss);
+		const char* dump = string_stream::c_str(ss);
+		ENSURE(strstr(dump, "parent: 0 allocations, 0 bytes, peak ") != NULL);
+		ENSURE(strstr(dump, "  child: 0 allocations") != NULL);
+	}
+
 	memory_globals::shutdown();
 }
 
@@ -671,6 +699,104 @@ static void test_matrix4x4()
 	}
 }
 
+static Matrix4x4 random_matrix4x4(Random& r)
+{
+	Matrix4x4 m;
+	f32* f = to_float_ptr(m);
+	for (u32 i = 0; i < 16; ++i)
+		f[i] = r.unit_float()*20.0f - 10.0f;
+	return m;
+}
+
+static Quaternion random_quaternion(Random& r)
+{
+	Quaternion q = quaternion(r.unit_float()*2.0f - 1.0f
+		, r.unit_float()*2.0f - 1.0f
+		, r.unit_float()*2.0f - 1.0f
+		, r.unit_float()*2.0f - 1.0f
+		);
+	return normalize(q);
+}
+
+static bool fequal(const Matrix4x4& a, const Matrix4x4& b, f32 epsilon)
+{
+	const f32* fa = to_float_ptr(a);
+	const f32* fb = to_float_ptr(b);
+	for (u32 i = 0; i < 16; ++i)
+	{
+		if (!fequal(fa[i], fb[i], epsilon*fmax(1.0f, fabs(fb[i]))))
+			return false;
+	}
+	return true;
+}
+
+static void test_matrix4x4_simd()
+{
+	// SIMD paths must match the scalar ones
+	Random rnd(1234);
+	for (u32 i = 0; i < 100; ++i)
+	{
+		const Matrix4x4 a = random_matrix4x4(rnd);
+		const Matrix4x4 b = random_matrix4x4(rnd);
+
+		Matrix4x4 c = a;
+		matrix4x4_internal::multiply_scalar(c, b);
+		ENSURE(fequal(a * b, c, 0.00001f));
+
+		Matrix4x4 d = a;
+		d *= d;
+		c = a;
+		matrix4x4_internal::multiply_scalar(c, a);
+		ENSURE(fequal(d, c, 0.00001f));
+
+		c = a;
+		matrix4x4_internal::transpose_scalar(c);
+		ENSURE(fequal(get_transposed(a), c, 0.0f));
+
+		const Vector4 v4 = vector4(rnd.unit_float(), rnd.unit_float(), rnd.unit_float(), rnd.unit_float());
+		const Vector4 r4 = v4 * a;
+		const Vector4 s4 = matrix4x4_internal::transform_scalar(v4, a);
+		ENSURE(fequal(r4.x, s4.x, 0.0001f));
+		ENSURE(fequal(r4.y, s4.y, 0.0001f));
+		ENSURE(fequal(r4.z, s4.z, 0.0001f));
+		ENSURE(fequal(r4.w, s4.w, 0.0001f));
+
+		const Vector3 v3 = vector3(rnd.unit_float(), rnd.unit_float(), rnd.unit_float());
+		const Vector3 r3 = v3 * a;
+		const Vector3 s3 = matrix4x4_internal::transform_scalar(v3, a);
+		ENSURE(fequal(r3.x, s3.x, 0.0001f));
+		ENSURE(fequal(r3.y, s3.y, 0.0001f));
+		ENSURE(fequal(r3.z, s3.z, 0.0001f));
+
+		const Quaternion q = random_quaternion(rnd);
+		const Vector3 t = vector3(rnd.unit_float(), rnd.unit_float(), rnd.unit_float());
+		const Matrix4x4 tm = matrix4x4(q, t);
+		ENSURE(fequal(tm, matrix4x4_internal::from_quaternion_scalar(q, t), 0.00001f));
+
+		c = tm;
+		matrix4x4_internal::invert_scalar(c);
+		ENSURE(fequal(get_inverted(tm), c, 0.0001f));
+		ENSURE(fequal(tm * get_inverted(tm), MATRIX4X4_IDENTITY, 0.0001f));
+
+		c = a;
+		matrix4x4_internal::invert_scalar(c);
+		ENSURE(fequal(a * get_inverted(a), MATRIX4X4_IDENTITY, 0.001f));
+		ENSURE(fequal(a * c, MATRIX4X4_IDENTITY, 0.001f));
+
+		AABB box;
+		box.min = vector3(rnd.unit_float()*-5.0f, rnd.unit_float()*-5.0f, rnd.unit_float()*-5.0f);
+		box.max = vector3(rnd.unit_float()* 5.0f, rnd.unit_float()* 5.0f, rnd.unit_float()* 5.0f);
+		const AABB ra = aabb::transformed(box, tm);
+		const AABB sa = aabb_internal::transformed_scalar(box, tm);
+		ENSURE(fequal(ra.min.x, sa.min.x, 0.0001f));
+		ENSURE(fequal(ra.min.y, sa.min.y, 0.0001f));
+		ENSURE(fequal(ra.min.z, sa.min.z, 0.0001f));
+		ENSURE(fequal(ra.max.x, sa.max.x, 0.0001f));
+		ENSURE(fequal(ra.max.y, sa.max.y, 0.0001f));
+		ENSURE(fequal(ra.max.z, sa.max.z, 0.0001f));
+	}
+}
+
 static void test_aabb()
 {
 	{
@@ -756,6 +882,94 @@ static void test_aabb()
 		ENSURE(!aabb::contains_point(a, vector3(1.2f, -1.0f, -4.4f)));
 		ENSURE(!aabb::contains_point(a, vector3(1.2f,  3.0f, -4.6f)));
 	}
+	{
+		AABB a;
+		a.min = vector3(1.0f, 2.0f, 3.0f);
+		a.max = vector3(2.0f, 4.0f, 6.0f);
+		const AABB b = aabb::transformed(a, matrix4x4(quaternion(VECTOR3_YAXIS, PI_HALF), vector3(10.0f, 0.0f, 0.0f)));
+		ENSURE(fequal(b.min.x, 13.0f, 0.00001f));
+		ENSURE(fequal(b.min.y,  2.0f, 0.00001f));
+		ENSURE(fequal(b.min.z, -2.0f, 0.00001f));
+		ENSURE(fequal(b.max.x, 16.0f, 0.00001f));
+		ENSURE(fequal(b.max.y,  4.0f, 0.00001f));
+		ENSURE(fequal(b.max.z, -1.0f, 0.00001f));
+	}
+}
+
+static void test_aabb_tree()
+{
+	memory_globals::init();
+	Allocator& a = default_allocator();
+	{
+		AABBTree tree(a, 0.0f);
+		ENSURE(tree.height() == 0);
+
+		// A row of unit boxes along the x axis
+		u32 proxies[64];
+		for (u32 i = 0; i < countof(proxies); ++i)
+		{
+			AABB b;
+			b.min = vector3(f32(i)*2.0f, 0.0f, 0.0f);
+			b.max = vector3(f32(i)*2.0f + 1.0f, 1.0f, 1.0f);
+			proxies[i] = tree.create(b, i);
+		}
+		ENSURE(tree.height() < 12);
+
+		TempAllocator1024 ta;
+		Array<u32> hits(ta);
+		tree.query_ray(vector3(-1.0f, 0.5f, 0.5f), vector3(1.0f, 0.0f, 0.0f), hits);
+		ENSURE(array::size(hits) == 64);
+
+		array::clear(hits);
+		tree.query_ray(vector3(10.5f, -1.0f, 0.5f), vector3(0.0f, 1.0f, 0.0f), hits);
+		ENSURE(array::size(hits) == 1);
+		ENSURE(hits[0] == 5);
+
+		array::clear(hits);
+		Sphere s;
+		s.c = vector3(6.5f, 0.5f, 0.5f);
+		s.r = 1.6f;
+		tree.query_sphere(s, hits);
+		ENSURE(array::size(hits) == 3);
+
+		// Moving a box far away takes it out of the query
+		AABB far;
+		far.min = vector3(0.0f, 100.0f, 0.0f);
+		far.max = vector3(1.0f, 101.0f, 1.0f);
+		ENSURE(tree.move(proxies[5], far));
+		array::clear(hits);
+		tree.query_ray(vector3(10.5f, -1.0f, 0.5f), vector3(0.0f, 1.0f, 0.0f), hits);
+		ENSURE(array::size(hits) == 0);
+
+		for (u32 i = 0; i < countof(proxies); ++i)
+			tree.destroy(proxies[i]);
+		ENSURE(tree.height() == 0);
+	}
+	memory_globals::shutdown();
+}
+
+static void test_intersection()
+{
+	{
+		AABB b;
+		b.min = vector3(-1.0f, -1.0f, -1.0f);
+		b.max = vector3( 1.0f,  1.0f,  1.0f);
+		ENSURE(fequal(ray_aabb_intersection(vector3(-5.0f, 0.0f, 0.0f), vector3(1.0f, 0.0f, 0.0f), b), 4.0f, 0.00001f));
+		ENSURE(ray_aabb_intersection(vector3(0.0f, 0.0f, 0.0f), vector3(0.0f, 1.0f, 0.0f), b) == 0.0f);
+		ENSURE(ray_aabb_intersection(vector3(-5.0f, 2.0f, 0.0f), vector3(1.0f, 0.0f, 0.0f), b) == -1.0f);
+		ENSURE(ray_aabb_intersection(vector3( 5.0f, 0.0f, 0.0f), vector3(1.0f, 0.0f, 0.0f), b) == -1.0f);
+	}
+	{
+		AABB b;
+		b.min = vector3(-1.0f, -1.0f, -1.0f);
+		b.max = vector3( 1.0f,  1.0f,  1.0f);
+		Sphere s;
+		s.c = vector3(2.5f, 0.0f, 0.0f);
+		s.r = 1.0f;
+		ENSURE(!sphere_box_intersection(s, b));
+		s.r = 1.6f;
+		ENSURE( sphere_box_intersection(s, b));
+	}
 }
 
 static void test_sphere()
@@ -1115,6 +1329,46 @@ static void test_sjson()
 		const Guid parsed = sjson::parse_guid("\"0f6c3b1c-9cba-4282-9096-2a77ca047b1b\"");
 		ENSURE(guid == parsed);
 	}
+	{
+		TempAllocator1024 ta;
+		JsonTape tape(ta);
+		sjson::parse("a = 1.5 b = [ true \"x\" { c = -2e3 } ] // Comment\n\"d\" : null", tape);
+		ENSURE(json_tape::size(tape, 0) == 3);
+		ENSURE(!json_tape::has(tape, 0, "e"));
+
+		const u32 a = json_tape::get(tape, 0, "a");
+		ENSURE(fequal(json_tape::to_float(tape, a), 1.5f));
+
+		const u32 b = json_tape::get(tape, 0, "b");
+		ENSURE(json_tape::node(tape, b).type == JsonValueType::ARRAY);
+		ENSURE(json_tape::size(tape, b) == 3);
+
+		u32 cur = json_tape::begin(tape, b);
+		ENSURE(json_tape::to_bool(tape, cur) == true);
+
+		cur = json_tape::next(tape, cur);
+		DynamicString str(ta);
+		sjson::parse_string(json_tape::node(tape, cur).json, str);
+		ENSURE(str == "x");
+
+		cur = json_tape::next(tape, cur);
+		ENSURE(json_tape::to_int(tape, json_tape::get(tape, cur, "c")) == -2000);
+		ENSURE(json_tape::next(tape, cur) == json_tape::end(tape, b));
+
+		const u32 d = json_tape::get(tape, 0, "d");
+		ENSURE(json_tape::node(tape, d).type == JsonValueType::NIL);
+		ENSURE(json_tape::next(tape, d) == json_tape::end(tape, 0));
+	}
+	{
+		TempAllocator1024 ta;
+		JsonTape tape(ta);
+		sjson::parse("{ a = 0.1 b = -0.000123 c = 1.7976931348623157e308 d = 123456789012345678901234 e = 4.9e-324 }", tape);
+		ENSURE(json_tape::node(tape, json_tape::get(tape, 0, "a")).number == 0.1);
+		ENSURE(json_tape::node(tape, json_tape::get(tape, 0, "b")).number == -0.000123);
+		ENSURE(json_tape::node(tape, json_tape::get(tape, 0, "c")).number == 1.7976931348623157e308);
+		ENSURE(json_tape::node(tape, json_tape::get(tape, 0, "d")).number == 123456789012345678901234.0);
+		ENSURE(json_tape::node(tape, json_tape::get(tape, 0, "e")).number == 4.9e-324);
+	}
 	memory_globals::shutdown();
 }
 
@@ -1255,7 +1509,10 @@ int main_unit_tests()
 	test_color4();
 	test_matrix3x3();
 	test_matrix4x4();
+	test_matrix4x4_simd();
 	test_aabb();
+	test_aabb_tree();
+	test_intersection();
 	test_sphere();
 	test_murmur();
 	test_string_id();
@@ -17,6 +17,7 @@ BootConfig::BootConfig(Allocator& a)
 	: boot_script_name(u64(0))
 	, boot_package_name(u64(0))
 	, window_title(a)
+	, lua_gc_budget(-1.0f)
 	, window_w(CROWN_DEFAULT_WINDOW_WIDTH)
 	, window_h(CROWN_DEFAULT_WINDOW_HEIGHT)
 	, aspect_ratio(-1.0f)
@@ -37,6 +38,8 @@ bool BootConfig::parse(const char* json)
 
 	if (json_object::has(cfg, "window_title"))
 		sjson::parse_string(cfg["window_title"], window_title);
+	if (json_object::has(cfg, "lua_gc_budget"))
+		lua_gc_budget = sjson::parse_float(cfg["lua_gc_budget"]);
 
 	// Platform-specific configs
 	if (json_object::has(cfg, CROWN_PLATFORM_NAME))
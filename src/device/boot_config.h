@@ -19,6 +19,7 @@ struct BootConfig
 	StringId64 boot_script_name;
 	StringId64 boot_package_name;
 	DynamicString window_title;
+	f32 lua_gc_budget;
 	u16 window_w;
 	u16 window_h;
 	float aspect_ratio;
@@ -29,6 +29,7 @@
 #include "device/input_manager.h"
 #include "device/log.h"
 #include "device/profiler.h"
+#include "device/profiler_capture.h"
 #include "lua/lua_environment.h"
 #include "resource/config_resource.h"
 #include "resource/font_resource.h"
@@ -182,6 +183,39 @@ static void console_command(ConsoleServer& cs, TCPSocket client, const char* jso
 
 		((Device*)user_data)->reload(ResourceId(type.c_str()), ResourceId(name.c_str()));
 	}
+	else if (cmd == "profile")
+	{
+		if (array::size(args) != 2 && array::size(args) != 3)
+		{
+			cs.error(client, "Usage: profile num_frames [path]");
+			return;
+		}
+
+		DynamicString path(ta);
+		path = CROWN_PROFILE_CAPTURE;
+		if (array::size(args) == 3)
+			sjson::parse_string(args[2], path);
+
+		((Device*)user_data)->capture_profile(path.c_str(), (u32)sjson::parse_int(args[1]));
+	}
+	else if (cmd == "memory")
+	{
+		StringStream ss(default_allocator());
+		proxy_allocator::dump(ss);
+		array::push_back(ss, '\0');
+
+		// Log one allocator per line
+		char* line = array::begin(ss);
+		for (char* ch = line; *ch; ++ch)
+		{
+			if (*ch == '\n')
+			{
+				*ch = '\0';
+				logi(DEVICE, "%s", line);
+				line = ch + 1;
+			}
+		}
+	}
 }
 
 Device::Device(const DeviceOptions& opts, ConsoleServer& cs)
@@ -191,6 +225,7 @@ Device::Device(const DeviceOptions& opts, ConsoleServer& cs)
 	, _console_server(&cs)
 	, _data_filesystem(NULL)
 	, _last_log(NULL)
+	, _profiler_capture(NULL)
 	, _resource_loader(NULL)
 	, _resource_manager(NULL)
 	, _bgfx_allocator(NULL)
@@ -333,6 +368,7 @@ void Device::run()
 		_data_filesystem->create_directory(data_dir);
 
 	_last_log = _data_filesystem->open(CROWN_LAST_LOG, FileOpenMode::WRITE);
+	_profiler_capture = CE_NEW(_allocator, ProfilerCapture)(default_allocator(), *_data_filesystem);
 #endif // CROWN_PLATFORM_ANDROID
 
 	logi(DEVICE, "Initializing Crown Engine %s %s %s", CROWN_VERSION, CROWN_PLATFORM_NAME, CROWN_ARCH_NAME);
@@ -368,7 +404,7 @@ void Device::run()
 	_resource_manager->register_type(RESOURCE_TYPE_PHYSICS_CONFIG,   RESOURCE_VERSION_PHYSICS_CONFIG,   NULL,      NULL,        NULL,        NULL        );
 	_resource_manager->register_type(RESOURCE_TYPE_SCRIPT,           RESOURCE_VERSION_SCRIPT,           NULL,      NULL,        NULL,        NULL        );
 	_resource_manager->register_type(RESOURCE_TYPE_SHADER,           RESOURCE_VERSION_SHADER,           shr::load, shr::unload, shr::online, shr::offline);
-	_resource_manager->register_type(RESOURCE_TYPE_SOUND,            RESOURCE_VERSION_SOUND,            NULL,      NULL,        NULL,        NULL        );
+	_resource_manager->register_type(RESOURCE_TYPE_SOUND,            RESOURCE_VERSION_SOUND,            sdr::load, sdr::unload, NULL,        NULL        );
 	_resource_manager->register_type(RESOURCE_TYPE_SPRITE,           RESOURCE_VERSION_SPRITE,           NULL,      NULL,        NULL,        NULL        );
 	_resource_manager->register_type(RESOURCE_TYPE_SPRITE_ANIMATION, RESOURCE_VERSION_SPRITE_ANIMATION, NULL,      NULL,        NULL,        NULL        );
 	_resource_manager->register_type(RESOURCE_TYPE_STATE_MACHINE,    RESOURCE_VERSION_STATE_MACHINE,    NULL,      NULL,        NULL,        NULL        );
@@ -421,7 +457,7 @@ void Device::run()
 	_material_manager = CE_NEW(_allocator, MaterialManager)(default_allocator(), *_resource_manager);
 	_input_manager    = CE_NEW(_allocator, InputManager)(default_allocator());
 	_unit_manager     = CE_NEW(_allocator, UnitManager)(default_allocator());
-	_lua_environment  = CE_NEW(_allocator, LuaEnvironment)();
+	_lua_environment  = CE_NEW(_allocator, LuaEnvironment)(default_allocator());
 
 	audio_globals::init();
 	physics_globals::init(_allocator);
@@ -431,11 +467,15 @@ void Device::run()
 	boot_package->flush();
 
 	_lua_environment->load_libs();
+	_lua_environment->set_gc_budget(_boot_config.lua_gc_budget);
 	_lua_environment->execute_string(_device_options._lua_string.c_str());
 	_lua_environment->execute((LuaResource*)_resource_manager->get(RESOURCE_TYPE_SCRIPT, _boot_config.boot_script_name));
 
 	logi(DEVICE, "Initialized");
 
+	if (_device_options._capture_frames > 0)
+		capture_profile(CROWN_PROFILE_CAPTURE, _device_options._capture_frames);
+
 	_lua_environment->call_global("init", 0);
 
 	s64 last_time = os::clocktime();
@@ -452,6 +492,7 @@ void Device::run()
 		_time_since_start += dt;
 
 		profiler_globals::clear();
+		ENTER_PROFILE_SCOPE("device.frame");
 		_console_server->update();
 
 		RECORD_FLOAT("device.dt", dt);
@@ -473,6 +514,9 @@ void Device::run()
 				const s64 t1 = os::clocktime();
 				RECORD_FLOAT("lua.render", f32((t1 - t0)*(1.0 / freq)));
 			}
+
+			// Upload the texture mips read in the background and request those needed while rendering
+			texture_resource::stream_mips(*_resource_loader, CROWN_TEXTURE_STREAMING_BUDGET);
 		}
 
 		_input_manager->update();
@@ -482,9 +526,25 @@ void Device::run()
 		RECORD_FLOAT("bgfx.cpu_time", f32(f64(stats->cpuTimeEnd - stats->cpuTimeBegin)*1000.0/stats->cpuTimerFreq));
 
 		bgfx::frame();
+		_material_manager->reset_uniforms();
+
+		{
+			const s64 t0 = os::clocktime();
+			_lua_environment->collect_garbage();
+			const s64 t1 = os::clocktime();
+			RECORD_FLOAT("lua.gc", f32((t1 - t0)*(1000.0 / freq)));
+			CE_UNUSED(t0);
+			CE_UNUSED(t1);
+			RECORD_FLOAT("lua.memory", f32(_lua_environment->memory_used()));
+		}
+
+		proxy_allocator::record();
+
+		LEAVE_PROFILE_SCOPE();
 		profiler_globals::flush();
 
-		_lua_environment->reset_temporaries();
+		if (_profiler_capture)
+			_profiler_capture->update();
 
 		_frame_count++;
 	}
@@ -512,6 +572,8 @@ void Device::run()
 	CE_DELETE(_allocator, _bgfx_callback);
 	CE_DELETE(_allocator, _bgfx_allocator);
 
+	CE_DELETE(_allocator, _profiler_capture);
+
 	if (_last_log)
 		_data_filesystem->close(*_last_log);
 
@@ -650,6 +712,20 @@ void Device::reload(StringId64 type, StringId64 name)
 	logi(DEVICE, "Reloaded #ID(%s-%s)", type_str.c_str(), name_str.c_str());
 }
 
+void Device::capture_profile(const char* path, u32 num_frames)
+{
+	if (!_profiler_capture)
+	{
+		loge(DEVICE, "Profile capture is not supported on this platform");
+		return;
+	}
+
+	if (num_frames == 0)
+		_profiler_capture->stop();
+	else
+		_profiler_capture->start(path, num_frames);
+}
+
 void Device::log(const char* msg)
 {
 	if (_last_log)
@@ -28,6 +28,7 @@ namespace crown
 {
 struct BgfxAllocator;
 struct BgfxCallback;
+struct ProfilerCapture;
 
 /// This is the place where to look for accessing all of
 /// the engine subsystems and related stuff.
@@ -42,6 +43,7 @@ struct Device
 	ConsoleServer* _console_server;
 	Filesystem* _data_filesystem;
 	File* _last_log;
+	ProfilerCapture* _profiler_capture;
 	ResourceLoader* _resource_loader;
 	ResourceManager* _resource_manager;
 	BgfxAllocator* _bgfx_allocator;
@@ -117,6 +119,10 @@ struct Device
 	/// Reloads the resource @a type @a name.
 	void reload(StringId64 type, StringId64 name);
 
+	/// Writes the profiler events of the next @a num_frames frames
+	/// to @a path in the Chrome Trace Event format.
+	void capture_profile(const char* path, u32 num_frames);
+
 	/// Logs @a msg to log file and console.
 	void log(const char* msg);
 
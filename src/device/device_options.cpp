@@ -27,6 +27,7 @@ static void help(const char* msg = NULL)
 		"  -v --version               Display engine version.\n"
 		"  --source-dir <path>        Use <path> as the source directory for resource compilation.\n"
 		"  --data-dir <path>          Use <path> as the destination directory for compiled resources.\n"
+		"  --cache-dir <path>         Use <path> as the shared cache of compiled resources.\n"
 		"  --boot-dir <path>          Boot the engine with the 'boot.config' from given <path>.\n"
 		"  --compile                  Do a full compile of the resources.\n"
 		"  --platform <platform>      Compile resources for the given <platform>.\n"
@@ -38,6 +39,7 @@ static void help(const char* msg = NULL)
 		"  --wait-console             Wait for a console connection before starting up.\n"
 		"  --parent-window <handle>   Set the parent window <handle> of the main window.\n"
 		"  --server                   Run the engine in server mode.\n"
+		"  --capture-profile <frames> Write the profiler events of the first <frames> frames to '" CROWN_PROFILE_CAPTURE "'.\n"
 	);
 
 	if (msg)
@@ -51,6 +53,7 @@ DeviceOptions::DeviceOptions(Allocator& a, int argc, const char** argv)
 	, _map_source_dir_name(NULL)
 	, _map_source_dir_prefix(a)
 	, _data_dir(a)
+	, _cache_dir(a)
 	, _boot_dir(NULL)
 	, _platform(NULL)
 	, _lua_string(a)
@@ -59,6 +62,7 @@ DeviceOptions::DeviceOptions(Allocator& a, int argc, const char** argv)
 	, _do_continue(false)
 	, _server(false)
 	, _parent_window(0)
+	, _capture_frames(0)
 	, _console_port(CROWN_DEFAULT_CONSOLE_PORT)
 	, _window_x(0)
 	, _window_y(0)
@@ -85,6 +89,7 @@ int DeviceOptions::parse()
 
 	path::reduce(_source_dir, cl.get_parameter(0, "source-dir"));
 	path::reduce(_data_dir, cl.get_parameter(0, "data-dir"));
+	path::reduce(_cache_dir, cl.get_parameter(0, "cache-dir"));
 
 	_map_source_dir_name = cl.get_parameter(0, "map-source-dir");
 	if (_map_source_dir_name)
@@ -148,6 +153,15 @@ int DeviceOptions::parse()
 		}
 	}
 
+	if (!_cache_dir.empty())
+	{
+		if (!path::is_absolute(_cache_dir.c_str()))
+		{
+			help("Cache dir must be absolute.");
+			return EXIT_FAILURE;
+		}
+	}
+
 	if (!_source_dir.empty())
 	{
 		if (!path::is_absolute(_source_dir.c_str()))
@@ -200,6 +214,16 @@ int DeviceOptions::parse()
 		}
 	}
 
+	const char* frames = cl.get_parameter(0, "capture-profile");
+	if (frames)
+	{
+		if (sscanf(frames, "%u", &_capture_frames) != 1)
+		{
+			help("Number of frames to capture is invalid.");
+			return EXIT_FAILURE;
+		}
+	}
+
 	const char* ls = cl.get_parameter(0, "lua-string");
 	if (ls)
 		_lua_string = ls;
@@ -22,6 +22,7 @@ struct DeviceOptions
 	const char* _map_source_dir_name;
 	DynamicString _map_source_dir_prefix;
 	DynamicString _data_dir;
+	DynamicString _cache_dir;
 	const char* _boot_dir;
 	const char* _platform;
 	DynamicString _lua_string;
@@ -30,6 +31,7 @@ struct DeviceOptions
 	bool _do_continue;
 	bool _server;
 	u32 _parent_window;
+	u32 _capture_frames;
 	u16 _console_port;
 	u16 _window_x;
 	u16 _window_y;
@@ -4,12 +4,19 @@
  */
 
 #include "core/containers/array.h"
+#include "core/error/error.h"
 #include "core/math/vector3.h"
 #include "core/memory/memory.h"
 #include "core/os.h"
-#include "core/thread/mutex.h"
 #include "device/profiler.h"
 
+#if CROWN_PLATFORM_WINDOWS
+	#ifndef WIN32_LEAN_AND_MEAN
+	#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+#endif
+
 namespace crown
 {
 namespace profiler_globals
@@ -17,69 +24,211 @@ namespace profiler_globals
 	char _mem[sizeof(Buffer)];
 	Buffer* _buffer = NULL;
 
-	void init()
+	const char* buffer()
 	{
-		_buffer = new (_mem)Buffer(default_allocator());
+		return array::begin(*_buffer);
 	}
 
-	void shutdown()
+} // namespace profiler_globals
+
+namespace profiler
+{
+	enum { THREAD_BUFFER_SIZE = 16 * 1024 };
+
+	struct ThreadBuffer
 	{
-		_buffer->~Buffer();
-		_buffer = NULL;
+		ThreadBuffer* next;
+		u32 size;
+		char data[THREAD_BUFFER_SIZE];
+	};
+
+	struct ThreadData
+	{
+		ThreadData* next;
+		ThreadBuffer* buffer;
+		u32 id;
+		u32 depth; // Number of open profile scopes
+	};
+
+	static bool _enabled = false;
+	static ThreadData* volatile _threads = NULL;    // All threads that recorded events
+	static ThreadBuffer* volatile _submitted = NULL; // Buffers waiting to be collected
+	static ThreadBuffer* volatile _free = NULL;      // Buffers already collected, ready for reuse
+	static s32 volatile _num_threads = 0;
+	static u32 _generation = 0;                      // Incremented by every profiler_globals::init()
+	static CE_THREAD ThreadData* _thread = NULL;
+	static CE_THREAD u32 _thread_generation = 0;     // Value of _generation when _thread was created
+
+	template <typename T>
+	static bool compare_and_swap(T* volatile* ptr, T* cmp, T* val)
+	{
+#if CROWN_PLATFORM_WINDOWS
+		return InterlockedCompareExchangePointer((void* volatile*)ptr, val, cmp) == cmp;
+#else
+		return __sync_bool_compare_and_swap(ptr, cmp, val);
+#endif
 	}
 
-	const char* buffer()
+	template <typename T>
+	static T* exchange(T* volatile* ptr, T* val)
 	{
-		return array::begin(*_buffer);
+#if CROWN_PLATFORM_WINDOWS
+		return (T*)InterlockedExchangePointer((void* volatile*)ptr, val);
+#else
+		return __sync_lock_test_and_set(ptr, val);
+#endif
 	}
 
-} // namespace profiler_globals
+	// Lock-free push onto an intrusive singly-linked list
+	template <typename T>
+	static void push_front(T* volatile* head, T* node)
+	{
+		T* old;
+		do
+		{
+			old = *head;
+			node->next = old;
+		}
+		while (!compare_and_swap(head, old, node));
+	}
 
-namespace profiler
-{
-	enum { THREAD_BUFFER_SIZE = 4 * 1024 };
-	static char _thread_buffer[THREAD_BUFFER_SIZE];
-	static u32 _thread_buffer_size = 0;
-	static Mutex _buffer_mutex;
+	// Lock-free push of the list from @a first to @a last
+	template <typename T>
+	static void push_front(T* volatile* head, T* first, T* last)
+	{
+		T* old;
+		do
+		{
+			old = *head;
+			last->next = old;
+		}
+		while (!compare_and_swap(head, old, first));
+	}
+
+	static ThreadBuffer* create_buffer()
+	{
+		// Pop from the free list by taking all of it at once, which is not
+		// subject to ABA, and give the remaining buffers back
+		ThreadBuffer* tb = exchange(&_free, (ThreadBuffer*)NULL);
+		if (tb != NULL)
+		{
+			if (tb->next != NULL)
+			{
+				ThreadBuffer* last = tb->next;
+				while (last->next != NULL)
+					last = last->next;
+				push_front(&_free, tb->next, last);
+			}
+		}
+		else
+		{
+			tb = CE_NEW(default_allocator(), ThreadBuffer);
+		}
+
+		tb->next = NULL;
+		tb->size = 0;
+		return tb;
+	}
+
+	static void delete_buffers(ThreadBuffer* tb)
+	{
+		while (tb != NULL)
+		{
+			ThreadBuffer* next = tb->next;
+			CE_DELETE(default_allocator(), tb);
+			tb = next;
+		}
+	}
+
+	static ThreadData* thread_data()
+	{
+		// Data created before the last profiler_globals::shutdown() has been freed
+		if (_thread == NULL || _thread_generation != _generation)
+		{
+			ThreadData* td = CE_NEW(default_allocator(), ThreadData);
+			td->buffer = create_buffer();
+			td->depth = 0;
+#if CROWN_PLATFORM_WINDOWS
+			td->id = (u32)InterlockedIncrement((LONG volatile*)&_num_threads) - 1;
+#else
+			td->id = (u32)__sync_fetch_and_add(&_num_threads, 1);
+#endif
+			push_front(&_threads, td);
+			_thread = td;
+			_thread_generation = _generation;
+		}
+
+		return _thread;
+	}
 
-	static void flush_local_buffer()
+	// Hands the current buffer of the calling thread over to the collector
+	static void submit_buffer(ThreadData& td)
 	{
-		ScopedMutex sm(_buffer_mutex);
-		array::push(*profiler_globals::_buffer, _thread_buffer, _thread_buffer_size);
-		_thread_buffer_size = 0;
+		if (td.buffer->size == 0)
+			return;
+
+		push_front(&_submitted, td.buffer);
+		td.buffer = create_buffer();
 	}
 
 	template <typename T>
-	static void push(ProfilerEventType::Enum type, const T& ev)
+	static void push(ThreadData& td, ProfilerEventType::Enum type, const T& ev)
 	{
-		if (_thread_buffer_size + 2*sizeof(u32) + sizeof(ev) >= THREAD_BUFFER_SIZE)
-			flush_local_buffer();
+		if (td.buffer->size + 2*sizeof(u32) + sizeof(ev) >= THREAD_BUFFER_SIZE)
+			submit_buffer(td);
 
-		char* p = _thread_buffer + _thread_buffer_size;
+		char* p = td.buffer->data + td.buffer->size;
 		*(u32*)p = type;
 		p += sizeof(u32);
 		*(u32*)p = sizeof(ev);
 		p += sizeof(u32);
 		*(T*)p = ev;
 
-		_thread_buffer_size += 2*sizeof(u32) + sizeof(ev);
+		td.buffer->size += 2*sizeof(u32) + sizeof(ev);
+	}
+
+	template <typename T>
+	static void push(ProfilerEventType::Enum type, const T& ev)
+	{
+		if (!_enabled)
+			return;
+
+		push(*thread_data(), type, ev);
 	}
 
 	void enter_profile_scope(const char* name)
 	{
+		if (!_enabled)
+			return;
+
+		ThreadData& td = *thread_data();
+
 		EnterProfileScope ev;
 		ev.name = name;
 		ev.time = os::clocktime();
+		ev.thread_id = td.id;
 
-		push(ProfilerEventType::ENTER_PROFILE_SCOPE, ev);
+		push(td, ProfilerEventType::ENTER_PROFILE_SCOPE, ev);
+		++td.depth;
 	}
 
 	void leave_profile_scope()
 	{
+		if (!_enabled)
+			return;
+
+		ThreadData& td = *thread_data();
+
 		LeaveProfileScope ev;
 		ev.time = os::clocktime();
+		ev.thread_id = td.id;
 
-		push(ProfilerEventType::LEAVE_PROFILE_SCOPE, ev);
+		push(td, ProfilerEventType::LEAVE_PROFILE_SCOPE, ev);
+
+		// Submit as soon as the outermost scope is closed so that the events
+		// of threads other than the main one are collected by the next flush()
+		if (td.depth > 0 && --td.depth == 0)
+			submit_buffer(td);
 	}
 
 	void record_float(const char* name, f32 value)
@@ -118,13 +267,81 @@ namespace profiler
 		push(ProfilerEventType::DEALLOCATE_MEMORY, ev);
 	}
 
+	void record_allocator(const RecordAllocator& stats)
+	{
+		push(ProfilerEventType::RECORD_ALLOCATOR, stats);
+	}
+
 } // namespace profiler
 
 namespace profiler_globals
 {
+	void init()
+	{
+		_buffer = new (_mem)Buffer(default_allocator());
+		++profiler::_generation;
+		profiler::_enabled = true;
+	}
+
+	void shutdown()
+	{
+		using namespace profiler;
+
+		_enabled = false;
+
+		delete_buffers(exchange(&_submitted, (ThreadBuffer*)NULL));
+		delete_buffers(exchange(&_free, (ThreadBuffer*)NULL));
+
+		// The data of every thread is freed here. Threads other than the
+		// calling one must have been stopped already, see profiler.h.
+		// Their stale _thread pointers are never dereferenced again because
+		// _enabled is checked first, and the next init() changes _generation.
+		ThreadData* td = exchange(&_threads, (ThreadData*)NULL);
+		while (td != NULL)
+		{
+			CE_ASSERT(td->depth == 0
+				, "Profile scopes still open in thread %u"
+				, td->id
+				);
+			ThreadData* next = td->next;
+			CE_DELETE(default_allocator(), td->buffer);
+			CE_DELETE(default_allocator(), td);
+			td = next;
+		}
+
+		_buffer->~Buffer();
+		_buffer = NULL;
+	}
+
 	void flush()
 	{
-		profiler::flush_local_buffer();
+		if (!profiler::_enabled)
+			return;
+
+		profiler::submit_buffer(*profiler::thread_data());
+
+		// Take all the submitted buffers at once and restore submission order
+		profiler::ThreadBuffer* tb = profiler::exchange(&profiler::_submitted, (profiler::ThreadBuffer*)NULL);
+		profiler::ThreadBuffer* ordered = NULL;
+		while (tb != NULL)
+		{
+			profiler::ThreadBuffer* next = tb->next;
+			tb->next = ordered;
+			ordered = tb;
+			tb = next;
+		}
+
+		profiler::ThreadBuffer* last = ordered;
+		for (tb = ordered; tb != NULL; tb = tb->next)
+		{
+			array::push(*_buffer, tb->data, tb->size);
+			last = tb;
+		}
+
+		// Make the buffers available to submit_buffer() again
+		if (ordered != NULL)
+			profiler::push_front(&profiler::_free, ordered, last);
+
 		u32 end = ProfilerEventType::COUNT;
 		array::push(*_buffer, (const char*)&end, (u32)sizeof(end));
 	}
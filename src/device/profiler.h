@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "config.h"
 #include "core/math/types.h"
 #include "core/types.h"
 
@@ -23,6 +24,7 @@ struct ProfilerEventType
 		RECORD_VECTOR3,
 		ALLOCATE_MEMORY,
 		DEALLOCATE_MEMORY,
+		RECORD_ALLOCATOR,
 
 		COUNT
 	};
@@ -44,11 +46,13 @@ struct EnterProfileScope
 {
 	const char* name;
 	s64 time;
+	u32 thread_id;
 };
 
 struct LeaveProfileScope
 {
 	s64 time;
+	u32 thread_id;
 };
 
 struct AllocateMemory
@@ -63,6 +67,16 @@ struct DeallocateMemory
 	u32 size;
 };
 
+struct RecordAllocator
+{
+	const char* name;
+	u32 num_allocations;
+	u32 allocated_size;
+	u32 peak_size;
+	u32 frame_allocations;
+	u32 frame_allocated_size;
+};
+
 /// Functions to access profiler.
 ///
 /// @ingroup Device
@@ -71,6 +85,9 @@ struct DeallocateMemory
 /// The profiler does not copy pointer data.
 /// You have to store it somewhere and make sure it is
 /// valid throughout the program execution.
+///
+/// Events are recorded into per-thread buffers without locking
+/// and collected into the global buffer by profiler_globals::flush().
 namespace profiler
 {
 	/// Starts a new profile scope with the given @a name.
@@ -91,33 +108,69 @@ namespace profiler
 	/// Records a memory deallocation of @a size with the given @a name.
 	void deallocate_memory(const char* name, u32 size);
 
+	/// Records the statistics of the allocator with the given @a name.
+	void record_allocator(const RecordAllocator& stats);
+
 } // namespace profiler
 
 namespace profiler_globals
 {
 	void init();
+
+	/// Frees the data of all the threads that recorded events.
+	/// Every thread other than the calling one must be stopped before,
+	/// and the calling thread must have closed all of its profile scopes.
 	void shutdown();
 
+	/// Returns the events collected by the last flush().
 	const char* buffer();
+
+	/// Collects the events recorded so far by all threads.
+	/// Must be called from the main thread.
 	void flush();
+
 	void clear();
 
 } // namespace profiler_globals
 
+/// Enters a profile scope when constructed and leaves it when destroyed.
+///
+/// @ingroup Device
+struct ProfileScope
+{
+	ProfileScope(const char* name)
+	{
+		profiler::enter_profile_scope(name);
+	}
+
+	~ProfileScope()
+	{
+		profiler::leave_profile_scope();
+	}
+};
+
 } // namespace crown
 
-#if CROWN_DEBUG
+#define CE_PROFILE_CONCAT_IMPL(a, b) a ## b
+#define CE_PROFILE_CONCAT(a, b) CE_PROFILE_CONCAT_IMPL(a, b)
+
+// Names must be string literals so that they need not be copied.
+#if CROWN_PROFILER
+	#define PROFILE_SCOPE(name) crown::ProfileScope CE_PROFILE_CONCAT(_profile_scope_, __LINE__)("" name)
 	#define ENTER_PROFILE_SCOPE(name) profiler::enter_profile_scope(name)
 	#define LEAVE_PROFILE_SCOPE() profiler::leave_profile_scope()
 	#define RECORD_FLOAT(name, value) profiler::record_float(name, value)
 	#define RECORD_VECTOR3(name, value) profiler::record_vector3(name, value)
 	#define ALLOCATE_MEMORY(name, size) profiler::allocate_memory(name, size)
 	#define DEALLOCATE_MEMORY(name, size) profiler::deallocate_memory(name, size)
+	#define RECORD_ALLOCATOR(stats) profiler::record_allocator(stats)
 #else
+	#define PROFILE_SCOPE(name) CE_NOOP()
 	#define ENTER_PROFILE_SCOPE(name) CE_NOOP()
 	#define LEAVE_PROFILE_SCOPE() CE_NOOP()
 	#define RECORD_FLOAT(name, value) CE_NOOP()
 	#define RECORD_VECTOR3(name, value) CE_NOOP()
 	#define ALLOCATE_MEMORY(name, size) CE_NOOP()
 	#define DEALLOCATE_MEMORY(name, size) CE_NOOP()
-#endif // CROWN_DEBUG
+	#define RECORD_ALLOCATOR(stats) CE_NOOP()
+#endif // CROWN_PROFILER
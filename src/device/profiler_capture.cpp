@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2012-2017 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/error/error.h"
+#include "core/filesystem/file.h"
+#include "core/filesystem/filesystem.h"
+#include "core/os.h"
+#include "core/strings/string.h"
+#include "core/strings/string_stream.h"
+#include "device/log.h"
+#include "device/profiler.h"
+#include "device/profiler_capture.h"
+
+namespace { const crown::log_internal::System PROFILER = { "Profiler" }; }
+
+namespace crown
+{
+namespace profiler_capture_internal
+{
+	static void write_string(StringStream& ss, const char* str)
+	{
+		ss << '"';
+		for (; *str; ++str)
+		{
+			if (*str == '"' || *str == '\\')
+				ss << '\\';
+			ss << *str;
+		}
+		ss << '"';
+	}
+
+	// JSON has no representation for infinity and NaN
+	static void write_number(StringStream& ss, f32 val)
+	{
+		ss << (val == val && val - val == 0.0f ? val : 0.0f);
+	}
+
+	static void write_header(StringStream& ss, const char* name, const char* ph, f64 ts, u32 tid)
+	{
+		ss << "{\"name\":";
+		write_string(ss, name);
+		ss << ",\"ph\":\"" << ph << "\",\"ts\":";
+		string_stream::stream_printf(ss, "%.3f", ts);
+		ss << ",\"pid\":0,\"tid\":" << tid;
+	}
+
+} // namespace profiler_capture_internal
+
+ProfilerCapture::ProfilerCapture(Allocator& a, Filesystem& fs)
+	: _filesystem(&fs)
+	, _file(NULL)
+	, _num_frames(0)
+	, _start_time(0)
+	, _last_time(0)
+	, _first_event(true)
+	, _memory(a)
+	, _ss(a)
+{
+}
+
+ProfilerCapture::~ProfilerCapture()
+{
+	stop();
+}
+
+void ProfilerCapture::start(const char* path, u32 num_frames)
+{
+	stop();
+
+	_file = _filesystem->open(path, FileOpenMode::WRITE);
+	_num_frames = num_frames;
+	_start_time = os::clocktime();
+	_last_time = _start_time;
+	_first_event = true;
+	array::clear(_memory);
+
+	const char* header = "{\"traceEvents\":[\n";
+	_file->write(header, strlen32(header));
+
+	logi(PROFILER, "Capturing %u frames to '%s'", num_frames, path);
+}
+
+void ProfilerCapture::stop()
+{
+	if (!_file)
+		return;
+
+	const char* footer = "\n]}\n";
+	_file->write(footer, strlen32(footer));
+	_file->flush();
+	_filesystem->close(*_file);
+	_file = NULL;
+	_num_frames = 0;
+
+	logi(PROFILER, "Profile capture done");
+}
+
+bool ProfilerCapture::active() const
+{
+	return _file != NULL;
+}
+
+void ProfilerCapture::update()
+{
+	using namespace profiler_capture_internal;
+
+	if (!_file)
+		return;
+
+	const f64 to_us = 1000000.0 / (f64)os::clockfrequency();
+	const char* p = profiler_globals::buffer();
+
+	array::clear(_ss);
+
+	for (;;)
+	{
+		const u32 type = *(u32*)p;
+		if (type == ProfilerEventType::COUNT)
+			break;
+
+		p += sizeof(u32);
+		const u32 size = *(u32*)p;
+		p += sizeof(u32);
+
+		if (!_first_event)
+			_ss << ",\n";
+		_first_event = false;
+
+		// Counters have no time of their own: use the time of the last scope event
+		const f64 last_ts = f64(_last_time - _start_time) * to_us;
+
+		switch (type)
+		{
+		case ProfilerEventType::ENTER_PROFILE_SCOPE:
+			{
+				const EnterProfileScope& ev = *(EnterProfileScope*)p;
+				_last_time = ev.time;
+				write_header(_ss, ev.name, "B", f64(ev.time - _start_time) * to_us, ev.thread_id);
+				_ss << '}';
+			}
+			break;
+
+		case ProfilerEventType::LEAVE_PROFILE_SCOPE:
+			{
+				const LeaveProfileScope& ev = *(LeaveProfileScope*)p;
+				_last_time = ev.time;
+				write_header(_ss, "", "E", f64(ev.time - _start_time) * to_us, ev.thread_id);
+				_ss << '}';
+			}
+			break;
+
+		case ProfilerEventType::RECORD_FLOAT:
+			{
+				const RecordFloat& ev = *(RecordFloat*)p;
+				write_header(_ss, ev.name, "C", last_ts, 0);
+				_ss << ",\"args\":{\"value\":";
+				write_number(_ss, ev.value);
+				_ss << "}}";
+			}
+			break;
+
+		case ProfilerEventType::RECORD_VECTOR3:
+			{
+				const RecordVector3& ev = *(RecordVector3*)p;
+				write_header(_ss, ev.name, "C", last_ts, 0);
+				_ss << ",\"args\":{\"x\":";
+				write_number(_ss, ev.value.x);
+				_ss << ",\"y\":";
+				write_number(_ss, ev.value.y);
+				_ss << ",\"z\":";
+				write_number(_ss, ev.value.z);
+				_ss << "}}";
+			}
+			break;
+
+		case ProfilerEventType::ALLOCATE_MEMORY:
+		case ProfilerEventType::DEALLOCATE_MEMORY:
+			{
+				// Both events share the same layout
+				const AllocateMemory& ev = *(AllocateMemory*)p;
+				const s64 delta = type == ProfilerEventType::ALLOCATE_MEMORY
+					? s64(ev.size)
+					: -s64(ev.size)
+					;
+
+				u32 i = 0;
+				for (; i < array::size(_memory); ++i)
+				{
+					if (strcmp(_memory[i].name, ev.name) == 0)
+						break;
+				}
+				if (i == array::size(_memory))
+				{
+					MemoryCounter mc;
+					mc.name = ev.name;
+					mc.size = 0;
+					array::push_back(_memory, mc);
+				}
+				_memory[i].size += delta;
+
+				write_header(_ss, ev.name, "C", last_ts, 0);
+				_ss << ",\"args\":{\"bytes\":" << _memory[i].size << "}}";
+			}
+			break;
+
+		case ProfilerEventType::RECORD_ALLOCATOR:
+			{
+				const RecordAllocator& ev = *(RecordAllocator*)p;
+				write_header(_ss, ev.name, "C", last_ts, 0);
+				_ss << ",\"args\":{\"bytes\":" << ev.allocated_size
+					<< ",\"peak\":" << ev.peak_size
+					<< ",\"frame_bytes\":" << ev.frame_allocated_size
+					<< ",\"allocations\":" << ev.num_allocations
+					<< ",\"frame_allocations\":" << ev.frame_allocations
+					<< "}}"
+					;
+			}
+			break;
+
+		default:
+			CE_FATAL("Unknown profiler event type");
+			break;
+		}
+
+		p += size;
+	}
+
+	_file->write(array::begin(_ss), array::size(_ss));
+
+	if (--_num_frames == 0)
+		stop();
+}
+
+} // namespace crown
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2012-2017 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/filesystem/types.h"
+#include "core/memory/types.h"
+#include "core/strings/types.h"
+#include "core/types.h"
+
+namespace crown
+{
+/// Writes the profiler events of a number of frames to a file
+/// in the Chrome Trace Event format.
+/// The file can be opened with chrome://tracing or Perfetto UI.
+///
+/// @ingroup Device
+struct ProfilerCapture
+{
+	struct MemoryCounter
+	{
+		const char* name;
+		s64 size;
+	};
+
+	Filesystem* _filesystem;
+	File* _file;
+	u32 _num_frames;
+	s64 _start_time;
+	s64 _last_time;
+	bool _first_event;
+	Array<MemoryCounter> _memory;
+	StringStream _ss;
+
+	ProfilerCapture(Allocator& a, Filesystem& fs);
+	~ProfilerCapture();
+
+	/// Starts capturing the next @a num_frames frames to @a path.
+	/// A capture in progress is stopped first.
+	void start(const char* path, u32 num_frames);
+
+	/// Stops capturing and closes the file.
+	void stop();
+
+	/// Returns whether a capture is in progress.
+	bool active() const;
+
+	/// Writes the events collected by the last profiler_globals::flush().
+	void update();
+
+private:
+
+	// Disable copying
+	ProfilerCapture(const ProfilerCapture&);
+	ProfilerCapture& operator=(const ProfilerCapture&);
+};
+
+} // namespace crown
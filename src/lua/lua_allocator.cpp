@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2012-2017 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/error/error.h"
+#include "core/memory/memory.h"
+#include "lua/lua_allocator.h"
+#include <string.h> // memcpy
+
+#define LUA_ALLOCATOR_ALIGN 16
+#define LUA_ALLOCATOR_MAX_SIZE 256
+#define LUA_ALLOCATOR_POOL_SIZE (512*1024)
+
+namespace crown
+{
+namespace lua_allocator_internal
+{
+#if CROWN_ARCH_32BIT
+	static const u32 s_class_size[LUA_ALLOCATOR_NUM_CLASSES] = { 16, 32, 48, 64, 96, 128, 192, 256 };
+
+	// Maps (size + 15) / 16 to its size class
+	static const u8 s_class_index[LUA_ALLOCATOR_MAX_SIZE/16 + 1] =
+	{
+		0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7
+	};
+
+	inline u32 size_class(u32 size)
+	{
+		return size <= LUA_ALLOCATOR_MAX_SIZE
+			? s_class_index[(size + 15) / 16]
+			: UINT32_MAX
+			;
+	}
+
+	static void* allocate(void* ud, void* ptr, size_t osize, size_t nsize)
+	{
+		LuaAllocator& la = *(LuaAllocator*)ud;
+
+		if (nsize == 0)
+		{
+			la.deallocate(ptr, (u32)osize);
+			return NULL;
+		}
+
+		// Blocks of the same size class can be reused as they are
+		const u32 nclass = size_class((u32)nsize);
+		if (ptr != NULL && nclass != UINT32_MAX && nclass == size_class((u32)osize))
+		{
+			la._proxy.record_deallocate((u32)osize);
+			la._proxy.record_allocate((u32)nsize);
+			return ptr;
+		}
+
+		void* p = la.allocate((u32)nsize);
+		if (ptr != NULL)
+		{
+			memcpy(p, ptr, osize < nsize ? osize : nsize);
+			la.deallocate(ptr, (u32)osize);
+		}
+		return p;
+	}
+
+	static int panic(lua_State* L)
+	{
+		CE_FATAL("PANIC: unprotected error in call to Lua API (%s)", lua_tostring(L, -1));
+		CE_UNUSED(L);
+		return 0;
+	}
+#else
+	// Forwards to LuaJIT's own allocator and keeps track of the memory usage
+	static void* allocate_forward(void* ud, void* ptr, size_t osize, size_t nsize)
+	{
+		LuaAllocator& la = *(LuaAllocator*)ud;
+		void* p = la._lua_alloc(la._lua_ud, ptr, osize, nsize);
+
+		if (p != NULL || nsize == 0)
+		{
+			if (ptr != NULL)
+				la._proxy.record_deallocate((u32)osize);
+			if (nsize != 0)
+				la._proxy.record_allocate((u32)nsize);
+		}
+
+		return p;
+	}
+#endif // CROWN_ARCH_32BIT
+
+} // namespace lua_allocator_internal
+
+LuaAllocator::LuaAllocator(Allocator& a)
+	: _backing(&a)
+	, _proxy(a, "lua")
+	, _lua_alloc(NULL)
+	, _lua_ud(NULL)
+{
+	memset(_pool, 0, sizeof(_pool));
+
+#if CROWN_ARCH_32BIT
+	for (u32 i = 0; i < LUA_ALLOCATOR_NUM_CLASSES; ++i)
+	{
+		const u32 size = lua_allocator_internal::s_class_size[i];
+		_pool[i] = CE_NEW(a, PoolAllocator)(a
+			, LUA_ALLOCATOR_POOL_SIZE / size
+			, size
+			, LUA_ALLOCATOR_ALIGN
+			);
+	}
+#endif // CROWN_ARCH_32BIT
+}
+
+LuaAllocator::~LuaAllocator()
+{
+	for (u32 i = 0; i < LUA_ALLOCATOR_NUM_CLASSES; ++i)
+		CE_DELETE(*_backing, _pool[i]);
+}
+
+lua_State* LuaAllocator::new_state()
+{
+#if CROWN_ARCH_64BIT
+	lua_State* L = luaL_newstate();
+	_lua_alloc = lua_getallocf(L, &_lua_ud);
+	// Account the memory allocated by luaL_newstate() as a single block
+	_proxy.record_allocate(u32(lua_gc(L, LUA_GCCOUNT, 0))*1024 + u32(lua_gc(L, LUA_GCCOUNTB, 0)));
+	lua_setallocf(L, lua_allocator_internal::allocate_forward, this);
+#else
+	lua_State* L = lua_newstate(lua_allocator_internal::allocate, this);
+	lua_atpanic(L, lua_allocator_internal::panic);
+#endif // CROWN_ARCH_64BIT
+	return L;
+}
+
+void LuaAllocator::close_state(lua_State* L)
+{
+#if CROWN_ARCH_64BIT
+	// Let LuaJIT release its own memory
+	lua_setallocf(L, _lua_alloc, _lua_ud);
+#endif // CROWN_ARCH_64BIT
+	lua_close(L);
+}
+
+#if CROWN_ARCH_32BIT
+void* LuaAllocator::allocate(u32 size)
+{
+	_proxy.record_allocate(size);
+
+	const u32 i = lua_allocator_internal::size_class(size);
+	if (i == UINT32_MAX)
+		return _backing->allocate(size, LUA_ALLOCATOR_ALIGN);
+
+	// Blocks are always as big as their size class, even when the pool is full
+	const u32 class_size = lua_allocator_internal::s_class_size[i];
+	return _pool[i]->full()
+		? _backing->allocate(class_size, LUA_ALLOCATOR_ALIGN)
+		: _pool[i]->allocate(class_size, LUA_ALLOCATOR_ALIGN)
+		;
+}
+
+void LuaAllocator::deallocate(void* data, u32 size)
+{
+	if (data == NULL)
+		return;
+
+	_proxy.record_deallocate(size);
+
+	const u32 i = lua_allocator_internal::size_class(size);
+	if (i != UINT32_MAX && _pool[i]->owns(data))
+		_pool[i]->deallocate(data);
+	else
+		_backing->deallocate(data);
+}
+#endif // CROWN_ARCH_32BIT
+
+} // namespace crown
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2012-2017 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/memory/pool_allocator.h"
+#include "core/memory/proxy_allocator.h"
+#include "core/platform.h"
+#include "core/types.h"
+#include <lua.hpp>
+
+#define LUA_ALLOCATOR_NUM_CLASSES 8
+
+namespace crown
+{
+/// Allocates the memory used by a Lua state.
+/// Small blocks such as strings, tables and closures are served from
+/// one pool per size class, bigger blocks come from the backing allocator.
+/// The memory in use is accounted to a proxy allocator named "lua".
+///
+/// @note
+/// LuaJIT requires its memory to be in the lowest 2GB of the address space
+/// on 64-bit targets and manages it by itself. There, the allocator only
+/// accounts the memory allocated by LuaJIT.
+///
+/// @ingroup Lua
+struct LuaAllocator
+{
+	Allocator* _backing;
+	ProxyAllocator _proxy;
+	PoolAllocator* _pool[LUA_ALLOCATOR_NUM_CLASSES];
+	lua_Alloc _lua_alloc;
+	void* _lua_ud;
+
+	/// Uses @a a to allocate the pools and the blocks that do not fit them.
+	LuaAllocator(Allocator& a);
+	~LuaAllocator();
+
+	/// Returns a new Lua state whose memory is managed by this allocator.
+	lua_State* new_state();
+
+	/// Closes the Lua state @a L created with new_state().
+	void close_state(lua_State* L);
+
+#if CROWN_ARCH_32BIT
+	/// Allocates @a size bytes.
+	void* allocate(u32 size);
+
+	/// Deallocates @a data of @a size bytes.
+	void deallocate(void* data, u32 size);
+#endif // CROWN_ARCH_32BIT
+
+private:
+
+	// Disable copying
+	LuaAllocator(const LuaAllocator&);
+	LuaAllocator& operator=(const LuaAllocator&);
+};
+
+} // namespace crown
@@ -5,6 +5,7 @@
 
 #include "core/guid.h"
 #include "core/math/color4.h"
+#include "core/math/frustum.h"
 #include "core/math/intersection.h"
 #include "core/math/math.h"
 #include "core/math/matrix4x4.h"
@@ -982,74 +983,6 @@ static int color4_orange(lua_State* L)
 	return 1;
 }
 
-static int lightuserdata_add(lua_State* L)
-{
-	LuaStack stack(L);
-	const Vector3& a = stack.get_vector3(1);
-	const Vector3& b = stack.get_vector3(2);
-	stack.push_vector3(a + b);
-	return 1;
-}
-
-static int lightuserdata_sub(lua_State* L)
-{
-	LuaStack stack(L);
-	const Vector3& a = stack.get_vector3(1);
-	const Vector3& b = stack.get_vector3(2);
-	stack.push_vector3(a - b);
-	return 1;
-}
-
-static int lightuserdata_mul(lua_State* L)
-{
-	LuaStack stack(L);
-	const int i = stack.is_number(1) ? 1 : 2;
-	stack.push_vector3(stack.get_float(i) * stack.get_vector3(3-i));
-	return 1;
-}
-
-static int lightuserdata_unm(lua_State* L)
-{
-	LuaStack stack(L);
-	stack.push_vector3(-stack.get_vector3(1));
-	return 1;
-}
-
-static int lightuserdata_index(lua_State* L)
-{
-	LuaStack stack(L);
-	Vector3& v = stack.get_vector3(1);
-	const char* s = stack.get_string(2);
-
-	switch (s[0])
-	{
-	case 'x': stack.push_float(v.x); return 1;
-	case 'y': stack.push_float(v.y); return 1;
-	case 'z': stack.push_float(v.z); return 1;
-	default: LUA_ASSERT(false, stack, "Bad index: '%c'", s[0]); break;
-	}
-
-	return 0;
-}
-
-static int lightuserdata_newindex(lua_State* L)
-{
-	LuaStack stack(L);
-	Vector3& v = stack.get_vector3(1);
-	const char* s = stack.get_string(2);
-	const f32 value = stack.get_float(3);
-
-	switch (s[0])
-	{
-	case 'x': v.x = value; break;
-	case 'y': v.y = value; break;
-	case 'z': v.z = value; break;
-	default: LUA_ASSERT(false, stack, "Bad index: '%c'", s[0]); break;
-	}
-
-	return 0;
-}
-
 static int input_device_name(lua_State* L, InputDevice& dev)
 {
 	LuaStack stack(L);
@@ -1892,6 +1825,8 @@ static int render_world_sprite_create(lua_State* L)
 	SpriteRendererDesc desc;
 	desc.sprite_resource = stack.get_resource_id(3);
 	desc.material_resource = stack.get_resource_id(4);
+	desc.layer = 0;
+	desc.depth = 0;
 	desc.visible = stack.get_bool(5);
 
 	Matrix4x4 pose = stack.get_matrix4x4(6);
@@ -1947,6 +1882,24 @@ static int render_world_sprite_flip_y(lua_State* L)
 	return 0;
 }
 
+static int render_world_sprite_set_layer(lua_State* L)
+{
+	LuaStack stack(L);
+	const int layer = stack.get_int(3);
+	LUA_ASSERT(layer >= 0 && layer < CROWN_MAX_SPRITE_LAYERS, stack, "Layer out of bounds: %d", layer);
+	stack.get_render_world(1)->sprite_set_layer(stack.get_unit(2), layer);
+	return 0;
+}
+
+static int render_world_sprite_set_depth(lua_State* L)
+{
+	LuaStack stack(L);
+	const int depth = stack.get_int(3);
+	LUA_ASSERT(depth >= 0 && depth <= CROWN_MAX_SPRITE_DEPTH, stack, "Depth out of bounds: %d", depth);
+	stack.get_render_world(1)->sprite_set_depth(stack.get_unit(2), depth);
+	return 0;
+}
+
 static int render_world_sprite_obb(lua_State* L)
 {
 	LuaStack stack(L);
@@ -2093,6 +2046,85 @@ static int render_world_light_debug_draw(lua_State* L)
 	return 0;
 }
 
+static int render_world_raycast(lua_State* L)
+{
+	LuaStack stack(L);
+
+	TempAllocator1024 ta;
+	Array<UnitId> units(ta);
+	Array<f32> distances(ta);
+	stack.get_render_world(1)->raycast(stack.get_vector3(2), stack.get_vector3(3), units, distances);
+
+	const u32 num = array::size(units);
+
+	stack.push_table(num);
+	for (u32 i = 0; i < num; ++i)
+	{
+		stack.push_key_begin(i+1);
+		stack.push_unit(units[i]);
+		stack.push_key_end();
+	}
+
+	stack.push_table(num);
+	for (u32 i = 0; i < num; ++i)
+	{
+		stack.push_key_begin(i+1);
+		stack.push_float(distances[i]);
+		stack.push_key_end();
+	}
+
+	return 2;
+}
+
+static int render_world_query_frustum(lua_State* L)
+{
+	LuaStack stack(L);
+
+	Frustum f;
+	frustum::from_matrix(f, stack.get_matrix4x4(2) * stack.get_matrix4x4(3));
+
+	TempAllocator1024 ta;
+	Array<UnitId> units(ta);
+	stack.get_render_world(1)->query_frustum(f, units);
+
+	const u32 num = array::size(units);
+
+	stack.push_table(num);
+	for (u32 i = 0; i < num; ++i)
+	{
+		stack.push_key_begin(i+1);
+		stack.push_unit(units[i]);
+		stack.push_key_end();
+	}
+
+	return 1;
+}
+
+static int render_world_query_sphere(lua_State* L)
+{
+	LuaStack stack(L);
+
+	Sphere s;
+	s.c = stack.get_vector3(2);
+	s.r = stack.get_float(3);
+
+	TempAllocator1024 ta;
+	Array<UnitId> units(ta);
+	stack.get_render_world(1)->query_sphere(s, units);
+
+	const u32 num = array::size(units);
+
+	stack.push_table(num);
+	for (u32 i = 0; i < num; ++i)
+	{
+		stack.push_key_begin(i+1);
+		stack.push_unit(units[i]);
+		stack.push_key_end();
+	}
+
+	return 1;
+}
+
 static int render_world_enable_debug_drawing(lua_State* L)
 {
 	LuaStack stack(L);
@@ -2738,27 +2770,6 @@ static int device_enable_resource_autoload(lua_State* L)
 	return 0;
 }
 
-static int device_temp_count(lua_State* L)
-{
-	LuaStack stack(L);
-	u32 nv, nq, nm;
-	device()->_lua_environment->temp_count(nv, nq, nm);
-	stack.push_int(nv);
-	stack.push_int(nq);
-	stack.push_int(nm);
-	return 3;
-}
-
-static int device_set_temp_count(lua_State* L)
-{
-	LuaStack stack(L);
-	u32 nv = stack.get_int(1);
-	u32 nq = stack.get_int(2);
-	u32 nm = stack.get_int(3);
-	device()->_lua_environment->set_temp_count(nv, nq, nm);
-	return 0;
-}
-
 static int device_guid(lua_State* L)
 {
 	LuaStack stack(L);
@@ -3283,13 +3294,6 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("Color4", "to_string", quaternion_to_string);
 	env.add_module_metafunction("Color4", "__call", color4_ctor);
 
-	env.add_module_metafunction("Lightuserdata_mt", "__add",      lightuserdata_add);
-	env.add_module_metafunction("Lightuserdata_mt", "__sub",      lightuserdata_sub);
-	env.add_module_metafunction("Lightuserdata_mt", "__mul",      lightuserdata_mul);
-	env.add_module_metafunction("Lightuserdata_mt", "__unm",      lightuserdata_unm);
-	env.add_module_metafunction("Lightuserdata_mt", "__index",    lightuserdata_index);
-	env.add_module_metafunction("Lightuserdata_mt", "__newindex", lightuserdata_newindex);
-
 	env.add_module_function("Keyboard", "name",         keyboard_name);
 	env.add_module_function("Keyboard", "connected",    keyboard_connected);
 	env.add_module_function("Keyboard", "num_buttons",  keyboard_num_buttons);
@@ -3458,6 +3462,8 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("RenderWorld", "sprite_set_visible",   render_world_sprite_set_visible);
 	env.add_module_function("RenderWorld", "sprite_flip_x",        render_world_sprite_flip_x);
 	env.add_module_function("RenderWorld", "sprite_flip_y",        render_world_sprite_flip_y);
+	env.add_module_function("RenderWorld", "sprite_set_layer",     render_world_sprite_set_layer);
+	env.add_module_function("RenderWorld", "sprite_set_depth",     render_world_sprite_set_depth);
 	env.add_module_function("RenderWorld", "sprite_obb",           render_world_sprite_obb);
 	env.add_module_function("RenderWorld", "sprite_raycast",       render_world_sprite_raycast);
 	env.add_module_function("RenderWorld", "light_create",         render_world_light_create);
@@ -3474,6 +3480,9 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("RenderWorld", "light_set_intensity",  render_world_light_set_intensity);
 	env.add_module_function("RenderWorld", "light_set_spot_angle", render_world_light_set_spot_angle);
 	env.add_module_function("RenderWorld", "light_debug_draw",     render_world_light_debug_draw);
+	env.add_module_function("RenderWorld", "raycast",              render_world_raycast);
+	env.add_module_function("RenderWorld", "query_frustum",        render_world_query_frustum);
+	env.add_module_function("RenderWorld", "query_sphere",         render_world_query_sphere);
 	env.add_module_function("RenderWorld", "enable_debug_drawing", render_world_enable_debug_drawing);
 
 	env.add_module_function("PhysicsWorld", "actor_instances",               physics_world_actor_instances);
@@ -3544,8 +3553,6 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("Device", "console_send",             device_console_send);
 	env.add_module_function("Device", "can_get",                  device_can_get);
 	env.add_module_function("Device", "enable_resource_autoload", device_enable_resource_autoload);
-	env.add_module_function("Device", "temp_count",               device_temp_count);
-	env.add_module_function("Device", "set_temp_count",           device_set_temp_count);
 	env.add_module_function("Device", "guid",                     device_guid);
 
 	env.add_module_function("Profiler", "enter_scope", profiler_enter_scope);
@@ -5,6 +5,7 @@
 
 #include "config.h"
 #include "core/error/error.h"
+#include "core/os.h"
 #include "device/device.h"
 #include "device/log.h"
 #include "lua/lua_environment.h"
@@ -13,11 +14,16 @@
 #include "resource/resource_manager.h"
 #include <stdarg.h>
 
+// The heap may grow up to this many times its size at the end of the last
+// collection cycle before garbage collection exceeds its budget
+#define LUA_GC_CEILING_FACTOR 2
+
 namespace { const crown::log_internal::System LUA = { "Lua" }; }
 
 namespace crown
 {
 extern void load_api(LuaEnvironment& env);
+extern void load_ffi(LuaEnvironment& env);
 
 // When an error occurs, logs the error message and pauses the engine.
 static int error_handler(lua_State* L)
@@ -57,19 +63,25 @@ static int require(lua_State* L)
 	return 1;
 }
 
-LuaEnvironment::LuaEnvironment()
-	: L(NULL)
-	, _vec3_used(0)
-	, _quat_used(0)
-	, _mat4_used(0)
+LuaEnvironment::LuaEnvironment(Allocator& a)
+	: _allocator(a)
+	, L(NULL)
+	, _vec3_ctor(LUA_NOREF)
+	, _quat_ctor(LUA_NOREF)
+	, _mat4_ctor(LUA_NOREF)
+	, _vec3_ctype(0)
+	, _quat_ctype(0)
+	, _mat4_ctype(0)
+	, _gc_budget(-1.0f)
+	, _gc_ceiling(0)
 {
-	L = luaL_newstate();
+	L = _allocator.new_state();
 	CE_ASSERT(L, "Unable to create lua state");
 }
 
 LuaEnvironment::~LuaEnvironment()
 {
-	lua_close(L);
+	_allocator.close_state(L);
 }
 
 void LuaEnvironment::load_libs()
@@ -81,6 +93,7 @@ void LuaEnvironment::load_libs()
 
 	// Register crown libraries
 	load_api(*this);
+	load_ffi(*this);
 
 	// Register custom loader
 	lua_getfield(L, LUA_GLOBALSINDEX, "package");
@@ -99,12 +112,6 @@ void LuaEnvironment::load_libs()
 	lua_rawset(L, -3);
 	lua_pop(L, 1);
 
-	// Create metatable for lightuserdata
-	lua_pushlightuserdata(L, 0);
-	lua_getfield(L, LUA_REGISTRYINDEX, "Lightuserdata_mt");
-	lua_setmetatable(L, -2);
-	lua_pop(L, 1);
-
 	// Ensure stack is clean
 	CE_ASSERT(lua_gettop(L) == 0, "Stack not clean");
 
@@ -230,61 +237,40 @@ LuaStack LuaEnvironment::get_global(const char* global)
 	return stack;
 }
 
-Vector3* LuaEnvironment::next_vector3(const Vector3& v)
+void LuaEnvironment::set_gc_budget(f32 budget)
 {
-	CE_ASSERT(_vec3_used < CROWN_MAX_LUA_VECTOR3, "Maximum number of Vector3 reached");
-	return &(_vec3_buffer[_vec3_used++] = v);
+	_gc_budget = budget;
+	_gc_ceiling = memory_used()*LUA_GC_CEILING_FACTOR;
+	lua_gc(L, budget < 0.0f ? LUA_GCRESTART : LUA_GCSTOP, 0);
 }
 
-Quaternion* LuaEnvironment::next_quaternion(const Quaternion& q)
+void LuaEnvironment::collect_garbage()
 {
-	CE_ASSERT(_quat_used < CROWN_MAX_LUA_QUATERNION, "Maximum number of Quaternion reached");
-	return &(_quat_buffer[_quat_used++] = q);
-}
+	if (_gc_budget < 0.0f)
+		return;
 
-Matrix4x4* LuaEnvironment::next_matrix4x4(const Matrix4x4& m)
-{
-	CE_ASSERT(_mat4_used < CROWN_MAX_LUA_MATRIX4X4, "Maximum number of Matrix4x4 reached");
-	return &(_mat4_buffer[_mat4_used++] = m);
-}
-
-bool LuaEnvironment::is_vector3(const Vector3* p) const
-{
-	return p >= &_vec3_buffer[0]
-		&& p <= &_vec3_buffer[CROWN_MAX_LUA_VECTOR3 - 1];
-}
+	const s64 end = os::clocktime() + s64(_gc_budget * 0.001 * os::clockfrequency());
 
-bool LuaEnvironment::is_quaternion(const Quaternion* p) const
-{
-	return p >= &_quat_buffer[0]
-		&& p <= &_quat_buffer[CROWN_MAX_LUA_QUATERNION - 1];
-}
+	// Stop at the end of a cycle so that tiny heaps do not spin the whole budget
+	bool cycle_done = false;
+	while (!cycle_done && os::clocktime() < end)
+		cycle_done = lua_gc(L, LUA_GCSTEP, 0) == 1;
 
-bool LuaEnvironment::is_matrix4x4(const Matrix4x4* p) const
-{
-	return p >= &_mat4_buffer[0]
-		&& p <= &_mat4_buffer[CROWN_MAX_LUA_MATRIX4X4 - 1];
-}
+	// Allocation outpaces the budget: finish the cycle regardless of it
+	// so that the heap cannot grow without limit
+	while (!cycle_done && memory_used() > _gc_ceiling)
+		cycle_done = lua_gc(L, LUA_GCSTEP, 0) == 1;
 
-void LuaEnvironment::temp_count(u32& num_vec3, u32& num_quat, u32& num_mat4)
-{
-	num_vec3 = _vec3_used;
-	num_quat = _quat_used;
-	num_mat4 = _mat4_used;
-}
+	if (cycle_done)
+		_gc_ceiling = memory_used()*LUA_GC_CEILING_FACTOR;
 
-void LuaEnvironment::set_temp_count(u32 num_vec3, u32 num_quat, u32 num_mat4)
-{
-	_vec3_used = num_vec3;
-	_quat_used = num_quat;
-	_mat4_used = num_mat4;
+	// Stepping re-arms the automatic collector
+	lua_gc(L, LUA_GCSTOP, 0);
 }
 
-void LuaEnvironment::reset_temporaries()
+u32 LuaEnvironment::memory_used()
 {
-	_vec3_used = 0;
-	_quat_used = 0;
-	_mat4_used = 0;
+	return u32(lua_gc(L, LUA_GCCOUNT, 0))*1024 + u32(lua_gc(L, LUA_GCCOUNTB, 0));
 }
 
 } // namespace crown
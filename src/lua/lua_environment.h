@@ -8,6 +8,7 @@
 #include "config.h"
 #include "core/math/types.h"
 #include "core/types.h"
+#include "lua/lua_allocator.h"
 #include "lua/lua_stack.h"
 #include "resource/types.h"
 #include <lua.hpp>
@@ -24,16 +25,20 @@ enum LuaArgumentType
 /// @ingroup Lua
 struct LuaEnvironment
 {
+	LuaAllocator _allocator;
 	lua_State* L;
 
-	u32 _vec3_used;
-	Vector3 _vec3_buffer[CROWN_MAX_LUA_VECTOR3];
-	u32 _quat_used;
-	Quaternion _quat_buffer[CROWN_MAX_LUA_QUATERNION];
-	u32 _mat4_used;
-	Matrix4x4 _mat4_buffer[CROWN_MAX_LUA_MATRIX4X4];
-
-	LuaEnvironment();
+	int _vec3_ctor;
+	int _quat_ctor;
+	int _mat4_ctor;
+	u32 _vec3_ctype;
+	u32 _quat_ctype;
+	u32 _mat4_ctype;
+	f32 _gc_budget;
+	u32 _gc_ceiling;
+
+	/// Uses @a a to allocate the memory used by Lua.
+	LuaEnvironment(Allocator& a);
 	~LuaEnvironment();
 
 	/// Loads lua libraries.
@@ -62,32 +67,18 @@ struct LuaEnvironment
 
 	LuaStack get_global(const char* global);
 
-	/// Returns the number of temporary objects in use.
-	void temp_count(u32& num_vec3, u32& num_quat, u32& num_mat4);
-
-	/// Sets the number of temporary objects in use.
-	void set_temp_count(u32 num_vec3, u32 num_quat, u32 num_mat4);
-
-	/// Resets temporary types.
-	void reset_temporaries();
-
-	/// Returns a new temporary Vector3.
-	Vector3* next_vector3(const Vector3& v);
-
-	/// Returns a new temporary Quaternion.
-	Quaternion* next_quaternion(const Quaternion& q);
-
-	/// Returns a new temporary Matrix4x4.
-	Matrix4x4* next_matrix4x4(const Matrix4x4& m);
-
-	/// Returns whether @a p is a temporary Vector3.
-	bool is_vector3(const Vector3* p) const;
+	/// Replaces automatic garbage collection with incremental steps
+	/// that last at most @a budget milliseconds per call to collect_garbage().
+	/// The budget is exceeded only when the heap grows past twice the size
+	/// it had at the end of the last collection cycle.
+	/// A negative @a budget restores automatic garbage collection.
+	void set_gc_budget(f32 budget);
 
-	/// Returns whether @a p is a temporary Quaternion.
-	bool is_quaternion(const Quaternion* p) const;
+	/// Performs garbage collection steps within the budget set with set_gc_budget().
+	void collect_garbage();
 
-	/// Returns whether @a p is a temporary Matrix4x4.
-	bool is_matrix4x4(const Matrix4x4* p) const;
+	/// Returns the amount of memory in use by Lua in bytes.
+	u32 memory_used();
 
 private:
 
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2012-2017 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/error/error.h"
+#include "core/math/matrix4x4.h"
+#include "core/math/quaternion.h"
+#include "core/math/vector3.h"
+#include "lua/lua_environment.h"
+#include "lua/lua_stack.h"
+#include "world/physics_world.h"
+#include "world/render_world.h"
+#include "world/scene_graph.h"
+
+#if CROWN_PLATFORM_WINDOWS
+	#define CE_FFI_EXPORT extern "C" __declspec(dllexport)
+#else
+	#define CE_FFI_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+namespace crown
+{
+namespace lua_ffi
+{
+	// Units are passed as the lightuserdata pushed by LuaStack::push_unit().
+	inline UnitId unit(const void* p)
+	{
+		const u32 enc = (u32)(uintptr_t)p;
+		CE_ASSERT((enc & LIGHTDATA_TYPE_MASK) == UNIT_MARKER, "Not a UnitId");
+		UnitId id;
+		id._idx = enc >> 2;
+		return id;
+	}
+
+	inline SceneGraph* scene_graph(SceneGraph* sg, const void* u)
+	{
+		CE_ASSERT(*(u32*)sg == SCENE_GRAPH_MARKER, "Not a SceneGraph");
+		CE_ASSERT(sg->has(unit(u)), "Unit does not have transform");
+		CE_UNUSED(u);
+		return sg;
+	}
+
+	inline PhysicsWorld* physics_world(PhysicsWorld* pw)
+	{
+		CE_ASSERT(*(u32*)pw == PHYSICS_WORLD_MARKER, "Not a PhysicsWorld");
+		return pw;
+	}
+
+	inline RenderWorld* render_world(RenderWorld* rw)
+	{
+		CE_ASSERT(*(u32*)rw == RENDER_WORLD_MARKER, "Not a RenderWorld");
+		return rw;
+	}
+
+} // namespace lua_ffi
+
+} // namespace crown
+
+using namespace crown;
+
+// Functions below are called directly from Lua through ffi.C.
+// Structs are never passed by value since LuaJIT does not compile such calls.
+CE_FFI_EXPORT void crown_scene_graph_local_position(SceneGraph* sg, const void* unit, Vector3* out)
+{
+	*out = lua_ffi::scene_graph(sg, unit)->local_position(lua_ffi::unit(unit));
+}
+
+CE_FFI_EXPORT void crown_scene_graph_local_rotation(SceneGraph* sg, const void* unit, Quaternion* out)
+{
+	*out = lua_ffi::scene_graph(sg, unit)->local_rotation(lua_ffi::unit(unit));
+}
+
+CE_FFI_EXPORT void crown_scene_graph_local_scale(SceneGraph* sg, const void* unit, Vector3* out)
+{
+	*out = lua_ffi::scene_graph(sg, unit)->local_scale(lua_ffi::unit(unit));
+}
+
+CE_FFI_EXPORT void crown_scene_graph_local_pose(SceneGraph* sg, const void* unit, Matrix4x4* out)
+{
+	*out = lua_ffi::scene_graph(sg, unit)->local_pose(lua_ffi::unit(unit));
+}
+
+CE_FFI_EXPORT void crown_scene_graph_world_position(SceneGraph* sg, const void* unit, Vector3* out)
+{
+	*out = lua_ffi::scene_graph(sg, unit)->world_position(lua_ffi::unit(unit));
+}
+
+CE_FFI_EXPORT void crown_scene_graph_world_rotation(SceneGraph* sg, const void* unit, Quaternion* out)
+{
+	*out = lua_ffi::scene_graph(sg, unit)->world_rotation(lua_ffi::unit(unit));
+}
+
+CE_FFI_EXPORT void crown_scene_graph_world_pose(SceneGraph* sg, const void* unit, Matrix4x4* out)
+{
+	*out = lua_ffi::scene_graph(sg, unit)->world_pose(lua_ffi::unit(unit));
+}
+
+CE_FFI_EXPORT void crown_scene_graph_set_local_position(SceneGraph* sg, const void* unit, const Vector3* pos)
+{
+	lua_ffi::scene_graph(sg, unit)->set_local_position(lua_ffi::unit(unit), *pos);
+}
+
+CE_FFI_EXPORT void crown_scene_graph_set_local_rotation(SceneGraph* sg, const void* unit, const Quaternion* rot)
+{
+	lua_ffi::scene_graph(sg, unit)->set_local_rotation(lua_ffi::unit(unit), *rot);
+}
+
+CE_FFI_EXPORT void crown_scene_graph_set_local_scale(SceneGraph* sg, const void* unit, const Vector3* scale)
+{
+	lua_ffi::scene_graph(sg, unit)->set_local_scale(lua_ffi::unit(unit), *scale);
+}
+
+CE_FFI_EXPORT void crown_scene_graph_set_local_pose(SceneGraph* sg, const void* unit, const Matrix4x4* pose)
+{
+	lua_ffi::scene_graph(sg, unit)->set_local_pose(lua_ffi::unit(unit), *pose);
+}
+
+CE_FFI_EXPORT void crown_physics_world_actor_linear_velocity(PhysicsWorld* pw, u32 actor, Vector3* out)
+{
+	ActorInstance inst = { actor };
+	*out = lua_ffi::physics_world(pw)->actor_linear_velocity(inst);
+}
+
+CE_FFI_EXPORT void crown_physics_world_actor_set_linear_velocity(PhysicsWorld* pw, u32 actor, const Vector3* vel)
+{
+	ActorInstance inst = { actor };
+	lua_ffi::physics_world(pw)->actor_set_linear_velocity(inst, *vel);
+}
+
+CE_FFI_EXPORT void crown_physics_world_actor_angular_velocity(PhysicsWorld* pw, u32 actor, Vector3* out)
+{
+	ActorInstance inst = { actor };
+	*out = lua_ffi::physics_world(pw)->actor_angular_velocity(inst);
+}
+
+CE_FFI_EXPORT void crown_physics_world_actor_set_angular_velocity(PhysicsWorld* pw, u32 actor, const Vector3* vel)
+{
+	ActorInstance inst = { actor };
+	lua_ffi::physics_world(pw)->actor_set_angular_velocity(inst, *vel);
+}
+
+CE_FFI_EXPORT void crown_render_world_mesh_set_visible(RenderWorld* rw, u32 mesh, bool visible)
+{
+	MeshInstance inst = { mesh };
+	lua_ffi::render_world(rw)->mesh_set_visible(inst, visible);
+}
+
+CE_FFI_EXPORT void crown_render_world_sprite_set_visible(RenderWorld* rw, const void* unit, bool visible)
+{
+	lua_ffi::render_world(rw)->sprite_set_visible(lua_ffi::unit(unit), visible);
+}
+
+CE_FFI_EXPORT void crown_matrix4x4_multiply(const Matrix4x4* a, const Matrix4x4* b, Matrix4x4* out)
+{
+	*out = *a * *b;
+}
+
+CE_FFI_EXPORT void crown_matrix4x4_invert(Matrix4x4* m, Matrix4x4* out)
+{
+	*out = invert(*m);
+}
+
+CE_FFI_EXPORT void crown_matrix4x4_transform(const Matrix4x4* m, const Vector3* v, Vector3* out)
+{
+	*out = *v * *m;
+}
+
+CE_FFI_EXPORT void crown_quaternion_multiply(const Quaternion* a, const Quaternion* b, Quaternion* out)
+{
+	*out = *a * *b;
+}
+
+namespace crown
+{
+// Declares the math types to the FFI and replaces the hottest functions
+// registered by load_api() with versions the JIT can compile.
+// Vector3, Quaternion and Matrix4x4 are cdata values owned by the Lua GC.
+static const char* s_ffi_prelude =
+	"local ffi = require 'ffi'\n"
+	"local C = ffi.C\n"
+	"ffi.cdef [[\n"
+	"	typedef struct { float x, y, z; } Vector3;\n"
+	"	typedef struct { float x, y, z, w; } Quaternion;\n"
+	"	typedef struct { float x, y, z, w; } Vector4;\n"
+	"	typedef struct { Vector4 x, y, z, t; } Matrix4x4;\n"
+	"	void crown_scene_graph_local_position(void*, const void*, Vector3*);\n"
+	"	void crown_scene_graph_local_rotation(void*, const void*, Quaternion*);\n"
+	"	void crown_scene_graph_local_scale(void*, const void*, Vector3*);\n"
+	"	void crown_scene_graph_local_pose(void*, const void*, Matrix4x4*);\n"
+	"	void crown_scene_graph_world_position(void*, const void*, Vector3*);\n"
+	"	void crown_scene_graph_world_rotation(void*, const void*, Quaternion*);\n"
+	"	void crown_scene_graph_world_pose(void*, const void*, Matrix4x4*);\n"
+	"	void crown_scene_graph_set_local_position(void*, const void*, const Vector3*);\n"
+	"	void crown_scene_graph_set_local_rotation(void*, const void*, const Quaternion*);\n"
+	"	void crown_scene_graph_set_local_scale(void*, const void*, const Vector3*);\n"
+	"	void crown_scene_graph_set_local_pose(void*, const void*, const Matrix4x4*);\n"
+	"	void crown_physics_world_actor_linear_velocity(void*, uint32_t, Vector3*);\n"
+	"	void crown_physics_world_actor_set_linear_velocity(void*, uint32_t, const Vector3*);\n"
+	"	void crown_physics_world_actor_angular_velocity(void*, uint32_t, Vector3*);\n"
+	"	void crown_physics_world_actor_set_angular_velocity(void*, uint32_t, const Vector3*);\n"
+	"	void crown_render_world_mesh_set_visible(void*, uint32_t, bool);\n"
+	"	void crown_render_world_sprite_set_visible(void*, const void*, bool);\n"
+	"	void crown_matrix4x4_multiply(const Matrix4x4*, const Matrix4x4*, Matrix4x4*);\n"
+	"	void crown_matrix4x4_invert(Matrix4x4*, Matrix4x4*);\n"
+	"	void crown_matrix4x4_transform(const Matrix4x4*, const Vector3*, Vector3*);\n"
+	"	void crown_quaternion_multiply(const Quaternion*, const Quaternion*, Quaternion*);\n"
+	"]]\n"
+	"local sqrt = math.sqrt\n"
+	"local fmt = string.format\n"
+	"local Vector3_t\n"
+	"local Quaternion_t\n"
+	"local Matrix4x4_t\n"
+	"Vector3_t = ffi.metatype('Vector3', {\n"
+	"	__add = function(a, b) return Vector3_t(a.x + b.x, a.y + b.y, a.z + b.z) end,\n"
+	"	__sub = function(a, b) return Vector3_t(a.x - b.x, a.y - b.y, a.z - b.z) end,\n"
+	"	__mul = function(a, b)\n"
+	"		if type(a) == 'number' then return Vector3_t(a * b.x, a * b.y, a * b.z) end\n"
+	"		return Vector3_t(a.x * b, a.y * b, a.z * b)\n"
+	"	end,\n"
+	"	__unm = function(a) return Vector3_t(-a.x, -a.y, -a.z) end,\n"
+	"	__tostring = function(a) return fmt('%.4f %.4f %.4f', a.x, a.y, a.z) end,\n"
+	"})\n"
+	"Quaternion_t = ffi.metatype('Quaternion', {\n"
+	"	__tostring = function(a) return fmt('%.4f %.4f %.4f %.4f', a.x, a.y, a.z, a.w) end,\n"
+	"})\n"
+	"Matrix4x4_t = ffi.typeof('Matrix4x4')\n"
+	"local ok = pcall(function() return C.crown_scene_graph_local_position end)\n"
+	"if ok then\n"
+	"	local function get(f, t) return function(a, b) local o = t() f(a, b, o) return o end end\n"
+	"	SceneGraph.local_position  = get(C.crown_scene_graph_local_position, Vector3_t)\n"
+	"	SceneGraph.local_rotation  = get(C.crown_scene_graph_local_rotation, Quaternion_t)\n"
+	"	SceneGraph.local_scale     = get(C.crown_scene_graph_local_scale, Vector3_t)\n"
+	"	SceneGraph.local_pose      = get(C.crown_scene_graph_local_pose, Matrix4x4_t)\n"
+	"	SceneGraph.world_position  = get(C.crown_scene_graph_world_position, Vector3_t)\n"
+	"	SceneGraph.world_rotation  = get(C.crown_scene_graph_world_rotation, Quaternion_t)\n"
+	"	SceneGraph.world_pose      = get(C.crown_scene_graph_world_pose, Matrix4x4_t)\n"
+	"	SceneGraph.set_local_position = C.crown_scene_graph_set_local_position\n"
+	"	SceneGraph.set_local_rotation = C.crown_scene_graph_set_local_rotation\n"
+	"	SceneGraph.set_local_scale    = C.crown_scene_graph_set_local_scale\n"
+	"	SceneGraph.set_local_pose     = C.crown_scene_graph_set_local_pose\n"
+	"	PhysicsWorld.actor_linear_velocity  = get(C.crown_physics_world_actor_linear_velocity, Vector3_t)\n"
+	"	PhysicsWorld.actor_angular_velocity = get(C.crown_physics_world_actor_angular_velocity, Vector3_t)\n"
+	"	PhysicsWorld.actor_set_linear_velocity  = C.crown_physics_world_actor_set_linear_velocity\n"
+	"	PhysicsWorld.actor_set_angular_velocity = C.crown_physics_world_actor_set_angular_velocity\n"
+	"	RenderWorld.mesh_set_visible   = C.crown_render_world_mesh_set_visible\n"
+	"	RenderWorld.sprite_set_visible = C.crown_render_world_sprite_set_visible\n"
+	"	Matrix4x4.multiply  = get(C.crown_matrix4x4_multiply, Matrix4x4_t)\n"
+	"	Matrix4x4.transform = get(C.crown_matrix4x4_transform, Vector3_t)\n"
+	"	Matrix4x4.invert    = function(m) local o = Matrix4x4_t() C.crown_matrix4x4_invert(m, o) return o end\n"
+	"	Quaternion.multiply = get(C.crown_quaternion_multiply, Quaternion_t)\n"
+	"end\n"
+	"getmetatable(Vector3).__call = function(_, x, y, z) return Vector3_t(x, y, z) end\n"
+	"Vector3.x = function(a) return a.x end\n"
+	"Vector3.y = function(a) return a.y end\n"
+	"Vector3.z = function(a) return a.z end\n"
+	"Vector3.set_x = function(a, x) a.x = x end\n"
+	"Vector3.set_y = function(a, y) a.y = y end\n"
+	"Vector3.set_z = function(a, z) a.z = z end\n"
+	"Vector3.add = function(a, b) return Vector3_t(a.x + b.x, a.y + b.y, a.z + b.z) end\n"
+	"Vector3.subtract = function(a, b) return Vector3_t(a.x - b.x, a.y - b.y, a.z - b.z) end\n"
+	"Vector3.multiply = function(a, k) return Vector3_t(a.x * k, a.y * k, a.z * k) end\n"
+	"Vector3.dot = function(a, b) return a.x * b.x + a.y * b.y + a.z * b.z end\n"
+	"Vector3.cross = function(a, b)\n"
+	"	return Vector3_t(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x)\n"
+	"end\n"
+	"Vector3.length_squared = function(a) return a.x * a.x + a.y * a.y + a.z * a.z end\n"
+	"Vector3.length = function(a) return sqrt(a.x * a.x + a.y * a.y + a.z * a.z) end\n"
+	"Vector3.distance_squared = function(a, b)\n"
+	"	local x, y, z = b.x - a.x, b.y - a.y, b.z - a.z\n"
+	"	return x * x + y * y + z * z\n"
+	"end\n"
+	"Vector3.distance = function(a, b)\n"
+	"	local x, y, z = b.x - a.x, b.y - a.y, b.z - a.z\n"
+	"	return sqrt(x * x + y * y + z * z)\n"
+	"end\n"
+	"Vector3.lerp = function(a, b, t)\n"
+	"	return Vector3_t(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t)\n"
+	"end\n"
+	"return Vector3_t, Quaternion_t, Matrix4x4_t, tonumber(Vector3_t), tonumber(Quaternion_t), tonumber(Matrix4x4_t)\n"
+	;
+
+void load_ffi(LuaEnvironment& env)
+{
+	lua_State* L = env.L;
+	LuaStack stack(L);
+
+	const int err = luaL_loadstring(L, s_ffi_prelude);
+	CE_ASSERT(err == 0, "%s", lua_tostring(L, -1));
+	CE_UNUSED(err);
+	lua_call(L, 0, 6);
+
+	// Ctype ids as given by the public FFI, tonumber(ctype)
+	env._vec3_ctype = (u32)lua_tointeger(L, -3);
+	env._quat_ctype = (u32)lua_tointeger(L, -2);
+	env._mat4_ctype = (u32)lua_tointeger(L, -1);
+	lua_pop(L, 3);
+
+	env._mat4_ctor = luaL_ref(L, LUA_REGISTRYINDEX);
+	env._quat_ctor = luaL_ref(L, LUA_REGISTRYINDEX);
+	env._vec3_ctor = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	// LuaStack::get_cdata_type() must agree with them
+	stack.push_cdata(env._vec3_ctor);
+	stack.push_cdata(env._quat_ctor);
+	stack.push_cdata(env._mat4_ctor);
+	CE_ASSERT(stack.get_cdata_type(-3) == env._vec3_ctype
+		&& stack.get_cdata_type(-2) == env._quat_ctype
+		&& stack.get_cdata_type(-1) == env._mat4_ctype
+		, "LuaJIT cdata layout has changed"
+		);
+	lua_pop(L, 3);
+}
+
+} // namespace crown
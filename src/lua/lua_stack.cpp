@@ -11,42 +11,46 @@ namespace crown
 {
 bool LuaStack::is_vector3(int i)
 {
-	return device()->_lua_environment->is_vector3((Vector3*)lua_touserdata(L, i));
+	return is_cdata(i) && get_cdata_type(i) == device()->_lua_environment->_vec3_ctype;
 }
 
 bool LuaStack::is_quaternion(int i)
 {
-	return device()->_lua_environment->is_quaternion((Quaternion*)lua_touserdata(L, i));
+	return is_cdata(i) && get_cdata_type(i) == device()->_lua_environment->_quat_ctype;
 }
 
 bool LuaStack::is_matrix4x4(int i)
 {
-	return device()->_lua_environment->is_matrix4x4((Matrix4x4*)lua_touserdata(L, i));
+	return is_cdata(i) && get_cdata_type(i) == device()->_lua_environment->_mat4_ctype;
 }
 
 #if !CROWN_RELEASE
-void LuaStack::check_temporary(int i, const Vector3* p)
+void LuaStack::check_type(int i, const Vector3* /*p*/)
 {
-	LuaEnvironment* env = device()->_lua_environment;
-	if (!is_pointer(i) || !env->is_vector3(p))
+	if (!is_vector3(i))
 		luaL_typerror(L, i, "Vector3");
 }
 
-void LuaStack::check_temporary(int i, const Quaternion* p)
+void LuaStack::check_type(int i, const Quaternion* /*p*/)
 {
-	LuaEnvironment* env = device()->_lua_environment;
-	if (!is_pointer(i) || !env->is_quaternion(p))
+	if (!is_quaternion(i))
 		luaL_typerror(L, i, "Quaternion");
 }
 
-void LuaStack::check_temporary(int i, const Matrix4x4* p)
+void LuaStack::check_type(int i, const Matrix4x4* /*p*/)
 {
-	LuaEnvironment* env = device()->_lua_environment;
-	if (!is_pointer(i) || !env->is_matrix4x4(p))
+	if (!is_matrix4x4(i))
 		luaL_typerror(L, i, "Matrix4x4");
 }
 #endif // !CROWN_RELEASE
 
+void* LuaStack::push_cdata(int ctor)
+{
+	lua_rawgeti(L, LUA_REGISTRYINDEX, ctor);
+	lua_call(L, 0, 1);
+	return (void*)lua_topointer(L, -1);
+}
+
 void LuaStack::push_vector2(const Vector2& v)
 {
 	Vector3 a;
@@ -58,17 +62,17 @@ void LuaStack::push_vector2(const Vector2& v)
 
 void LuaStack::push_vector3(const Vector3& v)
 {
-	lua_pushlightuserdata(L, device()->_lua_environment->next_vector3(v));
+	*(Vector3*)push_cdata(device()->_lua_environment->_vec3_ctor) = v;
 }
 
 void LuaStack::push_quaternion(const Quaternion& q)
 {
-	lua_pushlightuserdata(L, device()->_lua_environment->next_quaternion(q));
+	*(Quaternion*)push_cdata(device()->_lua_environment->_quat_ctor) = q;
 }
 
 void LuaStack::push_matrix4x4(const Matrix4x4& m)
 {
-	lua_pushlightuserdata(L, device()->_lua_environment->next_matrix4x4(m));
+	*(Matrix4x4*)push_cdata(device()->_lua_environment->_mat4_ctor) = m;
 }
 
 void LuaStack::push_color4(const Color4& c)
@@ -38,6 +38,10 @@
 #define POINTER_MARKER       0x0
 #define UNIT_MARKER          0x1
 
+#ifndef LUA_TCDATA
+	#define LUA_TCDATA 10 // LuaJIT FFI cdata, not exported by lua.h
+#endif
+
 namespace crown
 {
 /// Wrapper to manipulate Lua stack.
@@ -100,6 +104,11 @@ struct LuaStack
 			&& ((uintptr_t)lua_touserdata(L, i) & 0x3) == 0;
 	}
 
+	bool is_cdata(int i)
+	{
+		return lua_type(L, i) == LUA_TCDATA;
+	}
+
 	bool is_function(int i)
 	{
 		return lua_isfunction(L, i) == 1;
@@ -162,6 +171,21 @@ struct LuaStack
 		return p;
 	}
 
+	/// Returns the FFI ctype id of the cdata at @a i or 0 if it is not a cdata.
+	/// Reads the ctypeid field of LuaJIT's GCcdata (lj_obj.h), which precedes
+	/// the payload. load_ffi() checks it against the ids from the public FFI.
+	u32 get_cdata_type(int i)
+	{
+		CE_STATIC_ASSERT(LUAJIT_VERSION_NUM >= 20000 && LUAJIT_VERSION_NUM < 20200
+			, "GCcdata layout only checked for LuaJIT 2.0 and 2.1"
+			);
+
+		if (!is_cdata(i))
+			return 0;
+
+		return ((const u16*)lua_topointer(L, i))[-1];
+	}
+
 	u32 get_id(int i)
 	{
 #if !CROWN_RELEASE
@@ -366,27 +390,27 @@ struct LuaStack
 
 	Vector3& get_vector3(int i)
 	{
-		Vector3* v = (Vector3*)get_pointer(i);
+		Vector3* v = (Vector3*)lua_topointer(L, i);
 #if !CROWN_RELEASE
-		check_temporary(i, v);
+		check_type(i, v);
 #endif // !CROWN_RELEASE
 		return *v;
 	}
 
 	Quaternion& get_quaternion(int i)
 	{
-		Quaternion* q = (Quaternion*)get_pointer(i);
+		Quaternion* q = (Quaternion*)lua_topointer(L, i);
 #if !CROWN_RELEASE
-		check_temporary(i, q);
+		check_type(i, q);
 #endif // !CROWN_RELEASE
 		return *q;
 	}
 
 	Matrix4x4& get_matrix4x4(int i)
 	{
-		Matrix4x4* m = (Matrix4x4*)get_pointer(i);
+		Matrix4x4* m = (Matrix4x4*)lua_topointer(L, i);
 #if !CROWN_RELEASE
-		check_temporary(i, m);
+		check_type(i, m);
 #endif // !CROWN_RELEASE
 		return *m;
 	}
@@ -633,6 +657,10 @@ struct LuaStack
 		push_id(i.i);
 	}
 
+	/// Pushes a new cdata created by the ctype referenced by @a ctor
+	/// and returns a pointer to its payload.
+	void* push_cdata(int ctor);
+
 	void push_vector2(const Vector2& v);
 	void push_vector3(const Vector3& v);
 	void push_matrix4x4(const Matrix4x4& m);
@@ -682,9 +710,9 @@ struct LuaStack
 	}
 
 #if !CROWN_RELEASE
-	void check_temporary(int i, const Vector3* p);
-	void check_temporary(int i, const Quaternion* p);
-	void check_temporary(int i, const Matrix4x4* p);
+	void check_type(int i, const Vector3* p);
+	void check_type(int i, const Quaternion* p);
+	void check_type(int i, const Matrix4x4* p);
 
 	void check_type(int i, const DebugGui* p)
 	{
@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2012-2017 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/containers/hash_map.h"
+#include "core/containers/map.h"
+#include "core/containers/vector.h"
+#include "core/filesystem/file.h"
+#include "core/filesystem/filesystem.h"
+#include "core/filesystem/filesystem_disk.h"
+#include "core/json/json_object.h"
+#include "core/json/sjson.h"
+#include "core/memory/temp_allocator.h"
+#include "core/murmur.h"
+#include "core/strings/string.h"
+#include "core/strings/string_stream.h"
+#include "resource/build_database.h"
+#include "resource/data_compiler.h"
+#include <inttypes.h> // PRIx64, SCNx64
+
+#define BUILD_DATABASE_PATH CROWN_TEMP_DIRECTORY "/build.sjson"
+#define BUILD_DATABASE_VERSION 1
+
+// Value of the dependencies whose content does not matter
+#define BUILD_DATABASE_EXISTS "exists"
+
+namespace crown
+{
+namespace build_database_internal
+{
+	static void to_hex(u64 val, char* buf, u32 len)
+	{
+		snprintf(buf, len, "%.16" PRIx64, val);
+	}
+
+	static u64 parse_hex(const char* json)
+	{
+		TempAllocator64 ta;
+		DynamicString str(ta);
+		sjson::parse_string(json, str);
+
+		u64 val = 0;
+		sscanf(str.c_str(), "%" SCNx64, &val);
+		return val;
+	}
+
+	static void write_dependency(StringStream& ss, const char* path, const char* value)
+	{
+		ss << "\t\t\t\"" << path << "\" = \"" << value << "\"\n";
+	}
+
+} // namespace build_database_internal
+
+BuildDatabase::BuildDatabase(Allocator& a, DataCompiler& dc, Filesystem& data_filesystem, const char* platform)
+	: _data_compiler(dc)
+	, _data_filesystem(data_filesystem)
+	, _platform(platform)
+	, _json(a)
+	, _resources(a)
+	, _files(a)
+	, _checked(a)
+	, _referenced(a)
+	, _output(a)
+{
+	using namespace build_database_internal;
+
+	if (!_data_filesystem.exists(BUILD_DATABASE_PATH))
+		return;
+
+	File* file = _data_filesystem.open(BUILD_DATABASE_PATH, FileOpenMode::READ);
+	const u32 size = file->size();
+	array::resize(_json, size);
+	file->read(array::begin(_json), size);
+	_data_filesystem.close(*file);
+	array::push_back(_json, '\0');
+
+	TempAllocator1024 ta;
+	JsonObject obj(ta);
+	sjson::parse(array::begin(_json), obj);
+
+	DynamicString db_platform(ta);
+	sjson::parse_string(obj["platform"], db_platform);
+
+	if (sjson::parse_int(obj["version"]) != BUILD_DATABASE_VERSION || !(db_platform == _platform))
+		return;
+
+	JsonObject files(a);
+	sjson::parse_object(obj["files"], files);
+
+	auto cur = json_object::begin(files);
+	auto end = json_object::end(files);
+	for (; cur != end; ++cur)
+	{
+		TempAllocator512 ta;
+		JsonObject file(ta);
+		sjson::parse_object(cur->pair.second, file);
+
+		SourceFile sf;
+		sf.mtime = parse_hex(file["mtime"]);
+		sf.hash  = parse_hex(file["hash"]);
+
+		DynamicString path(ta);
+		path.set(cur->pair.first.data(), cur->pair.first.length());
+		map::set(_files, path, sf);
+	}
+
+	sjson::parse_object(obj["resources"], _resources);
+}
+
+bool BuildDatabase::file_hash(const char* path, u64& hash)
+{
+	const StringId64 id(path);
+
+	FileState fs;
+	fs.hash = 0;
+	fs.exists = false;
+	fs = hash_map::get(_checked, id, fs);
+
+	if (hash_map::has(_checked, id))
+	{
+		hash = fs.hash;
+		return fs.exists;
+	}
+
+	TempAllocator256 ta;
+	DynamicString source_dir(ta);
+	_data_compiler.source_dir(path, source_dir);
+
+	FilesystemDisk source_filesystem(ta);
+	source_filesystem.set_prefix(source_dir.c_str());
+
+	fs.exists = source_filesystem.exists(path) && source_filesystem.is_file(path);
+
+	if (fs.exists)
+	{
+		DynamicString key(ta);
+		key = path;
+
+		SourceFile sf;
+		sf.mtime = 0;
+		sf.hash = 0;
+		sf = map::get(_files, key, sf);
+
+		const u64 mtime = source_filesystem.last_modified_time(path);
+
+		// Files are hashed again only when they have been touched since the last build
+		if (!map::has(_files, key) || sf.mtime != mtime)
+		{
+			File* file = source_filesystem.open(path, FileOpenMode::READ);
+			const u32 size = file->size();
+			Buffer buf(default_allocator());
+			array::resize(buf, size);
+			file->read(array::begin(buf), size);
+			source_filesystem.close(*file);
+
+			sf.mtime = mtime;
+			sf.hash = murmur64(array::begin(buf), size, 0);
+			map::set(_files, key, sf);
+		}
+
+		fs.hash = sf.hash;
+	}
+
+	hash_map::set(_checked, id, fs);
+	hash = fs.hash;
+	return fs.exists;
+}
+
+bool BuildDatabase::is_dirty(const char* path, u32 version)
+{
+	using namespace build_database_internal;
+
+	if (!json_object::has(_resources, path))
+		return true;
+
+	TempAllocator1024 ta;
+	JsonObject resource(ta);
+	sjson::parse_object(_resources[path], resource);
+
+	if ((u32)sjson::parse_int(resource["version"]) != version)
+		return true;
+
+	JsonObject dependencies(ta);
+	sjson::parse_object(resource["dependencies"], dependencies);
+
+	auto cur = json_object::begin(dependencies);
+	auto end = json_object::end(dependencies);
+	for (; cur != end; ++cur)
+	{
+		TempAllocator512 ta;
+		DynamicString dep(ta);
+		dep.set(cur->pair.first.data(), cur->pair.first.length());
+
+		DynamicString value(ta);
+		sjson::parse_string(cur->pair.second, value);
+
+		u64 hash;
+		if (!file_hash(dep.c_str(), hash))
+			return true;
+
+		if (!(value == BUILD_DATABASE_EXISTS) && parse_hex(cur->pair.second) != hash)
+			return true;
+	}
+
+	return false;
+}
+
+void BuildDatabase::add(const char* path, u32 version, const Vector<DynamicString>& dependencies, const Vector<DynamicString>& requirements)
+{
+	using namespace build_database_internal;
+
+	_output << "\t\"" << path << "\" = {\n";
+	_output << "\t\tversion = " << version << "\n";
+	_output << "\t\tdependencies = {\n";
+
+	TempAllocator1024 ta;
+	HashMap<StringId64, bool> written(ta);
+
+	for (u32 i = 0; i < vector::size(dependencies); ++i)
+	{
+		const StringId64 id(dependencies[i].c_str());
+		if (hash_map::has(written, id))
+			continue;
+
+		u64 hash = 0;
+		file_hash(dependencies[i].c_str(), hash);
+
+		char buf[32];
+		to_hex(hash, buf, sizeof(buf));
+		write_dependency(_output, dependencies[i].c_str(), buf);
+
+		hash_map::set(written, id, true);
+		hash_map::set(_referenced, id, true);
+	}
+
+	for (u32 i = 0; i < vector::size(requirements); ++i)
+	{
+		const StringId64 id(requirements[i].c_str());
+		if (hash_map::has(written, id))
+			continue;
+
+		// Missing requirements made the compilation fail
+		u64 hash;
+		if (!file_hash(requirements[i].c_str(), hash))
+			continue;
+
+		write_dependency(_output, requirements[i].c_str(), BUILD_DATABASE_EXISTS);
+
+		hash_map::set(written, id, true);
+		hash_map::set(_referenced, id, true);
+	}
+
+	_output << "\t\t}\n";
+	_output << "\t}\n";
+}
+
+void BuildDatabase::keep(const char* path)
+{
+	if (!json_object::has(_resources, path))
+		return;
+
+	TempAllocator1024 ta;
+	JsonObject resource(ta);
+	sjson::parse_object(_resources[path], resource);
+
+	_output << "\t\"" << path << "\" = {\n";
+	_output << "\t\tversion = " << sjson::parse_int(resource["version"]) << "\n";
+	_output << "\t\tdependencies = {\n";
+
+	JsonObject dependencies(ta);
+	sjson::parse_object(resource["dependencies"], dependencies);
+
+	auto cur = json_object::begin(dependencies);
+	auto end = json_object::end(dependencies);
+	for (; cur != end; ++cur)
+	{
+		TempAllocator512 ta;
+		DynamicString dep(ta);
+		dep.set(cur->pair.first.data(), cur->pair.first.length());
+
+		DynamicString value(ta);
+		sjson::parse_string(cur->pair.second, value);
+
+		build_database_internal::write_dependency(_output, dep.c_str(), value.c_str());
+		hash_map::set(_referenced, StringId64(dep.c_str()), true);
+	}
+
+	_output << "\t\t}\n";
+	_output << "\t}\n";
+}
+
+void BuildDatabase::save()
+{
+	using namespace build_database_internal;
+
+	StringStream ss(default_allocator());
+	ss << "version = " << BUILD_DATABASE_VERSION << "\n";
+	ss << "platform = \"" << _platform << "\"\n";
+
+	// Only the files that are still referenced by some resource
+	ss << "files = {\n";
+	auto cur = map::begin(_files);
+	auto end = map::end(_files);
+	for (; cur != end; ++cur)
+	{
+		if (!hash_map::has(_referenced, StringId64(cur->pair.first.c_str())))
+			continue;
+
+		char mtime[32];
+		char hash[32];
+		to_hex(cur->pair.second.mtime, mtime, sizeof(mtime));
+		to_hex(cur->pair.second.hash, hash, sizeof(hash));
+		ss << "\t\"" << cur->pair.first.c_str() << "\" = { mtime = \"" << mtime << "\" hash = \"" << hash << "\" }\n";
+	}
+	ss << "}\n";
+
+	ss << "resources = {\n";
+	array::push(ss, array::begin(_output), array::size(_output));
+	ss << "}\n";
+
+	File* file = _data_filesystem.open(BUILD_DATABASE_PATH, FileOpenMode::WRITE);
+	file->write(array::begin(ss), array::size(ss));
+	_data_filesystem.close(*file);
+}
+
+} // namespace crown
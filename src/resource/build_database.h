@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2012-2017 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/filesystem/types.h"
+#include "core/json/types.h"
+#include "core/strings/dynamic_string.h"
+#include "core/strings/string_id.h"
+#include "core/strings/types.h"
+#include "resource/types.h"
+
+namespace crown
+{
+/// Remembers the sources and the dependencies of the resources compiled
+/// by the previous builds, so that only the resources affected by a change
+/// are compiled again.
+///
+/// @ingroup Resource
+struct BuildDatabase
+{
+	struct SourceFile
+	{
+		u64 mtime;
+		u64 hash;
+	};
+
+	struct FileState
+	{
+		u64 hash;
+		bool exists;
+	};
+
+	DataCompiler& _data_compiler;
+	Filesystem& _data_filesystem;
+	const char* _platform;
+	Buffer _json;
+	JsonObject _resources;
+	Map<DynamicString, SourceFile> _files;
+	HashMap<StringId64, FileState> _checked;
+	HashMap<StringId64, bool> _referenced;
+	StringStream _output;
+
+	/// Reads the database from @a data_filesystem.
+	/// The database is discarded if it has been built for a @a platform
+	/// other than the given one.
+	BuildDatabase(Allocator& a, DataCompiler& dc, Filesystem& data_filesystem, const char* platform);
+
+	/// Returns whether the source file @a path exists and its content hash in @a hash.
+	bool file_hash(const char* path, u64& hash);
+
+	/// Returns whether the resource @a path needs to be compiled by
+	/// a compiler of the given @a version.
+	bool is_dirty(const char* path, u32 version);
+
+	/// Records that the resource @a path has been compiled by a compiler of the
+	/// given @a version with the given @a dependencies and @a requirements.
+	void add(const char* path, u32 version, const Vector<DynamicString>& dependencies, const Vector<DynamicString>& requirements);
+
+	/// Records the resource @a path as it was recorded by the previous build.
+	void keep(const char* path);
+
+	/// Writes the database to the data filesystem.
+	void save();
+
+private:
+
+	// Disable copying
+	BuildDatabase(const BuildDatabase&);
+	BuildDatabase& operator=(const BuildDatabase&);
+};
+
+} // namespace crown
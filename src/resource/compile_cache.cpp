@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2012-2017 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/filesystem/file.h"
+#include "core/guid.h"
+#include "core/memory/temp_allocator.h"
+#include "core/os.h"
+#include "core/strings/dynamic_string.h"
+#include "resource/compile_cache.h"
+#include <inttypes.h> // PRIx64
+
+namespace crown
+{
+namespace compile_cache_internal
+{
+	static void key_to_path(u64 key, DynamicString& path)
+	{
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.16" PRIx64, key);
+		path += buf;
+	}
+
+} // namespace compile_cache_internal
+
+CompileCacheDisk::CompileCacheDisk(Allocator& a, const char* dir)
+	: _fs(a)
+{
+	_fs.set_prefix(dir);
+	_fs.create_directory("");
+}
+
+bool CompileCacheDisk::get(u64 key, Buffer& data)
+{
+	TempAllocator128 ta;
+	DynamicString path(ta);
+	compile_cache_internal::key_to_path(key, path);
+
+	if (!_fs.exists(path.c_str()))
+		return false;
+
+	File* file = _fs.open(path.c_str(), FileOpenMode::READ);
+	const u32 size = file->size();
+	array::resize(data, size);
+	const u32 num = file->read(array::begin(data), size);
+	_fs.close(*file);
+
+	return num == size;
+}
+
+void CompileCacheDisk::put(u64 key, const char* data, u32 size)
+{
+	TempAllocator256 ta;
+	DynamicString path(ta);
+	DynamicString tmp_path(ta);
+	compile_cache_internal::key_to_path(key, path);
+
+	// Write to a unique file first, so that other compilers never
+	// read an entry that is only partially written
+	DynamicString guid(ta);
+	guid::to_string(guid::new_guid(), guid);
+	tmp_path += path;
+	tmp_path += '.';
+	tmp_path += guid;
+	tmp_path += ".tmp";
+
+	File* file = _fs.open(tmp_path.c_str(), FileOpenMode::WRITE);
+	const u32 num = file->write(data, size);
+	_fs.close(*file);
+
+	DynamicString abs_path(ta);
+	DynamicString abs_tmp_path(ta);
+	_fs.get_absolute_path(path.c_str(), abs_path);
+	_fs.get_absolute_path(tmp_path.c_str(), abs_tmp_path);
+
+	if (num != size || !os::rename(abs_tmp_path.c_str(), abs_path.c_str()))
+		_fs.delete_file(tmp_path.c_str());
+}
+
+} // namespace crown
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2012-2017 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/filesystem/filesystem_disk.h"
+#include "core/types.h"
+#include "resource/types.h"
+
+namespace crown
+{
+/// Stores the compiled resources by content key so that they can be shared
+/// between data directories, machines and builds.
+/// Implementations must be safe to use from multiple threads.
+///
+/// @ingroup Resource
+class CompileCache
+{
+public:
+
+	CompileCache() {};
+	virtual ~CompileCache() {};
+
+	/// Reads the data stored with @a key into @a data.
+	/// Returns whether the @a key has been found.
+	virtual bool get(u64 key, Buffer& data) = 0;
+
+	/// Stores @a size bytes of @a data with @a key.
+	virtual void put(u64 key, const char* data, u32 size) = 0;
+
+private:
+
+	// Disable copying
+	CompileCache(const CompileCache&);
+	CompileCache& operator=(const CompileCache&);
+};
+
+/// Compile cache stored in a directory on disk.
+/// The directory can be shared by multiple compilers at the same time.
+///
+/// @ingroup Resource
+class CompileCacheDisk : public CompileCache
+{
+	FilesystemDisk _fs;
+
+public:
+
+	/// Uses the absolute @a dir as the cache directory and creates it if missing.
+	CompileCacheDisk(Allocator& a, const char* dir);
+
+	/// @copydoc CompileCache::get()
+	bool get(u64 key, Buffer& data);
+
+	/// @copydoc CompileCache::put()
+	void put(u64 key, const char* data, u32 size);
+};
+
+} // namespace crown
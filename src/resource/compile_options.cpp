@@ -17,6 +17,8 @@
 #include "resource/compile_options.h"
 #include "resource/data_compiler.h"
 
+namespace { const crown::log_internal::System COMPILER = { "Compiler" }; }
+
 namespace crown
 {
 CompileOptions::CompileOptions(DataCompiler& dc, Filesystem& data_filesystem, DynamicString& source_path, Buffer& output, const char* platform)
@@ -26,12 +28,14 @@ CompileOptions::CompileOptions(DataCompiler& dc, Filesystem& data_filesystem, Dy
 	, _output(output)
 	, _platform(platform)
 	, _dependencies(default_allocator())
+	, _requirements(default_allocator())
 {
 }
 
 void CompileOptions::error(const char* msg, va_list args)
 {
-	_data_compiler.error(msg, args);
+	logev(COMPILER, msg, args);
+	longjmp(_jmpbuf, 1);
 }
 
 void CompileOptions::error(const char* msg, ...)
@@ -49,6 +53,8 @@ const char* CompileOptions::source_path()
 
 bool CompileOptions::file_exists(const char* path)
 {
+	add_requirement(path);
+
 	TempAllocator256 ta;
 	DynamicString source_dir(ta);
 	FilesystemDisk fs(ta);
@@ -120,6 +126,9 @@ Buffer CompileOptions::read(const char* path)
 
 void CompileOptions::get_absolute_path(const char* path, DynamicString& abs)
 {
+	// The file is most likely going to be read by an external compiler
+	add_dependency(path);
+
 	TempAllocator256 ta;
 	DynamicString source_dir(ta);
 	_data_compiler.source_dir(path, source_dir);
@@ -170,12 +179,33 @@ const Vector<DynamicString>& CompileOptions::dependencies() const
 
 void CompileOptions::add_dependency(const char* path)
 {
+	// Temporary files are not tracked
+	if (path::is_absolute(path))
+		return;
+
 	TempAllocator256 ta;
 	DynamicString dep(ta);
 	dep += path;
 	vector::push_back(_dependencies, dep);
 }
 
+const Vector<DynamicString>& CompileOptions::requirements() const
+{
+	return _requirements;
+}
+
+void CompileOptions::add_requirement(const char* path)
+{
+	// Temporary files are not tracked
+	if (path::is_absolute(path))
+		return;
+
+	TempAllocator256 ta;
+	DynamicString req(ta);
+	req += path;
+	vector::push_back(_requirements, req);
+}
+
 int CompileOptions::run_external_compiler(const char* const* argv, StringStream& output)
 {
 	return os::execute_process(argv, output);
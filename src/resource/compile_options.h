@@ -10,6 +10,7 @@
 #include "core/strings/dynamic_string.h"
 #include "core/strings/types.h"
 #include "resource/types.h"
+#include <setjmp.h>
 #include <stdarg.h>
 
 #define DATA_COMPILER_ASSERT(condition, opts, msg, ...) \
@@ -44,14 +45,17 @@ struct CompileOptions
 	Buffer& _output;
 	const char* _platform;
 	Vector<DynamicString> _dependencies;
+	Vector<DynamicString> _requirements;
+	jmp_buf _jmpbuf;
 
 	///
 	CompileOptions(DataCompiler& dc, Filesystem& data_filesystem, DynamicString& source_path, Buffer& output, const char* platform);
 
-	///
+	/// Logs the error @a msg and aborts the compilation by jumping back to
+	/// the setjmp(_jmpbuf) that started it.
 	void error(const char* msg, va_list args);
 
-	///
+	/// @copydoc CompileOptions::error()
 	void error(const char* msg, ...);
 
 	///
@@ -103,12 +107,20 @@ struct CompileOptions
 	///
 	const char* platform() const;
 
-	///
+	/// Returns the files whose content has been used to compile the resource.
 	const Vector<DynamicString>& dependencies() const;
 
-	///
+	/// Adds the file @a path to the dependencies of the resource.
+	/// The resource is compiled again whenever the content of @a path changes.
 	void add_dependency(const char* path);
 
+	/// Returns the files whose existence has been checked to compile the resource.
+	const Vector<DynamicString>& requirements() const;
+
+	/// Adds the file @a path to the requirements of the resource.
+	/// The resource is compiled again whenever @a path is created or deleted.
+	void add_requirement(const char* path);
+
 	///
 	int run_external_compiler(const char* const* argv, StringStream& output);
 };
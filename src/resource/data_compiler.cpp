@@ -14,12 +14,18 @@
 #include "core/json/sjson.h"
 #include "core/memory/allocator.h"
 #include "core/memory/temp_allocator.h"
+#include "core/murmur.h"
 #include "core/os.h"
 #include "core/strings/dynamic_string.h"
 #include "core/strings/string_stream.h"
+#include "core/thread/atomic_int.h"
+#include "core/thread/mutex.h"
+#include "core/thread/thread.h"
 #include "device/console_server.h"
 #include "device/device_options.h"
 #include "device/log.h"
+#include "resource/build_database.h"
+#include "resource/compile_cache.h"
 #include "resource/compile_options.h"
 #include "resource/config_resource.h"
 #include "resource/data_compiler.h"
@@ -37,6 +43,11 @@
 #include "resource/texture_resource.h"
 #include "resource/types.h"
 #include "resource/unit_resource.h"
+#include <algorithm> // std::min, std::sort
+#include <inttypes.h> // PRIx64
+
+// Changing this invalidates all the entries in the compile caches
+#define COMPILE_CACHE_VERSION 1
 
 namespace { const crown::log_internal::System COMPILER = { "Compiler" }; }
 
@@ -114,6 +125,8 @@ DataCompiler::DataCompiler(ConsoleServer& cs)
 	, _globs(default_allocator())
 	, _data_index(default_allocator())
 	, _file_monitor(default_allocator())
+	, _cache(NULL)
+	, _idle_workers(0)
 {
 	cs.register_command("compile", console_command_compile, this);
 }
@@ -243,6 +256,11 @@ void DataCompiler::map_source_dir(const char* name, const char* source_dir)
 	map::set(_source_dirs, sname, sdir);
 }
 
+void DataCompiler::set_cache(CompileCache* cache)
+{
+	_cache = cache;
+}
+
 void DataCompiler::source_dir(const char* resource_name, DynamicString& source_dir)
 {
 	const char* slash = strchr(resource_name, '/');
@@ -319,104 +337,372 @@ void DataCompiler::scan()
 	_file_monitor.start(map::begin(_source_dirs)->pair.second.c_str(), true, filemonitor_callback, this);
 }
 
-bool DataCompiler::compile(const char* data_dir, const char* platform)
+namespace data_compiler_internal
 {
-	FilesystemDisk data_filesystem(default_allocator());
-	data_filesystem.set_prefix(data_dir);
-	data_filesystem.create_directory("");
+	// State shared by the threads compiling the resources
+	struct CompileContext
+	{
+		DataCompiler* data_compiler;
+		Filesystem* data_filesystem;
+		const char* platform;
+		BuildDatabase* db;
+		CompileCache* cache;
+		const Array<u32>* jobs; // Indices of the files to compile
+		AtomicInt next_job;
+		AtomicInt num_compiled;
+		AtomicInt num_cached;
+		AtomicInt failed;
+		Mutex mutex; // Protects db and DataCompiler::_data_index
+
+		CompileContext()
+			: next_job(0)
+			, num_compiled(0)
+			, num_cached(0)
+			, failed(0)
+		{
+		}
+	};
 
-	if (!data_filesystem.exists(CROWN_DATA_DIRECTORY))
-		data_filesystem.create_directory(CROWN_DATA_DIRECTORY);
+	// Returns the path of the compiled resource @a src_path relative to the data directory
+	static void destination_path(const char* src_path, DynamicString& dst_path)
+	{
+		const char* type = path::extension(src_path);
 
-	if (!data_filesystem.exists(CROWN_TEMP_DIRECTORY))
-		data_filesystem.create_directory(CROWN_TEMP_DIRECTORY);
+		char name[256];
+		const u32 size = u32(type - src_path - 1);
+		strncpy(name, src_path, size);
+		name[size] = '\0';
 
-	std::sort(vector::begin(_files), vector::end(_files));
+		TempAllocator128 ta;
+		DynamicString type_str(ta);
+		DynamicString name_str(ta);
+		StringId64(type).to_string(type_str);
+		StringId64(name).to_string(name_str);
 
-	bool success = false;
+		dst_path += type_str;
+		dst_path += '-';
+		dst_path += name_str;
+	}
 
-	// Compile all changed resources
-	for (u32 i = 0; i < vector::size(_files); ++i)
+	static void write_hex(StringStream& ss, u64 val)
 	{
-		const char* filename = _files[i].c_str();
-		const char* type = path::extension(filename);
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.16" PRIx64, val);
+		ss << buf;
+	}
 
-		if (type == NULL)
-			continue;
+	// Returns the key of the cache entry listing the dependencies and the
+	// requirements of the resource @a src_path.
+	static u64 manifest_key(CompileContext& ctx, const char* src_path, u32 version)
+	{
+		u64 hash = 0;
+		{
+			ScopedMutex sm(ctx.mutex);
+			ctx.db->file_hash(src_path, hash);
+		}
 
-		char name[256];
-		const u32 size = u32(type - filename - 1);
-		strncpy(name, filename, size);
-		name[size] = '\0';
+		TempAllocator512 ta;
+		StringStream ss(ta);
+		ss << COMPILE_CACHE_VERSION << '\n';
+		ss << ctx.platform << '\n';
+		ss << version << '\n';
+		ss << src_path << '\n';
+		write_hex(ss, hash);
+		return murmur64(array::begin(ss), array::size(ss), 0);
+	}
+
+	// Returns the key of the cache entry holding the compiled resource whose
+	// manifest is @a manifest and whose sources are in the given state.
+	static u64 output_key(CompileContext& ctx, u64 manifest, const Vector<DynamicString>& dependencies, const Vector<DynamicString>& requirements)
+	{
+		StringStream ss(default_allocator());
+		write_hex(ss, manifest);
+		ss << '\n';
+
+		ScopedMutex sm(ctx.mutex);
+		for (u32 i = 0; i < vector::size(dependencies); ++i)
+		{
+			u64 hash;
+			ss << dependencies[i].c_str() << ' ';
+			if (ctx.db->file_hash(dependencies[i].c_str(), hash))
+				write_hex(ss, hash);
+			else
+				ss << "missing";
+			ss << '\n';
+		}
+		for (u32 i = 0; i < vector::size(requirements); ++i)
+		{
+			u64 hash;
+			ss << requirements[i].c_str() << ' ';
+			ss << (ctx.db->file_hash(requirements[i].c_str(), hash) ? "exists" : "missing");
+			ss << '\n';
+		}
+
+		return murmur64(array::begin(ss), array::size(ss), 0);
+	}
+
+	static void write_paths(StringStream& ss, const char* name, const Vector<DynamicString>& paths)
+	{
+		ss << name << " = [\n";
+		for (u32 i = 0; i < vector::size(paths); ++i)
+			ss << "\t\"" << paths[i].c_str() << "\"\n";
+		ss << "]\n";
+	}
+
+	static void parse_paths(const char* json, Vector<DynamicString>& paths)
+	{
+		TempAllocator1024 ta;
+		JsonArray arr(ta);
+		sjson::parse_array(json, arr);
+
+		for (u32 i = 0; i < array::size(arr); ++i)
+		{
+			TempAllocator256 ta;
+			DynamicString path(ta);
+			sjson::parse_string(arr[i], path);
+			vector::push_back(paths, path);
+		}
+	}
+
+	// Stores the compiled resource @a output in the cache.
+	static void cache_put(CompileContext& ctx, u64 manifest, const Vector<DynamicString>& dependencies, const Vector<DynamicString>& requirements, const Buffer& output)
+	{
+		StringStream ss(default_allocator());
+		write_paths(ss, "dependencies", dependencies);
+		write_paths(ss, "requirements", requirements);
+
+		ctx.cache->put(output_key(ctx, manifest, dependencies, requirements), array::begin(output), array::size(output));
+		ctx.cache->put(manifest, array::begin(ss), array::size(ss));
+	}
+
+	// Reads the compiled resource from the cache into @a output.
+	// Returns whether the resource has been found.
+	static bool cache_get(CompileContext& ctx, u64 manifest, Vector<DynamicString>& dependencies, Vector<DynamicString>& requirements, Buffer& output)
+	{
+		Buffer json(default_allocator());
+		if (!ctx.cache->get(manifest, json))
+			return false;
+		array::push_back(json, '\0');
+
+		TempAllocator1024 ta;
+		JsonObject obj(ta);
+		sjson::parse(array::begin(json), obj);
+		parse_paths(obj["dependencies"], dependencies);
+		parse_paths(obj["requirements"], requirements);
+
+		return ctx.cache->get(output_key(ctx, manifest, dependencies, requirements), output);
+	}
+
+	// Writes the compiled resource @a output to the data directory and records it.
+	static bool write_output(CompileContext& ctx, DynamicString& src_path, DynamicString& dst_path, u32 version, const Buffer& output, const Vector<DynamicString>& dependencies, const Vector<DynamicString>& requirements)
+	{
+		DataCompiler& dc = *ctx.data_compiler;
+		Filesystem& data_filesystem = *ctx.data_filesystem;
 
 		TempAllocator1024 ta;
 		DynamicString path(ta);
-		DynamicString src_path(ta);
-		DynamicString type_str(ta);
-		DynamicString name_str(ta);
+		path::join(path, CROWN_DATA_DIRECTORY, dst_path.c_str());
+
+		File* outf = data_filesystem.open(path.c_str(), FileOpenMode::WRITE);
+		u32 size = array::size(output);
+		u32 written = outf->write(array::begin(output), size);
+		data_filesystem.close(*outf);
+
+		if (size != written)
+			return false;
+
+		ScopedMutex sm(ctx.mutex);
+		ctx.db->add(src_path.c_str(), version, dependencies, requirements);
+		if (!map::has(dc._data_index, dst_path))
+			map::set(dc._data_index, dst_path, src_path);
+
+		return true;
+	}
+
+	// Compilers report errors by jumping back here. Kept apart from compile()
+	// so that no other local lives in the frame that calls setjmp().
+	static CE_NOINLINE bool run_compiler(DataCompiler::CompileFunction compiler, CompileOptions& opts)
+	{
+		if (setjmp(opts._jmpbuf))
+			return false;
+
+		compiler(opts);
+		return true;
+	}
+
+	static bool compile(CompileContext& ctx, DynamicString& src_path)
+	{
+		DataCompiler& dc = *ctx.data_compiler;
+
+		TempAllocator1024 ta;
 		DynamicString dst_path(ta);
+		destination_path(src_path.c_str(), dst_path);
 
-		StringId64 _type(type);
-		StringId64 _name(name);
+		const StringId64 type(path::extension(src_path.c_str()));
+		const u32 version = dc.version(type);
 
-		// Build source file path
-		src_path += name;
-		src_path += '.';
-		src_path += type;
+		Buffer output(default_allocator());
+		u64 manifest = 0;
 
-		// Build compiled file path
-		_type.to_string(type_str);
-		_name.to_string(name_str);
+		if (ctx.cache != NULL)
+		{
+			manifest = manifest_key(ctx, src_path.c_str(), version);
 
-		// Build destination file path
-		dst_path += type_str;
-		dst_path += '-';
-		dst_path += name_str;
+			Vector<DynamicString> dependencies(default_allocator());
+			Vector<DynamicString> requirements(default_allocator());
+			if (cache_get(ctx, manifest, dependencies, requirements, output))
+			{
+				logi(COMPILER, "%s (cached)", src_path.c_str());
+				ctx.num_cached.fetch_add(1);
+				return write_output(ctx, src_path, dst_path, version, output, dependencies, requirements);
+			}
 
-		path::join(path, CROWN_DATA_DIRECTORY, dst_path.c_str());
+			array::clear(output);
+		}
 
 		logi(COMPILER, "%s", src_path.c_str());
 
-		if (!can_compile(_type))
+		array::reserve(output, 4*1024*1024);
+
+		CompileOptions opts(dc, *ctx.data_filesystem, src_path, output, ctx.platform);
+		if (!run_compiler(hash_map::get(dc._compilers, type, DataCompiler::ResourceTypeData()).compiler, opts))
+			return false;
+
+		if (ctx.cache != NULL)
+			cache_put(ctx, manifest, opts.dependencies(), opts.requirements(), output);
+
+		ctx.num_compiled.fetch_add(1);
+		return write_output(ctx, src_path, dst_path, version, output, opts.dependencies(), opts.requirements());
+	}
+
+	static s32 compile_thread(void* user_data)
+	{
+		CompileContext& ctx = *(CompileContext*)user_data;
+		const Array<u32>& jobs = *ctx.jobs;
+
+		// Stop picking new jobs as soon as one fails
+		while (ctx.failed.load() == 0)
+		{
+			const u32 job = (u32)ctx.next_job.fetch_add(1);
+			if (job >= array::size(jobs))
+				break;
+
+			if (!compile(ctx, ctx.data_compiler->_files[jobs[job]]))
+			{
+				loge(COMPILER, "Error");
+				ctx.failed.store(1);
+			}
+		}
+
+		// Let the compilers still running use this processor
+		ctx.data_compiler->release_worker();
+		return 0;
+	}
+
+} // namespace data_compiler_internal
+
+bool DataCompiler::compile(const char* data_dir, const char* platform)
+{
+	using namespace data_compiler_internal;
+
+	FilesystemDisk data_filesystem(default_allocator());
+	data_filesystem.set_prefix(data_dir);
+	data_filesystem.create_directory("");
+
+	if (!data_filesystem.exists(CROWN_DATA_DIRECTORY))
+		data_filesystem.create_directory(CROWN_DATA_DIRECTORY);
+
+	if (!data_filesystem.exists(CROWN_TEMP_DIRECTORY))
+		data_filesystem.create_directory(CROWN_TEMP_DIRECTORY);
+
+	if (!data_filesystem.exists(CROWN_SHADER_CACHE_DIRECTORY))
+		data_filesystem.create_directory(CROWN_SHADER_CACHE_DIRECTORY);
+
+	std::sort(vector::begin(_files), vector::end(_files));
+
+	BuildDatabase db(default_allocator(), *this, data_filesystem, platform);
+
+	bool success = true;
+	u32 num_up_to_date = 0;
+	Array<u32> jobs(default_allocator());
+
+	// Find the resources that need to be compiled
+	for (u32 i = 0; i < vector::size(_files); ++i)
+	{
+		const char* src_path = _files[i].c_str();
+		const char* type = path::extension(src_path);
+
+		if (type == NULL)
+			continue;
+
+		if (!can_compile(StringId64(type)))
 		{
 			loge(COMPILER, "Unknown resource type: '%s'", type);
 			success = false;
 			break;
 		}
 
-		Buffer output(default_allocator());
-		array::reserve(output, 4*1024*1024);
+		TempAllocator1024 ta;
+		DynamicString dst_path(ta);
+		DynamicString path(ta);
+		destination_path(src_path, dst_path);
+		path::join(path, CROWN_DATA_DIRECTORY, dst_path.c_str());
 
-		if (!setjmp(_jmpbuf))
+		if (data_filesystem.exists(path.c_str()) && !db.is_dirty(src_path, version(StringId64(type))))
 		{
-			CompileOptions opts(*this, data_filesystem, src_path, output, platform);
+			db.keep(src_path);
+			++num_up_to_date;
 
-			hash_map::get(_compilers, _type, ResourceTypeData()).compiler(opts);
+			if (!map::has(_data_index, dst_path))
+				map::set(_data_index, dst_path, _files[i]);
+			continue;
+		}
 
-			File* outf = data_filesystem.open(path.c_str(), FileOpenMode::WRITE);
-			u32 size = array::size(output);
-			u32 written = outf->write(array::begin(output), size);
-			data_filesystem.close(*outf);
+		array::push_back(jobs, i);
+	}
 
-			success = size == written;
-		}
-		else
+	// Compile them on all processors
+	if (success && array::size(jobs) > 0)
+	{
+		CompileContext ctx;
+		ctx.data_compiler = this;
+		ctx.data_filesystem = &data_filesystem;
+		ctx.platform = platform;
+		ctx.db = &db;
+		ctx.cache = _cache;
+		ctx.jobs = &jobs;
+
+		const u32 num_processors = os::num_processors();
+		const u32 num_threads = std::min(num_processors, array::size(jobs)) - 1;
+		_idle_workers.store(num_processors - (num_threads + 1));
+
+		Array<Thread*> threads(default_allocator());
+		for (u32 i = 0; i < num_threads; ++i)
 		{
-			success = false;
+			Thread* t = CE_NEW(default_allocator(), Thread)();
+			t->start(compile_thread, &ctx);
+			array::push_back(threads, t);
 		}
 
-		if (!success)
-		{
-			loge(COMPILER, "Error");
-			break;
-		}
-		else
+		compile_thread(&ctx);
+
+		for (u32 i = 0; i < array::size(threads); ++i)
 		{
-			if (!map::has(_data_index, dst_path))
-				map::set(_data_index, dst_path, src_path);
+			threads[i]->stop();
+			CE_DELETE(default_allocator(), threads[i]);
 		}
+		_idle_workers.store(0);
+
+		success = ctx.failed.load() == 0;
+		logi(COMPILER, "%d resources compiled, %d from cache, %u up to date"
+			, ctx.num_compiled.load()
+			, ctx.num_cached.load()
+			, num_up_to_date
+			);
 	}
 
+	db.save();
+
 	// Write index
 	{
 		File* file = data_filesystem.open("data_index.sjson", FileOpenMode::WRITE);
@@ -439,6 +725,23 @@ bool DataCompiler::compile(const char* data_dir, const char* platform)
 	return success;
 }
 
+bool DataCompiler::acquire_worker()
+{
+	for (;;)
+	{
+		const int idle = _idle_workers.load();
+		if (idle <= 0)
+			return false;
+		if (_idle_workers.compare_and_swap(idle, idle - 1))
+			return true;
+	}
+}
+
+void DataCompiler::release_worker()
+{
+	_idle_workers.fetch_add(1);
+}
+
 void DataCompiler::register_compiler(StringId64 type, u32 version, CompileFunction compiler)
 {
 	CE_ASSERT(!hash_map::has(_compilers, type), "Type already registered");
@@ -465,12 +768,6 @@ bool DataCompiler::can_compile(StringId64 type)
 	return hash_map::has(_compilers, type);
 }
 
-void DataCompiler::error(const char* msg, va_list args)
-{
-	logev(COMPILER, msg, args);
-	longjmp(_jmpbuf, 1);
-}
-
 void DataCompiler::filemonitor_callback(FileMonitorEvent::Enum fme, bool is_dir, const char* path, const char* path_renamed)
 {
 	TempAllocator512 ta;
@@ -610,6 +907,13 @@ int main_data_compiler(int argc, char** argv)
 			);
 	}
 
+	CompileCache* cache = NULL;
+	if (!opts._cache_dir.empty())
+	{
+		cache = CE_NEW(default_allocator(), CompileCacheDisk)(default_allocator(), opts._cache_dir.c_str());
+		dc->set_cache(cache);
+	}
+
 	dc->scan();
 
 	bool success = true;
@@ -628,6 +932,7 @@ int main_data_compiler(int argc, char** argv)
 	}
 
 	CE_DELETE(default_allocator(), dc);
+	CE_DELETE(default_allocator(), cache);
 	console_server_globals::shutdown();
 
 	return success ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -8,9 +8,9 @@
 #include "core/containers/types.h"
 #include "core/filesystem/file_monitor.h"
 #include "core/filesystem/filesystem_disk.h"
+#include "core/thread/atomic_int.h"
 #include "device/console_server.h"
 #include "resource/types.h"
-#include <setjmp.h>
 
 namespace crown
 {
@@ -35,7 +35,8 @@ struct DataCompiler
 	Vector<DynamicString> _globs;
 	Map<DynamicString, DynamicString> _data_index;
 	FileMonitor _file_monitor;
-	jmp_buf _jmpbuf;
+	CompileCache* _cache;
+	AtomicInt _idle_workers; // Processors not used by the threads compiling resources
 
 	void add_file(const char* path);
 	void add_tree(const char* path);
@@ -55,6 +56,10 @@ struct DataCompiler
 	///
 	void map_source_dir(const char* name, const char* source_dir);
 
+	/// Sets the @a cache to look the resources up before compiling them.
+	/// The cache is not owned by the data compiler.
+	void set_cache(CompileCache* cache);
+
 	///
 	void source_dir(const char* resource_name, DynamicString& source_dir);
 
@@ -68,6 +73,15 @@ struct DataCompiler
 	/// Returns true on success, false otherwise.
 	bool compile(const char* data_dir, const char* platform);
 
+	/// Reserves one of the processors left idle by the threads compiling
+	/// resources, so that a compiler can do work in parallel without
+	/// exceeding the number of processors. Returns false if none is idle.
+	/// Every successful call must be matched by a call to release_worker().
+	bool acquire_worker();
+
+	/// Gives back a processor reserved with acquire_worker().
+	void release_worker();
+
 	/// Registers the resource @a compiler for the given resource @a type and @a version.
 	void register_compiler(StringId64 type, u32 version, CompileFunction compiler);
 
@@ -78,9 +92,6 @@ struct DataCompiler
 	/// is found.
 	u32 version(StringId64 type);
 
-	///
-	void error(const char* msg, va_list args);
-
 	static const u32 COMPILER_NOT_FOUND = UINT32_MAX;
 };
 
@@ -3,27 +3,687 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "core/containers/hash_map.h"
 #include "core/containers/map.h"
 #include "core/containers/vector.h"
 #include "core/filesystem/filesystem.h"
 #include "core/filesystem/reader_writer.h"
-#include "core/json/json_object.h"
+#include "core/json/json_tape.h"
 #include "core/json/sjson.h"
 #include "core/math/aabb.h"
+#include "core/math/intersection.h"
+#include "core/math/math.h"
 #include "core/math/matrix4x4.h"
 #include "core/math/vector2.h"
 #include "core/math/vector3.h"
 #include "core/memory/temp_allocator.h"
+#include "core/murmur.h"
 #include "core/strings/dynamic_string.h"
 #include "device/log.h"
 #include "resource/compile_options.h"
 #include "resource/mesh_resource.h"
 #include "resource/resource_manager.h"
+#include <algorithm> // std::sort, std::nth_element
+#include <math.h> // fabs, powf
+
+// Number of vertices in the simulated post-transform cache
+#define MESH_VERTEX_CACHE_SIZE 32
 
 namespace crown
 {
 namespace mesh_resource_internal
 {
+	// Scores a vertex by its position in the simulated post-transform cache
+	// and by the number of triangles that still use it.
+	// See: https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+	static f32 vertex_score(s32 cache_position, u32 num_triangles)
+	{
+		if (num_triangles == 0)
+			return -1.0f;
+
+		f32 score = 0.0f;
+		if (cache_position >= 3)
+		{
+			const f32 scaler = 1.0f / (MESH_VERTEX_CACHE_SIZE - 3);
+			score = powf(1.0f - (cache_position - 3) * scaler, 1.5f);
+		}
+		else if (cache_position >= 0)
+		{
+			// Vertices of the last triangle are penalized
+			// to avoid strips that turn back on themselves
+			score = 0.75f;
+		}
+
+		// Vertices with few triangles left are boosted
+		// so that they get out of the way sooner
+		return score + 2.0f * powf((f32)num_triangles, -0.5f);
+	}
+
+	// Reorders the triangles in @a indices to make the best use of
+	// the post-transform vertex cache.
+	static void optimize_vertex_cache(u32* indices, u32 num_indices, u32 num_vertices)
+	{
+		const u32 num_triangles = num_indices / 3;
+
+		// Triangles using each vertex, only the first num_remaining[v] are not yet emitted
+		Array<u32> num_remaining(default_allocator());
+		Array<u32> offsets(default_allocator());
+		Array<u32> triangles(default_allocator());
+		array::resize(num_remaining, num_vertices);
+		array::resize(offsets, num_vertices + 1);
+		array::resize(triangles, num_indices);
+		memset(array::begin(num_remaining), 0, num_vertices*sizeof(u32));
+
+		for (u32 i = 0; i < num_indices; ++i)
+			++num_remaining[indices[i]];
+
+		offsets[0] = 0;
+		for (u32 v = 0; v < num_vertices; ++v)
+			offsets[v + 1] = offsets[v] + num_remaining[v];
+
+		for (u32 v = 0; v < num_vertices; ++v)
+			num_remaining[v] = 0;
+
+		for (u32 i = 0; i < num_indices; ++i)
+		{
+			const u32 v = indices[i];
+			triangles[offsets[v] + num_remaining[v]++] = i / 3;
+		}
+
+		Array<s32> cache_position(default_allocator());
+		Array<f32> vscore(default_allocator());
+		Array<f32> tscore(default_allocator());
+		Array<u32> output(default_allocator());
+		array::resize(cache_position, num_vertices);
+		array::resize(vscore, num_vertices);
+		array::resize(tscore, num_triangles);
+		array::resize(output, num_indices);
+
+		for (u32 v = 0; v < num_vertices; ++v)
+		{
+			cache_position[v] = -1;
+			vscore[v] = vertex_score(-1, num_remaining[v]);
+		}
+
+		u32 best = UINT32_MAX;
+		f32 best_score = -1.0f;
+		for (u32 t = 0; t < num_triangles; ++t)
+		{
+			tscore[t] = vscore[indices[t*3 + 0]] + vscore[indices[t*3 + 1]] + vscore[indices[t*3 + 2]];
+			if (tscore[t] > best_score)
+			{
+				best = t;
+				best_score = tscore[t];
+			}
+		}
+
+		u32 cache[MESH_VERTEX_CACHE_SIZE + 3];
+		u32 cache_size = 0;
+		u32 next_unemitted = 0;
+
+		for (u32 n = 0; n < num_triangles; ++n)
+		{
+			if (best == UINT32_MAX)
+			{
+				// Nothing in the cache is useful, continue with any triangle left
+				while (tscore[next_unemitted] < 0.0f)
+					++next_unemitted;
+				best = next_unemitted;
+			}
+
+			const u32* tri = &indices[best*3];
+			output[n*3 + 0] = tri[0];
+			output[n*3 + 1] = tri[1];
+			output[n*3 + 2] = tri[2];
+			tscore[best] = -1.0f;
+
+			// Remove the triangle from the vertices that use it
+			for (u32 k = 0; k < 3; ++k)
+			{
+				const u32 v = tri[k];
+				u32* first = &triangles[offsets[v]];
+				u32 j = 0;
+				while (first[j] != best)
+					++j;
+				first[j] = first[--num_remaining[v]];
+			}
+
+			// Move the vertices of the triangle to the front of the cache
+			u32 new_cache[MESH_VERTEX_CACHE_SIZE + 3];
+			u32 new_size = 0;
+			new_cache[new_size++] = tri[0];
+			if (tri[1] != tri[0])
+				new_cache[new_size++] = tri[1];
+			if (tri[2] != tri[0] && tri[2] != tri[1])
+				new_cache[new_size++] = tri[2];
+			for (u32 i = 0; i < cache_size; ++i)
+			{
+				const u32 v = cache[i];
+				if (v != tri[0] && v != tri[1] && v != tri[2])
+					new_cache[new_size++] = v;
+			}
+
+			// Update the scores of the vertices whose cache position changed
+			for (u32 i = 0; i < new_size; ++i)
+			{
+				const u32 v = new_cache[i];
+				cache_position[v] = i < MESH_VERTEX_CACHE_SIZE ? s32(i) : -1;
+
+				const f32 score = vertex_score(cache_position[v], num_remaining[v]);
+				const f32 delta = score - vscore[v];
+				vscore[v] = score;
+
+				for (u32 j = 0; j < num_remaining[v]; ++j)
+					tscore[triangles[offsets[v] + j]] += delta;
+			}
+
+			cache_size = new_size < MESH_VERTEX_CACHE_SIZE ? new_size : MESH_VERTEX_CACHE_SIZE;
+			memcpy(cache, new_cache, cache_size*sizeof(u32));
+
+			// Continue with the best triangle using the cached vertices
+			best = UINT32_MAX;
+			best_score = -1.0f;
+			for (u32 i = 0; i < cache_size; ++i)
+			{
+				const u32 v = cache[i];
+				for (u32 j = 0; j < num_remaining[v]; ++j)
+				{
+					const u32 t = triangles[offsets[v] + j];
+					if (tscore[t] > best_score)
+					{
+						best = t;
+						best_score = tscore[t];
+					}
+				}
+			}
+		}
+
+		memcpy(indices, array::begin(output), num_indices*sizeof(u32));
+	}
+
+	// Reorders the vertices in the order they are first used by @a indices
+	// and puts them into @a output. The new index of each vertex, or UINT32_MAX
+	// if unused, is stored in @a remap.
+	static void optimize_vertex_fetch(u32* indices, u32 num_indices, const char* vertices, u32 num_vertices, u32 stride, Array<char>& output, Array<u32>& remap)
+	{
+		array::resize(remap, num_vertices);
+		for (u32 v = 0; v < num_vertices; ++v)
+			remap[v] = UINT32_MAX;
+
+		array::resize(output, num_vertices*stride);
+
+		u32 next = 0;
+		for (u32 i = 0; i < num_indices; ++i)
+		{
+			const u32 v = indices[i];
+			if (remap[v] == UINT32_MAX)
+			{
+				remap[v] = next++;
+				memcpy(&output[remap[v]*stride], &vertices[v*stride], stride);
+			}
+
+			indices[i] = remap[v];
+		}
+
+		array::resize(output, next*stride);
+	}
+
+	// Symmetric 4x4 matrix measuring the squared distance of a point from a set of planes.
+	// See: Garland, Heckbert, "Surface Simplification Using Quadric Error Metrics".
+	struct Quadric
+	{
+		f64 a00, a01, a02, a03;
+		f64 a11, a12, a13;
+		f64 a22, a23;
+		f64 a33;
+	};
+
+	static void quadric_add_plane(Quadric& q, const Vector3& n, f64 d, f64 w)
+	{
+		q.a00 += w*n.x*n.x; q.a01 += w*n.x*n.y; q.a02 += w*n.x*n.z; q.a03 += w*n.x*d;
+		q.a11 += w*n.y*n.y; q.a12 += w*n.y*n.z; q.a13 += w*n.y*d;
+		q.a22 += w*n.z*n.z; q.a23 += w*n.z*d;
+		q.a33 += w*d*d;
+	}
+
+	static void quadric_add(Quadric& q, const Quadric& b)
+	{
+		q.a00 += b.a00; q.a01 += b.a01; q.a02 += b.a02; q.a03 += b.a03;
+		q.a11 += b.a11; q.a12 += b.a12; q.a13 += b.a13;
+		q.a22 += b.a22; q.a23 += b.a23;
+		q.a33 += b.a33;
+	}
+
+	static f64 quadric_error(const Quadric& q, const Vector3& p)
+	{
+		const f64 x = p.x;
+		const f64 y = p.y;
+		const f64 z = p.z;
+		return x*x*q.a00 + 2.0*x*y*q.a01 + 2.0*x*z*q.a02 + 2.0*x*q.a03
+			+ y*y*q.a11 + 2.0*y*z*q.a12 + 2.0*y*q.a13
+			+ z*z*q.a22 + 2.0*z*q.a23
+			+ q.a33
+			;
+	}
+
+	struct Collapse
+	{
+		u32 from;
+		u32 to;
+		f64 error;
+
+		bool operator<(const Collapse& c) const
+		{
+			return error < c.error;
+		}
+	};
+
+	// Simplifies a triangle list by collapsing its edges, cheapest first.
+	// A vertex is only ever moved onto one of its neighbors, so that all the
+	// levels of detail can share the same vertices. Vertices on borders and
+	// on attribute seams never move.
+	struct MeshSimplifier
+	{
+		const Vector3* _positions;
+		u32 _num_vertices;
+		Array<u32> _indices;
+		Array<Quadric> _quadrics;
+		Array<bool> _locked;
+
+		MeshSimplifier(const u32* indices, u32 num_indices, const Vector3* positions, u32 num_vertices)
+			: _positions(positions)
+			, _num_vertices(num_vertices)
+			, _indices(default_allocator())
+			, _quadrics(default_allocator())
+			, _locked(default_allocator())
+		{
+			array::push(_indices, indices, num_indices);
+			array::resize(_quadrics, num_vertices);
+			array::resize(_locked, num_vertices);
+			memset(array::begin(_quadrics), 0, num_vertices*sizeof(Quadric));
+
+			// Vertices sharing their position with other vertices are on a seam
+			HashMap<u64, u32> position_map(default_allocator());
+			Array<u32> position_class(default_allocator());
+			array::resize(position_class, num_vertices);
+			for (u32 v = 0; v < num_vertices; ++v)
+			{
+				_locked[v] = false;
+
+				u64 key = murmur64(&positions[v], sizeof(Vector3), 0);
+				while (true)
+				{
+					const u32 first = hash_map::get(position_map, key, UINT32_MAX);
+					if (first == UINT32_MAX)
+					{
+						hash_map::set(position_map, key, v);
+						position_class[v] = v;
+						break;
+					}
+					if (memcmp(&positions[first], &positions[v], sizeof(Vector3)) == 0)
+					{
+						position_class[v] = first;
+						_locked[v] = true;
+						_locked[first] = true;
+						break;
+					}
+					++key;
+				}
+			}
+
+			// Edges not shared by exactly two triangles are on a border
+			HashMap<u64, u32> edges(default_allocator());
+			for (u32 i = 0; i < num_indices; i += 3)
+			{
+				for (u32 e = 0; e < 3; ++e)
+				{
+					const u32 a = position_class[indices[i + e]];
+					const u32 b = position_class[indices[i + (e + 1) % 3]];
+					const u64 key = a < b ? (u64(a) << 32 | b) : (u64(b) << 32 | a);
+					hash_map::set(edges, key, hash_map::get(edges, key, 0u) + 1);
+				}
+			}
+			for (u32 i = 0; i < num_indices; i += 3)
+			{
+				for (u32 e = 0; e < 3; ++e)
+				{
+					const u32 a = position_class[indices[i + e]];
+					const u32 b = position_class[indices[i + (e + 1) % 3]];
+					const u64 key = a < b ? (u64(a) << 32 | b) : (u64(b) << 32 | a);
+					if (hash_map::get(edges, key, 0u) != 2)
+					{
+						_locked[indices[i + e]] = true;
+						_locked[indices[i + (e + 1) % 3]] = true;
+					}
+				}
+			}
+
+			// Each vertex starts with the planes of its triangles, weighted by their area
+			for (u32 i = 0; i < num_indices; i += 3)
+			{
+				const Vector3& p0 = positions[indices[i + 0]];
+				const Vector3& p1 = positions[indices[i + 1]];
+				const Vector3& p2 = positions[indices[i + 2]];
+
+				Vector3 n = cross(p1 - p0, p2 - p0);
+				const f32 len = length(n);
+				if (len == 0.0f)
+					continue;
+
+				n *= 1.0f / len;
+				const f64 d = -dot(n, p0);
+				for (u32 j = 0; j < 3; ++j)
+					quadric_add_plane(_quadrics[indices[i + j]], n, d, len * 0.5);
+			}
+		}
+
+		// Returns whether moving @a from onto @a to flips any of the
+		// triangles around @a from.
+		bool flips(u32 from, u32 to, const u32* triangles, u32 num_triangles) const
+		{
+			for (u32 i = 0; i < num_triangles; ++i)
+			{
+				const u32* tri = &_indices[triangles[i] * 3];
+				if (tri[0] == to || tri[1] == to || tri[2] == to)
+					continue;
+
+				Vector3 p[3];
+				Vector3 q[3];
+				for (u32 j = 0; j < 3; ++j)
+				{
+					p[j] = _positions[tri[j]];
+					q[j] = tri[j] == from ? _positions[to] : p[j];
+				}
+
+				const Vector3 n0 = cross(p[1] - p[0], p[2] - p[0]);
+				const Vector3 n1 = cross(q[1] - q[0], q[2] - q[0]);
+				if (dot(n0, n1) <= 0.0f)
+					return true;
+			}
+
+			return false;
+		}
+
+		// Collapses edges until there are no more than @a target_indices indices
+		// or no edge can be collapsed.
+		void simplify(u32 target_indices)
+		{
+			Array<u32> offsets(default_allocator());
+			Array<u32> triangles(default_allocator());
+			Array<u32> count(default_allocator());
+			Array<Collapse> collapses(default_allocator());
+			Array<u32> collapse_to(default_allocator());
+			Array<bool> touched(default_allocator());
+			array::resize(offsets, _num_vertices + 1);
+			array::resize(count, _num_vertices);
+			array::resize(collapse_to, _num_vertices);
+			array::resize(touched, _num_vertices);
+
+			while (array::size(_indices) > target_indices)
+			{
+				const u32 num_indices = array::size(_indices);
+
+				// Triangles around each vertex
+				memset(array::begin(count), 0, _num_vertices*sizeof(u32));
+				for (u32 i = 0; i < num_indices; ++i)
+					++count[_indices[i]];
+
+				offsets[0] = 0;
+				for (u32 v = 0; v < _num_vertices; ++v)
+					offsets[v + 1] = offsets[v] + count[v];
+
+				array::resize(triangles, num_indices);
+				memset(array::begin(count), 0, _num_vertices*sizeof(u32));
+				for (u32 i = 0; i < num_indices; ++i)
+				{
+					const u32 v = _indices[i];
+					triangles[offsets[v] + count[v]++] = i / 3;
+				}
+
+				// Cheapest collapse of each vertex
+				array::clear(collapses);
+				for (u32 v = 0; v < _num_vertices; ++v)
+				{
+					if (_locked[v])
+						continue;
+
+					Collapse best;
+					best.from = v;
+					best.to = UINT32_MAX;
+					best.error = 0.0;
+
+					for (u32 t = offsets[v]; t < offsets[v + 1]; ++t)
+					{
+						const u32* tri = &_indices[triangles[t] * 3];
+						for (u32 j = 0; j < 3; ++j)
+						{
+							if (tri[j] == v)
+								continue;
+
+							Quadric q = _quadrics[v];
+							quadric_add(q, _quadrics[tri[j]]);
+							const f64 error = quadric_error(q, _positions[tri[j]]);
+							if (best.to == UINT32_MAX || error < best.error)
+							{
+								best.to = tri[j];
+								best.error = error;
+							}
+						}
+					}
+
+					if (best.to != UINT32_MAX)
+						array::push_back(collapses, best);
+				}
+
+				std::sort(array::begin(collapses), array::end(collapses));
+
+				// Apply the collapses that do not touch each other's triangles
+				for (u32 v = 0; v < _num_vertices; ++v)
+				{
+					collapse_to[v] = v;
+					touched[v] = false;
+				}
+
+				u32 removed = 0;
+				u32 num_collapsed = 0;
+				for (u32 i = 0; i < array::size(collapses) && num_indices - removed > target_indices; ++i)
+				{
+					const Collapse& c = collapses[i];
+					if (touched[c.from] || touched[c.to])
+						continue;
+
+					const u32 num = offsets[c.from + 1] - offsets[c.from];
+					if (flips(c.from, c.to, &triangles[offsets[c.from]], num))
+						continue;
+
+					for (u32 t = offsets[c.from]; t < offsets[c.from + 1]; ++t)
+					{
+						const u32* tri = &_indices[triangles[t] * 3];
+						touched[tri[0]] = true;
+						touched[tri[1]] = true;
+						touched[tri[2]] = true;
+
+						if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+							removed += 3;
+					}
+
+					collapse_to[c.from] = c.to;
+					quadric_add(_quadrics[c.to], _quadrics[c.from]);
+					++num_collapsed;
+				}
+
+				if (num_collapsed == 0)
+					break;
+
+				// Remove the triangles that became degenerate
+				u32 n = 0;
+				for (u32 i = 0; i < num_indices; i += 3)
+				{
+					const u32 a = collapse_to[_indices[i + 0]];
+					const u32 b = collapse_to[_indices[i + 1]];
+					const u32 c = collapse_to[_indices[i + 2]];
+					if (a == b || b == c || c == a)
+						continue;
+
+					_indices[n++] = a;
+					_indices[n++] = b;
+					_indices[n++] = c;
+				}
+				array::resize(_indices, n);
+			}
+		}
+	};
+
+	struct Quantization
+	{
+		enum Enum
+		{
+			FLOAT,
+			HALF,
+			UNORM16,
+			INT8,
+			OCTAHEDRAL,
+
+			COUNT
+		};
+	};
+
+	struct QuantizationInfo
+	{
+		const char* name;
+		Quantization::Enum value;
+	};
+
+	static const QuantizationInfo _quantization_map[] =
+	{
+		{ "float",      Quantization::FLOAT      },
+		{ "half",       Quantization::HALF       },
+		{ "unorm16",    Quantization::UNORM16    },
+		{ "int8",       Quantization::INT8       },
+		{ "octahedral", Quantization::OCTAHEDRAL }
+	};
+	CE_STATIC_ASSERT(countof(_quantization_map) == Quantization::COUNT);
+
+	static Quantization::Enum name_to_quantization(const char* name)
+	{
+		for (u32 i = 0; i < countof(_quantization_map); ++i)
+		{
+			if (strcmp(name, _quantization_map[i].name) == 0)
+				return _quantization_map[i].value;
+		}
+
+		return Quantization::COUNT;
+	}
+
+	// Maps the unit vector @a n to the [-1; 1] square by projecting it onto
+	// the octahedron |x| + |y| + |z| = 1 and folding the lower half over the upper.
+	static Vector2 octahedral_encode(const Vector3& n)
+	{
+		const f32 l1 = fabs(n.x) + fabs(n.y) + fabs(n.z);
+		Vector2 e = vector2(n.x / l1, n.y / l1);
+
+		if (n.z < 0.0f)
+		{
+			const Vector2 f = e;
+			e.x = (1.0f - fabs(f.y)) * (f.x >= 0.0f ? 1.0f : -1.0f);
+			e.y = (1.0f - fabs(f.x)) * (f.y >= 0.0f ? 1.0f : -1.0f);
+		}
+
+		return e;
+	}
+
+	struct LodOption
+	{
+		f32 ratio;
+		f32 screen_size;
+	};
+
+	struct TriangleCentroidLess
+	{
+		const Vector3* _centroids;
+		u32 _axis;
+
+		TriangleCentroidLess(const Vector3* centroids, u32 axis)
+			: _centroids(centroids)
+			, _axis(axis)
+		{
+		}
+
+		bool operator()(u32 a, u32 b) const
+		{
+			return to_float_ptr(_centroids[a])[_axis] < to_float_ptr(_centroids[b])[_axis];
+		}
+	};
+
+	// Builds the subtree of the @a num triangles starting at @a first by splitting
+	// them in halves along the longest axis of their centroids. Returns the index
+	// of the root of the subtree.
+	static u32 build_bvh(Array<MeshBVHNode>& nodes, u32* triangles, u32 first, u32 num, const AABB* bounds, const Vector3* centroids)
+	{
+		const u32 node = array::size(nodes);
+		array::resize(nodes, node + 1);
+
+		AABB aabb = bounds[triangles[first]];
+		AABB centers;
+		centers.min = centroids[triangles[first]];
+		centers.max = centroids[triangles[first]];
+		for (u32 i = first + 1; i < first + num; ++i)
+		{
+			aabb.min = min(aabb.min, bounds[triangles[i]].min);
+			aabb.max = max(aabb.max, bounds[triangles[i]].max);
+			centers.min = min(centers.min, centroids[triangles[i]]);
+			centers.max = max(centers.max, centroids[triangles[i]]);
+		}
+		nodes[node].aabb = aabb;
+
+		if (num <= MESH_BVH_MAX_TRIANGLES)
+		{
+			nodes[node].offset = first;
+			nodes[node].num    = num;
+			return node;
+		}
+
+		const Vector3 extents = centers.max - centers.min;
+		const u32 axis = extents.x > extents.y
+			? (extents.x > extents.z ? 0 : 2)
+			: (extents.y > extents.z ? 1 : 2)
+			;
+
+		const u32 half = num / 2;
+		std::nth_element(&triangles[first]
+			, &triangles[first + half]
+			, &triangles[first + num]
+			, TriangleCentroidLess(centroids, axis)
+			);
+
+		build_bvh(nodes, triangles, first, half, bounds, centroids);
+		const u32 right = build_bvh(nodes, triangles, first + half, num - half, bounds, centroids);
+		nodes[node].offset = right;
+		nodes[node].num    = 0;
+		return node;
+	}
+
+	// Compiles the geometries of a .mesh. Its optional quantization object
+	// selects how the vertex attributes of all the geometries are stored:
+	//
+	// quantization = {
+	//     position = "float" | "half" | "unorm16"
+	//     normal   = "float" | "int8" | "octahedral"
+	//     texcoord = "float" | "half" | "unorm16"
+	// }
+	//
+	// Quantized positions are relative to the bounds of the geometry and
+	// are brought back to mesh space by MeshGeometry::dequantize_positions,
+	// the other attributes are dequantized by the mesh shader.
+	//
+	// The optional lods array adds simplified levels of detail, each keeping
+	// a ratio of the triangles of the geometry and drawn when its bounding
+	// sphere covers less than screen_size of the screen height:
+	//
+	// lods = [
+	//     { ratio = 0.5 screen_size = 0.25 }
+	//     { ratio = 0.2 screen_size = 0.1 }
+	// ]
 	struct MeshCompiler
 	{
 		CompileOptions& _opts;
@@ -34,23 +694,35 @@ namespace mesh_resource_internal
 		Array<f32> _tangents;
 		Array<f32> _binormals;
 
-		Array<u16> _position_indices;
-		Array<u16> _normal_indices;
-		Array<u16> _uv_indices;
-		Array<u16> _tangent_indices;
-		Array<u16> _binormal_indices;
+		Array<u32> _position_indices;
+		Array<u32> _normal_indices;
+		Array<u32> _uv_indices;
+		Array<u32> _tangent_indices;
+		Array<u32> _binormal_indices;
 
 		Matrix4x4 _matrix_local;
 
 		u32 _vertex_stride;
 		Array<char> _vertex_buffer;
-		Array<u16> _index_buffer;
+		Array<u32> _index_buffer;
 
 		AABB _aabb;
 		OBB _obb;
 
 		bgfx::VertexDecl _decl;
 
+		Array<LodOption> _lod_options;
+		Array<MeshLod> _lods;
+		Array<Vector3> _vertex_positions;
+		Array<MeshBVHNode> _bvh_nodes;
+		Array<u32> _bvh_triangles;
+
+		Quantization::Enum _position_quantization;
+		Quantization::Enum _normal_quantization;
+		Quantization::Enum _uv_quantization;
+		Matrix4x4 _dequantize_positions;
+		Vector4 _dequantize_attributes;
+
 		bool _has_normal;
 		bool _has_uv;
 
@@ -70,6 +742,16 @@ namespace mesh_resource_internal
 			, _vertex_stride(0)
 			, _vertex_buffer(default_allocator())
 			, _index_buffer(default_allocator())
+			, _lod_options(default_allocator())
+			, _lods(default_allocator())
+			, _vertex_positions(default_allocator())
+			, _bvh_nodes(default_allocator())
+			, _bvh_triangles(default_allocator())
+			, _position_quantization(Quantization::FLOAT)
+			, _normal_quantization(Quantization::FLOAT)
+			, _uv_quantization(Quantization::FLOAT)
+			, _dequantize_positions(MATRIX4X4_IDENTITY)
+			, _dequantize_attributes(VECTOR4_ZERO)
 			, _has_normal(false)
 			, _has_uv(false)
 		{
@@ -92,6 +774,10 @@ namespace mesh_resource_internal
 			_vertex_stride = 0;
 			array::clear(_vertex_buffer);
 			array::clear(_index_buffer);
+			array::clear(_lods);
+			array::clear(_vertex_positions);
+			array::clear(_bvh_nodes);
+			array::clear(_bvh_triangles);
 
 			aabb::reset(_aabb);
 			memset(&_obb, 0, sizeof(_obb));
@@ -101,197 +787,575 @@ namespace mesh_resource_internal
 			_has_uv = false;
 		}
 
-		void parse(const char* geometry, const char* node)
+		// Returns the quantization @a key of the object @a node, defaulting to float.
+		Quantization::Enum parse_quantization(const JsonTape& tape, u32 node, const char* key)
+		{
+			const u32 value = json_tape::find(tape, node, key);
+			if (value == UINT32_MAX)
+				return Quantization::FLOAT;
+
+			TempAllocator64 ta;
+			DynamicString name(ta);
+			sjson::parse_string(json_tape::node(tape, value).json, name);
+
+			const Quantization::Enum q = name_to_quantization(name.c_str());
+			DATA_COMPILER_ASSERT(q != Quantization::COUNT
+				, _opts
+				, "Unknown %s quantization: '%s'"
+				, key
+				, name.c_str()
+				);
+			return q;
+		}
+
+		void parse_quantization(const MeshSource& source)
+		{
+			const JsonTape& tape = source._tape;
+			const u32 quantization = json_tape::find(tape, 0, "quantization");
+			if (quantization == UINT32_MAX)
+				return;
+
+			_position_quantization = parse_quantization(tape, quantization, "position");
+			_normal_quantization   = parse_quantization(tape, quantization, "normal");
+			_uv_quantization       = parse_quantization(tape, quantization, "texcoord");
+
+			DATA_COMPILER_ASSERT(_position_quantization == Quantization::FLOAT
+				|| _position_quantization == Quantization::HALF
+				|| _position_quantization == Quantization::UNORM16
+				, _opts
+				, "Positions can be float, half or unorm16"
+				);
+			DATA_COMPILER_ASSERT(_normal_quantization == Quantization::FLOAT
+				|| _normal_quantization == Quantization::INT8
+				|| _normal_quantization == Quantization::OCTAHEDRAL
+				, _opts
+				, "Normals can be float, int8 or octahedral"
+				);
+			DATA_COMPILER_ASSERT(_uv_quantization == Quantization::FLOAT
+				|| _uv_quantization == Quantization::HALF
+				|| _uv_quantization == Quantization::UNORM16
+				, _opts
+				, "Texcoords can be float, half or unorm16"
+				);
+		}
+
+		// Reads the levels of detail to generate from the .mesh @a source.
+		void parse_lods(const MeshSource& source)
+		{
+			const JsonTape& tape = source._tape;
+			const u32 lods = json_tape::find(tape, 0, "lods");
+			if (lods == UINT32_MAX)
+				return;
+
+			DATA_COMPILER_ASSERT(json_tape::size(tape, lods) < MESH_MAX_LODS
+				, _opts
+				, "Too many LODs, maximum is %d"
+				, MESH_MAX_LODS - 1
+				);
+
+			for (u32 cur = json_tape::begin(tape, lods), end = json_tape::end(tape, lods); cur != end; cur = json_tape::next(tape, cur))
+			{
+				LodOption lod;
+				lod.ratio       = json_tape::to_float(tape, json_tape::get(tape, cur, "ratio"));
+				lod.screen_size = json_tape::to_float(tape, json_tape::get(tape, cur, "screen_size"));
+
+				const f32 prev_ratio = array::empty(_lod_options) ? 1.0f : array::back(_lod_options).ratio;
+				DATA_COMPILER_ASSERT(lod.ratio > 0.0f && lod.ratio < prev_ratio
+					, _opts
+					, "LOD ratios must decrease from 1 to 0"
+					);
+
+				const bool decreasing = array::empty(_lod_options) || lod.screen_size < array::back(_lod_options).screen_size;
+				DATA_COMPILER_ASSERT(lod.screen_size > 0.0f && decreasing
+					, _opts
+					, "LOD screen sizes must decrease"
+					);
+
+				array::push_back(_lod_options, lod);
+			}
+		}
+
+		void parse(const MeshSource& source, u32 geometry, u32 node)
 		{
-			TempAllocator4096 ta;
-			JsonObject object(ta);
-			JsonObject object_node(ta);
-			sjson::parse(geometry, object);
-			sjson::parse(node, object_node);
+			const JsonTape& tape = source._tape;
 
-			_has_normal = json_object::has(object, "normal");
-			_has_uv     = json_object::has(object, "texcoord");
+			_has_normal = json_tape::has(tape, geometry, "normal");
+			_has_uv     = json_tape::has(tape, geometry, "texcoord");
 
-			parse_float_array(object["position"], _positions);
+			source.parse_floats(_opts, json_tape::get(tape, geometry, "position"), _positions);
 
 			if (_has_normal)
 			{
-				parse_float_array(object["normal"], _normals);
+				source.parse_floats(_opts, json_tape::get(tape, geometry, "normal"), _normals);
 			}
 			if (_has_uv)
 			{
-				parse_float_array(object["texcoord"], _uvs);
+				source.parse_floats(_opts, json_tape::get(tape, geometry, "texcoord"), _uvs);
 			}
 
-			parse_indices(object["indices"]);
+			// Position, normal and texcoord indices, in this order
+			const u32 data = json_tape::get(tape, json_tape::get(tape, geometry, "indices"), "data");
+			u32 cur = json_tape::begin(tape, data);
+			source.parse_indices(_opts, cur, _position_indices);
 
-			_matrix_local = sjson::parse_matrix4x4(object_node["matrix_local"]);
-		}
-
-		void parse_float_array(const char* array_json, Array<f32>& output)
-		{
-			TempAllocator4096 ta;
-			JsonArray array(ta);
-			sjson::parse_array(array_json, array);
-
-			array::resize(output, array::size(array));
-			for (u32 i = 0; i < array::size(array); ++i)
+			cur = json_tape::next(tape, cur);
+			if (_has_normal)
 			{
-				output[i] = sjson::parse_float(array[i]);
+				source.parse_indices(_opts, cur, _normal_indices);
 			}
-		}
 
-		void parse_index_array(const char* array_json, Array<u16>& output)
-		{
-			TempAllocator4096 ta;
-			JsonArray array(ta);
-			sjson::parse_array(array_json, array);
-
-			array::resize(output, array::size(array));
-			for (u32 i = 0; i < array::size(array); ++i)
+			cur = json_tape::next(tape, cur);
+			if (_has_uv)
 			{
-				output[i] = (u16)sjson::parse_int(array[i]);
+				source.parse_indices(_opts, cur, _uv_indices);
 			}
+
+			_matrix_local = sjson::parse_matrix4x4(json_tape::node(tape, json_tape::get(tape, node, "matrix_local")).json);
 		}
 
-		void parse_indices(const char* json)
+		void compile()
 		{
-			TempAllocator4096 ta;
-			JsonObject object(ta);
-			sjson::parse(json, object);
+			// Bounds
+			aabb::reset(_aabb);
+			aabb::add_points(_aabb
+				, array::size(_positions) / 3
+				, sizeof(f32) * 3
+				, array::begin(_positions)
+				);
+			_aabb = aabb::transformed(_aabb, _matrix_local);
 
-			JsonArray data_json(ta);
-			sjson::parse_array(object["data"], data_json);
+			const Vector3 center = aabb::center(_aabb);
+			_obb.tm = matrix4x4(QUATERNION_IDENTITY, center);
+			_obb.half_extents.x = (_aabb.max.x - _aabb.min.x) * 0.5f;
+			_obb.half_extents.y = (_aabb.max.y - _aabb.min.y) * 0.5f;
+			_obb.half_extents.z = (_aabb.max.z - _aabb.min.z) * 0.5f;
 
-			parse_index_array(data_json[0], _position_indices);
+			// Vertex decl
+			_decl.begin();
+
+			if (_position_quantization == Quantization::HALF)
+				_decl.add(bgfx::Attrib::Position, 3, bgfx::AttribType::Half);
+			else if (_position_quantization == Quantization::UNORM16)
+				_decl.add(bgfx::Attrib::Position, 3, bgfx::AttribType::Int16, true, true);
+			else
+				_decl.add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float);
 
 			if (_has_normal)
 			{
-				parse_index_array(data_json[1], _normal_indices);
+				if (_normal_quantization == Quantization::INT8)
+					_decl.add(bgfx::Attrib::Normal, 4, bgfx::AttribType::Uint8, true, true);
+				else if (_normal_quantization == Quantization::OCTAHEDRAL)
+					_decl.add(bgfx::Attrib::Normal, 2, bgfx::AttribType::Int16, true, true);
+				else
+					_decl.add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Float, true);
 			}
 			if (_has_uv)
 			{
-				parse_index_array(data_json[2], _uv_indices);
+				if (_uv_quantization == Quantization::HALF)
+					_decl.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Half);
+				else if (_uv_quantization == Quantization::UNORM16)
+					_decl.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Int16, true, true);
+				else
+					_decl.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float);
 			}
-		}
 
-		void compile()
-		{
-			_vertex_stride = 0;
-			_vertex_stride += 3 * sizeof(f32);
-			_vertex_stride += (_has_normal ? 3 * sizeof(f32) : 0);
-			_vertex_stride += (_has_uv     ? 2 * sizeof(f32) : 0);
+			_decl.end();
+			_vertex_stride = _decl.getStride();
+
+			// Half positions are relative to the center of the bounds, unorm16
+			// positions are also scaled to fit the bounds in [-1; 1].
+			// The scale is uniform so that the mesh shader can still
+			// transform the normals by the model matrix.
+			Vector3 offset = VECTOR3_ZERO;
+			f32 scale = 1.0f;
+			if (_position_quantization != Quantization::FLOAT)
+				offset = center;
+			if (_position_quantization == Quantization::UNORM16)
+			{
+				scale = fmax(_obb.half_extents.x, fmax(_obb.half_extents.y, _obb.half_extents.z));
+				scale = scale > 0.0f ? scale : 1.0f;
+			}
+
+			_dequantize_positions = matrix4x4(offset);
+			_dequantize_positions.x.x = scale;
+			_dequantize_positions.y.y = scale;
+			_dequantize_positions.z.z = scale;
+
+			// Normals: n = a_normal * x + y, unfolded from the octahedron if z = 1.
+			// Texcoords: uv = a_texcoord0 * 0.5 + 0.5 if w = 1.
+			_dequantize_attributes.x = _normal_quantization == Quantization::INT8 ? 2.0f : 1.0f;
+			_dequantize_attributes.y = _normal_quantization == Quantization::INT8 ? -1.0f : 0.0f;
+			_dequantize_attributes.z = _normal_quantization == Quantization::OCTAHEDRAL ? 1.0f : 0.0f;
+			_dequantize_attributes.w = _uv_quantization == Quantization::UNORM16 ? 1.0f : 0.0f;
+
+			// Generate vb/ib, welding the corners whose quantized attributes are all equal
+			const u32 num_indices = array::size(_position_indices);
+			DATA_COMPILER_ASSERT(!_has_normal || array::size(_normal_indices) == num_indices
+				, _opts
+				, "Number of normal indices does not match number of position indices"
+				);
+			DATA_COMPILER_ASSERT(!_has_uv || array::size(_uv_indices) == num_indices
+				, _opts
+				, "Number of uv indices does not match number of position indices"
+				);
+			array::resize(_index_buffer, num_indices);
 
-			// Generate vb/ib
-			array::resize(_index_buffer, array::size(_position_indices));
+			HashMap<u64, u32> vertex_map(default_allocator());
+			Array<char> vertices(default_allocator());
+			u32 num_vertices = 0;
 
-			u16 index = 0;
-			for (u32 i = 0; i < array::size(_position_indices); ++i)
+			for (u32 i = 0; i < num_indices; ++i)
 			{
-				_index_buffer[i] = index++;
-
-				const u16 p_idx = _position_indices[i] * 3;
+				char vertex[32];
+				memset(vertex, 0, sizeof(vertex));
+
+				DATA_COMPILER_ASSERT(_position_indices[i] < array::size(_positions) / 3
+					, _opts
+					, "Position index out of bounds: %u"
+					, _position_indices[i]
+					);
+				const u32 p_idx = _position_indices[i] * 3;
 				Vector3 xyz;
 				xyz.x = _positions[p_idx + 0];
 				xyz.y = _positions[p_idx + 1];
 				xyz.z = _positions[p_idx + 2];
 				xyz = xyz * _matrix_local;
-				array::push(_vertex_buffer, (char*)&xyz, sizeof(xyz));
+				const Vector3 q = (xyz - offset) * (1.0f / scale);
+				pack(bgfx::Attrib::Position, q.x, q.y, q.z, vertex);
 
 				if (_has_normal)
 				{
-					const u16 n_idx = _normal_indices[i] * 3;
+					DATA_COMPILER_ASSERT(_normal_indices[i] < array::size(_normals) / 3
+						, _opts
+						, "Normal index out of bounds: %u"
+						, _normal_indices[i]
+						);
+					const u32 n_idx = _normal_indices[i] * 3;
 					Vector3 n;
 					n.x = _normals[n_idx + 0];
 					n.y = _normals[n_idx + 1];
 					n.z = _normals[n_idx + 2];
-					array::push(_vertex_buffer, (char*)&n, sizeof(n));
+
+					if (_normal_quantization == Quantization::OCTAHEDRAL)
+					{
+						const Vector2 e = octahedral_encode(normalize(n));
+						pack(bgfx::Attrib::Normal, e.x, e.y, 0.0f, vertex);
+					}
+					else if (_normal_quantization == Quantization::INT8)
+					{
+						n = normalize(n);
+						pack(bgfx::Attrib::Normal, n.x, n.y, n.z, vertex);
+					}
+					else
+					{
+						pack(bgfx::Attrib::Normal, n.x, n.y, n.z, vertex);
+					}
 				}
 				if (_has_uv)
 				{
-					const u16 t_idx = _uv_indices[i] * 2;
-					Vector2 uv;
-					uv.x = _uvs[t_idx + 0];
-					uv.y = _uvs[t_idx + 1];
-					array::push(_vertex_buffer, (char*)&uv, sizeof(uv));
+					DATA_COMPILER_ASSERT(_uv_indices[i] < array::size(_uvs) / 2
+						, _opts
+						, "UV index out of bounds: %u"
+						, _uv_indices[i]
+						);
+					const u32 t_idx = _uv_indices[i] * 2;
+					f32 u = _uvs[t_idx + 0];
+					f32 v = _uvs[t_idx + 1];
+
+					if (_uv_quantization == Quantization::UNORM16)
+					{
+						DATA_COMPILER_ASSERT(u >= 0.0f && u <= 1.0f && v >= 0.0f && v <= 1.0f
+							, _opts
+							, "Texcoords out of [0; 1] cannot be unorm16"
+							);
+						u = u * 2.0f - 1.0f;
+						v = v * 2.0f - 1.0f;
+					}
+					pack(bgfx::Attrib::TexCoord0, u, v, 0.0f, vertex);
+				}
+
+				// Colliding hashes are resolved by probing the following keys
+				u64 key = murmur64(vertex, _vertex_stride, 0);
+				while (true)
+				{
+					const u32 index = hash_map::get(vertex_map, key, UINT32_MAX);
+					if (index == UINT32_MAX)
+					{
+						_index_buffer[i] = num_vertices++;
+						array::push(vertices, (const char*)vertex, _vertex_stride);
+						array::push_back(_vertex_positions, xyz);
+						hash_map::set(vertex_map, key, _index_buffer[i]);
+						break;
+					}
+					if (memcmp(&vertices[index*_vertex_stride], vertex, _vertex_stride) == 0)
+					{
+						_index_buffer[i] = index;
+						break;
+					}
+					++key;
 				}
 			}
 
-			// Vertex decl
-			_decl.begin();
-			_decl.add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float);
+			// Levels of detail, simplified one after the other
+			MeshLod lod;
+			lod.first_index = 0;
+			lod.num_indices = num_indices;
+			lod.screen_size = 0.0f;
+			array::push_back(_lods, lod);
 
-			if (_has_normal)
+			if (!array::empty(_lod_options))
+			{
+				MeshSimplifier ms(array::begin(_index_buffer)
+					, num_indices
+					, array::begin(_vertex_positions)
+					, num_vertices
+					);
+
+				for (u32 i = 0; i < array::size(_lod_options); ++i)
+				{
+					ms.simplify(u32(num_indices / 3 * _lod_options[i].ratio) * 3);
+
+					// Stop when the geometry cannot be simplified any further
+					const u32 num_lod_indices = array::size(ms._indices);
+					if (num_lod_indices == 0 || num_lod_indices == array::back(_lods).num_indices)
+						break;
+
+					lod.first_index = array::size(_index_buffer);
+					lod.num_indices = num_lod_indices;
+					lod.screen_size = _lod_options[i].screen_size;
+					array::push_back(_lods, lod);
+					array::push(_index_buffer, array::begin(ms._indices), num_lod_indices);
+				}
+			}
+
+			for (u32 i = 0; i < array::size(_lods); ++i)
 			{
-				_decl.add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Float, true);
+				optimize_vertex_cache(&_index_buffer[_lods[i].first_index]
+					, _lods[i].num_indices
+					, num_vertices
+					);
 			}
-			if (_has_uv)
+
+			// Vertices are ordered as LOD 0 uses them, the other LODs only use a subset
+			Array<u32> remap(default_allocator());
+			optimize_vertex_fetch(array::begin(_index_buffer)
+				, num_indices
+				, array::begin(vertices)
+				, num_vertices
+				, _vertex_stride
+				, _vertex_buffer
+				, remap
+				);
+
+			for (u32 i = num_indices; i < array::size(_index_buffer); ++i)
+				_index_buffer[i] = remap[_index_buffer[i]];
+
+			build_triangle_bvh(num_indices / 3);
+		}
+
+		// Builds the bounding volume hierarchy of the triangles of LOD 0
+		// used to intersect the geometry without testing all its triangles.
+		void build_triangle_bvh(u32 num_triangles)
+		{
+			if (num_triangles == 0)
+				return;
+
+			// Positions as they are read back by load()
+			const u32 num_vertices = array::size(_vertex_buffer) / _vertex_stride;
+			Array<Vector3> positions(default_allocator());
+			array::resize(positions, num_vertices);
+			for (u32 v = 0; v < num_vertices; ++v)
 			{
-				_decl.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float);
+				f32 output[4];
+				bgfx::vertexUnpack(output, bgfx::Attrib::Position, _decl, array::begin(_vertex_buffer), v);
+				positions[v] = vector3(output[0], output[1], output[2]) * _dequantize_positions;
 			}
 
-			_decl.end();
+			Array<AABB> bounds(default_allocator());
+			Array<Vector3> centroids(default_allocator());
+			array::resize(bounds, num_triangles);
+			array::resize(centroids, num_triangles);
+			array::resize(_bvh_triangles, num_triangles);
 
-			// Bounds
-			aabb::reset(_aabb);
-			aabb::add_points(_aabb
-				, array::size(_positions) / 3
-				, sizeof(f32) * 3
-				, array::begin(_positions)
+			for (u32 t = 0; t < num_triangles; ++t)
+			{
+				const Vector3& v0 = positions[_index_buffer[t*3 + 0]];
+				const Vector3& v1 = positions[_index_buffer[t*3 + 1]];
+				const Vector3& v2 = positions[_index_buffer[t*3 + 2]];
+
+				bounds[t].min = min(min(v0, v1), v2);
+				bounds[t].max = max(max(v0, v1), v2);
+				centroids[t] = (v0 + v1 + v2) * (1.0f/3.0f);
+				_bvh_triangles[t] = t;
+			}
+
+			build_bvh(_bvh_nodes
+				, array::begin(_bvh_triangles)
+				, 0
+				, num_triangles
+				, array::begin(bounds)
+				, array::begin(centroids)
 				);
-			_aabb = aabb::transformed(_aabb, _matrix_local);
+		}
 
-			_obb.tm = matrix4x4(QUATERNION_IDENTITY, aabb::center(_aabb));
-			_obb.half_extents.x = (_aabb.max.x - _aabb.min.x) * 0.5f;
-			_obb.half_extents.y = (_aabb.max.y - _aabb.min.y) * 0.5f;
-			_obb.half_extents.z = (_aabb.max.z - _aabb.min.z) * 0.5f;
+		// Stores the attribute @a attr = (x, y, z) into @a vertex, quantized as in the decl.
+		void pack(bgfx::Attrib::Enum attr, f32 x, f32 y, f32 z, char* vertex)
+		{
+			uint8_t num;
+			bgfx::AttribType::Enum type;
+			bool normalized;
+			bool as_int;
+			_decl.decode(attr, num, type, normalized, as_int);
+
+			// Normalized integers must not wrap around
+			if (normalized)
+			{
+				x = fclamp(-1.0f, 1.0f, x);
+				y = fclamp(-1.0f, 1.0f, y);
+				z = fclamp(-1.0f, 1.0f, z);
+			}
+
+			const f32 input[4] = { x, y, z, 0.0f };
+			bgfx::vertexPack(input, true, attr, _decl, vertex);
 		}
 
 		void write()
 		{
+			const u32 num_vertices = array::size(_vertex_buffer) / _vertex_stride;
+			const u32 index_stride = num_vertices > UINT16_MAX + 1 ? sizeof(u32) : sizeof(u16);
+
 			_opts.write(_decl);
 			_opts.write(_obb);
+			_opts.write(_dequantize_positions);
+			_opts.write(_dequantize_attributes);
 
-			_opts.write(array::size(_vertex_buffer) / _vertex_stride);
+			_opts.write(num_vertices);
 			_opts.write(_vertex_stride);
 			_opts.write(array::size(_index_buffer));
+			_opts.write(index_stride);
+
+			_opts.write(array::size(_lods));
+			for (u32 i = 0; i < array::size(_lods); ++i)
+			{
+				_opts.write(_lods[i].first_index);
+				_opts.write(_lods[i].num_indices);
+				_opts.write(_lods[i].screen_size);
+			}
+
+			_opts.write(array::size(_bvh_nodes));
+			_opts.write(array::size(_bvh_triangles));
 
 			_opts.write(_vertex_buffer);
-			_opts.write(array::begin(_index_buffer), array::size(_index_buffer) * sizeof(u16));
+
+			if (index_stride == sizeof(u32))
+			{
+				_opts.write(array::begin(_index_buffer), array::size(_index_buffer) * sizeof(u32));
+			}
+			else
+			{
+				for (u32 i = 0; i < array::size(_index_buffer); ++i)
+				{
+					const u16 index = (u16)_index_buffer[i];
+					_opts.write(index);
+				}
+			}
+
+			_opts.write(array::begin(_bvh_nodes), array::size(_bvh_nodes) * sizeof(MeshBVHNode));
+			_opts.write(array::begin(_bvh_triangles), array::size(_bvh_triangles) * sizeof(u32));
 		}
 	};
 
+	// Copies the binary stream @a node = { offset = N size = M } into @a output.
+	template <typename T>
+	static void read_stream(CompileOptions& opts, const MeshSource& source, u32 node, Array<T>& output)
+	{
+		const JsonTape& tape = source._tape;
+		const u32 offset = (u32)json_tape::to_int(tape, json_tape::get(tape, node, "offset"));
+		const u32 size   = (u32)json_tape::to_int(tape, json_tape::get(tape, node, "size"));
+		DATA_COMPILER_ASSERT(u64(offset) + u64(size)*sizeof(T) <= source._streams_size
+			, opts
+			, "Stream out of bounds"
+			);
+
+		array::resize(output, size);
+		memcpy(array::begin(output), source._streams + offset, size*sizeof(T));
+	}
+
+	MeshSource::MeshSource(Allocator& a, Buffer& buf)
+		: _tape(a)
+	{
+		sjson::parse(buf, _tape);
+
+		const u32 text_size = strlen32(array::begin(buf));
+		const u32 offset = text_size < array::size(buf) ? text_size + 1 : text_size;
+		_streams = array::begin(buf) + offset;
+		_streams_size = array::size(buf) - offset;
+	}
+
+	void MeshSource::parse_floats(CompileOptions& opts, u32 node, Array<f32>& output) const
+	{
+		if (json_tape::node(_tape, node).type == JsonValueType::OBJECT)
+		{
+			read_stream(opts, *this, node, output);
+			return;
+		}
+
+		array::resize(output, json_tape::size(_tape, node));
+
+		u32 i = 0;
+		for (u32 cur = json_tape::begin(_tape, node), end = json_tape::end(_tape, node); cur != end; cur = json_tape::next(_tape, cur))
+		{
+			output[i++] = json_tape::to_float(_tape, cur);
+		}
+	}
+
+	void MeshSource::parse_indices(CompileOptions& opts, u32 node, Array<u32>& output) const
+	{
+		if (json_tape::node(_tape, node).type == JsonValueType::OBJECT)
+		{
+			read_stream(opts, *this, node, output);
+			return;
+		}
+
+		array::resize(output, json_tape::size(_tape, node));
+
+		u32 i = 0;
+		for (u32 cur = json_tape::begin(_tape, node), end = json_tape::end(_tape, node); cur != end; cur = json_tape::next(_tape, cur))
+		{
+			output[i++] = (u32)json_tape::to_int(_tape, cur);
+		}
+	}
+
 	void compile(CompileOptions& opts)
 	{
 		Buffer buf = opts.read();
+		MeshSource source(default_allocator(), buf);
+		const JsonTape& tape = source._tape;
 
-		TempAllocator4096 ta;
-		JsonObject object(ta);
-		sjson::parse(buf, object);
-
-		JsonObject geometries(ta);
-		sjson::parse(object["geometries"], geometries);
-		JsonObject nodes(ta);
-		sjson::parse(object["nodes"], nodes);
+		const u32 geometries = json_tape::get(tape, 0, "geometries");
+		const u32 nodes = json_tape::get(tape, 0, "nodes");
 
 		opts.write(RESOURCE_VERSION_MESH);
-		opts.write(json_object::size(geometries));
+		opts.write(json_tape::size(tape, geometries));
 
 		MeshCompiler mc(opts);
+		mc.parse_quantization(source);
+		mc.parse_lods(source);
 
-		auto cur = json_object::begin(geometries);
-		auto end = json_object::end(geometries);
-		for (; cur != end; ++cur)
+		for (u32 cur = json_tape::begin(tape, geometries), end = json_tape::end(tape, geometries); cur != end; cur = json_tape::next(tape, cur))
 		{
-			const FixedString key = cur->pair.first;
-			const char* geometry = cur->pair.second;
-			const char* node = nodes[key];
+			const JsonNode& geometry = json_tape::node(tape, cur);
+
+			TempAllocator256 ta;
+			DynamicString key(ta);
+			key.set(geometry.key, geometry.key_length);
+			const u32 node = json_tape::get(tape, nodes, key.c_str());
 
-			const StringId32 name(key.data(), key.length());
+			const StringId32 name(geometry.key, geometry.key_length);
 			opts.write(name._id);
 
 			mc.reset();
-			mc.parse(geometry, node);
+			mc.parse(source, cur, node);
 			mc.compile();
 			mc.write();
 		}
@@ -323,6 +1387,12 @@ namespace mesh_resource_internal
 			OBB obb;
 			br.read(obb);
 
+			Matrix4x4 dequantize_positions;
+			br.read(dequantize_positions);
+
+			Vector4 dequantize_attributes;
+			br.read(dequantize_attributes);
+
 			u32 num_verts;
 			br.read(num_verts);
 
@@ -332,24 +1402,78 @@ namespace mesh_resource_internal
 			u32 num_inds;
 			br.read(num_inds);
 
+			u32 index_stride;
+			br.read(index_stride);
+
+			u32 num_lods;
+			br.read(num_lods);
+			CE_ASSERT(num_lods <= MESH_MAX_LODS, "Too many LODs");
+
+			MeshLod lods[MESH_MAX_LODS];
+			for (u32 l = 0; l < num_lods; ++l)
+			{
+				br.read(lods[l].first_index);
+				br.read(lods[l].num_indices);
+				br.read(lods[l].screen_size);
+			}
+
+			u32 num_bvh_nodes;
+			br.read(num_bvh_nodes);
+
+			u32 num_bvh_triangles;
+			br.read(num_bvh_triangles);
+
+			// Quantized positions are also kept in mesh space for the CPU
+			uint8_t num;
+			bgfx::AttribType::Enum type;
+			bool normalized;
+			bool as_int;
+			decl.decode(bgfx::Attrib::Position, num, type, normalized, as_int);
+			const bool quantized = type != bgfx::AttribType::Float;
+
+			const u32 psize = quantized ? num_verts*sizeof(Vector3) : 0;
+			const u32 nsize = num_bvh_nodes*sizeof(MeshBVHNode);
+			const u32 tsize = num_bvh_triangles*sizeof(u32);
 			const u32 vsize = num_verts*stride;
-			const u32 isize = num_inds*sizeof(u16);
+			const u32 isize = num_inds*index_stride;
 
-			const u32 size = sizeof(MeshGeometry) + vsize + isize;
+			const u32 size = sizeof(MeshGeometry) + psize + nsize + tsize + vsize + isize;
 
 			MeshGeometry* mg = (MeshGeometry*)a.allocate(size);
-			mg->obb             = obb;
-			mg->decl            = decl;
-			mg->vertex_buffer   = BGFX_INVALID_HANDLE;
-			mg->index_buffer    = BGFX_INVALID_HANDLE;
-			mg->vertices.num    = num_verts;
-			mg->vertices.stride = stride;
-			mg->vertices.data   = (char*)&mg[1];
-			mg->indices.num     = num_inds;
-			mg->indices.data    = mg->vertices.data + vsize;
+			mg->obb                   = obb;
+			mg->dequantize_positions  = dequantize_positions;
+			mg->dequantize_attributes = dequantize_attributes;
+			mg->decl                  = decl;
+			mg->vertex_buffer         = BGFX_INVALID_HANDLE;
+			mg->index_buffer          = BGFX_INVALID_HANDLE;
+			mg->vertices.num          = num_verts;
+			mg->vertices.stride       = stride;
+			mg->vertices.data         = (char*)&mg[1] + psize + nsize + tsize;
+			mg->positions.num         = num_verts;
+			mg->positions.stride      = quantized ? sizeof(Vector3) : stride;
+			mg->positions.data        = quantized ? (char*)&mg[1] : mg->vertices.data;
+			mg->indices.num           = lods[0].num_indices;
+			mg->indices.stride        = index_stride;
+			mg->indices.data          = mg->vertices.data + vsize;
+			mg->num_lods              = num_lods;
+			memcpy(mg->lods, lods, sizeof(lods));
+			mg->num_bvh_nodes         = num_bvh_nodes;
+			mg->bvh_nodes             = (MeshBVHNode*)((char*)&mg[1] + psize);
+			mg->bvh_triangles         = (u32*)((char*)&mg[1] + psize + nsize);
 
 			br.read(mg->vertices.data, vsize);
 			br.read(mg->indices.data, isize);
+			br.read(mg->bvh_nodes, nsize);
+			br.read(mg->bvh_triangles, tsize);
+
+			for (u32 v = 0; quantized && v < num_verts; ++v)
+			{
+				f32 output[4];
+				bgfx::vertexUnpack(output, bgfx::Attrib::Position, decl, mg->vertices.data, v);
+
+				Vector3* pos = (Vector3*)mg->positions.data + v;
+				*pos = vector3(output[0], output[1], output[2]) * dequantize_positions;
+			}
 
 			mr->geometry_names[i] = name;
 			mr->geometries[i] = mg;
@@ -366,14 +1490,17 @@ namespace mesh_resource_internal
 		{
 			MeshGeometry& mg = *mr->geometries[i];
 
+			const MeshLod& last = mg.lods[mg.num_lods - 1];
 			const u32 vsize = mg.vertices.num * mg.vertices.stride;
-			const u32 isize = mg.indices.num * sizeof(u16);
+			const u32 isize = (last.first_index + last.num_indices) * mg.indices.stride;
 
 			const bgfx::Memory* vmem = bgfx::makeRef(mg.vertices.data, vsize);
 			const bgfx::Memory* imem = bgfx::makeRef(mg.indices.data, isize);
 
 			bgfx::VertexBufferHandle vbh = bgfx::createVertexBuffer(vmem, mg.decl);
-			bgfx::IndexBufferHandle ibh  = bgfx::createIndexBuffer(imem);
+			bgfx::IndexBufferHandle ibh  = bgfx::createIndexBuffer(imem
+				, mg.indices.stride == sizeof(u32) ? BGFX_BUFFER_INDEX32 : BGFX_BUFFER_NONE
+				);
 			CE_ASSERT(bgfx::isValid(vbh), "Invalid vertex buffer");
 			CE_ASSERT(bgfx::isValid(ibh), "Invalid index buffer");
 
@@ -407,4 +1534,68 @@ namespace mesh_resource_internal
 
 } // namespace mesh_resource_internal
 
+namespace mesh_resource
+{
+	f32 raycast(const MeshGeometry& mg, const Vector3& from, const Vector3& dir, const Matrix4x4& tm)
+	{
+		if (mg.num_bvh_nodes == 0)
+			return -1.0f;
+
+		// Distances along the ray are the same in mesh space
+		const Matrix4x4 inv = get_inverted(tm);
+		const Vector3 local_from = from * inv;
+		const Vector3 local_dir = (from + dir) * inv - local_from;
+
+		f32 tmin = -1.0f;
+
+		TempAllocator512 ta;
+		Array<u32> stack(ta);
+		array::push_back(stack, 0u);
+
+		while (!array::empty(stack))
+		{
+			const MeshBVHNode& node = mg.bvh_nodes[array::back(stack)];
+			array::pop_back(stack);
+
+			// Skip the nodes farther than the closest hit so far
+			const f32 t = ray_aabb_intersection(local_from, local_dir, node.aabb);
+			if (t == -1.0f || (tmin != -1.0f && t > tmin))
+				continue;
+
+			if (node.num == 0)
+			{
+				const u32 left = u32(&node - mg.bvh_nodes) + 1;
+				array::push_back(stack, node.offset);
+				array::push_back(stack, left);
+				continue;
+			}
+
+			for (u32 i = node.offset; i < node.offset + node.num; ++i)
+			{
+				const u32 tri = mg.bvh_triangles[i];
+
+				u32 idx[3];
+				for (u32 j = 0; j < 3; ++j)
+				{
+					idx[j] = mg.indices.stride == sizeof(u32)
+						? ((const u32*)mg.indices.data)[tri*3 + j]
+						: ((const u16*)mg.indices.data)[tri*3 + j]
+						;
+				}
+
+				const Vector3& v0 = *(const Vector3*)(mg.positions.data + idx[0]*mg.positions.stride);
+				const Vector3& v1 = *(const Vector3*)(mg.positions.data + idx[1]*mg.positions.stride);
+				const Vector3& v2 = *(const Vector3*)(mg.positions.data + idx[2]*mg.positions.stride);
+
+				const f32 th = ray_triangle_intersection(local_from, local_dir, v0, v1, v2);
+				if (th != -1.0f && (tmin == -1.0f || th < tmin))
+					tmin = th;
+			}
+		}
+
+		return tmin;
+	}
+
+} // namespace mesh_resource
+
 } // namespace crown
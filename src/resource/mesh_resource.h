@@ -8,6 +8,7 @@
 #include "core/containers/array.h"
 #include "core/containers/types.h"
 #include "core/filesystem/types.h"
+#include "core/json/types.h"
 #include "core/math/types.h"
 #include "core/memory/types.h"
 #include "core/strings/string_id.h"
@@ -15,6 +16,9 @@
 #include "resource/types.h"
 #include <bgfx/bgfx.h>
 
+#define MESH_MAX_LODS 4
+#define MESH_BVH_MAX_TRIANGLES 4 // Per leaf
+
 namespace crown
 {
 struct VertexData
@@ -27,7 +31,22 @@ struct VertexData
 struct IndexData
 {
 	u32 num;
-	char* data; // size = num*sizeof(u16)
+	u32 stride; // sizeof(u16) or sizeof(u32)
+	char* data; // size = num*stride, followed by the indices of the other LODs
+};
+
+struct MeshLod
+{
+	u32 first_index;
+	u32 num_indices;
+	f32 screen_size; // Drawn below this projected size, unused by LOD 0
+};
+
+struct MeshBVHNode
+{
+	AABB aabb;  // In mesh space
+	u32 offset; // First triangle if leaf, right child otherwise; the left child follows its parent
+	u32 num;    // Number of triangles, 0 if not leaf
 };
 
 struct MeshGeometry
@@ -36,8 +55,16 @@ struct MeshGeometry
 	bgfx::VertexBufferHandle vertex_buffer;
 	bgfx::IndexBufferHandle index_buffer;
 	OBB obb;
+	Matrix4x4 dequantize_positions; // Transforms the stored positions to mesh space
+	Vector4 dequantize_attributes;  // See u_mesh_dequantize in the mesh shader
 	VertexData vertices;
-	IndexData indices;
+	VertexData positions;           // Positions in mesh space
+	IndexData indices;              // Indices of LOD 0
+	u32 num_lods;
+	MeshLod lods[MESH_MAX_LODS];
+	u32 num_bvh_nodes;
+	MeshBVHNode* bvh_nodes;         // Bounding volume hierarchy of the triangles of LOD 0
+	u32* bvh_triangles;             // Triangles of LOD 0 in the order of the leaves
 };
 
 struct MeshResource
@@ -64,8 +91,38 @@ struct MeshResource
 	}
 };
 
+namespace mesh_resource
+{
+	/// Returns the distance along ray (from, dir) to intersection point with the
+	/// geometry @a mg transformed by @a tm or -1.0 if no intersection.
+	f32 raycast(const MeshGeometry& mg, const Vector3& from, const Vector3& dir, const Matrix4x4& tm);
+
+} // namespace mesh_resource
+
 namespace mesh_resource_internal
 {
+	/// Source .mesh whose vertex attributes and indices are either SJSON arrays
+	/// or binary streams. Binary streams are stored after the null byte
+	/// that terminates the SJSON text and referenced from it by
+	/// { offset = N size = M }, where N is the byte offset of the stream
+	/// and M its number of f32 (attributes) or u32 (indices) items in
+	/// little-endian order.
+	struct MeshSource
+	{
+		JsonTape _tape;
+		const char* _streams;
+		u32 _streams_size;
+
+		/// Parses the .mesh @a buf, which must outlive the source.
+		MeshSource(Allocator& a, Buffer& buf);
+
+		/// Reads the vertex attribute at @a node into @a output.
+		void parse_floats(CompileOptions& opts, u32 node, Array<f32>& output) const;
+
+		/// Reads the indices at @a node into @a output.
+		void parse_indices(CompileOptions& opts, u32 node, Array<u32>& output) const;
+	};
+
 	void compile(CompileOptions& opts);
 	void* load(File& file, Allocator& a);
 	void online(StringId64 /*id*/, ResourceManager& /*rm*/);
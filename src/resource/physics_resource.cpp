@@ -7,6 +7,7 @@
 #include "core/filesystem/file.h"
 #include "core/filesystem/filesystem.h"
 #include "core/json/json_object.h"
+#include "core/json/json_tape.h"
 #include "core/json/sjson.h"
 #include "core/math/aabb.h"
 #include "core/math/quaternion.h"
@@ -15,6 +16,7 @@
 #include "core/strings/dynamic_string.h"
 #include "core/strings/string.h"
 #include "resource/compile_options.h"
+#include "resource/mesh_resource.h"
 #include "resource/physics_resource.h"
 #include "world/types.h"
 
@@ -155,56 +157,48 @@ namespace physics_resource_internal
 		scene += ".mesh";
 
 		Buffer file = opts.read(scene.c_str());
-		JsonObject json_mesh(ta);
-		JsonObject geometries(ta);
-		JsonObject geometry(ta);
-		JsonObject nodes(ta);
-		JsonObject node(ta);
-		sjson::parse(file, json_mesh);
-		sjson::parse(json_mesh["geometries"], geometries);
-		DATA_COMPILER_ASSERT(json_object::has(geometries, name.c_str())
+		mesh_resource_internal::MeshSource source(default_allocator(), file);
+		const JsonTape& tape = source._tape;
+
+		const u32 geometry = json_tape::find(tape, json_tape::get(tape, 0, "geometries"), name.c_str());
+		DATA_COMPILER_ASSERT(geometry != UINT32_MAX
 			, opts
 			, "Geometry '%s' does not exist"
 			, name.c_str()
 			);
-		sjson::parse(geometries[name.c_str()], geometry);
-		sjson::parse(json_mesh["nodes"], nodes);
-		DATA_COMPILER_ASSERT(json_object::has(nodes, name.c_str())
+		const u32 node = json_tape::find(tape, json_tape::get(tape, 0, "nodes"), name.c_str());
+		DATA_COMPILER_ASSERT(node != UINT32_MAX
 			, opts
 			, "Node '%s' does not exist"
 			, name.c_str()
 			);
-		sjson::parse(nodes[name.c_str()], node);
 
-		Matrix4x4 matrix_local = sjson::parse_matrix4x4(node["matrix_local"]);
+		Matrix4x4 matrix_local = sjson::parse_matrix4x4(json_tape::node(tape, json_tape::get(tape, node, "matrix_local")).json);
 		cd.local_tm = matrix_local;
 
-		JsonArray positions(ta);
-		sjson::parse_array(geometry["position"], positions);
+		Array<f32> positions(default_allocator());
+		source.parse_floats(opts, json_tape::get(tape, geometry, "position"), positions);
+
+		const u32 indices_data = json_tape::get(tape, json_tape::get(tape, geometry, "indices"), "data");
+		Array<u32> position_indices(default_allocator());
+		source.parse_indices(opts, json_tape::begin(tape, indices_data), position_indices);
 
-		JsonObject indices(ta);
-		JsonArray indices_data(ta);
-		JsonArray position_indices(ta);
-		sjson::parse_object(geometry["indices"], indices);
-		sjson::parse_array(indices["data"], indices_data);
-		sjson::parse_array(indices_data[0], position_indices);
+		Array<u16> point_indices(default_allocator());
+		for (u32 i = 0; i < array::size(position_indices); ++i)
+		{
+			array::push_back(point_indices, (u16)position_indices[i]);
+		}
 
 		Array<Vector3> points(default_allocator());
 		for (u32 i = 0; i < array::size(positions); i += 3)
 		{
 			Vector3 p;
-			p.x = sjson::parse_float(positions[i + 0]);
-			p.y = sjson::parse_float(positions[i + 1]);
-			p.z = sjson::parse_float(positions[i + 2]);
+			p.x = positions[i + 0];
+			p.y = positions[i + 1];
+			p.z = positions[i + 2];
 			array::push_back(points, p*matrix_local);
 		}
 
-		Array<u16> point_indices(default_allocator());
-		for (u32 i = 0; i < array::size(position_indices); ++i)
-		{
-			array::push_back(point_indices, (u16)sjson::parse_int(position_indices[i]));
-		}
-
 		switch (cd.type)
 		{
 		case ColliderType::SPHERE:      compile_sphere(points, cd); break;
@@ -20,6 +20,8 @@ ResourceLoader::ResourceLoader(Filesystem& data_filesystem)
 	: _data_filesystem(data_filesystem)
 	, _requests(default_allocator())
 	, _loaded(default_allocator())
+	, _stream_requests(default_allocator())
+	, _streamed(default_allocator())
 	, _exit(false)
 {
 	_thread.start(ResourceLoader::thread_proc, this);
@@ -29,6 +31,12 @@ ResourceLoader::~ResourceLoader()
 {
 	_exit = true;
 	_thread.stop();
+
+	// Nobody is going to take the data of the stream requests left
+	for (u32 i = 0; i < queue::size(_stream_requests); ++i)
+		_stream_requests[i].allocator->deallocate(_stream_requests[i].data);
+	for (u32 i = 0; i < queue::size(_streamed); ++i)
+		_streamed[i].allocator->deallocate(_streamed[i].data);
 }
 
 bool ResourceLoader::can_load(StringId64 type, StringId64 name)
@@ -50,6 +58,30 @@ bool ResourceLoader::can_load(StringId64 type, StringId64 name)
 	return _data_filesystem.exists(path.c_str());
 }
 
+File* ResourceLoader::open(StringId64 type, StringId64 name)
+{
+	TempAllocator128 ta;
+	DynamicString type_str(ta);
+	DynamicString name_str(ta);
+	type.to_string(type_str);
+	name.to_string(name_str);
+
+	DynamicString res_path(ta);
+	res_path += type_str;
+	res_path += '-';
+	res_path += name_str;
+
+	DynamicString path(ta);
+	path::join(path, CROWN_DATA_DIRECTORY, res_path.c_str());
+
+	return _data_filesystem.open(path.c_str(), FileOpenMode::READ);
+}
+
+void ResourceLoader::close(File& file)
+{
+	_data_filesystem.close(file);
+}
+
 void ResourceLoader::add_request(const ResourceRequest& rr)
 {
 	ScopedMutex sm(_mutex);
@@ -87,6 +119,37 @@ void ResourceLoader::get_loaded(Array<ResourceRequest>& loaded)
 	}
 }
 
+void ResourceLoader::add_stream_request(const StreamRequest& sr)
+{
+	ScopedMutex sm(_mutex);
+	queue::push_back(_stream_requests, sr);
+}
+
+void ResourceLoader::get_streamed(Array<StreamRequest>& streamed)
+{
+	ScopedMutex sm(_loaded_mutex);
+
+	const u32 num = queue::size(_streamed);
+	array::reserve(streamed, num);
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		array::push_back(streamed, queue::front(_streamed));
+		queue::pop_front(_streamed);
+	}
+}
+
+void ResourceLoader::stream(StreamRequest& sr)
+{
+	File* file = open(sr.type, sr.name);
+	file->seek(sr.offset);
+	file->read(sr.data, sr.size);
+	close(*file);
+
+	ScopedMutex sm(_loaded_mutex);
+	queue::push_back(_streamed, sr);
+}
+
 s32 ResourceLoader::run()
 {
 	while (!_exit)
@@ -94,6 +157,16 @@ s32 ResourceLoader::run()
 		_mutex.lock();
 		if (queue::empty(_requests))
 		{
+			if (!queue::empty(_stream_requests))
+			{
+				StreamRequest sr = queue::front(_stream_requests);
+				queue::pop_front(_stream_requests);
+				_mutex.unlock();
+
+				stream(sr);
+				continue;
+			}
+
 			_mutex.unlock();
 			os::sleep(16);
 			continue;
@@ -102,21 +175,7 @@ s32 ResourceLoader::run()
 		ResourceRequest rr = queue::front(_requests);
 		_mutex.unlock();
 
-		TempAllocator128 ta;
-		DynamicString type_str(ta);
-		DynamicString name_str(ta);
-		rr.type.to_string(type_str);
-		rr.name.to_string(name_str);
-
-		DynamicString res_path(ta);
-		res_path += type_str;
-		res_path += '-';
-		res_path += name_str;
-
-		DynamicString path(ta);
-		path::join(path, CROWN_DATA_DIRECTORY, res_path.c_str());
-
-		File* file = _data_filesystem.open(path.c_str(), FileOpenMode::READ);
+		File* file = open(rr.type, rr.name);
 
 		if (rr.load_function)
 		{
@@ -131,7 +190,7 @@ s32 ResourceLoader::run()
 			rr.data = data;
 		}
 
-		_data_filesystem.close(*file);
+		close(*file);
 
 		add_loaded(rr);
 		_mutex.lock();
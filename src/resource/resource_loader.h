@@ -26,6 +26,17 @@ struct ResourceRequest
 	void* data;
 };
 
+/// Reads part of the compiled data of a resource.
+struct StreamRequest
+{
+	StringId64 type;
+	StringId64 name;
+	u32 offset;           // In the compiled data
+	u32 size;
+	Allocator* allocator; // Allocator of data
+	void* data;           // Receives size bytes
+};
+
 /// Loads resources in a background thread.
 ///
 /// @ingroup Resource
@@ -35,6 +46,8 @@ struct ResourceLoader
 
 	Queue<ResourceRequest> _requests;
 	Queue<ResourceRequest> _loaded;
+	Queue<StreamRequest> _stream_requests;
+	Queue<StreamRequest> _streamed;
 
 	Thread _thread;
 	Mutex _mutex;
@@ -43,6 +56,7 @@ struct ResourceLoader
 
 	u32 num_requests();
 	void add_loaded(ResourceRequest rr);
+	void stream(StreamRequest& sr);
 	s32 run();
 	static s32 thread_proc(void* thiz);
 
@@ -55,6 +69,13 @@ struct ResourceLoader
 	/// Returns whether the resource (type, name) can be loaded.
 	bool can_load(StringId64 type, StringId64 name);
 
+	/// Opens the compiled data of the resource (@a type, @a name) for reading.
+	/// It can be called from any thread.
+	File* open(StringId64 type, StringId64 name);
+
+	/// Closes the @a file returned by open().
+	void close(File& file);
+
 	/// Adds a request for loading the resource described by @a rr.
 	void add_request(const ResourceRequest& rr);
 
@@ -63,6 +84,14 @@ struct ResourceLoader
 
 	/// Returns all the resources that have been loaded.
 	void get_loaded(Array<ResourceRequest>& loaded);
+
+	/// Adds a request for reading the data described by @a sr.
+	/// Stream requests are served when no resource is waiting to be loaded.
+	void add_stream_request(const StreamRequest& sr);
+
+	/// Returns all the stream requests that have been served.
+	/// The caller takes ownership of their data.
+	void get_streamed(Array<StreamRequest>& streamed);
 };
 
 } // namespace crown
@@ -20,6 +20,7 @@ ResourceManager::ResourceManager(ResourceLoader& rl)
 	, _type_data(default_allocator())
 	, _rm(default_allocator())
 	, _autoload(false)
+	, _generation(0)
 {
 }
 
@@ -198,6 +199,8 @@ void ResourceManager::on_online(StringId64 type, StringId64 name)
 
 	if (func)
 		func(name, *this);
+
+	++_generation;
 }
 
 void ResourceManager::on_offline(StringId64 type, StringId64 name)
@@ -206,6 +209,8 @@ void ResourceManager::on_offline(StringId64 type, StringId64 name)
 
 	if (func)
 		func(name, *this);
+
+	++_generation;
 }
 
 void ResourceManager::on_unload(StringId64 type, void* data)
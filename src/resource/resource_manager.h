@@ -65,6 +65,7 @@ struct ResourceManager
 	TypeMap _type_data;
 	ResourceMap _rm;
 	bool _autoload;
+	u32 _generation; // Incremented whenever a resource goes online or offline
 
 	void on_online(StringId64 type, StringId64 name);
 	void on_offline(StringId64 type, StringId64 name);
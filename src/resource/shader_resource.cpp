@@ -4,14 +4,22 @@
  */
 
 #include "config.h"
+#include "core/containers/array.h"
+#include "core/containers/hash_map.h"
 #include "core/containers/map.h"
 #include "core/filesystem/filesystem.h"
 #include "core/json/json_object.h"
 #include "core/json/sjson.h"
 #include "core/memory/temp_allocator.h"
+#include "core/murmur.h"
+#include "core/strings/string.h"
 #include "core/strings/string_stream.h"
+#include "core/thread/atomic_int.h"
+#include "core/thread/thread.h"
 #include "device/device.h"
+#include "resource/compile_cache.h"
 #include "resource/compile_options.h"
+#include "resource/data_compiler.h"
 #include "resource/resource_manager.h"
 #include "resource/shader_resource.h"
 #include "world/shader_manager.h"
@@ -625,6 +633,116 @@ namespace shader_resource_internal
 		}
 	};
 
+	// Vertex or fragment shader compiled by shaderc
+	struct ShaderVariant
+	{
+		CompileOptions* _opts;
+		CompileCache* _cache;
+		const char* _type;
+		const DynamicString* _varying;
+		StringStream _source;
+		u64 _key;       // Hash of everything shaderc is given
+		Buffer _compiled;
+		StringStream _output;
+		int _ec;
+
+		ShaderVariant(CompileOptions& opts, CompileCache& cache, const char* type, const DynamicString& varying)
+			: _opts(&opts)
+			, _cache(&cache)
+			, _type(type)
+			, _varying(&varying)
+			, _source(default_allocator())
+			, _key(0)
+			, _compiled(default_allocator())
+			, _output(default_allocator())
+			, _ec(0)
+		{
+		}
+	};
+
+	struct VariantContext
+	{
+		const Array<ShaderVariant*>* variants;
+		AtomicInt next_variant;
+		AtomicInt failed;
+
+		VariantContext()
+			: variants(NULL)
+			, next_variant(0)
+			, failed(0)
+		{
+		}
+	};
+
+	static u64 variant_key(ShaderVariant& sv)
+	{
+		const char* platform = sv._opts->platform();
+		u64 key = RESOURCE_VERSION_SHADER;
+		key = murmur64(platform, strlen32(platform), key);
+		key = murmur64(sv._type, strlen32(sv._type), key);
+		key = murmur64(sv._varying->c_str(), sv._varying->length(), key);
+		key = murmur64(string_stream::c_str(sv._source), strlen32(string_stream::c_str(sv._source)), key);
+		return key;
+	}
+
+	static void compile_variant(ShaderVariant& sv)
+	{
+		CompileOptions& opts = *sv._opts;
+
+		// Every variant has its own files, so that many of them can be compiled at once
+		TempAllocator1024 ta;
+		DynamicString source_path(ta);
+		DynamicString varying_path(ta);
+		DynamicString compiled_path(ta);
+		opts.get_temporary_path("source.sc", source_path);
+		opts.get_temporary_path("varying.sc", varying_path);
+		opts.get_temporary_path("compiled.bin", compiled_path);
+
+		const char* source = string_stream::c_str(sv._source);
+		opts.write_temporary(source_path.c_str(), source, strlen32(source));
+		opts.write_temporary(varying_path.c_str(), sv._varying->c_str(), sv._varying->length());
+
+		sv._ec = run_external_compiler(opts, source_path.c_str()
+			, compiled_path.c_str()
+			, varying_path.c_str()
+			, sv._type
+			, opts.platform()
+			, sv._output
+			);
+		if (sv._ec == 0)
+		{
+			sv._compiled = opts.read_temporary(compiled_path.c_str());
+			sv._cache->put(sv._key, array::begin(sv._compiled), array::size(sv._compiled));
+		}
+
+		const char* paths[] = { source_path.c_str(), varying_path.c_str(), compiled_path.c_str() };
+		for (u32 i = 0; i < countof(paths); ++i)
+		{
+			if (opts._data_filesystem.exists(paths[i]))
+				opts.delete_file(paths[i]);
+		}
+	}
+
+	static s32 compile_variants_thread(void* user_data)
+	{
+		VariantContext& ctx = *(VariantContext*)user_data;
+		const Array<ShaderVariant*>& variants = *ctx.variants;
+
+		// Stop picking new variants as soon as one fails
+		while (ctx.failed.load() == 0)
+		{
+			const u32 i = (u32)ctx.next_variant.fetch_add(1);
+			if (i >= array::size(variants))
+				break;
+
+			compile_variant(*variants[i]);
+			if (variants[i]->_ec != 0)
+				ctx.failed.store(1);
+		}
+
+		return 0;
+	}
+
 	struct ShaderCompiler
 	{
 		CompileOptions& _opts;
@@ -633,31 +751,27 @@ namespace shader_resource_internal
 		Map<DynamicString, BgfxShader> _bgfx_shaders;
 		Map<DynamicString, ShaderPermutation> _shaders;
 		Vector<StaticCompile> _static_compile;
+		CompileCacheDisk _cache;
+		Array<ShaderVariant*> _variants;       // Distinct variants
+		HashMap<u64, u32> _variant_index;      // Index of the variants by key
 
-		DynamicString _vs_source_path;
-		DynamicString _fs_source_path;
-		DynamicString _varying_path;
-		DynamicString _vs_compiled_path;
-		DynamicString _fs_compiled_path;
-
-		ShaderCompiler(CompileOptions& opts)
+		ShaderCompiler(CompileOptions& opts, const char* cache_dir)
 			: _opts(opts)
 			, _render_states(default_allocator())
 			, _sampler_states(default_allocator())
 			, _bgfx_shaders(default_allocator())
 			, _shaders(default_allocator())
 			, _static_compile(default_allocator())
-			, _vs_source_path(default_allocator())
-			, _fs_source_path(default_allocator())
-			, _varying_path(default_allocator())
-			, _vs_compiled_path(default_allocator())
-			, _fs_compiled_path(default_allocator())
+			, _cache(default_allocator(), cache_dir)
+			, _variants(default_allocator())
+			, _variant_index(default_allocator())
 		{
-			_opts.get_temporary_path("vs_source.sc", _vs_source_path);
-			_opts.get_temporary_path("fs_source.sc", _fs_source_path);
-			_opts.get_temporary_path("varying.sc", _varying_path);
-			_opts.get_temporary_path("vs_compiled.bin", _vs_compiled_path);
-			_opts.get_temporary_path("fs_compiled.bin", _fs_compiled_path);
+		}
+
+		~ShaderCompiler()
+		{
+			for (u32 i = 0; i < array::size(_variants); ++i)
+				CE_DELETE(default_allocator(), _variants[i]);
 		}
 
 		void parse(const char* path)
@@ -1047,34 +1161,11 @@ namespace shader_resource_internal
 			}
 		}
 
-		void delete_temp_files()
-		{
-			const char* vs_source_path   = _vs_source_path.c_str();
-			const char* fs_source_path   = _fs_source_path.c_str();
-			const char* varying_path     = _varying_path.c_str();
-			const char* vs_compiled_path = _vs_compiled_path.c_str();
-			const char* fs_compiled_path = _fs_compiled_path.c_str();
-
-			if (_opts.file_exists(vs_source_path))
-				_opts.delete_file(vs_source_path);
-
-			if (_opts.file_exists(fs_source_path))
-				_opts.delete_file(fs_source_path);
-
-			if (_opts.file_exists(varying_path))
-				_opts.delete_file(varying_path);
-
-			if (_opts.file_exists(vs_compiled_path))
-				_opts.delete_file(vs_compiled_path);
-
-			if (_opts.file_exists(fs_compiled_path))
-				_opts.delete_file(fs_compiled_path);
-		}
-
 		void compile()
 		{
-			_opts.write(RESOURCE_VERSION_SHADER);
-			_opts.write(vector::size(_static_compile));
+			Array<u32> variants(default_allocator()); // Vertex and fragment shader of each static compile
+			Array<u32> names(default_allocator());
+			Array<u64> states(default_allocator());
 
 			for (u32 i = 0; i < vector::size(_static_compile); ++i)
 			{
@@ -1114,9 +1205,27 @@ namespace shader_resource_internal
 
 				const RenderState& rs = _render_states[render_state];
 
-				_opts.write(shader_name._id);  // Shader name
-				_opts.write(rs.encode());      // Render state
-				compile(bgfx_shader.c_str(), defines); // Shader code
+				array::push_back(names, shader_name._id);
+				array::push_back(states, rs.encode());
+				add_variants(bgfx_shader.c_str(), defines, variants);
+			}
+
+			compile_variants();
+
+			_opts.write(RESOURCE_VERSION_SHADER);
+			_opts.write(vector::size(_static_compile));
+
+			for (u32 i = 0; i < vector::size(_static_compile); ++i)
+			{
+				const Buffer& vs = _variants[variants[i*2 + 0]]->_compiled;
+				const Buffer& fs = _variants[variants[i*2 + 1]]->_compiled;
+
+				_opts.write(names[i]);  // Shader name
+				_opts.write(states[i]); // Render state
+				_opts.write(array::size(vs)); // Shader code
+				_opts.write(vs);
+				_opts.write(array::size(fs));
+				_opts.write(fs);
 			}
 		}
 
@@ -1142,7 +1251,25 @@ namespace shader_resource_internal
 			}
 		}
 
-		void compile(const char* bgfx_shader, const Vector<DynamicString>& defines)
+		// Returns the index of the variant @a sv, which is dropped
+		// in favor of an existing one with the same key if any.
+		u32 add_variant(ShaderVariant* sv)
+		{
+			sv->_key = variant_key(*sv);
+
+			const u32 index = hash_map::get(_variant_index, sv->_key, UINT32_MAX);
+			if (index != UINT32_MAX)
+			{
+				CE_DELETE(default_allocator(), sv);
+				return index;
+			}
+
+			hash_map::set(_variant_index, sv->_key, array::size(_variants));
+			array::push_back(_variants, sv);
+			return array::size(_variants) - 1;
+		}
+
+		void add_variants(const char* bgfx_shader, const Vector<DynamicString>& defines, Array<u32>& variants)
 		{
 			TempAllocator512 taa;
 			DynamicString key(taa);
@@ -1156,8 +1283,10 @@ namespace shader_resource_internal
 				included_code = included._code;
 			}
 
-			StringStream vs_code(default_allocator());
-			StringStream fs_code(default_allocator());
+			ShaderVariant* vs = CE_NEW(default_allocator(), ShaderVariant)(_opts, _cache, "vertex", shader._varying);
+			ShaderVariant* fs = CE_NEW(default_allocator(), ShaderVariant)(_opts, _cache, "fragment", shader._varying);
+			StringStream& vs_code = vs->_source;
+			StringStream& fs_code = fs->_source;
 			vs_code << shader._vs_input_output.c_str();
 			for (u32 i = 0; i < vector::size(defines); ++i)
 			{
@@ -1175,64 +1304,67 @@ namespace shader_resource_internal
 			fs_code << shader._code.c_str();
 			fs_code << shader._fs_code.c_str();
 
-			_opts.write_temporary(_vs_source_path.c_str(), vs_code);
-			_opts.write_temporary(_fs_source_path.c_str(), fs_code);
-			_opts.write_temporary(_varying_path.c_str(), shader._varying.c_str(), shader._varying.length());
+			array::push_back(variants, add_variant(vs));
+			array::push_back(variants, add_variant(fs));
+		}
 
-			TempAllocator4096 ta;
-			StringStream output(ta);
-
-			int ec = run_external_compiler(_opts, _vs_source_path.c_str()
-				, _vs_compiled_path.c_str()
-				, _varying_path.c_str()
-				, "vertex"
-				, _opts.platform()
-				, output
-				);
-			if (ec)
+		void compile_variants()
+		{
+			// Variants compiled by previous builds or by other shaders are reused
+			Array<ShaderVariant*> pending(default_allocator());
+			for (u32 i = 0; i < array::size(_variants); ++i)
 			{
-				delete_temp_files();
-				DATA_COMPILER_ASSERT(false
-					, _opts
-					, "Failed to compile vertex shader:\n%s"
-					, string_stream::c_str(output)
-					);
+				if (!_cache.get(_variants[i]->_key, _variants[i]->_compiled))
+					array::push_back(pending, _variants[i]);
 			}
 
-			array::clear(output);
-			ec = run_external_compiler(_opts, _fs_source_path.c_str()
-				, _fs_compiled_path.c_str()
-				, _varying_path.c_str()
-				, "fragment"
-				, _opts.platform()
-				, output
-				);
-			if (ec)
+			if (array::size(pending) == 0)
+				return;
+
+			// Compile the others on this thread plus the processors left idle
+			// by the data compiler, so that the total number of shaderc
+			// processes never exceeds the number of processors
+			VariantContext ctx;
+			ctx.variants = &pending;
+
+			const u32 num_pending = array::size(pending);
+
+			Array<Thread*> threads(default_allocator());
+			while (array::size(threads) + 1 < num_pending && _opts._data_compiler.acquire_worker())
 			{
-				delete_temp_files();
-				DATA_COMPILER_ASSERT(false
-					, _opts
-					, "Failed to compile fragment shader:\n%s"
-					, string_stream::c_str(output)
-					);
+				Thread* t = CE_NEW(default_allocator(), Thread)();
+				t->start(compile_variants_thread, &ctx);
+				array::push_back(threads, t);
 			}
 
-			Buffer tmpvs = _opts.read_temporary(_vs_compiled_path.c_str());
-			Buffer tmpfs = _opts.read_temporary(_fs_compiled_path.c_str());
+			compile_variants_thread(&ctx);
 
-			delete_temp_files();
+			for (u32 i = 0; i < array::size(threads); ++i)
+			{
+				threads[i]->stop();
+				CE_DELETE(default_allocator(), threads[i]);
+				_opts._data_compiler.release_worker();
+			}
 
-			// Write
-			_opts.write(array::size(tmpvs));
-			_opts.write(tmpvs);
-			_opts.write(array::size(tmpfs));
-			_opts.write(tmpfs);
+			for (u32 i = 0; i < num_pending; ++i)
+			{
+				DATA_COMPILER_ASSERT(pending[i]->_ec == 0
+					, _opts
+					, "Failed to compile %s shader:\n%s"
+					, pending[i]->_type
+					, string_stream::c_str(pending[i]->_output)
+					);
+			}
 		}
 	};
 
 	void compile(CompileOptions& opts)
 	{
-		ShaderCompiler sc(opts);
+		TempAllocator256 ta;
+		DynamicString cache_dir(ta);
+		opts._data_filesystem.get_absolute_path(CROWN_SHADER_CACHE_DIRECTORY, cache_dir);
+
+		ShaderCompiler sc(opts, cache_dir.c_str());
 		sc.parse(opts.source_path());
 		sc.compile();
 	}
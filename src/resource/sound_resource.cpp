@@ -3,14 +3,24 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "core/containers/array.h"
+#include "core/error/error.h"
 #include "core/filesystem/file.h"
+#include "core/filesystem/path.h"
+#include "core/filesystem/reader_writer.h"
 #include "core/json/json_object.h"
 #include "core/json/sjson.h"
 #include "core/memory/allocator.h"
 #include "core/memory/temp_allocator.h"
 #include "core/strings/dynamic_string.h"
+#include "core/strings/string.h"
+#include "device/log.h"
 #include "resource/compile_options.h"
 #include "resource/sound_resource.h"
+#define STB_VORBIS_HEADER_ONLY
+#include <stb_vorbis.c>
+
+namespace { const crown::log_internal::System SOUND = { "Sound" }; }
 
 namespace crown
 {
@@ -43,21 +53,95 @@ namespace sound_resource_internal
 
 		DynamicString name(ta);
 		sjson::parse_string(object["source"], name);
+		DATA_COMPILER_ASSERT_FILE_EXISTS(name.c_str(), opts);
+
+		const bool stream = json_object::has(object, "stream")
+			? sjson::parse_bool(object["stream"])
+			: false
+			;
+
+		const char* ext = path::extension(name.c_str());
+		const bool is_ogg = ext != NULL && strcmp(ext, "ogg") == 0;
+		const bool is_wav = ext != NULL && strcmp(ext, "wav") == 0;
+		DATA_COMPILER_ASSERT(is_ogg || is_wav
+			, opts
+			, "Unknown sound format: '%s'"
+			, name.c_str()
+			);
 
 		Buffer sound = opts.read(name.c_str());
-		const WAVHeader* wav = (const WAVHeader*)array::begin(sound);
-		const char* wavdata = (const char*)&wav[1];
 
-		// Write
 		SoundResource sr;
-		sr.version      = RESOURCE_VERSION_SOUND;
-		sr.size         = wav->data_size;
-		sr.sample_rate  = wav->fmt_sample_rate;
-		sr.avg_bytes_ps = wav->fmt_avarage;
-		sr.channels     = wav->fmt_channels;
-		sr.block_size   = wav->fmt_block_align;
-		sr.bits_ps      = wav->fmt_bits_ps;
-		sr.sound_type   = SoundType::WAV;
+		sr.version = RESOURCE_VERSION_SOUND;
+		sr.stream  = stream;
+
+		const char* sound_data = NULL;
+
+		if (is_wav)
+		{
+			DATA_COMPILER_ASSERT(array::size(sound) >= sizeof(WAVHeader)
+				, opts
+				, "Invalid WAV file: '%s'"
+				, name.c_str()
+				);
+
+			const WAVHeader* wav = (const WAVHeader*)array::begin(sound);
+			DATA_COMPILER_ASSERT(strncmp(wav->riff, "RIFF", 4) == 0 && wav->fmt_tag == 1
+				, opts
+				, "Unsupported WAV file: '%s'"
+				, name.c_str()
+				);
+			DATA_COMPILER_ASSERT(!stream
+				, opts
+				, "Only OGG sounds can be streamed"
+				);
+
+			sr.size         = wav->data_size;
+			sr.sample_rate  = wav->fmt_sample_rate;
+			sr.avg_bytes_ps = wav->fmt_avarage;
+			sr.channels     = wav->fmt_channels;
+			sr.block_size   = wav->fmt_block_align;
+			sr.bits_ps      = wav->fmt_bits_ps;
+			sr.sound_type   = SoundType::PCM;
+			sr.num_samples  = wav->data_size / wav->fmt_block_align;
+			sound_data      = (const char*)&wav[1];
+		}
+		else
+		{
+			// Keep the compressed stream and only validate it here, it will be
+			// decoded at load time or while playing, depending on sr.stream.
+			int err = VORBIS__no_error;
+			stb_vorbis* vorbis = stb_vorbis_open_memory((const unsigned char*)array::begin(sound)
+				, array::size(sound)
+				, &err
+				, NULL
+				);
+			DATA_COMPILER_ASSERT(vorbis != NULL
+				, opts
+				, "Invalid OGG file: '%s' (error %d)"
+				, name.c_str()
+				, err
+				);
+
+			const stb_vorbis_info info = stb_vorbis_get_info(vorbis);
+			const u32 num_samples = stb_vorbis_stream_length_in_samples(vorbis);
+			stb_vorbis_close(vorbis);
+			DATA_COMPILER_ASSERT(info.channels == 1 || info.channels == 2
+				, opts
+				, "Number of channels not supported: %d"
+				, info.channels
+				);
+
+			sr.size         = array::size(sound);
+			sr.sample_rate  = info.sample_rate;
+			sr.avg_bytes_ps = info.sample_rate * info.channels * 2;
+			sr.channels     = info.channels;
+			sr.block_size   = info.channels * 2;
+			sr.bits_ps      = 16;
+			sr.sound_type   = SoundType::OGG;
+			sr.num_samples  = num_samples;
+			sound_data      = array::begin(sound);
+		}
 
 		opts.write(sr.version);
 		opts.write(sr.size);
@@ -67,8 +151,82 @@ namespace sound_resource_internal
 		opts.write(sr.block_size);
 		opts.write(sr.bits_ps);
 		opts.write(sr.sound_type);
+		opts.write(sr.stream);
+		opts.write(sr.num_samples);
 
-		opts.write(wavdata, wav->data_size);
+		opts.write(sound_data, sr.size);
+	}
+
+	void* load(File& file, Allocator& a)
+	{
+		BinaryReader br(file);
+
+		SoundResource header;
+		br.read(header);
+		CE_ASSERT(header.version == RESOURCE_VERSION_SOUND, "Wrong version");
+
+		if (header.sound_type == SoundType::PCM || header.stream)
+		{
+			SoundResource* sr = (SoundResource*)a.allocate(sizeof(SoundResource) + header.size);
+			*sr = header;
+			br.read(&sr[1], header.size);
+			return sr;
+		}
+
+		// Decode the whole OGG stream now so that playing it is as cheap as PCM.
+		void* ogg = a.allocate(header.size);
+		br.read(ogg, header.size);
+
+		int channels = 0;
+		int sample_rate = 0;
+		short* pcm = NULL;
+		const int num_samples = stb_vorbis_decode_memory((const unsigned char*)ogg
+			, header.size
+			, &channels
+			, &sample_rate
+			, &pcm
+			);
+		a.deallocate(ogg);
+
+		// Play silence for the samples that could not be decoded
+		u32 num_decoded = 0;
+		if (num_samples < 0 || u32(channels) != header.channels)
+		{
+			loge(SOUND, "Failed to decode OGG stream, loading silence");
+		}
+		else
+		{
+			num_decoded = u32(num_samples);
+			if (num_decoded < header.num_samples)
+			{
+				loge(SOUND, "OGG stream decoded %u of %u samples, padding with silence"
+					, num_decoded
+					, header.num_samples
+					);
+			}
+			else
+			{
+				num_decoded = header.num_samples;
+			}
+		}
+
+		const u32 size = header.num_samples * header.channels * sizeof(s16);
+		const u32 decoded_size = num_decoded * header.channels * sizeof(s16);
+
+		SoundResource* sr = (SoundResource*)a.allocate(sizeof(SoundResource) + size);
+		*sr = header;
+		sr->size        = size;
+		sr->sound_type  = SoundType::PCM;
+		memcpy(&sr[1], pcm, decoded_size);
+		memset((char*)&sr[1] + decoded_size, 0, size - decoded_size);
+		free(pcm);
+
+		return sr;
+	}
+
+	void unload(Allocator& a, void* resource)
+	{
+		a.deallocate(resource);
 	}
 
 } // namespace sound_resource_internal
@@ -10,7 +10,6 @@
 #include "core/strings/string_id.h"
 #include "core/types.h"
 #include "resource/types.h"
-#include "resource/types.h"
 
 namespace crown
 {
@@ -18,8 +17,8 @@ struct SoundType
 {
 	enum Enum
 	{
-		WAV,
-		OGG
+		PCM, ///< Uncompressed PCM samples.
+		OGG  ///< Ogg Vorbis stream, decoded while playing.
 	};
 };
 
@@ -33,11 +32,15 @@ struct SoundResource
 	u16 block_size;
 	u16 bits_ps;
 	u32 sound_type;
+	u32 stream;
+	u32 num_samples;
 };
 
 namespace sound_resource_internal
 {
 	void compile(CompileOptions& opts);
+	void* load(File& file, Allocator& a);
+	void unload(Allocator& a, void* resource);
 
 } // namespace	sound_resource_internal
 
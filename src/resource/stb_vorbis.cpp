@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2012-2017 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+// Implementation of stb_vorbis, the other files include it with
+// STB_VORBIS_HEADER_ONLY. Its warnings are not ours to fix.
+#if defined(__GNUC__)
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wunused-parameter"
+	#pragma GCC diagnostic ignored "-Wunused-function"
+	#pragma GCC diagnostic ignored "-Wunused-value"
+	#if !defined(__clang__)
+		#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+	#endif
+#elif defined(_MSC_VER)
+	#pragma warning(push, 0)
+#endif
+
+#include <stb_vorbis.c>
+
+#if defined(__GNUC__)
+	#pragma GCC diagnostic pop
+#elif defined(_MSC_VER)
+	#pragma warning(pop)
+#endif
@@ -3,6 +3,9 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "config.h"
+#include "core/containers/array.h"
+#include "core/filesystem/file.h"
 #include "core/filesystem/reader_writer.h"
 #include "core/json/json_object.h"
 #include "core/json/sjson.h"
@@ -10,8 +13,10 @@
 #include "core/strings/dynamic_string.h"
 #include "core/strings/string_stream.h"
 #include "resource/compile_options.h"
+#include "resource/resource_loader.h"
 #include "resource/resource_manager.h"
 #include "resource/texture_resource.h"
+#include <bimg/bimg.h>
 
 #if CROWN_DEVELOPMENT
 	#define TEXTUREC_NAME "texturec-development"
@@ -33,6 +38,63 @@ namespace crown
 {
 namespace texture_resource_internal
 {
+	// Formats that can be requested by the .texture files
+	static const char* _texture_formats[] =
+	{
+		"BC1",
+		"BC3",
+		"BC5",
+		"BC7"
+	};
+
+	static bool is_texture_format(const char* name)
+	{
+		for (u32 i = 0; i < countof(_texture_formats); ++i)
+		{
+			if (strcmp(name, _texture_formats[i]) == 0)
+				return true;
+		}
+
+		return false;
+	}
+
+	// Creates a texture whose most detailed mip is @a mip.
+	static bgfx::TextureHandle create_texture(const TextureResource& tr, u32 mip, const bgfx::Memory* mem)
+	{
+		const u32 width  = tr.width  >> mip;
+		const u32 height = tr.height >> mip;
+
+		return bgfx::createTexture2D(u16(width > 0 ? width : 1)
+			, u16(height > 0 ? height : 1)
+			, tr.num_mips - mip > 1
+			, 1
+			, (bgfx::TextureFormat::Enum)tr.format
+			, BGFX_TEXTURE_NONE
+			, mem
+			);
+	}
+
+	// Online streaming textures
+	static TextureResource* _streaming = NULL;
+
+	// Returns the size of the mips from @a mip down.
+	static u32 mips_size(const TextureResource& tr, u32 mip)
+	{
+		return tr.mip_offsets[tr.num_mips] - tr.mip_offsets[mip];
+	}
+
+	// Mips are allocated from the default allocator because bgfx may
+	// release them from its render thread.
+	static void release_mips(void* ptr, void* /*user_data*/)
+	{
+		default_allocator().deallocate(ptr);
+	}
+
+	static const bgfx::Memory* make_ref(void* mips, u32 size)
+	{
+		return bgfx::makeRef(mips, size, release_mips);
+	}
+
 	void compile(CompileOptions& opts)
 	{
 		Buffer buf = opts.read();
@@ -47,6 +109,18 @@ namespace texture_resource_internal
 
 		const bool generate_mips = sjson::parse_bool(object["generate_mips"]);
 		const bool is_normalmap  = sjson::parse_bool(object["is_normalmap"]);
+		const bool streaming     = json_object::has(object, "streaming") ? sjson::parse_bool(object["streaming"]) : false;
+
+		DynamicString format(ta);
+		if (json_object::has(object, "format"))
+		{
+			sjson::parse_string(object["format"], format);
+			DATA_COMPILER_ASSERT(is_texture_format(format.c_str())
+				, opts
+				, "Unknown texture format: '%s'"
+				, format.c_str()
+				);
+		}
 
 		DynamicString texsrc(ta);
 		DynamicString texout(ta);
@@ -62,6 +136,8 @@ namespace texture_resource_internal
 			texout.c_str(),
 			(generate_mips ? "-m" : ""),
 			(is_normalmap  ? "-n" : ""),
+			(format.empty() ? "" : "-t"),
+			format.c_str(),
 			NULL
 		};
 
@@ -76,10 +152,45 @@ namespace texture_resource_internal
 		Buffer blob = opts.read_temporary(texout.c_str());
 		opts.delete_file(texout.c_str());
 
-		// Write DDS
+		bimg::ImageContainer ic;
+		const bool parsed = bimg::imageParse(ic, array::begin(blob), array::size(blob));
+		DATA_COMPILER_ASSERT(parsed, opts, "Failed to parse texture");
+		DATA_COMPILER_ASSERT(!ic.m_cubeMap && ic.m_depth == 1 && ic.m_numLayers == 1
+			, opts
+			, "Only 2D textures are supported"
+			);
+		DATA_COMPILER_ASSERT(ic.m_numMips <= TEXTURE_MAX_MIPS
+			, opts
+			, "Too many mips"
+			);
+
+		// Mips go from the most detailed to the least, as bgfx expects them,
+		// so that the mips from any level down can be read at once
+		u32 offsets[TEXTURE_MAX_MIPS + 1];
+		offsets[0] = 0;
+		for (u32 i = 0; i < ic.m_numMips; ++i)
+		{
+			bimg::ImageMip mip;
+			bimg::imageGetRawData(ic, 0, i, array::begin(blob), array::size(blob), mip);
+			offsets[i + 1] = offsets[i] + mip.m_size;
+		}
+
 		opts.write(RESOURCE_VERSION_TEXTURE);
-		opts.write(array::size(blob));
-		opts.write(blob);
+		opts.write(u32(ic.m_format));
+		opts.write(ic.m_width);
+		opts.write(ic.m_height);
+		opts.write(u32(ic.m_numMips));
+		opts.write(u32(streaming));
+
+		for (u32 i = 0; i < u32(ic.m_numMips) + 1; ++i)
+			opts.write(offsets[i]);
+
+		for (u32 i = 0; i < ic.m_numMips; ++i)
+		{
+			bimg::ImageMip mip;
+			bimg::imageGetRawData(ic, 0, i, array::begin(blob), array::size(blob), mip);
+			opts.write(mip.m_data, mip.m_size);
+		}
 	}
 
 	void* load(File& file, Allocator& a)
@@ -90,16 +201,40 @@ namespace texture_resource_internal
 		br.read(version);
 		CE_ASSERT(version == RESOURCE_VERSION_TEXTURE, "Wrong version");
 
-		u32 size;
-		br.read(size);
+		TextureResource* tr = (TextureResource*)a.allocate(sizeof(TextureResource));
+		br.read(tr->format);
+		br.read(tr->width);
+		br.read(tr->height);
+		br.read(tr->num_mips);
+		br.read(tr->streaming);
+		CE_ASSERT(tr->num_mips <= TEXTURE_MAX_MIPS, "Too many mips");
+
+		for (u32 i = 0; i < tr->num_mips + 1; ++i)
+			br.read(tr->mip_offsets[i]);
 
-		TextureResource* tr = (TextureResource*)a.allocate(sizeof(TextureResource) + size);
+		tr->data_offset = file.position();
 
-		void* data = &tr[1];
-		br.read(data, size);
+		// Streaming textures start from the first mip small enough
+		u32 mip = 0;
+		while (tr->streaming
+			&& mip + 1 < tr->num_mips
+			&& ((tr->width >> mip) > CROWN_TEXTURE_STREAMING_MIN_SIZE || (tr->height >> mip) > CROWN_TEXTURE_STREAMING_MIN_SIZE)
+			)
+		{
+			++mip;
+		}
 
-		tr->mem        = bgfx::makeRef(data, size);
-		tr->handle.idx = bgfx::invalidHandle;
+		const u32 size = mips_size(*tr, mip);
+		tr->mips = default_allocator().allocate(size);
+		file.seek(tr->data_offset + tr->mip_offsets[mip]);
+		file.read(tr->mips, size);
+
+		tr->handle.idx   = bgfx::invalidHandle;
+		tr->prev         = NULL;
+		tr->next         = NULL;
+		tr->resident_mip = mip;
+		tr->wanted_mip   = UINT32_MAX;
+		tr->pending_mip  = UINT32_MAX;
 
 		return tr;
 	}
@@ -107,20 +242,132 @@ namespace texture_resource_internal
 	void online(StringId64 id, ResourceManager& rm)
 	{
 		TextureResource* tr = (TextureResource*)rm.get(RESOURCE_TYPE_TEXTURE, id);
-		tr->handle = bgfx::createTexture(tr->mem);
+
+		// bgfx releases the mips once they are uploaded
+		tr->handle = create_texture(*tr, tr->resident_mip, make_ref(tr->mips, mips_size(*tr, tr->resident_mip)));
+		tr->mips = NULL;
+		tr->name = id;
+
+		if (tr->streaming)
+		{
+			tr->prev = NULL;
+			tr->next = _streaming;
+			if (_streaming != NULL)
+				_streaming->prev = tr;
+			_streaming = tr;
+		}
 	}
 
 	void offline(StringId64 id, ResourceManager& rm)
 	{
 		TextureResource* tr = (TextureResource*)rm.get(RESOURCE_TYPE_TEXTURE, id);
 		bgfx::destroyTexture(tr->handle);
+
+		// The mips still being read are released by stream_mips()
+		if (tr->streaming)
+		{
+			if (tr->prev != NULL)
+				tr->prev->next = tr->next;
+			else
+				_streaming = tr->next;
+			if (tr->next != NULL)
+				tr->next->prev = tr->prev;
+
+			tr->prev = NULL;
+			tr->next = NULL;
+			tr->pending_mip = UINT32_MAX;
+		}
 	}
 
 	void unload(Allocator& a, void* resource)
 	{
+		// The mips are still owned if the texture never went online
+		TextureResource* tr = (TextureResource*)resource;
+		if (tr->mips != NULL)
+			default_allocator().deallocate(tr->mips);
+
 		a.deallocate(resource);
 	}
 
 } // namespace texture_resource_internal
 
+namespace texture_resource
+{
+	void request_pixels(TextureResource* tr, f32 pixels)
+	{
+		// Least detailed mip still as big as the texture on screen
+		f32 size = f32(tr->width > tr->height ? tr->width : tr->height);
+		u32 mip = 0;
+		while (mip + 1 < tr->num_mips && size * 0.5f >= pixels)
+		{
+			size *= 0.5f;
+			++mip;
+		}
+
+		tr->wanted_mip = mip < tr->wanted_mip ? mip : tr->wanted_mip;
+	}
+
+	void stream_mips(ResourceLoader& rl, u32 budget)
+	{
+		using namespace texture_resource_internal;
+
+		// Upload the mips read since the last call, the texture is created
+		// again with the new mip on top
+		TempAllocator1024 ta;
+		Array<StreamRequest> streamed(ta);
+		rl.get_streamed(streamed);
+
+		for (u32 i = 0; i < array::size(streamed); ++i)
+		{
+			const StreamRequest& sr = streamed[i];
+
+			TextureResource* tr = _streaming;
+			while (tr != NULL && tr->name != sr.name)
+				tr = tr->next;
+
+			// The texture went offline while its mips were being read
+			if (tr == NULL
+				|| tr->pending_mip == UINT32_MAX
+				|| sr.offset != tr->data_offset + tr->mip_offsets[tr->pending_mip]
+				)
+			{
+				sr.allocator->deallocate(sr.data);
+				continue;
+			}
+
+			const u32 mip = tr->pending_mip;
+			bgfx::destroyTexture(tr->handle);
+			tr->handle = create_texture(*tr, mip, make_ref(sr.data, sr.size));
+			tr->resident_mip = mip;
+			tr->pending_mip = UINT32_MAX;
+		}
+
+		// Request one more detailed mip at a time for the textures that need it
+		u32 size = 0;
+		for (TextureResource* tr = _streaming; tr != NULL; tr = tr->next)
+		{
+			const u32 wanted_mip = tr->wanted_mip;
+			tr->wanted_mip = UINT32_MAX;
+
+			if (tr->pending_mip != UINT32_MAX || wanted_mip >= tr->resident_mip || size >= budget)
+				continue;
+
+			const u32 mip = tr->resident_mip - 1;
+
+			StreamRequest sr;
+			sr.type      = RESOURCE_TYPE_TEXTURE;
+			sr.name      = tr->name;
+			sr.offset    = tr->data_offset + tr->mip_offsets[mip];
+			sr.size      = mips_size(*tr, mip);
+			sr.allocator = &default_allocator();
+			sr.data      = default_allocator().allocate(sr.size);
+			rl.add_stream_request(sr);
+
+			tr->pending_mip = mip;
+			size += sr.size;
+		}
+	}
+
+} // namespace texture_resource
+
 } // namespace crown
@@ -7,17 +7,31 @@
 
 #include "core/filesystem/types.h"
 #include "core/memory/types.h"
-#include "core/memory/types.h"
-#include "resource/types.h"
+#include "core/strings/string_id.h"
 #include "resource/types.h"
 #include <bgfx/bgfx.h>
 
+#define TEXTURE_MAX_MIPS 16
+
 namespace crown
 {
 struct TextureResource
 {
-	const bgfx::Memory* mem;
 	bgfx::TextureHandle handle;
+	void* mips;               // Mips read by load(), owned until online() uploads them
+	StringId64 name;          // Set by online()
+	TextureResource* prev;    // In the list of online streaming textures
+	TextureResource* next;
+	u32 format;               // bgfx::TextureFormat::Enum
+	u32 width;                // Of mip 0
+	u32 height;
+	u32 num_mips;
+	u32 streaming;            // Whether the detailed mips are loaded on demand
+	u32 resident_mip;         // Most detailed mip on the GPU
+	u32 wanted_mip;           // Most detailed mip drawn since the last stream_mips()
+	u32 pending_mip;          // Mip being read by the ResourceLoader or UINT32_MAX
+	u32 data_offset;          // Of mip 0 in the compiled resource
+	u32 mip_offsets[TEXTURE_MAX_MIPS + 1]; // Relative to mip 0
 };
 
 namespace texture_resource_internal
@@ -30,4 +44,16 @@ namespace texture_resource_internal
 
 } // namespace texture_resource_internal
 
+namespace texture_resource
+{
+	/// Records that the texture @a tr is drawn over @a pixels pixels on screen.
+	void request_pixels(TextureResource* tr, f32 pixels);
+
+	/// Uploads the mips read by @a rl since the last call and asks @a rl
+	/// to read, in the background, at most @a budget bytes of the more
+	/// detailed mips requested since the last call.
+	void stream_mips(ResourceLoader& rl, u32 budget);
+
+} // namespace texture_resource
+
 } // namespace crown
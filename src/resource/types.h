@@ -8,6 +8,7 @@
 /// @defgroup Resource Resource
 namespace crown
 {
+struct CompileCache;
 struct CompileOptions;
 struct DataCompiler;
 struct ResourceLoader;
@@ -58,17 +59,17 @@ struct UnitResource;
 #define RESOURCE_VERSION_STATE_MACHINE    u32(1)
 #define RESOURCE_VERSION_CONFIG           u32(1)
 #define RESOURCE_VERSION_FONT             u32(1)
-#define RESOURCE_VERSION_LEVEL            u32(1)
+#define RESOURCE_VERSION_LEVEL            u32(2)
 #define RESOURCE_VERSION_MATERIAL         u32(1)
-#define RESOURCE_VERSION_MESH             u32(1)
+#define RESOURCE_VERSION_MESH             u32(6)
 #define RESOURCE_VERSION_PACKAGE          u32(1)
 #define RESOURCE_VERSION_PHYSICS_CONFIG   u32(1)
 #define RESOURCE_VERSION_PHYSICS          u32(1)
 #define RESOURCE_VERSION_SCRIPT           u32(1)
 #define RESOURCE_VERSION_SHADER           u32(1)
-#define RESOURCE_VERSION_SOUND            u32(1)
+#define RESOURCE_VERSION_SOUND            u32(3)
 #define RESOURCE_VERSION_SPRITE_ANIMATION u32(1)
 #define RESOURCE_VERSION_SPRITE           u32(1)
-#define RESOURCE_VERSION_TEXTURE          u32(1)
-#define RESOURCE_VERSION_UNIT             u32(1)
+#define RESOURCE_VERSION_TEXTURE          u32(2)
+#define RESOURCE_VERSION_UNIT             u32(2)
 /// @}
@@ -154,6 +154,8 @@ static Buffer compile_sprite_renderer(const char* json, CompileOptions& opts)
 	SpriteRendererDesc srd;
 	srd.sprite_resource   = sjson::parse_resource_id(obj["sprite_resource"]);
 	srd.material_resource = sjson::parse_resource_id(obj["material"]);
+	srd.layer             = json_object::has(obj, "layer") ? sjson::parse_int(obj["layer"]) : 0;
+	srd.depth             = json_object::has(obj, "depth") ? sjson::parse_int(obj["depth"]) : 0;
 	srd.visible           = sjson::parse_bool       (obj["visible"]);
 	srd._pad0[0]          = 0;
 	srd._pad0[1]          = 0;
@@ -163,6 +165,19 @@ static Buffer compile_sprite_renderer(const char* json, CompileOptions& opts)
 	srd._pad1[2]          = 0;
 	srd._pad1[3]          = 0;
 
+	DATA_COMPILER_ASSERT(srd.layer < CROWN_MAX_SPRITE_LAYERS
+		, opts
+		, "Sprite layer must be in [0; %d]: %u"
+		, CROWN_MAX_SPRITE_LAYERS - 1
+		, srd.layer
+		);
+	DATA_COMPILER_ASSERT(srd.depth <= CROWN_MAX_SPRITE_DEPTH
+		, opts
+		, "Sprite depth must be in [0; %d]: %u"
+		, CROWN_MAX_SPRITE_DEPTH
+		, srd.depth
+		);
+
 	Buffer buf(default_allocator());
 	array::push(buf, (char*)&srd, sizeof(srd));
 	return buf;
@@ -187,22 +187,37 @@ void DebugLine::add_obb(const Matrix4x4& tm, const Vector3& half_extents, const
 	add_line(o - x + y - z, o - x + y + z, color);
 }
 
-void DebugLine::add_mesh(const Matrix4x4& tm, const void* vertices, u32 stride, const u16* indices, u32 num, const Color4& color)
+namespace debug_line_internal
 {
-	for (u32 i = 0; i < num; i += 3)
+	template <typename T>
+	static void add_mesh(DebugLine& dl, const Matrix4x4& tm, const void* vertices, u32 stride, const T* indices, u32 num, const Color4& color)
 	{
-		const u32 i0 = indices[i + 0];
-		const u32 i1 = indices[i + 1];
-		const u32 i2 = indices[i + 2];
+		for (u32 i = 0; i < num; i += 3)
+		{
+			const u32 i0 = indices[i + 0];
+			const u32 i1 = indices[i + 1];
+			const u32 i2 = indices[i + 2];
 
-		const Vector3& v0 = *(const Vector3*)((const char*)vertices + i0*stride) * tm;
-		const Vector3& v1 = *(const Vector3*)((const char*)vertices + i1*stride) * tm;
-		const Vector3& v2 = *(const Vector3*)((const char*)vertices + i2*stride) * tm;
+			const Vector3& v0 = *(const Vector3*)((const char*)vertices + i0*stride) * tm;
+			const Vector3& v1 = *(const Vector3*)((const char*)vertices + i1*stride) * tm;
+			const Vector3& v2 = *(const Vector3*)((const char*)vertices + i2*stride) * tm;
 
-		add_line(v0, v1, color);
-		add_line(v1, v2, color);
-		add_line(v2, v0, color);
+			dl.add_line(v0, v1, color);
+			dl.add_line(v1, v2, color);
+			dl.add_line(v2, v0, color);
+		}
 	}
+
+} // namespace debug_line_internal
+
+void DebugLine::add_mesh(const Matrix4x4& tm, const void* vertices, u32 stride, const u16* indices, u32 num, const Color4& color)
+{
+	debug_line_internal::add_mesh(*this, tm, vertices, stride, indices, num, color);
+}
+
+void DebugLine::add_mesh(const Matrix4x4& tm, const void* vertices, u32 stride, const u32* indices, u32 num, const Color4& color)
+{
+	debug_line_internal::add_mesh(*this, tm, vertices, stride, indices, num, color);
 }
 
 void DebugLine::add_unit(ResourceManager& rm, const Matrix4x4& tm, StringId64 name, const Color4& color)
@@ -225,13 +240,26 @@ void DebugLine::add_unit(ResourceManager& rm, const Matrix4x4& tm, StringId64 na
 				const MeshResource* mr = (const MeshResource*)rm.get(RESOURCE_TYPE_MESH, mrd->mesh_resource);
 				const MeshGeometry* mg = mr->geometry(mrd->geometry_name);
 
-				add_mesh(tm
-					, mg->vertices.data
-					, mg->vertices.stride
-					, (u16*)mg->indices.data
-					, mg->indices.num
-					, color
-					);
+				if (mg->indices.stride == sizeof(u32))
+				{
+					add_mesh(tm
+						, mg->positions.data
+						, mg->positions.stride
+						, (u32*)mg->indices.data
+						, mg->indices.num
+						, color
+						);
+				}
+				else
+				{
+					add_mesh(tm
+						, mg->positions.data
+						, mg->positions.stride
+						, (u16*)mg->indices.data
+						, mg->indices.num
+						, color
+						);
+				}
 			}
 		}
 		else if (component->type == COMPONENT_TYPE_SPRITE_RENDERER)
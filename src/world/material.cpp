@@ -7,60 +7,96 @@
 #include "resource/resource_manager.h"
 #include "resource/texture_resource.h"
 #include "world/material.h"
+#include "world/material_manager.h"
 #include "world/shader_manager.h"
 #include <bgfx/bgfx.h>
 
 namespace crown
 {
-void Material::bind(ResourceManager& rm, ShaderManager& sm, u8 view) const
+void Material::resolve(ResourceManager& rm, ShaderManager& sm)
 {
 	using namespace material_resource;
 
+	const ShaderManager::ShaderData sd = sm.get(_resource->shader);
+	_state   = sd.state;
+	_program = sd.program.idx;
+
+	for (u32 i = 0; i < _resource->num_textures; ++i)
+	{
+		const TextureData* td = get_texture_data(_resource, i);
+		_textures[i] = (TextureResource*)rm.get(RESOURCE_TYPE_TEXTURE, td->id);
+	}
+
+	_resolved = rm._generation;
+}
+
+void Material::bind(ResourceManager& rm, ShaderManager& sm, u8 view)
+{
+	using namespace material_resource;
+
+	// Shaders and textures can only change when resources go online or offline
+	if (_resolved != rm._generation)
+		resolve(rm, sm);
+
 	// Set samplers
 	for (u32 i = 0; i < _resource->num_textures; ++i)
 	{
-		const TextureData* td   = get_texture_data(_resource, i);
 		const TextureHandle* th = get_texture_handle(_resource, i, _data);
 
-		const TextureResource* teximg = (TextureResource*)rm.get(RESOURCE_TYPE_TEXTURE, td->id);
-
 		bgfx::UniformHandle sampler;
-		bgfx::TextureHandle texture;
 		sampler.idx = th->sampler_handle;
-		texture.idx = teximg->handle.idx;
 
-		bgfx::setTexture(i, sampler, texture);
+		bgfx::setTexture(i, sampler, _textures[i]->handle);
 	}
 
 	// Set uniforms
-	for (u32 i = 0; i < _resource->num_uniforms; ++i)
+	if (_manager->bind_uniforms(this, view))
 	{
-		const UniformHandle* uh = get_uniform_handle(_resource, i, _data);
+		for (u32 i = 0; i < _resource->num_uniforms; ++i)
+		{
+			const UniformHandle* uh = get_uniform_handle(_resource, i, _data);
 
-		bgfx::UniformHandle buh;
-		buh.idx = uh->uniform_handle;
-		bgfx::setUniform(buh, (char*)uh + sizeof(uh->uniform_handle));
+			bgfx::UniformHandle buh;
+			buh.idx = uh->uniform_handle;
+			bgfx::setUniform(buh, (char*)uh + sizeof(uh->uniform_handle));
+		}
 	}
 
-	sm.submit(_resource->shader, view);
+	bgfx::ProgramHandle program;
+	program.idx = _program;
+
+	bgfx::setState(_state);
+	bgfx::submit(view, program);
+}
+
+void Material::request_pixels(ResourceManager& rm, ShaderManager& sm, f32 pixels)
+{
+	if (_resolved != rm._generation)
+		resolve(rm, sm);
+
+	for (u32 i = 0; i < _resource->num_textures; ++i)
+		texture_resource::request_pixels(_textures[i], pixels);
 }
 
 void Material::set_float(StringId32 name, f32 value)
 {
 	char* p = (char*)material_resource::get_uniform_handle_by_name(_resource, name, _data);
 	*(f32*)(p + sizeof(u32)) = value;
+	++_generation;
 }
 
 void Material::set_vector2(StringId32 name, const Vector2& value)
 {
 	char* p = (char*)material_resource::get_uniform_handle_by_name(_resource, name, _data);
 	*(Vector2*)(p + sizeof(u32)) = value;
+	++_generation;
 }
 
 void Material::set_vector3(StringId32 name, const Vector3& value)
 {
 	char* p = (char*)material_resource::get_uniform_handle_by_name(_resource, name, _data);
 	*(Vector3*)(p + sizeof(u32)) = value;
+	++_generation;
 }
 
 } // namespace crown
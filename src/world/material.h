@@ -18,9 +18,22 @@ struct Material
 {
 	const MaterialResource* _resource;
 	char* _data;
-
-	///
-	void bind(ResourceManager& rm, ShaderManager& sm, u8 view = 0) const;
+	MaterialManager* _manager;
+	TextureResource** _textures;       // Texture of each sampler
+	u64 _state;                        // Render state of the shader
+	u32 _program;                      // Program of the shader
+	u32 _resolved;                     // ResourceManager::_generation the above have been resolved at
+	u32 _generation;                   // Incremented whenever a uniform changes
+
+	/// Resolves the program, the render state and the textures of the material.
+	void resolve(ResourceManager& rm, ShaderManager& sm);
+
+	/// Sets the textures, the uniforms and the render state of the material
+	/// and submits the draw call to @a view.
+	void bind(ResourceManager& rm, ShaderManager& sm, u8 view = 0);
+
+	/// Requests the mips of the textures needed to cover @a pixels on screen.
+	void request_pixels(ResourceManager& rm, ShaderManager& sm, f32 pixels);
 
 	/// Sets the @a value of the variable @a name.
 	void set_float(StringId32 name, f32 value);
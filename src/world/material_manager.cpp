@@ -17,6 +17,9 @@ MaterialManager::MaterialManager(Allocator& a, ResourceManager& rm)
 	: _allocator(&a)
 	, _resource_manager(&rm)
 	, _materials(a)
+	, _bound(NULL)
+	, _bound_generation(0)
+	, _bound_view(0)
 {
 }
 
@@ -99,10 +102,16 @@ void MaterialManager::create_material(StringId64 id)
 
 	const MaterialResource* mr = (MaterialResource*)_resource_manager->get(RESOURCE_TYPE_MATERIAL, id);
 
-	const u32 size = sizeof(Material) + mr->dynamic_data_size;
-	Material* mat  = (Material*)_allocator->allocate(size);
-	mat->_resource = mr;
-	mat->_data     = (char*)&mat[1];
+	const u32 size = sizeof(Material) + mr->num_textures*sizeof(TextureResource*) + mr->dynamic_data_size;
+	Material* mat    = (Material*)_allocator->allocate(size);
+	mat->_resource   = mr;
+	mat->_manager    = this;
+	mat->_textures   = (TextureResource**)&mat[1];
+	mat->_data       = (char*)&mat->_textures[mr->num_textures];
+	mat->_state      = 0;
+	mat->_program    = UINT16_MAX;
+	mat->_resolved   = _resource_manager->_generation - 1; // Resolved by the first bind()
+	mat->_generation = 0;
 
 	const char* data = (char*)mr + mr->dynamic_data_offset;
 	memcpy(mat->_data, data, mr->dynamic_data_size);
@@ -114,6 +123,8 @@ void MaterialManager::create_material(StringId64 id)
 void MaterialManager::destroy_material(StringId64 id)
 {
 	Material* mat = sort_map::get(_materials, id, (Material*)NULL);
+	if (_bound == mat)
+		_bound = NULL;
 	_allocator->deallocate(mat);
 
 	sort_map::remove(_materials, id);
@@ -126,4 +137,23 @@ Material* MaterialManager::get(StringId64 id)
 	return sort_map::get(_materials, id, (Material*)NULL);
 }
 
+bool MaterialManager::bind_uniforms(const Material* mat, u8 view)
+{
+	// bgfx keeps the value of the uniforms between draw calls, and consecutive
+	// draws with the same material in the same view share the same sort key,
+	// so they stay next to each other in submission order
+	if (_bound == mat && _bound_generation == mat->_generation && _bound_view == view)
+		return false;
+
+	_bound = mat;
+	_bound_generation = mat->_generation;
+	_bound_view = view;
+	return true;
+}
+
+void MaterialManager::reset_uniforms()
+{
+	_bound = NULL;
+}
+
 } // namespace crown
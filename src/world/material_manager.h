@@ -19,6 +19,9 @@ struct MaterialManager
 	Allocator* _allocator;
 	ResourceManager* _resource_manager;
 	SortMap<StringId64, Material*> _materials;
+	const Material* _bound;  // Material whose uniforms have been set last
+	u32 _bound_generation;
+	u8 _bound_view;
 
 	///
 	MaterialManager(Allocator& a, ResourceManager& rm);
@@ -46,6 +49,16 @@ struct MaterialManager
 
 	/// Returns the material @a id.
 	Material* get(StringId64 id);
+
+	/// Returns whether the uniforms of the material @a mat need to be set
+	/// for the next draw call in @a view, and records them as set.
+	/// Draws that use the same material one after the other in the same view
+	/// share its uniforms until the material changes.
+	bool bind_uniforms(const Material* mat, u8 view);
+
+	/// Forgets the uniforms set by the materials.
+	/// It must be called once per frame.
+	void reset_uniforms();
 };
 
 } // namespace crown
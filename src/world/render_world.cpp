@@ -3,11 +3,15 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "core/containers/array.h"
 #include "core/containers/hash_map.h"
 #include "core/math/aabb.h"
 #include "core/math/color4.h"
 #include "core/math/intersection.h"
 #include "core/math/matrix4x4.h"
+#include "core/math/vector2.h"
+#include "core/math/vector3.h"
+#include "core/memory/temp_allocator.h"
 #include "resource/mesh_resource.h"
 #include "resource/resource_manager.h"
 #include "resource/sprite_resource.h"
@@ -18,8 +22,94 @@
 #include "world/unit_manager.h"
 #include <bgfx/bgfx.h>
 
+// Bounds in the tree are enlarged by this much so that small moves do not change it
+#define RENDER_WORLD_TREE_MARGIN 0.1f
+
 namespace crown
 {
+namespace render_world_internal
+{
+	// Sprites are drawn by layer, then by depth. Sprites at the same
+	// layer and depth are grouped by material so that they can be batched.
+	inline u64 sprite_sort_key(u32 layer, u32 depth, StringId64 material)
+	{
+		return u64(layer) << 56 | u64(depth) << 32 | (material._id & 0xffffffffu);
+	}
+
+	// Sorts the @a num sprite indices in @a order by their @a keys, 8 bits
+	// at a time. Sprites with the same key keep their relative order.
+	// @a temp must hold @a num indices.
+	static void radix_sort(u32* order, u32* temp, u32 num, const u64* keys)
+	{
+		if (num < 2)
+			return;
+
+		u32 count[8][256];
+		memset(count, 0, sizeof(count));
+
+		for (u32 i = 0; i < num; ++i)
+		{
+			const u64 key = keys[order[i]];
+			for (u32 pass = 0; pass < 8; ++pass)
+				++count[pass][(key >> pass*8) & 0xff];
+		}
+
+		u32* src = order;
+		u32* dst = temp;
+		for (u32 pass = 0; pass < 8; ++pass)
+		{
+			// Skip the digits that are the same in all the keys
+			u32* offset = count[pass];
+			if (offset[(keys[src[0]] >> pass*8) & 0xff] == num)
+				continue;
+
+			u32 sum = 0;
+			for (u32 d = 0; d < 256; ++d)
+			{
+				const u32 c = offset[d];
+				offset[d] = sum;
+				sum += c;
+			}
+
+			for (u32 i = 0; i < num; ++i)
+				dst[offset[(keys[src[i]] >> pass*8) & 0xff]++] = src[i];
+
+			u32* t = src;
+			src = dst;
+			dst = t;
+		}
+
+		if (src != order)
+			memcpy(order, src, num*sizeof(u32));
+	}
+
+	// Appends the units in @a user_data to @a units, skipping the duplicates.
+	static void unique_units(const Array<u32>& user_data, Array<UnitId>& units)
+	{
+		TempAllocator1024 ta;
+		HashMap<UnitId, bool> seen(ta);
+
+		for (u32 i = 0; i < array::size(user_data); ++i)
+		{
+			UnitId unit;
+			unit._idx = user_data[i];
+
+			if (hash_map::has(seen, unit))
+				continue;
+
+			hash_map::set(seen, unit, true);
+			array::push_back(units, unit);
+		}
+	}
+
+	// Returns whether sprite @a a is drawn before sprite @a b.
+	inline bool sprite_less(u32 a, u32 b, const u64* keys)
+	{
+		return keys[a] < keys[b] || (keys[a] == keys[b] && a < b);
+	}
+
+} // namespace render_world_internal
+
 static void unit_destroyed_callback_bridge(UnitId id, void* user_ptr)
 {
 	((RenderWorld*)user_ptr)->unit_destroyed_callback(id);
@@ -32,6 +122,13 @@ RenderWorld::RenderWorld(Allocator& a, ResourceManager& rm, ShaderManager& sm, M
 	, _shader_manager(&sm)
 	, _material_manager(&mm)
 	, _unit_manager(&um)
+	, _sprite_capacity(0)
+	, _sprite_vertices(a)
+	, _sprite_order(a)
+	, _sprite_keys(a)
+	, _sprite_temp(a)
+	, _sprite_batches(a)
+	, _tree(a, RENDER_WORLD_TREE_MARGIN)
 	, _debug_drawing(false)
 	, _mesh_manager(a)
 	, _sprite_manager(a)
@@ -44,12 +141,23 @@ RenderWorld::RenderWorld(Allocator& a, ResourceManager& rm, ShaderManager& sm, M
 	_u_light_color     = bgfx::createUniform("u_light_color", bgfx::UniformType::Vec4);
 	_u_light_range     = bgfx::createUniform("u_light_range", bgfx::UniformType::Vec4);
 	_u_light_intensity = bgfx::createUniform("u_light_intensity", bgfx::UniformType::Vec4);
+	_u_mesh_dequantize = bgfx::createUniform("u_mesh_dequantize", bgfx::UniformType::Vec4);
+
+	_sprite_vbh.idx = bgfx::invalidHandle;
+	_sprite_ibh.idx = bgfx::invalidHandle;
 }
 
 RenderWorld::~RenderWorld()
 {
 	_unit_manager->unregister_destroy_function(this);
 
+	if (bgfx::isValid(_sprite_vbh))
+	{
+		bgfx::destroyDynamicVertexBuffer(_sprite_vbh);
+		bgfx::destroyDynamicIndexBuffer(_sprite_ibh);
+	}
+
+	bgfx::destroyUniform(_u_mesh_dequantize);
 	bgfx::destroyUniform(_u_light_intensity);
 	bgfx::destroyUniform(_u_light_range);
 	bgfx::destroyUniform(_u_light_color);
@@ -69,11 +177,15 @@ MeshInstance RenderWorld::mesh_create(UnitId id, const MeshRendererDesc& mrd, co
 	const MeshGeometry* mg = mr->geometry(mrd.geometry_name);
 	_material_manager->create_material(mrd.material_resource);
 
-	return _mesh_manager.create(id, mr, mg, mrd.material_resource, tr);
+	MeshInstance i = _mesh_manager.create(id, mr, mg, mrd.material_resource, tr);
+	_mesh_manager._data.proxy[i.i] = _tree.create(mesh_aabb(i), id._idx);
+	return i;
 }
 
 void RenderWorld::mesh_destroy(MeshInstance i)
 {
+	CE_ASSERT(i.i < _mesh_manager._data.size, "Index out of bounds");
+	_tree.destroy(_mesh_manager._data.proxy[i.i]);
 	_mesh_manager.destroy(i);
 }
 
@@ -116,14 +228,10 @@ OBB RenderWorld::mesh_obb(MeshInstance i)
 f32 RenderWorld::mesh_raycast(MeshInstance i, const Vector3& from, const Vector3& dir)
 {
 	CE_ASSERT(i.i < _mesh_manager._data.size, "Index out of bounds");
-	const MeshGeometry* mg = _mesh_manager._data.geometry[i.i];
-	return ray_mesh_intersection(from
+	return mesh_resource::raycast(*_mesh_manager._data.geometry[i.i]
+		, from
 		, dir
 		, _mesh_manager._data.world[i.i]
-		, mg->vertices.data
-		, mg->vertices.stride
-		, (u16*)mg->indices.data
-		, mg->indices.num
 		);
 }
 
@@ -132,13 +240,18 @@ SpriteInstance RenderWorld::sprite_create(UnitId unit, const SpriteRendererDesc&
 	const SpriteResource* sr = (const SpriteResource*)_resource_manager->get(RESOURCE_TYPE_SPRITE, srd.sprite_resource);
 	_material_manager->create_material(srd.material_resource);
 
-	return _sprite_manager.create(unit, sr, srd.material_resource, tr);
+	CE_ASSERT(srd.layer < CROWN_MAX_SPRITE_LAYERS, "Layer out of bounds");
+	CE_ASSERT(srd.depth <= CROWN_MAX_SPRITE_DEPTH, "Depth out of bounds");
+	SpriteInstance i = _sprite_manager.create(unit, sr, srd, tr);
+	_sprite_manager._data.proxy[i.i] = _tree.create(sprite_aabb(i), unit._idx);
+	return i;
 }
 
 void RenderWorld::sprite_destroy(UnitId unit, SpriteInstance /*i*/)
 {
 	SpriteInstance i = _sprite_manager.sprite(unit);
 	CE_ASSERT(i.i < _sprite_manager._data.size, "Index out of bounds");
+	_tree.destroy(_sprite_manager._data.proxy[i.i]);
 	_sprite_manager.destroy(i);
 }
 
@@ -152,6 +265,7 @@ void RenderWorld::sprite_set_material(UnitId unit, StringId64 id)
 	SpriteInstance i = _sprite_manager.sprite(unit);
 	CE_ASSERT(i.i < _sprite_manager._data.size, "Index out of bounds");
 	_sprite_manager._data.material[i.i] = id;
+	_sprite_manager.move(i);
 }
 
 void RenderWorld::sprite_set_frame(UnitId unit, u32 index)
@@ -159,6 +273,7 @@ void RenderWorld::sprite_set_frame(UnitId unit, u32 index)
 	SpriteInstance i = _sprite_manager.sprite(unit);
 	CE_ASSERT(i.i < _sprite_manager._data.size, "Index out of bounds");
 	_sprite_manager._data.frame[i.i] = index;
+	_sprite_manager._data.dirty[i.i] = true;
 }
 
 void RenderWorld::sprite_set_visible(UnitId unit, bool visible)
@@ -172,6 +287,7 @@ void RenderWorld::sprite_flip_x(UnitId unit, bool flip)
 	SpriteInstance i = _sprite_manager.sprite(unit);
 	CE_ASSERT(i.i < _sprite_manager._data.size, "Index out of bounds");
 	_sprite_manager._data.flip_x[i.i] = flip;
+	_sprite_manager._data.dirty[i.i] = true;
 }
 
 void RenderWorld::sprite_flip_y(UnitId unit, bool flip)
@@ -179,6 +295,33 @@ void RenderWorld::sprite_flip_y(UnitId unit, bool flip)
 	SpriteInstance i = _sprite_manager.sprite(unit);
 	CE_ASSERT(i.i < _sprite_manager._data.size, "Index out of bounds");
 	_sprite_manager._data.flip_y[i.i] = flip;
+	_sprite_manager._data.dirty[i.i] = true;
+}
+
+void RenderWorld::sprite_set_layer(UnitId unit, u32 layer)
+{
+	CE_ASSERT(layer < CROWN_MAX_SPRITE_LAYERS, "Layer out of bounds");
+	layer = layer < CROWN_MAX_SPRITE_LAYERS ? layer : CROWN_MAX_SPRITE_LAYERS - 1;
+	SpriteInstance i = _sprite_manager.sprite(unit);
+	CE_ASSERT(i.i < _sprite_manager._data.size, "Index out of bounds");
+	if (_sprite_manager._data.layer[i.i] == layer)
+		return;
+
+	_sprite_manager._data.layer[i.i] = layer;
+	_sprite_manager.move(i);
+}
+
+void RenderWorld::sprite_set_depth(UnitId unit, u32 depth)
+{
+	CE_ASSERT(depth <= CROWN_MAX_SPRITE_DEPTH, "Depth out of bounds");
+	depth = depth <= CROWN_MAX_SPRITE_DEPTH ? depth : CROWN_MAX_SPRITE_DEPTH;
+	SpriteInstance i = _sprite_manager.sprite(unit);
+	CE_ASSERT(i.i < _sprite_manager._data.size, "Index out of bounds");
+	if (_sprite_manager._data.depth[i.i] == depth)
+		return;
+
+	_sprite_manager._data.depth[i.i] = depth;
+	_sprite_manager.move(i);
 }
 
 OBB RenderWorld::sprite_obb(UnitId unit)
@@ -230,13 +373,17 @@ f32 RenderWorld::sprite_raycast(UnitId unit, const Vector3& from, const Vector3&
 
 LightInstance RenderWorld::light_create(UnitId unit, const LightDesc& ld, const Matrix4x4& tr)
 {
-	return _light_manager.create(unit, ld, tr);
+	LightInstance i = _light_manager.create(unit, ld, tr);
+	light_update_proxy(i);
+	return i;
 }
 
 void RenderWorld::light_destroy(UnitId unit, LightInstance /*i*/)
 {
 	LightInstance i = _light_manager.light(unit);
 	CE_ASSERT(i.i < _light_manager._data.size, "Index out of bounds");
+	if (_light_manager._data.proxy[i.i] != UINT32_MAX)
+		_tree.destroy(_light_manager._data.proxy[i.i]);
 	_light_manager.destroy(i);
 }
 
@@ -292,6 +439,7 @@ void RenderWorld::light_set_type(UnitId unit, LightType::Enum type)
 	LightInstance i = _light_manager.light(unit);
 	CE_ASSERT(i.i < _light_manager._data.size, "Index out of bounds");
 	_light_manager._data.type[i.i] = type;
+	light_update_proxy(i);
 }
 
 void RenderWorld::light_set_range(UnitId unit, f32 range)
@@ -299,6 +447,7 @@ void RenderWorld::light_set_range(UnitId unit, f32 range)
 	LightInstance i = _light_manager.light(unit);
 	CE_ASSERT(i.i < _light_manager._data.size, "Index out of bounds");
 	_light_manager._data.range[i.i] = range;
+	light_update_proxy(i);
 }
 
 void RenderWorld::light_set_intensity(UnitId unit, f32 intensity)
@@ -322,6 +471,118 @@ void RenderWorld::light_debug_draw(UnitId unit, DebugLine& dl)
 	_light_manager.debug_draw(i.i, 1, dl);
 }
 
+void RenderWorld::raycast(const Vector3& from, const Vector3& dir, Array<UnitId>& units, Array<f32>& distances)
+{
+	TempAllocator1024 ta;
+	Array<u32> user_data(ta);
+	_tree.query_ray(from, dir, user_data);
+
+	Array<UnitId> candidates(ta);
+	render_world_internal::unique_units(user_data, candidates);
+
+	// Only the bounds of the candidates are hit, test their geometry
+	for (u32 c = 0; c < array::size(candidates); ++c)
+	{
+		const UnitId unit = candidates[c];
+		f32 t = -1.0f;
+
+		MeshInstance mesh = _mesh_manager.first(unit);
+		for (; is_valid(mesh); mesh = _mesh_manager.next(mesh))
+		{
+			const f32 tm = mesh_raycast(mesh, from, dir);
+			if (tm != -1.0f && (t == -1.0f || tm < t))
+				t = tm;
+		}
+
+		if (_sprite_manager.has(unit))
+		{
+			const f32 ts = sprite_raycast(unit, from, dir);
+			if (ts != -1.0f && (t == -1.0f || ts < t))
+				t = ts;
+		}
+
+		if (t == -1.0f)
+			continue;
+
+		// Keep the hits sorted by distance
+		array::push_back(units, unit);
+		array::push_back(distances, t);
+		for (u32 i = array::size(distances) - 1; i > 0 && distances[i - 1] > distances[i]; --i)
+		{
+			const UnitId u = units[i];
+			units[i] = units[i - 1];
+			units[i - 1] = u;
+
+			const f32 d = distances[i];
+			distances[i] = distances[i - 1];
+			distances[i - 1] = d;
+		}
+	}
+}
+
+void RenderWorld::query_frustum(const Frustum& f, Array<UnitId>& units)
+{
+	TempAllocator1024 ta;
+	Array<u32> user_data(ta);
+	_tree.query_frustum(f, user_data);
+	render_world_internal::unique_units(user_data, units);
+}
+
+void RenderWorld::query_sphere(const Sphere& s, Array<UnitId>& units)
+{
+	TempAllocator1024 ta;
+	Array<u32> user_data(ta);
+	_tree.query_sphere(s, user_data);
+	render_world_internal::unique_units(user_data, units);
+}
+
+AABB RenderWorld::mesh_aabb(MeshInstance i)
+{
+	const OBB o = mesh_obb(i);
+
+	AABB b;
+	b.min = -o.half_extents;
+	b.max =  o.half_extents;
+	return aabb::transformed(b, o.tm);
+}
+
+AABB RenderWorld::sprite_aabb(SpriteInstance i)
+{
+	const OBB& obb = _sprite_manager._data.resource[i.i]->obb;
+
+	AABB b;
+	b.min = -obb.half_extents;
+	b.max =  obb.half_extents;
+	return aabb::transformed(b, obb.tm * _sprite_manager._data.world[i.i]);
+}
+
+void RenderWorld::light_update_proxy(LightInstance i)
+{
+	LightManager::LightInstanceData& lid = _light_manager._data;
+
+	// Directional lights have no bounds
+	if (lid.type[i.i] == LightType::DIRECTIONAL)
+	{
+		if (lid.proxy[i.i] != UINT32_MAX)
+			_tree.destroy(lid.proxy[i.i]);
+
+		lid.proxy[i.i] = UINT32_MAX;
+		return;
+	}
+
+	const Vector3 pos = translation(lid.world[i.i]);
+	const Vector3 range = vector3(lid.range[i.i], lid.range[i.i], lid.range[i.i]);
+
+	AABB b;
+	b.min = pos - range;
+	b.max = pos + range;
+
+	if (lid.proxy[i.i] == UINT32_MAX)
+		lid.proxy[i.i] = _tree.create(b, lid.unit[i.i]._idx);
+	else
+		_tree.move(lid.proxy[i.i], b);
+}
+
 void RenderWorld::update_transforms(const UnitId* begin, const UnitId* end, const Matrix4x4* world)
 {
 	MeshManager::MeshInstanceData& mid = _mesh_manager._data;
@@ -334,18 +595,22 @@ void RenderWorld::update_transforms(const UnitId* begin, const UnitId* end, cons
 		{
 			MeshInstance inst = _mesh_manager.first(*begin);
 			mid.world[inst.i] = *world;
+			_tree.move(mid.proxy[inst.i], mesh_aabb(inst));
 		}
 
 		if (_sprite_manager.has(*begin))
 		{
 			SpriteInstance inst = _sprite_manager.sprite(*begin);
 			sid.world[inst.i] = *world;
+			sid.dirty[inst.i] = true;
+			_tree.move(sid.proxy[inst.i], sprite_aabb(inst));
 		}
 
 		if (_light_manager.has(*begin))
 		{
 			LightInstance inst = _light_manager.light(*begin);
 			lid.world[inst.i] = *world;
+			light_update_proxy(inst);
 		}
 	}
 }
@@ -353,9 +618,35 @@ void RenderWorld::update_transforms(const UnitId* begin, const UnitId* end, cons
 void RenderWorld::render(const Matrix4x4& view, const Matrix4x4& projection)
 {
 	MeshManager::MeshInstanceData& mid = _mesh_manager._data;
-	SpriteManager::SpriteInstanceData& sid = _sprite_manager._data;
 	LightManager::LightInstanceData& lid = _light_manager._data;
 
+	// Select the LOD of each mesh from the size of its bounding sphere on screen
+	// and request the mips of its textures accordingly
+	const Matrix4x4 view_proj = view * projection;
+	const f32 screen_height = f32(bgfx::getStats()->height);
+	for (u32 i = 0; i < mid.first_hidden; ++i)
+	{
+		const MeshGeometry* mg = mid.geometry[i];
+		const Vector3 center = translation(mid.obb[i].tm) * mid.world[i];
+		const Vector3 sc = scale(mid.world[i]);
+		const f32 radius = length(mid.obb[i].half_extents) * fmax(sc.x, fmax(sc.y, sc.z));
+		const Vector4 clip = vector4(center.x, center.y, center.z, 1.0f) * view_proj;
+
+		// Fraction of the screen height covered by the sphere
+		u32 lod = 0;
+		if (clip.w > 0.0f)
+		{
+			const f32 size = radius * projection.y.y / clip.w;
+			for (lod = mg->num_lods - 1; lod > 0 && size >= mg->lods[lod].screen_size; --lod)
+				;
+
+			_material_manager->get(mid.material[i])->request_pixels(*_resource_manager, *_shader_manager, size * screen_height);
+		}
+
+		mid.mesh[i].first_index = mg->lods[lod].first_index;
+		mid.mesh[i].num_indices = mg->lods[lod].num_indices;
+	}
+
 	for (u32 ll = 0; ll < lid.size; ++ll)
 	{
 		const Vector4 ldir = normalize(lid.world[ll].z) * view;
@@ -370,98 +661,207 @@ void RenderWorld::render(const Matrix4x4& view, const Matrix4x4& projection)
 		// Render meshes
 		for (u32 i = 0; i < mid.first_hidden; ++i)
 		{
-			bgfx::setTransform(to_float_ptr(mid.world[i]));
+			const MeshGeometry* mg = mid.geometry[i];
+			const Matrix4x4 world = mg->dequantize_positions * mid.world[i];
+
+			bgfx::setTransform(to_float_ptr(world));
+			bgfx::setUniform(_u_mesh_dequantize, to_float_ptr(mg->dequantize_attributes));
 			bgfx::setVertexBuffer(0, mid.mesh[i].vbh);
-			bgfx::setIndexBuffer(mid.mesh[i].ibh);
+			bgfx::setIndexBuffer(mid.mesh[i].ibh, mid.mesh[i].first_index, mid.mesh[i].num_indices);
 
 			_material_manager->get(mid.material[i])->bind(*_resource_manager, *_shader_manager);
 		}
 	}
 
 	// Render sprites
-	if (sid.first_hidden)
+	update_sprite_batches();
+
+	for (u32 i = 0; i < array::size(_sprite_batches); ++i)
+	{
+		const SpriteBatch& sb = _sprite_batches[i];
+
+		bgfx::setVertexBuffer(0, _sprite_vbh);
+		bgfx::setIndexBuffer(_sprite_ibh, sb.first_index, sb.num_indices);
+
+		_material_manager->get(sb.material)->bind(*_resource_manager, *_shader_manager);
+	}
+}
+
+void RenderWorld::update_sprite_batches()
+{
+	using namespace render_world_internal;
+
+	SpriteManager::SpriteInstanceData& sid = _sprite_manager._data;
+
+	if (sid.first_hidden == 0)
+	{
+		array::clear(_sprite_batches);
+		return;
+	}
+
+	// Grow the buffers to hold every sprite, all of them have to be uploaded again
+	if (sid.capacity > _sprite_capacity)
 	{
+		if (bgfx::isValid(_sprite_vbh))
+		{
+			bgfx::destroyDynamicVertexBuffer(_sprite_vbh);
+			bgfx::destroyDynamicIndexBuffer(_sprite_ibh);
+		}
+
 		bgfx::VertexDecl decl;
 		decl.begin()
-			.add(bgfx::Attrib::Position,  2, bgfx::AttribType::Float)
+			.add(bgfx::Attrib::Position,  3, bgfx::AttribType::Float)
 			.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float, false)
 			.end()
 			;
-		bgfx::TransientVertexBuffer tvb;
-		bgfx::allocTransientVertexBuffer(&tvb, 4*sid.first_hidden, decl);
-		bgfx::TransientIndexBuffer tib;
-		bgfx::allocTransientIndexBuffer(&tib, 6*sid.first_hidden);
 
-		f32* vdata = (f32*)tvb.data;
-		u16* idata = (u16*)tib.data;
+		_sprite_capacity = sid.capacity;
+		_sprite_vbh = bgfx::createDynamicVertexBuffer(_sprite_capacity*4, decl);
+		_sprite_ibh = bgfx::createDynamicIndexBuffer(_sprite_capacity*6, BGFX_BUFFER_INDEX32);
+		array::resize(_sprite_vertices, _sprite_capacity*4);
+
+		memset(sid.dirty, true, sid.size*sizeof(bool));
+		_sprite_manager._order_changed = true;
+	}
+
+	// Sprites that did not change since the last frame keep their vertices
+	u32 first_dirty = UINT32_MAX;
+	u32 last_dirty = 0;
+	for (u32 i = 0; i < sid.first_hidden; ++i)
+	{
+		if (!sid.dirty[i])
+			continue;
+
+		const f32* frame = sprite_resource::frame_data(sid.resource[i], sid.frame[i]);
+
+		// Position and uv of the four corners
+		f32 u[4] = { frame[2], frame[6], frame[10], frame[14] };
+		f32 v[4] = { frame[3], frame[7], frame[11], frame[15] };
+
+		if (sid.flip_x[i])
+		{
+			f32 t;
+			t = u[0]; u[0] = u[1]; u[1] = t;
+			t = u[2]; u[2] = u[3]; u[3] = t;
+		}
 
-		// Render sprites
-		for (u32 i = 0; i < sid.first_hidden; ++i)
+		if (sid.flip_y[i])
 		{
-			const f32* frame = sprite_resource::frame_data(sid.resource[i], sid.frame[i]);
+			f32 t;
+			t = v[0]; v[0] = v[2]; v[2] = t;
+			t = v[1]; v[1] = v[3]; v[3] = t;
+		}
 
-			float u0 = frame[ 2]; // u
-			float v0 = frame[ 3]; // v
+		SpriteVertex* sv = &_sprite_vertices[i*4];
+		for (u32 c = 0; c < 4; ++c)
+		{
+			sv[c].position = vector3(frame[c*4 + 0], frame[c*4 + 1], 0.0f) * sid.world[i];
+			sv[c].uv       = vector2(u[c], v[c]);
+		}
 
-			float u1 = frame[ 6]; // u
-			float v1 = frame[ 7]; // v
+		sid.dirty[i] = false;
+		first_dirty = first_dirty == UINT32_MAX ? i : first_dirty;
+		last_dirty = i;
+	}
 
-			float u2 = frame[10]; // u
-			float v2 = frame[11]; // v
+	if (first_dirty != UINT32_MAX)
+	{
+		const u32 num = last_dirty - first_dirty + 1;
+		bgfx::updateDynamicVertexBuffer(_sprite_vbh
+			, first_dirty*4
+			, bgfx::copy(&_sprite_vertices[first_dirty*4], num*4*sizeof(SpriteVertex))
+			);
+	}
 
-			float u3 = frame[14]; // u
-			float v3 = frame[15]; // v
+	if (!_sprite_manager._order_changed && _sprite_manager._num_moved == 0)
+		return;
 
-			if (sid.flip_x[i])
-			{
-				float u;
-				u = u0; u0 = u1; u1 = u;
-				u = u2; u2 = u3; u3 = u;
-			}
+	const u32 num = sid.first_hidden;
 
-			if (sid.flip_y[i])
-			{
-				float v;
-				v = v0; v0 = v2; v2 = v;
-				v = v1; v1 = v3; v3 = v;
-			}
+	array::resize(_sprite_keys, num);
+	for (u32 i = 0; i < num; ++i)
+		_sprite_keys[i] = sprite_sort_key(sid.layer[i], sid.depth[i], sid.material[i]);
+
+	array::resize(_sprite_temp, num*2);
+	const u64* keys = array::begin(_sprite_keys);
+	u32* order = array::begin(_sprite_order);
+	u32* temp = array::begin(_sprite_temp);
+
+	if (_sprite_manager._order_changed || _sprite_manager._num_moved > num/4)
+	{
+		array::resize(_sprite_order, num);
+		order = array::begin(_sprite_order);
+		for (u32 i = 0; i < num; ++i)
+			order[i] = i;
+
+		radix_sort(order, temp, num, keys);
+	}
+	else
+	{
+		// Only a few sprites moved: take them out of the order, sort them
+		// and merge them back in.
+		u32* moved = temp + num;
+		u32 num_moved = 0;
+		for (u32 i = 0; i < num; ++i)
+		{
+			if (sid.moved[i])
+				moved[num_moved++] = i;
+		}
 
-			vdata[ 0] = frame[ 0]; // x
-			vdata[ 1] = frame[ 1]; // y
-			vdata[ 2] = u0;
-			vdata[ 3] = v0;
+		u32 num_kept = 0;
+		for (u32 i = 0; i < num; ++i)
+		{
+			if (!sid.moved[order[i]])
+				order[num_kept++] = order[i];
+		}
 
-			vdata[ 4] = frame[ 4]; // x
-			vdata[ 5] = frame[ 5]; // y
-			vdata[ 6] = u1;
-			vdata[ 7] = v1;
+		radix_sort(moved, temp, num_moved, keys);
 
-			vdata[ 8] = frame[ 8]; // x
-			vdata[ 9] = frame[ 9]; // y
-			vdata[10] = u2;
-			vdata[11] = v2;
+		u32 k = 0;
+		u32 m = 0;
+		u32* out = temp;
+		while (k < num_kept && m < num_moved)
+			*out++ = sprite_less(moved[m], order[k], keys) ? moved[m++] : order[k++];
+		while (k < num_kept)
+			*out++ = order[k++];
+		while (m < num_moved)
+			*out++ = moved[m++];
 
-			vdata[12] = frame[12]; // x
-			vdata[13] = frame[13]; // y
-			vdata[14] = u3;
-			vdata[15] = v3;
+		memcpy(order, temp, num*sizeof(u32));
+	}
 
-			vdata += 16;
+	memset(sid.moved, 0, sid.size*sizeof(bool));
+	_sprite_manager._num_moved = 0;
 
-			*idata++ = i*4+0;
-			*idata++ = i*4+1;
-			*idata++ = i*4+2;
-			*idata++ = i*4+0;
-			*idata++ = i*4+2;
-			*idata++ = i*4+3;
+	// Consecutive sprites sharing a material are drawn together
+	const bgfx::Memory* mem = bgfx::alloc(num*6*sizeof(u32));
+	u32* idata = (u32*)mem->data;
 
-			bgfx::setTransform(to_float_ptr(sid.world[i]));
-			bgfx::setVertexBuffer(0, &tvb);
-			bgfx::setIndexBuffer(&tib, i*6, 6);
+	array::clear(_sprite_batches);
+	for (u32 i = 0; i < num; ++i)
+	{
+		const u32 s = order[i];
 
-			_material_manager->get(sid.material[i])->bind(*_resource_manager, *_shader_manager);
+		if (i == 0 || sid.material[s] != sid.material[order[i - 1]])
+		{
+			SpriteBatch sb;
+			sb.material = sid.material[s];
+			sb.first_index = i*6;
+			sb.num_indices = 0;
+			array::push_back(_sprite_batches, sb);
 		}
+
+		*idata++ = s*4 + 0;
+		*idata++ = s*4 + 1;
+		*idata++ = s*4 + 2;
+		*idata++ = s*4 + 0;
+		*idata++ = s*4 + 2;
+		*idata++ = s*4 + 3;
+		array::back(_sprite_batches).num_indices += 6;
 	}
+
+	bgfx::updateDynamicIndexBuffer(_sprite_ibh, 0, mem);
+	_sprite_manager._order_changed = false;
 }
 
 void RenderWorld::debug_draw(DebugLine& dl)
@@ -528,6 +928,7 @@ void RenderWorld::MeshManager::allocate(u32 num)
 		+ num*sizeof(Matrix4x4) + alignof(Matrix4x4)
 		+ num*sizeof(OBB) + alignof(OBB)
 		+ num*sizeof(MeshInstance) + alignof(MeshInstance)
+		+ num*sizeof(u32) + alignof(u32)
 		;
 
 	MeshInstanceData new_data;
@@ -544,6 +945,7 @@ void RenderWorld::MeshManager::allocate(u32 num)
 	new_data.world         = (Matrix4x4*          )memory::align_top(new_data.material + num, alignof(Matrix4x4          ));
 	new_data.obb           = (OBB*                )memory::align_top(new_data.world + num,    alignof(OBB                ));
 	new_data.next_instance = (MeshInstance*       )memory::align_top(new_data.obb + num,      alignof(MeshInstance       ));
+	new_data.proxy         = (u32*                )memory::align_top(new_data.next_instance + num, alignof(u32                ));
 
 	memcpy(new_data.unit, _data.unit, _data.size * sizeof(UnitId));
 	memcpy(new_data.resource, _data.resource, _data.size * sizeof(MeshResource*));
@@ -553,6 +955,7 @@ void RenderWorld::MeshManager::allocate(u32 num)
 	memcpy(new_data.world, _data.world, _data.size * sizeof(Matrix4x4));
 	memcpy(new_data.obb, _data.obb, _data.size * sizeof(OBB));
 	memcpy(new_data.next_instance, _data.next_instance, _data.size * sizeof(MeshInstance));
+	memcpy(new_data.proxy, _data.proxy, _data.size * sizeof(u32));
 
 	_allocator->deallocate(_data.buffer);
 	_data = new_data;
@@ -579,6 +982,7 @@ MeshInstance RenderWorld::MeshManager::create(UnitId id, const MeshResource* mr,
 	_data.world[last]         = tr;
 	_data.obb[last]           = mg->obb;
 	_data.next_instance[last] = make_instance(UINT32_MAX);
+	_data.proxy[last]         = UINT32_MAX;
 
 	++_data.size;
 	++_data.first_hidden;
@@ -617,6 +1021,7 @@ void RenderWorld::MeshManager::destroy(MeshInstance i)
 	_data.world[i.i]         = _data.world[last];
 	_data.obb[i.i]           = _data.obb[last];
 	_data.next_instance[i.i] = _data.next_instance[last];
+	_data.proxy[i.i]         = _data.proxy[last];
 
 	--_data.size;
 	--_data.first_hidden;
@@ -727,7 +1132,12 @@ void RenderWorld::SpriteManager::allocate(u32 num)
 		+ num*sizeof(AABB) + alignof(AABB)
 		+ num*sizeof(bool) + alignof(bool)
 		+ num*sizeof(bool) + alignof(bool)
+		+ num*sizeof(u32) + alignof(u32)
+		+ num*sizeof(u32) + alignof(u32)
+		+ num*sizeof(bool) + alignof(bool)
+		+ num*sizeof(bool) + alignof(bool)
 		+ num*sizeof(SpriteInstance) + alignof(SpriteInstance)
+		+ num*sizeof(u32) + alignof(u32)
 		;
 
 	SpriteInstanceData new_data;
@@ -744,7 +1154,12 @@ void RenderWorld::SpriteManager::allocate(u32 num)
 	new_data.aabb          = (AABB*                 )memory::align_top(new_data.world + num,    alignof(AABB                 ));
 	new_data.flip_x        = (bool*                 )memory::align_top(new_data.aabb + num,     alignof(bool                 ));
 	new_data.flip_y        = (bool*                 )memory::align_top(new_data.flip_x + num,   alignof(bool                 ));
-	new_data.next_instance = (SpriteInstance*       )memory::align_top(new_data.flip_y + num,   alignof(SpriteInstance       ));
+	new_data.layer         = (u32*                  )memory::align_top(new_data.flip_y + num,   alignof(u32                  ));
+	new_data.depth         = (u32*                  )memory::align_top(new_data.layer + num,    alignof(u32                  ));
+	new_data.dirty         = (bool*                 )memory::align_top(new_data.depth + num,    alignof(bool                 ));
+	new_data.moved         = (bool*                 )memory::align_top(new_data.dirty + num,    alignof(bool                 ));
+	new_data.next_instance = (SpriteInstance*       )memory::align_top(new_data.moved + num,    alignof(SpriteInstance       ));
+	new_data.proxy         = (u32*                  )memory::align_top(new_data.next_instance + num, alignof(u32                  ));
 
 	memcpy(new_data.unit, _data.unit, _data.size * sizeof(UnitId));
 	memcpy(new_data.resource, _data.resource, _data.size * sizeof(SpriteResource**));
@@ -754,7 +1169,12 @@ void RenderWorld::SpriteManager::allocate(u32 num)
 	memcpy(new_data.aabb, _data.aabb, _data.size * sizeof(AABB));
 	memcpy(new_data.flip_x, _data.flip_x, _data.size * sizeof(bool));
 	memcpy(new_data.flip_y, _data.flip_y, _data.size * sizeof(bool));
+	memcpy(new_data.layer, _data.layer, _data.size * sizeof(u32));
+	memcpy(new_data.depth, _data.depth, _data.size * sizeof(u32));
+	memcpy(new_data.dirty, _data.dirty, _data.size * sizeof(bool));
+	memcpy(new_data.moved, _data.moved, _data.size * sizeof(bool));
 	memcpy(new_data.next_instance, _data.next_instance, _data.size * sizeof(SpriteInstance));
+	memcpy(new_data.proxy, _data.proxy, _data.size * sizeof(u32));
 
 	_allocator->deallocate(_data.buffer);
 	_data = new_data;
@@ -765,7 +1185,7 @@ void RenderWorld::SpriteManager::grow()
 	allocate(_data.capacity * 2 + 1);
 }
 
-SpriteInstance RenderWorld::SpriteManager::create(UnitId id, const SpriteResource* sr, StringId64 mat, const Matrix4x4& tr)
+SpriteInstance RenderWorld::SpriteManager::create(UnitId id, const SpriteResource* sr, const SpriteRendererDesc& srd, const Matrix4x4& tr)
 {
 	if (_data.size == _data.capacity)
 		grow();
@@ -774,16 +1194,22 @@ SpriteInstance RenderWorld::SpriteManager::create(UnitId id, const SpriteResourc
 
 	_data.unit[last]          = id;
 	_data.resource[last]      = sr;
-	_data.material[last]      = mat;
+	_data.material[last]      = srd.material_resource;
 	_data.frame[last]         = 0;
 	_data.world[last]         = tr;
 	_data.aabb[last]          = AABB();
 	_data.flip_x[last]        = false;
 	_data.flip_y[last]        = false;
+	_data.layer[last]         = srd.layer;
+	_data.depth[last]         = srd.depth;
+	_data.dirty[last]         = true;
+	_data.moved[last]         = false;
 	_data.next_instance[last] = make_instance(UINT32_MAX);
+	_data.proxy[last]         = UINT32_MAX;
 
 	++_data.size;
 	++_data.first_hidden;
+	_order_changed = true;
 
 	hash_map::set(_map, id, last);
 	return make_instance(last);
@@ -805,15 +1231,32 @@ void RenderWorld::SpriteManager::destroy(SpriteInstance i)
 	_data.aabb[i.i]          = _data.aabb[last];
 	_data.flip_x[i.i]        = _data.flip_x[last];
 	_data.flip_y[i.i]        = _data.flip_y[last];
+	_data.layer[i.i]         = _data.layer[last];
+	_data.depth[i.i]         = _data.depth[last];
+	_data.dirty[i.i]         = true;
+	_data.moved[i.i]         = _data.moved[last];
 	_data.next_instance[i.i] = _data.next_instance[last];
+	_data.proxy[i.i]         = _data.proxy[last];
 
 	--_data.size;
 	--_data.first_hidden;
+	_order_changed = true;
 
 	hash_map::set(_map, last_u, i.i);
 	hash_map::remove(_map, u);
 }
 
+void RenderWorld::SpriteManager::move(SpriteInstance i)
+{
+	CE_ASSERT(i.i < _data.size, "Index out of bounds");
+
+	if (_data.moved[i.i])
+		return;
+
+	_data.moved[i.i] = true;
+	++_num_moved;
+}
+
 bool RenderWorld::SpriteManager::has(UnitId id)
 {
 	return is_valid(sprite(id));
@@ -841,6 +1284,7 @@ void RenderWorld::LightManager::allocate(u32 num)
 		+ num*sizeof(f32) + alignof(f32)
 		+ num*sizeof(Color4) + alignof(Color4)
 		+ num*sizeof(u32) + alignof(u32)
+		+ num*sizeof(u32) + alignof(u32)
 		;
 
 	LightInstanceData new_data;
@@ -855,6 +1299,7 @@ void RenderWorld::LightManager::allocate(u32 num)
 	new_data.spot_angle = (f32*      )memory::align_top(new_data.intensity + num,  alignof(f32      ));
 	new_data.color      = (Color4*   )memory::align_top(new_data.spot_angle + num, alignof(Color4   ));
 	new_data.type       = (u32*      )memory::align_top(new_data.color + num,      alignof(u32      ));
+	new_data.proxy      = (u32*      )memory::align_top(new_data.type + num,       alignof(u32      ));
 
 	memcpy(new_data.unit, _data.unit, _data.size * sizeof(UnitId));
 	memcpy(new_data.world, _data.world, _data.size * sizeof(Matrix4x4));
@@ -863,6 +1308,7 @@ void RenderWorld::LightManager::allocate(u32 num)
 	memcpy(new_data.spot_angle, _data.spot_angle, _data.size * sizeof(f32));
 	memcpy(new_data.color, _data.color, _data.size * sizeof(Color4));
 	memcpy(new_data.type, _data.type, _data.size * sizeof(u32));
+	memcpy(new_data.proxy, _data.proxy, _data.size * sizeof(u32));
 
 	_allocator->deallocate(_data.buffer);
 	_data = new_data;
@@ -889,6 +1335,7 @@ LightInstance RenderWorld::LightManager::create(UnitId id, const LightDesc& ld,
 	_data.spot_angle[last] = ld.spot_angle;
 	_data.color[last]      = vector4(ld.color.x, ld.color.y, ld.color.z, 1.0f);
 	_data.type[last]       = ld.type;
+	_data.proxy[last]      = UINT32_MAX;
 
 	++_data.size;
 
@@ -911,6 +1358,7 @@ void RenderWorld::LightManager::destroy(LightInstance i)
 	_data.spot_angle[i.i] = _data.spot_angle[last];
 	_data.color[i.i]      = _data.color[last];
 	_data.type[i.i]       = _data.type[last];
+	_data.proxy[i.i]      = _data.proxy[last];
 
 	--_data.size;
 
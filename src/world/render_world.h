@@ -6,6 +6,7 @@
 #pragma once
 
 #include "core/containers/types.h"
+#include "core/math/aabb_tree.h"
 #include "core/math/types.h"
 #include "core/strings/string_id.h"
 #include "resource/mesh_resource.h"
@@ -72,6 +73,14 @@ struct RenderWorld
 	/// Sets whether to flip the sprite on the y-axis.
 	void sprite_flip_y(UnitId unit, bool flip);
 
+	/// Sets the rendering @a layer of the sprite.
+	/// Layers past CROWN_MAX_SPRITE_LAYERS - 1 are clamped.
+	void sprite_set_layer(UnitId unit, u32 layer);
+
+	/// Sets the rendering @a depth of the sprite.
+	/// Depths past CROWN_MAX_SPRITE_DEPTH are clamped.
+	void sprite_set_depth(UnitId unit, u32 depth);
+
 	/// Returns the OBB of the sprite.
 	OBB sprite_obb(UnitId unit);
 
@@ -121,6 +130,19 @@ struct RenderWorld
 	/// Fills @a dl with debug lines from the light.
 	void light_debug_draw(UnitId unit, DebugLine& dl);
 
+	/// Fills @a units and @a distances with the units whose meshes or sprites
+	/// are hit by the ray (from, dir) and the distances along the ray to the
+	/// intersection points, nearest first.
+	void raycast(const Vector3& from, const Vector3& dir, Array<UnitId>& units, Array<f32>& distances);
+
+	/// Fills @a units with the units whose meshes, sprites or lights intersect
+	/// the frustum @a f. Directional lights are never returned.
+	void query_frustum(const Frustum& f, Array<UnitId>& units);
+
+	/// Fills @a units with the units whose meshes, sprites or lights intersect
+	/// the sphere @a s. Directional lights are never returned.
+	void query_sphere(const Sphere& s, Array<UnitId>& units);
+
 	void update_transforms(const UnitId* begin, const UnitId* end, const Matrix4x4* world);
 
 	void render(const Matrix4x4& view, const Matrix4x4& projection);
@@ -133,12 +155,28 @@ struct RenderWorld
 
 	void unit_destroyed_callback(UnitId id);
 
+	/// Returns the bounds of the mesh @a i in world space.
+	AABB mesh_aabb(MeshInstance i);
+
+	/// Returns the bounds of the sprite @a i in world space.
+	AABB sprite_aabb(SpriteInstance i);
+
+	/// Inserts, moves or removes the bounds of the light @a i
+	/// in the tree after its type, range or transform changed.
+	void light_update_proxy(LightInstance i);
+
+	/// Updates the vertices of the sprites that changed since the last call
+	/// and the batches the visible sprites are drawn with.
+	void update_sprite_batches();
+
 	struct MeshManager
 	{
 		struct MeshData
 		{
 			bgfx::VertexBufferHandle vbh;
 			bgfx::IndexBufferHandle ibh;
+			u32 first_index; // Of the LOD selected by render()
+			u32 num_indices;
 		};
 
 		struct MeshInstanceData
@@ -157,6 +195,7 @@ struct RenderWorld
 			Matrix4x4* world;
 			OBB* obb;
 			MeshInstance* next_instance;
+			u32* proxy; // In RenderWorld::_tree
 		};
 
 		Allocator* _allocator;
@@ -204,21 +243,31 @@ struct RenderWorld
 			AABB* aabb;
 			bool* flip_x;
 			bool* flip_y;
+			u32* layer;
+			u32* depth;
+			bool* dirty; // Whether the vertices of the sprite need to be updated
+			bool* moved; // Whether the sprite changed its place in the draw order
 			SpriteInstance* next_instance;
+			u32* proxy; // In RenderWorld::_tree
 		};
 
 		Allocator* _allocator;
 		HashMap<UnitId, u32> _map;
 		SpriteInstanceData _data;
+		bool _order_changed; // Whether the draw order has to be sorted from scratch
+		u32 _num_moved;
 
 		SpriteManager(Allocator& a)
 			: _allocator(&a)
 			, _map(a)
+			, _order_changed(false)
+			, _num_moved(0)
 		{
 			memset(&_data, 0, sizeof(_data));
 		}
 
-		SpriteInstance create(UnitId id, const SpriteResource* sr, StringId64 material, const Matrix4x4& tr);
+		SpriteInstance create(UnitId id, const SpriteResource* sr, const SpriteRendererDesc& srd, const Matrix4x4& tr);
+		void move(SpriteInstance i);
 		void destroy(SpriteInstance i);
 		bool has(UnitId id);
 		SpriteInstance sprite(UnitId id);
@@ -244,6 +293,7 @@ struct RenderWorld
 			f32* spot_angle;
 			Color4* color;
 			u32* type; // LightType::Enum
+			u32* proxy; // In RenderWorld::_tree, UINT32_MAX for directional lights
 		};
 
 		Allocator* _allocator;
@@ -270,6 +320,19 @@ struct RenderWorld
 		LightInstance make_instance(u32 i) { LightInstance inst = { i }; return inst; }
 	};
 
+	struct SpriteVertex
+	{
+		Vector3 position; // In world space
+		Vector2 uv;
+	};
+
+	struct SpriteBatch
+	{
+		StringId64 material;
+		u32 first_index;
+		u32 num_indices;
+	};
+
 	u32 _marker;
 	Allocator* _allocator;
 	ResourceManager* _resource_manager;
@@ -282,6 +345,20 @@ struct RenderWorld
 	bgfx::UniformHandle _u_light_color;
 	bgfx::UniformHandle _u_light_range;
 	bgfx::UniformHandle _u_light_intensity;
+	bgfx::UniformHandle _u_mesh_dequantize;
+
+	// Vertices of every sprite, four per instance, kept on the GPU between frames
+	bgfx::DynamicVertexBufferHandle _sprite_vbh;
+	bgfx::DynamicIndexBufferHandle _sprite_ibh;
+	u32 _sprite_capacity;
+	Array<SpriteVertex> _sprite_vertices;
+	Array<u32> _sprite_order; // Visible sprites in the order they are drawn
+	Array<u64> _sprite_keys;
+	Array<u32> _sprite_temp;
+	Array<SpriteBatch> _sprite_batches;
+
+	// Bounds of meshes, sprites and lights, the user data of the proxies is the unit
+	AABBTree _tree;
 
 	bool _debug_drawing;
 	MeshManager _mesh_manager;
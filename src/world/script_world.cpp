@@ -5,11 +5,13 @@
 
 #include "core/containers/array.h"
 #include "core/containers/hash_map.h"
+#include "core/memory/temp_allocator.h"
 #include "lua/lua_environment.h"
 #include "lua/lua_stack.h"
 #include "resource/resource_manager.h"
 #include "world/script_world.h"
 #include "world/unit_manager.h"
+#include <algorithm>
 
 namespace crown
 {
@@ -21,6 +23,17 @@ namespace script_world_internal
 		return inst;
 	}
 
+	struct SpawnedUnit
+	{
+		u32 script_i;
+		UnitId unit;
+
+		bool operator<(const SpawnedUnit& other) const
+		{
+			return script_i < other.script_i;
+		}
+	};
+
 	static void unit_destroyed_callback(ScriptWorld& sw, UnitId unit, ScriptInstance i)
 	{
 		if (hash_map::has(sw._map, unit))
@@ -35,57 +48,76 @@ namespace script_world_internal
 
 namespace script_world
 {
-	ScriptInstance create(ScriptWorld& sw, UnitId unit, const ScriptDesc& desc)
+	void create(ScriptWorld& sw, const UnitId* units, const ScriptDesc* desc, u32 num)
 	{
-		CE_ASSERT(!hash_map::has(sw._map, unit), "Unit already has script component");
+		TempAllocator4096 ta;
+		Array<script_world_internal::SpawnedUnit> spawned(ta);
+		array::resize(spawned, num);
 
-		u32 script_i = hash_map::get(sw._cache
-			, desc.script_resource
-			, UINT32_MAX
-			);
+		for (u32 i = 0; i < num; ++i)
+		{
+			const UnitId unit = units[i];
+			CE_ASSERT(!hash_map::has(sw._map, unit), "Unit already has script component");
 
-		ScriptWorld::ScriptData sd;
-		sd.module_ref = LUA_REFNIL;
+			u32 script_i = hash_map::get(sw._cache
+				, desc[i].script_resource
+				, UINT32_MAX
+				);
 
-		if (script_i != UINT32_MAX)
-		{
-			sd = sw._script[script_i];
-		}
-		else
-		{
-			script_i = array::size(sw._script);
+			if (script_i == UINT32_MAX)
+			{
+				script_i = array::size(sw._script);
+
+				// Scripts are loaded by the package containing the unit
+				const LuaResource* lr = (LuaResource*)sw._resource_manager->get(RESOURCE_TYPE_SCRIPT, desc[i].script_resource);
+
+				LuaStack stack = sw._lua_environment->execute(lr);
+				stack.push_value(0);
+
+				ScriptWorld::ScriptData sd;
+				sd.module_ref = luaL_ref(stack.L, LUA_REGISTRYINDEX);
+
+				array::push_back(sw._script, sd);
+				hash_map::set(sw._cache, desc[i].script_resource, script_i);
+			}
 
-			sw._resource_manager->load(RESOURCE_TYPE_SCRIPT, desc.script_resource);
-			sw._resource_manager->flush();
-			const LuaResource* lr = (LuaResource*)sw._resource_manager->get(RESOURCE_TYPE_SCRIPT, desc.script_resource);
+			ScriptWorld::InstanceData data;
+			data.unit     = unit;
+			data.script_i = script_i;
 
-			LuaStack stack = sw._lua_environment->execute(lr);
-			stack.push_value(0);
-			sd.module_ref = luaL_ref(stack.L, LUA_REGISTRYINDEX);
+			const u32 instance_i = array::size(sw._data);
+			array::push_back(sw._data, data);
+			hash_map::set(sw._map, unit, instance_i);
 
-			array::push_back(sw._script, sd);
-			hash_map::set(sw._cache, desc.script_resource, script_i);
+			spawned[i].script_i = script_i;
+			spawned[i].unit     = unit;
 		}
 
-		ScriptWorld::InstanceData data;
-		data.unit     = unit;
-		data.script_i = script_i;
+		// Call spawned() once per script with all its units, in spawn order
+		std::stable_sort(array::begin(spawned), array::end(spawned));
 
-		u32 instance_i = array::size(sw._data);
-		array::push_back(sw._data, data);
-		hash_map::set(sw._map, unit, instance_i);
+		for (u32 i = 0; i < num;)
+		{
+			const u32 script_i = spawned[i].script_i;
 
-		LuaStack stack(sw._lua_environment->L);
-		lua_rawgeti(stack.L, LUA_REGISTRYINDEX, sd.module_ref);
-		lua_getfield(stack.L, -1, "spawned");
-		stack.push_world(sw._world);
-		stack.push_table(1);
-		stack.push_key_begin(1);
-		stack.push_unit(unit);
-		stack.push_key_end();
-		stack.call(0);
+			u32 end = i + 1;
+			while (end < num && spawned[end].script_i == script_i)
+				++end;
+
+			LuaStack stack(sw._lua_environment->L);
+			lua_rawgeti(stack.L, LUA_REGISTRYINDEX, sw._script[script_i].module_ref);
+			lua_getfield(stack.L, -1, "spawned");
+			stack.push_world(sw._world);
+			stack.push_table(end - i);
+			for (u32 k = i; k < end; ++k)
+			{
+				stack.push_unit(spawned[k].unit);
+				lua_rawseti(stack.L, -2, k - i + 1);
+			}
+			stack.call(0);
 
-		return script_world_internal::make_instance(instance_i);
+			i = end;
+		}
 	}
 
 	void destroy(ScriptWorld& sw, UnitId unit, ScriptInstance /*i*/)
@@ -43,8 +43,11 @@ struct ScriptWorld
 
 namespace script_world
 {
-	/// Creates a new component for the @a unit and returns its id.
-	ScriptInstance create(ScriptWorld& sw, UnitId unit, const ScriptDesc& desc);
+	/// Creates new components for the @a num @a units from the descriptions @a desc.
+	/// The spawned() function of each script is called once with all the units
+	/// using that script.
+	/// Script resources must be loaded already, usually by the unit's package.
+	void create(ScriptWorld& sw, const UnitId* units, const ScriptDesc* desc, u32 num);
 
 	/// Destroys the component for the @a unit.
 	void destroy(ScriptWorld& sw, UnitId unit, ScriptInstance i);
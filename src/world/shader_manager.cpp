@@ -109,13 +109,18 @@ void ShaderManager::add_shader(StringId32 name, u64 state, bgfx::ProgramHandle p
 	hash_map::set(_shader_map, name, sd);
 }
 
-void ShaderManager::submit(StringId32 shader_id, u8 view_id)
+ShaderManager::ShaderData ShaderManager::get(StringId32 shader_id)
 {
 	CE_ASSERT(hash_map::has(_shader_map, shader_id), "Shader not found");
 	ShaderData sd;
 	sd.state = BGFX_STATE_DEFAULT;
 	sd.program = BGFX_INVALID_HANDLE;
-	sd = hash_map::get(_shader_map, shader_id, sd);
+	return hash_map::get(_shader_map, shader_id, sd);
+}
+
+void ShaderManager::submit(StringId32 shader_id, u8 view_id)
+{
+	const ShaderData sd = get(shader_id);
 
 	bgfx::setState(sd.state);
 	bgfx::submit(view_id, sd.program);
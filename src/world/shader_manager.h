@@ -45,6 +45,9 @@ struct ShaderManager
 	///
 	void unload(Allocator& a, void* res);
 
+	/// Returns the program and the render state of the shader @a shader_id.
+	ShaderData get(StringId32 shader_id);
+
 	///
 	void submit(StringId32 shader_id, u8 view_id);
 };
@@ -65,8 +65,9 @@ struct SoundWorld
 	/// Sets the @a pose of the listener in world space.
 	void set_listener_pose(const Matrix4x4& pose);
 
-	///
-	void update();
+	/// Advances the sounds by @a dt seconds and assigns voices to the
+	/// audible ones.
+	void update(f32 dt);
 };
 
 } // namespace crown
@@ -8,15 +8,24 @@
 #if CROWN_SOUND_OPENAL
 
 #include "core/containers/array.h"
+#include "core/containers/queue.h"
+#include "core/math/math.h"
 #include "core/math/matrix4x4.h"
 #include "core/math/vector3.h"
+#include "core/memory/memory.h"
 #include "core/memory/temp_allocator.h"
+#include "core/os.h"
+#include "core/thread/mutex.h"
+#include "core/thread/thread.h"
 #include "device/log.h"
 #include "resource/sound_resource.h"
 #include "world/audio.h"
 #include "world/sound_world.h"
 #include <AL/al.h>
 #include <AL/alc.h>
+#include <algorithm>
+#define STB_VORBIS_HEADER_ONLY
+#include <stb_vorbis.c>
 
 namespace { const crown::log_internal::System SOUND = { "Sound" }; }
 
@@ -82,60 +91,251 @@ namespace audio_globals
 
 } // namespace audio_globals
 
-struct SoundInstance
+#define STREAM_NUM_BUFFERS    4
+#define STREAM_BUFFER_SAMPLES 8192
+#define STREAM_UPDATE_MS      10
+
+#define MAX_VOICES            64
+#define AUDIBILITY_THRESHOLD  0.001f
+#define REFERENCE_DISTANCE    0.01f
+
+static ALenum al_format(const SoundResource& sr)
+{
+	switch (sr.bits_ps)
+	{
+	case  8: return sr.channels > 1 ? AL_FORMAT_STEREO8  : AL_FORMAT_MONO8;
+	case 16: return sr.channels > 1 ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16;
+	default: CE_FATAL("Number of bits per sample not supported."); return AL_INVALID_ENUM;
+	}
+}
+
+/// Decodes an OGG sound into a small ring of AL buffers queued on a source.
+/// All the members are owned by the stream thread once the stream has been
+/// added to SoundWorldImpl::_streams and must be accessed under its mutex.
+struct SoundStream
 {
 	const SoundResource* _resource;
-	SoundInstanceId _id;
+	stb_vorbis* _decoder;
+	ALuint _source;
+	ALuint _buffers[STREAM_NUM_BUFFERS];
+	u32 _buffer_samples[STREAM_NUM_BUFFERS];
+	u32 _cursor; // Samples played by the buffers already unqueued
+	ALenum _format;
+	bool _loop;
+	bool _eof;
+	bool _stopped;
+	s16 _pcm[STREAM_BUFFER_SAMPLES];
+
+	void create(const SoundResource& sr, ALuint source)
+	{
+		using namespace sound_resource;
+
+		int err = VORBIS__no_error;
+		_decoder = stb_vorbis_open_memory((const unsigned char*)data(&sr), sr.size, &err, NULL);
+		CE_ASSERT(_decoder != NULL, "stb_vorbis_open_memory: error %d", err);
+
+		AL_CHECK(alGenBuffers(STREAM_NUM_BUFFERS, _buffers));
+
+		_resource = &sr;
+		_source   = source;
+		_cursor   = 0;
+		_format   = al_format(sr);
+		_loop     = false;
+		_eof      = false;
+		_stopped  = false;
+	}
+
+	void destroy()
+	{
+		AL_CHECK(alDeleteBuffers(STREAM_NUM_BUFFERS, _buffers));
+		stb_vorbis_close(_decoder);
+	}
+
+	/// Decodes the next chunk of samples into @a buffer.
+	/// Returns false if there is nothing left to decode.
+	bool fill(ALuint buffer)
+	{
+		const u32 channels = _resource->channels;
+		int num = stb_vorbis_get_samples_short_interleaved(_decoder, channels, _pcm, STREAM_BUFFER_SAMPLES);
+
+		if (num == 0 && _loop)
+		{
+			stb_vorbis_seek_start(_decoder);
+			num = stb_vorbis_get_samples_short_interleaved(_decoder, channels, _pcm, STREAM_BUFFER_SAMPLES);
+		}
+
+		if (num == 0)
+		{
+			_eof = true;
+			return false;
+		}
+
+		AL_CHECK(alBufferData(buffer, _format, _pcm, num * channels * sizeof(s16), _resource->sample_rate));
+		_buffer_samples[buffer_index(buffer)] = num;
+		return true;
+	}
+
+	u32 buffer_index(ALuint buffer)
+	{
+		u32 i = 0;
+		for (; i < STREAM_NUM_BUFFERS - 1 && _buffers[i] != buffer; ++i) {}
+		return i;
+	}
+
+	/// Starts decoding at @a cursor samples from the beginning of the sound.
+	void start(bool loop, u32 cursor)
+	{
+		_loop   = loop;
+		_cursor = cursor;
+
+		if (cursor > 0)
+			stb_vorbis_seek(_decoder, cursor);
+
+		u32 num = 0;
+		while (num < STREAM_NUM_BUFFERS && fill(_buffers[num]))
+			++num;
+
+		AL_CHECK(alSourcei(_source, AL_LOOPING, AL_FALSE));
+		AL_CHECK(alSourceQueueBuffers(_source, num, _buffers));
+	}
+
+	void stop()
+	{
+		_stopped = true;
+		AL_CHECK(alSourceStop(_source));
+
+		ALint processed;
+		AL_CHECK(alGetSourcei(_source, AL_BUFFERS_PROCESSED, &processed));
+
+		ALuint removed[STREAM_NUM_BUFFERS];
+		AL_CHECK(alSourceUnqueueBuffers(_source, processed, removed));
+	}
+
+	void update()
+	{
+		if (_stopped)
+			return;
+
+		ALint processed;
+		AL_CHECK(alGetSourcei(_source, AL_BUFFERS_PROCESSED, &processed));
+
+		for (; processed > 0; --processed)
+		{
+			ALuint buffer;
+			AL_CHECK(alSourceUnqueueBuffers(_source, 1, &buffer));
+
+			_cursor += _buffer_samples[buffer_index(buffer)];
+			if (_resource->num_samples > 0)
+				_cursor %= _resource->num_samples;
+
+			if (fill(buffer))
+			{
+				AL_CHECK(alSourceQueueBuffers(_source, 1, &buffer));
+			}
+		}
+
+		// Restart the source if the decoder could not keep up with it
+		ALint state;
+		AL_CHECK(alGetSourcei(_source, AL_SOURCE_STATE, &state));
+		ALint queued;
+		AL_CHECK(alGetSourcei(_source, AL_BUFFERS_QUEUED, &queued));
+
+		if (state == AL_STOPPED && queued > 0)
+		{
+			AL_CHECK(alSourcePlay(_source));
+		}
+	}
+
+	/// Returns the playback position in samples.
+	u32 cursor()
+	{
+		ALint offset;
+		AL_CHECK(alGetSourcei(_source, AL_SAMPLE_OFFSET, &offset));
+		return _resource->num_samples > 0
+			? (_cursor + offset) % _resource->num_samples
+			: 0
+			;
+	}
+
+	bool finished()
+	{
+		return _eof || _stopped;
+	}
+};
+
+/// The part of a sound instance that is actually mixed by OpenAL.
+/// Sound instances only own a voice while they are audible.
+struct SoundVoice
+{
 	ALuint _buffer;
 	ALuint _source;
+	SoundStream* _stream;
 
-	void create(const SoundResource& sr, const Vector3& pos, f32 range)
+	void create(Allocator& a, const SoundResource& sr, const Vector3& pos, f32 range)
 	{
 		using namespace sound_resource;
 
 		AL_CHECK(alGenSources(1, &_source));
 		CE_ASSERT(alIsSource(_source), "alGenSources: error");
 
-		AL_CHECK(alSourcef(_source, AL_REFERENCE_DISTANCE, 0.01f));
+		AL_CHECK(alSourcef(_source, AL_REFERENCE_DISTANCE, REFERENCE_DISTANCE));
 		AL_CHECK(alSourcef(_source, AL_MAX_DISTANCE, range));
 		AL_CHECK(alSourcef(_source, AL_PITCH, 1.0f));
 
-		// Generates AL buffers
-		AL_CHECK(alGenBuffers(1, &_buffer));
-		CE_ASSERT(alIsBuffer(_buffer), "alGenBuffers: error");
+		_buffer = 0;
+		_stream = NULL;
 
-		ALenum fmt = AL_INVALID_ENUM;
-		switch (sr.bits_ps)
+		if (sr.sound_type == SoundType::OGG)
 		{
-		case  8: fmt = sr.channels > 1 ? AL_FORMAT_STEREO8  : AL_FORMAT_MONO8; break;
-		case 16: fmt = sr.channels > 1 ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16; break;
-		default: CE_FATAL("Number of bits per sample not supported."); break;
+			_stream = CE_NEW(a, SoundStream)();
+			_stream->create(sr, _source);
+		}
+		else
+		{
+			// Generates AL buffers
+			AL_CHECK(alGenBuffers(1, &_buffer));
+			CE_ASSERT(alIsBuffer(_buffer), "alGenBuffers: error");
+
+			AL_CHECK(alBufferData(_buffer, al_format(sr), data(&sr), sr.size, sr.sample_rate));
 		}
-		AL_CHECK(alBufferData(_buffer, fmt, data(&sr), sr.size, sr.sample_rate));
 
-		_resource = &sr;
 		set_position(pos);
 	}
 
-	void destroy()
+	void destroy(Allocator& a)
 	{
 		stop();
 		AL_CHECK(alSourcei(_source, AL_BUFFER, 0));
-		AL_CHECK(alDeleteBuffers(1, &_buffer));
-		AL_CHECK(alDeleteSources(1, &_source));
-	}
 
-	void reload(const SoundResource& new_sr)
-	{
-		destroy();
-		create(new_sr, position(), range());
+		if (_stream)
+		{
+			_stream->destroy();
+			CE_DELETE(a, _stream);
+			_stream = NULL;
+		}
+		else
+		{
+			AL_CHECK(alDeleteBuffers(1, &_buffer));
+		}
+
+		AL_CHECK(alDeleteSources(1, &_source));
 	}
 
-	void play(bool loop, f32 volume)
+	void play(bool loop, f32 volume, u32 cursor)
 	{
 		set_volume(volume);
-		AL_CHECK(alSourcei(_source, AL_LOOPING, (loop ? AL_TRUE : AL_FALSE)));
-		AL_CHECK(alSourceQueueBuffers(_source, 1, &_buffer));
+
+		if (_stream)
+		{
+			_stream->start(loop, cursor);
+		}
+		else
+		{
+			AL_CHECK(alSourcei(_source, AL_LOOPING, (loop ? AL_TRUE : AL_FALSE)));
+			AL_CHECK(alSourceQueueBuffers(_source, 1, &_buffer));
+			AL_CHECK(alSourcei(_source, AL_SAMPLE_OFFSET, cursor));
+		}
+
 		AL_CHECK(alSourcePlay(_source));
 	}
 
@@ -151,6 +351,12 @@ struct SoundInstance
 
 	void stop()
 	{
+		if (_stream)
+		{
+			_stream->stop();
+			return;
+		}
+
 		AL_CHECK(alSourceStop(_source));
 		AL_CHECK(alSourceRewind(_source)); // Workaround
 		ALint processed;
@@ -163,32 +369,27 @@ struct SoundInstance
 		}
 	}
 
-	bool is_playing()
-	{
-		ALint state;
-		AL_CHECK(alGetSourcei(_source, AL_SOURCE_STATE, &state));
-		return state == AL_PLAYING;
-	}
-
 	bool finished()
 	{
 		ALint state;
 		AL_CHECK(alGetSourcei(_source, AL_SOURCE_STATE, &state));
+
+		// A stopped stream may just be waiting for the decoder to catch up
+		if (_stream && !_stream->finished())
+			return false;
+
 		return (state != AL_PLAYING && state != AL_PAUSED);
 	}
 
-	Vector3 position()
+	/// Returns the playback position in samples.
+	u32 cursor()
 	{
-		ALfloat pos[3];
-		AL_CHECK(alGetSourcefv(_source, AL_POSITION, pos));
-		return vector3(pos[0], pos[1], pos[2]);
-	}
+		if (_stream)
+			return _stream->cursor();
 
-	float range()
-	{
-		ALfloat range;
-		AL_CHECK(alGetSourcefv(_source, AL_MAX_DISTANCE, &range));
-		return range;
+		ALint offset;
+		AL_CHECK(alGetSourcei(_source, AL_SAMPLE_OFFSET, &offset));
+		return offset;
 	}
 
 	void set_position(const Vector3& pos)
@@ -207,30 +408,64 @@ struct SoundInstance
 	}
 };
 
-#define MAX_OBJECTS       1024
-#define INDEX_MASK        0xffff
-#define NEW_OBJECT_ID_ADD 0x10000
+/// A playing sound. While not audible the instance is virtual: it has no
+/// voice and only advances its playback cursor.
+struct SoundInstance
+{
+	const SoundResource* _resource;
+	SoundInstanceId _id;
+	SoundVoice* _voice;
+	Vector3 _position;
+	f32 _range;
+	f32 _volume;
+	f32 _cursor; // Playback position in samples, valid while virtual
+	f32 _gain;   // Estimated gain at the listener position
+	bool _loop;
+	bool _paused;
+};
+
+#define INDEX_MASK           0xffff
+#define NEW_OBJECT_ID_ADD    0x10000
+#define MIN_FREE_INDICES     1024
 
 struct SoundWorldImpl
 {
 	struct Index
 	{
 		SoundInstanceId id;
-		u16 index;
-		u16 next;
+		u32 index;
 	};
 
-	u32 _num_objects;
-	SoundInstance _playing_sounds[MAX_OBJECTS];
-	Index _indices[MAX_OBJECTS];
-	u16 _freelist_enqueue;
-	u16 _freelist_dequeue;
+	struct VoiceCandidate
+	{
+		f32 gain;
+		u32 index;
+
+		bool operator<(const VoiceCandidate& vc) const
+		{
+			return gain > vc.gain;
+		}
+	};
+
+	Allocator* _allocator;
+	Array<SoundInstance> _playing_sounds;
+	Array<Index> _indices;
+	Queue<u32> _free_indices;
+	Array<VoiceCandidate> _candidates;
+	u32 _num_voices;
 	Matrix4x4 _listener_pose;
+	Array<SoundStream*> _streams;
+	Mutex _mutex;
+	Thread _thread;
+	bool _exit;
 
 	bool has(SoundInstanceId id)
 	{
-		Index& in = _indices[id & INDEX_MASK];
-		return in.id == id && in.index != UINT16_MAX;
+		const u32 i = id & INDEX_MASK;
+		return i < array::size(_indices)
+			&& _indices[i].id == id
+			&& _indices[i].index != UINT32_MAX
+			;
 	}
 
 	SoundInstance& lookup(SoundInstanceId id)
@@ -240,118 +475,287 @@ struct SoundWorldImpl
 
 	SoundInstanceId add()
 	{
-		Index& in = _indices[_freelist_dequeue];
-		_freelist_dequeue = in.next;
+		// Delay the reuse of indices to make stale ids less likely to alias new sounds
+		u32 i;
+		if (queue::size(_free_indices) > MIN_FREE_INDICES)
+		{
+			i = queue::front(_free_indices);
+			queue::pop_front(_free_indices);
+		}
+		else
+		{
+			i = array::size(_indices);
+			CE_ASSERT(i <= INDEX_MASK, "Too many sound instances");
+			Index in;
+			in.id = i;
+			in.index = UINT32_MAX;
+			array::push_back(_indices, in);
+		}
+
+		Index& in = _indices[i];
 		in.id += NEW_OBJECT_ID_ADD;
-		in.index = _num_objects++;
-		SoundInstance& o = _playing_sounds[in.index];
-		o._id = in.id;
-		return o._id;
+		in.index = array::size(_playing_sounds);
+
+		SoundInstance si;
+		memset(&si, 0, sizeof(si));
+		si._id = in.id;
+		array::push_back(_playing_sounds, si);
+		return in.id;
 	}
 
 	void remove(SoundInstanceId id)
 	{
 		Index& in = _indices[id & INDEX_MASK];
 
-		SoundInstance& o = _playing_sounds[in.index];
-		o = _playing_sounds[--_num_objects];
-		_indices[o._id & INDEX_MASK].index = in.index;
+		const SoundInstance& last = array::back(_playing_sounds);
+		_playing_sounds[in.index] = last;
+		_indices[last._id & INDEX_MASK].index = in.index;
+		array::pop_back(_playing_sounds);
 
-		in.index = UINT16_MAX;
-		_indices[_freelist_enqueue].next = id & INDEX_MASK;
-		_freelist_enqueue = id & INDEX_MASK;
+		in.index = UINT32_MAX;
+		queue::push_back(_free_indices, id & INDEX_MASK);
 	}
 
-	SoundWorldImpl()
+	SoundWorldImpl(Allocator& a)
+		: _allocator(&a)
+		, _playing_sounds(a)
+		, _indices(a)
+		, _free_indices(a)
+		, _candidates(a)
+		, _num_voices(0)
+		, _streams(a)
+		, _exit(false)
 	{
-		_num_objects = 0;
-		for (u32 i = 0; i < MAX_OBJECTS; ++i)
+		set_listener_pose(MATRIX4X4_IDENTITY);
+
+		_thread.start(SoundWorldImpl::stream_thread_proc, this);
+	}
+
+	~SoundWorldImpl()
+	{
+		_exit = true;
+		_thread.stop();
+
+		for (u32 i = 0; i < array::size(_playing_sounds); ++i)
 		{
-			_indices[i].id = i;
-			_indices[i].next = i + 1;
+			release_voice(_playing_sounds[i]);
 		}
-		_freelist_dequeue = 0;
-		_freelist_enqueue = MAX_OBJECTS - 1;
+	}
 
-		set_listener_pose(MATRIX4X4_IDENTITY);
+	static s32 stream_thread_proc(void* thiz)
+	{
+		return ((SoundWorldImpl*)thiz)->stream_run();
+	}
+
+	s32 stream_run()
+	{
+		while (!_exit)
+		{
+			_mutex.lock();
+			for (u32 i = 0; i < array::size(_streams); ++i)
+			{
+				_streams[i]->update();
+			}
+			_mutex.unlock();
+
+			os::sleep(STREAM_UPDATE_MS);
+		}
+
+		return 0;
+	}
+
+	void remove_stream(SoundStream* ss)
+	{
+		const u32 num = array::size(_streams);
+		for (u32 i = 0; i < num; ++i)
+		{
+			if (_streams[i] == ss)
+			{
+				_streams[i] = _streams[num - 1];
+				array::pop_back(_streams);
+				return;
+			}
+		}
+	}
+
+	/// Gives @a si a voice and starts playing it from its cursor.
+	void make_real(SoundInstance& si)
+	{
+		SoundVoice* sv = CE_NEW(*_allocator, SoundVoice)();
+		sv->create(*_allocator, *si._resource, si._position, si._range);
+		sv->play(si._loop, si._volume, u32(si._cursor));
+
+		if (si._paused)
+			sv->pause();
+
+		if (sv->_stream)
+			array::push_back(_streams, sv->_stream);
+
+		si._voice = sv;
+		++_num_voices;
+	}
+
+	/// Releases the voice of @a si and keeps only its cursor.
+	void make_virtual(SoundInstance& si)
+	{
+		si._cursor = f32(si._voice->cursor());
+		release_voice(si);
+	}
+
+	void release_voice(SoundInstance& si)
+	{
+		if (!si._voice)
+			return;
+
+		if (si._voice->_stream)
+			remove_stream(si._voice->_stream);
+
+		si._voice->destroy(*_allocator);
+		CE_DELETE(*_allocator, si._voice);
+		si._voice = NULL;
+		--_num_voices;
+	}
+
+	/// Returns the gain of @a si at the listener position, mirroring
+	/// the AL_LINEAR_DISTANCE_CLAMPED model set in audio_globals::init().
+	f32 gain(const SoundInstance& si)
+	{
+		if (si._range <= REFERENCE_DISTANCE)
+			return 0.0f;
+
+		const f32 dist = length(si._position - translation(_listener_pose));
+		const f32 d = fclamp(REFERENCE_DISTANCE, si._range, dist);
+		return si._volume * (1.0f - (d - REFERENCE_DISTANCE) / (si._range - REFERENCE_DISTANCE));
 	}
 
 	SoundInstanceId play(const SoundResource& sr, bool loop, f32 volume, f32 range, const Vector3& pos)
 	{
+		ScopedMutex sm(_mutex);
+
 		SoundInstanceId id = add();
 		SoundInstance& si = lookup(id);
-		si.create(sr, pos, range);
-		si.play(loop, volume);
+		si._resource = &sr;
+		si._position = pos;
+		si._range    = range;
+		si._volume   = volume;
+		si._loop     = loop;
+		si._gain     = gain(si);
+
+		if (si._gain >= AUDIBILITY_THRESHOLD && _num_voices < MAX_VOICES)
+			make_real(si);
+
 		return id;
 	}
 
 	void stop(SoundInstanceId id)
 	{
-		SoundInstance& si = lookup(id);
-		si.destroy();
+		ScopedMutex sm(_mutex);
+		destroy(id);
+	}
+
+	void destroy(SoundInstanceId id)
+	{
+		release_voice(lookup(id));
 		remove(id);
 	}
 
 	bool is_playing(SoundInstanceId id)
 	{
-		return has(id) && lookup(id).is_playing();
+		ScopedMutex sm(_mutex);
+		return has(id) && !lookup(id)._paused;
 	}
 
 	void stop_all()
 	{
-		for (u32 i = 0; i < _num_objects; ++i)
+		ScopedMutex sm(_mutex);
+
+		while (array::size(_playing_sounds) > 0)
 		{
-			_playing_sounds[i].stop();
+			destroy(array::back(_playing_sounds)._id);
 		}
 	}
 
 	void pause_all()
 	{
-		for (u32 i = 0; i < _num_objects; ++i)
+		ScopedMutex sm(_mutex);
+
+		for (u32 i = 0; i < array::size(_playing_sounds); ++i)
 		{
-			_playing_sounds[i].pause();
+			SoundInstance& si = _playing_sounds[i];
+			si._paused = true;
+			if (si._voice)
+				si._voice->pause();
 		}
 	}
 
 	void resume_all()
 	{
-		for (u32 i = 0; i < _num_objects; ++i)
+		ScopedMutex sm(_mutex);
+
+		for (u32 i = 0; i < array::size(_playing_sounds); ++i)
 		{
-			_playing_sounds[i].resume();
+			SoundInstance& si = _playing_sounds[i];
+			si._paused = false;
+			if (si._voice)
+				si._voice->resume();
 		}
 	}
 
 	void set_sound_positions(u32 num, const SoundInstanceId* ids, const Vector3* positions)
 	{
+		ScopedMutex sm(_mutex);
+
 		for (u32 i = 0; i < num; ++i)
 		{
-			lookup(ids[i]).set_position(positions[i]);
+			SoundInstance& si = lookup(ids[i]);
+			si._position = positions[i];
+			if (si._voice)
+				si._voice->set_position(positions[i]);
 		}
 	}
 
 	void set_sound_ranges(u32 num, const SoundInstanceId* ids, const f32* ranges)
 	{
+		ScopedMutex sm(_mutex);
+
 		for (u32 i = 0; i < num; ++i)
 		{
-			lookup(ids[i]).set_range(ranges[i]);
+			SoundInstance& si = lookup(ids[i]);
+			si._range = ranges[i];
+			if (si._voice)
+				si._voice->set_range(ranges[i]);
 		}
 	}
 
 	void set_sound_volumes(u32 num, const SoundInstanceId* ids, const f32* volumes)
 	{
+		ScopedMutex sm(_mutex);
+
 		for (u32 i = 0; i < num; i++)
 		{
-			lookup(ids[i]).set_volume(volumes[i]);
+			SoundInstance& si = lookup(ids[i]);
+			si._volume = volumes[i];
+			if (si._voice)
+				si._voice->set_volume(volumes[i]);
 		}
 	}
 
 	void reload_sounds(const SoundResource& old_sr, const SoundResource& new_sr)
 	{
-		for (u32 i = 0; i < _num_objects; ++i)
+		ScopedMutex sm(_mutex);
+
+		for (u32 i = 0; i < array::size(_playing_sounds); ++i)
 		{
-			if (_playing_sounds[i]._resource == &old_sr)
+			SoundInstance& si = _playing_sounds[i];
+			if (si._resource == &old_sr)
 			{
-				_playing_sounds[i].reload(new_sr);
+				const bool real = si._voice != NULL;
+				release_voice(si);
+				si._resource = &new_sr;
+				si._cursor = 0.0f;
+
+				if (real)
+					make_real(si);
 			}
 		}
 	}
@@ -370,25 +774,84 @@ struct SoundWorldImpl
 		_listener_pose = pose;
 	}
 
-	void update()
+	void update(f32 dt)
 	{
+		ScopedMutex sm(_mutex);
+
 		TempAllocator256 alloc;
 		Array<SoundInstanceId> to_delete(alloc);
 
-		// Check what sounds finished playing
-		for (u32 i = 0; i < _num_objects; ++i)
+		for (u32 i = 0; i < array::size(_playing_sounds); ++i)
 		{
-			SoundInstance& instance = _playing_sounds[i];
-			if (instance.finished())
+			SoundInstance& si = _playing_sounds[i];
+
+			if (si._voice)
+			{
+				// Check what sounds finished playing
+				if (si._voice->finished())
+					array::push_back(to_delete, si._id);
+			}
+			else if (!si._paused)
 			{
-				array::push_back(to_delete, instance._id);
+				// Advance virtual sounds as if they were playing
+				const u32 num_samples = si._resource->num_samples;
+				si._cursor += dt * si._resource->sample_rate;
+
+				if (si._cursor >= f32(num_samples))
+				{
+					if (si._loop && num_samples > 0)
+						si._cursor = fmodf(si._cursor, f32(num_samples));
+					else
+						array::push_back(to_delete, si._id);
+				}
 			}
 		}
 
 		// Destroy instances which finished playing
 		for (u32 i = 0; i < array::size(to_delete); ++i)
 		{
-			stop(to_delete[i]);
+			destroy(to_delete[i]);
+		}
+
+		// Only the loudest audible sounds get a voice
+		array::clear(_candidates);
+		for (u32 i = 0; i < array::size(_playing_sounds); ++i)
+		{
+			SoundInstance& si = _playing_sounds[i];
+			si._gain = gain(si);
+
+			if (si._gain >= AUDIBILITY_THRESHOLD && !si._paused)
+			{
+				VoiceCandidate vc;
+				vc.gain = si._gain;
+				vc.index = i;
+				array::push_back(_candidates, vc);
+			}
+		}
+
+		const u32 num_candidates = array::size(_candidates);
+		u32 num_real = num_candidates;
+		f32 min_gain = AUDIBILITY_THRESHOLD;
+
+		if (num_candidates > MAX_VOICES)
+		{
+			std::sort(array::begin(_candidates), array::end(_candidates));
+			num_real = MAX_VOICES;
+			min_gain = _candidates[MAX_VOICES - 1].gain;
+		}
+
+		for (u32 i = 0; i < array::size(_playing_sounds); ++i)
+		{
+			SoundInstance& si = _playing_sounds[i];
+			if (si._voice && !si._paused && si._gain < min_gain)
+				make_virtual(si);
+		}
+
+		for (u32 i = 0; i < num_real && _num_voices < MAX_VOICES; ++i)
+		{
+			SoundInstance& si = _playing_sounds[_candidates[i].index];
+			if (!si._voice)
+				make_real(si);
 		}
 	}
 };
@@ -398,7 +861,7 @@ SoundWorld::SoundWorld(Allocator& a)
 	, _allocator(&a)
 	, _impl(NULL)
 {
-	_impl = CE_NEW(*_allocator, SoundWorldImpl)();
+	_impl = CE_NEW(*_allocator, SoundWorldImpl)(*_allocator);
 }
 
 SoundWorld::~SoundWorld()
@@ -462,9 +925,9 @@ void SoundWorld::set_listener_pose(const Matrix4x4& pose)
 	_impl->set_listener_pose(pose);
 }
 
-void SoundWorld::update()
+void SoundWorld::update(f32 dt)
 {
-	_impl->update();
+	_impl->update(dt);
 }
 
 } // namespace crown
@@ -81,7 +81,7 @@ struct SoundWorldImpl
 	{
 	}
 
-	void update()
+	void update(f32 /*dt*/)
 	{
 	}
 };
@@ -155,9 +155,9 @@ void SoundWorld::set_listener_pose(const Matrix4x4& pose)
 	_impl->set_listener_pose(pose);
 }
 
-void SoundWorld::update()
+void SoundWorld::update(f32 dt)
 {
-	_impl->update();
+	_impl->update(dt);
 }
 
 } // namespace crown
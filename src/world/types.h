@@ -308,6 +308,8 @@ struct SpriteRendererDesc
 {
 	StringId64 sprite_resource;   ///< Name of .sprite resource.
 	StringId64 material_resource; ///< Name of .material resource.
+	u32 layer;                    ///< Sprites in higher layers are drawn on top.
+	u32 depth;                    ///< Sprites with higher depth are drawn on top within the same layer.
 	bool visible;                 ///< Whether sprite is visible.
 	char _pad0[3];
 	char _pad1[4];
@@ -9,6 +9,7 @@
 #include "core/math/vector3.h"
 #include "core/math/vector4.h"
 #include "core/memory/temp_allocator.h"
+#include "device/profiler.h"
 #include "lua/lua_environment.h"
 #include "resource/resource_manager.h"
 #include "resource/unit_resource.h"
@@ -28,7 +29,8 @@ namespace crown
 {
 World::World(Allocator& a, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm, UnitManager& um, LuaEnvironment& env)
 	: _marker(WORLD_MARKER)
-	, _allocator(&a)
+	, _proxy_allocator(a, "world")
+	, _allocator(&_proxy_allocator)
 	, _resource_manager(&rm)
 	, _shader_manager(&sm)
 	, _material_manager(&mm)
@@ -40,11 +42,11 @@ World::World(Allocator& a, ResourceManager& rm, ShaderManager& sm, MaterialManag
 	, _physics_world(NULL)
 	, _sound_world(NULL)
 	, _animation_state_machine(NULL)
-	, _units(a)
-	, _levels(a)
-	, _camera(a)
-	, _camera_map(a)
-	, _events(a)
+	, _units(_proxy_allocator)
+	, _levels(_proxy_allocator)
+	, _camera(_proxy_allocator)
+	, _camera_map(_proxy_allocator)
+	, _events(_proxy_allocator)
 {
 	_lines = create_debug_line(true);
 	_scene_graph   = CE_NEW(*_allocator, SceneGraph)(*_allocator, um);
@@ -122,6 +124,8 @@ void World::update_animations(f32 /*dt*/)
 
 void World::update_scene(f32 dt)
 {
+	PROFILE_SCOPE("world.update_scene");
+
 	TempAllocator4096 ta;
 	Array<UnitId> changed_units(ta);
 	Array<Matrix4x4> changed_world(ta);
@@ -211,7 +215,7 @@ void World::update_scene(f32 dt)
 	}
 	array::clear(animation_events);
 
-	_sound_world->update();
+	_sound_world->update(dt);
 
 	script_world::update(*_script_world, dt);
 
@@ -226,6 +230,8 @@ void World::update(f32 dt)
 
 void World::render(const Matrix4x4& view, const Matrix4x4& projection)
 {
+	PROFILE_SCOPE("world.render");
+
 	_render_world->render(view, projection);
 
 	_physics_world->debug_draw();
@@ -624,11 +630,17 @@ void spawn_units(World& w, const UnitResource& ur, const Vector3& pos, const Qua
 		}
 		else if (component->type == COMPONENT_TYPE_SCRIPT)
 		{
-			const ScriptDesc* sd = (const ScriptDesc*)data;
-			for (u32 i = 0; i < component->num_instances; ++i, ++sd)
-			{
-				script_world::create(*script_world, unit_lookup[unit_index[i]], *sd);
-			}
+			TempAllocator4096 ta;
+			Array<UnitId> units(ta);
+			array::resize(units, component->num_instances);
+			for (u32 i = 0; i < component->num_instances; ++i)
+				units[i] = unit_lookup[unit_index[i]];
+
+			script_world::create(*script_world
+				, array::begin(units)
+				, (const ScriptDesc*)data
+				, component->num_instances
+				);
 		}
 		else if (component->type == COMPONENT_TYPE_ANIMATION_STATE_MACHINE)
 		{
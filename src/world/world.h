@@ -7,6 +7,7 @@
 
 #include "core/containers/event_stream.h"
 #include "core/math/types.h"
+#include "core/memory/proxy_allocator.h"
 #include "core/strings/string_id.h"
 #include "core/types.h"
 #include "lua/types.h"
@@ -42,6 +43,7 @@ struct World
 	};
 
 	u32 _marker;
+	ProxyAllocator _proxy_allocator;
 	Allocator* _allocator;
 	ResourceManager* _resource_manager;
 	ShaderManager* _shader_manager;
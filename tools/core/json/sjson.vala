@@ -43,11 +43,16 @@ namespace Crown
 		/// <summary>
 		/// Decodes a SJSON bytestream into a Hashtable with numbers, bools, strings,
 		/// ArrayLists and Hashtables.
+		/// Decoding stops at the first NUL byte, binary data may follow it.
 		/// </summary>
 		public static Hashtable decode(uint8[] sjson)
 		{
+			int end = 0;
+			while (end < sjson.length && sjson[end] != '\0')
+				++end;
+
 			int index = 0;
-			return parse_root_object(sjson, ref index);
+			return parse_root_object(sjson[0:end], ref index);
 		}
 
 		/// <summary>